@@ -7,6 +7,15 @@ set SRC=../src/unity.cc
 set VKINC=C:\VulkanSDK\1.3.268.0\Include
 set VKLIB=C:\VulkanSDK\1.3.268.0\Lib\vulkan-1.lib
 
-cl -O2 -I%VKINC% %SRC% %VKLIB% user32.lib gdi32.lib kernel32.lib /link /SUBSYSTEM:CONSOLE /OUT:main.exe
+rem "build release" leaves the profiler out
+set FLAGS=-O2 -DPROFILE
+if "%1"=="release" set FLAGS=-O2
+
+cl %FLAGS% -I%VKINC% %SRC% %VKLIB% user32.lib gdi32.lib kernel32.lib /link /SUBSYSTEM:CONSOLE /OUT:main.exe
+cl %FLAGS% -I%VKINC% ../src/bench_unity.cc %VKLIB% kernel32.lib /link /SUBSYSTEM:CONSOLE /OUT:bench.exe
+cl %FLAGS% -I%VKINC% ../src/microbench_unity.cc %VKLIB% kernel32.lib /link /SUBSYSTEM:CONSOLE /OUT:microbench.exe
+cl %FLAGS% -I%VKINC% ../src/replay_unity.cc %VKLIB% kernel32.lib /link /SUBSYSTEM:CONSOLE /OUT:replay.exe
+cl -O2 ../src/cooker_unity.cc kernel32.lib /link /SUBSYSTEM:CONSOLE /OUT:cooker.exe
+cl -O2 ../src/telemetry_watch_unity.cc kernel32.lib /link /SUBSYSTEM:CONSOLE /OUT:telemetry_watch.exe
 
 popd
@@ -0,0 +1,14 @@
+#!/bin/sh
+
+# "./build.sh release" leaves the profiler out
+FLAGS="-O2 -DPROFILE"
+if [ "$1" = "release" ]; then FLAGS="-O2"; fi
+
+mkdir -p debug
+cd debug
+
+g++ $FLAGS -std=c++14 ../src/unity.cc -o main -lvulkan -lpthread -lrt
+g++ $FLAGS -std=c++14 ../src/bench_unity.cc -o bench -lvulkan -lpthread -lrt
+g++ $FLAGS -std=c++14 ../src/microbench_unity.cc -o microbench -lvulkan -lpthread -lrt
+g++ $FLAGS -std=c++14 ../src/replay_unity.cc -o replay -lvulkan -lpthread -lrt
+g++ $FLAGS -std=c++14 ../src/telemetry_watch_unity.cc -o telemetry_watch -lpthread -lrt
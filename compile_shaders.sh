@@ -0,0 +1,6 @@
+#!/bin/sh
+
+mkdir -p compiled
+for f in shaders/*; do
+    glslc "$f" -o "compiled/$(basename "$f").spv"
+done
@@ -1,12 +1,104 @@
 #version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
+layout(constant_id=0) const bool ALPHA_TEST = false;
+// Set from SAMPLER_COUNT when the pipeline is built.
+layout(constant_id=1) const uint SAMPLER_COUNT = 1;
+
+// Must match light_cluster.hh.
+const uint CLUSTER_X = 16;
+const uint CLUSTER_Y = 9;
+const uint CLUSTER_Z = 24;
+const uint MAX_CLUSTER_LIGHTS = 1024;
+const uint CLUSTER_COUNT = CLUSTER_X * CLUSTER_Y * CLUSTER_Z;
 
 layout(location=0) in vec2 tex_coords;
+layout(location=1) flat in uint texture_index;
+layout(location=2) flat in uint sampler_index;
 
-layout(binding=0) uniform sampler2D tex_sampler;
+layout(set=0, binding=0) uniform texture2D textures[];
+layout(set=0, binding=1) uniform sampler samplers[SAMPLER_COUNT];
+layout(set=0, binding=2) readonly buffer Residency
+{
+    float min_lod[];
+} residency;
+
+struct ClusterHeader
+{
+    vec2 tile_scale;
+    vec2 ndc_scale;
+    vec2 inv_proj;
+    float near_plane;
+    float z_scale;
+    float z_bias;
+    uint light_count;
+    uint padding[2];
+    vec4 ambient;
+};
+
+struct ClusterLight
+{
+    vec4 sphere;
+    vec4 color;
+};
+
+layout(set=1, binding=1) readonly buffer Clusters
+{
+    ClusterHeader header;
+    ClusterLight lights[MAX_CLUSTER_LIGHTS];
+    uvec2 clusters[CLUSTER_COUNT];
+    uint indices[];
+};
 
 layout(location=0) out vec4 fragColor;
 
+// Depth is near / gl_FragCoord.z with the camera's reverse-Z infinite
+// projection. There are no vertex normals yet, so the surface normal comes
+// from the derivatives of the position and is flat per triangle.
+vec3 ClusterLighting()
+{
+    float depth = header.near_plane / gl_FragCoord.z;
+    vec2 ndc = gl_FragCoord.xy * header.ndc_scale - 1.0;
+    vec3 position = vec3(ndc * header.inv_proj * depth, -depth);
+    vec3 normal = normalize(cross(dFdy(position), dFdx(position)));
+
+    vec3 lighting = header.ambient.rgb;
+    float slice = log(depth) * header.z_scale + header.z_bias;
+    if(header.light_count == 0 || slice < 0.0 || slice >= float(CLUSTER_Z))
+    {
+        return lighting;
+    }
+
+    uvec2 tile = min(uvec2(gl_FragCoord.xy * header.tile_scale), uvec2(CLUSTER_X - 1, CLUSTER_Y - 1));
+    uvec2 cluster = clusters[(uint(slice) * CLUSTER_Y + tile.y) * CLUSTER_X + tile.x];
+    for(uint i = cluster.x; i < cluster.x + cluster.y; i++)
+    {
+        uint light_index = (indices[i >> 1u] >> ((i & 1u) * 16u)) & 0xffffu;
+        ClusterLight light = lights[light_index];
+
+        vec3 to_light = light.sphere.xyz - position;
+        float light_distance = length(to_light);
+        float falloff = clamp(1.0 - light_distance / light.sphere.w, 0.0, 1.0);
+        float diffuse = max(dot(normal, to_light / max(light_distance, 1e-4)), 0.0);
+        lighting += light.color.rgb * diffuse * falloff * falloff;
+    }
+
+    return lighting;
+}
+
 void main()
 {
-    fragColor = texture(tex_sampler, tex_coords);
+    // Ahead of the discard, which would leave the derivatives undefined.
+    vec3 lighting = ClusterLighting();
+
+    uint index = texture_index;
+    float lod = textureQueryLod(sampler2D(textures[index], samplers[sampler_index]), tex_coords).y;
+    lod = max(lod, residency.min_lod[index]);
+    fragColor = textureLod(sampler2D(textures[index], samplers[sampler_index]), tex_coords, lod);
+    if(ALPHA_TEST && fragColor.a < 0.5)
+    {
+        discard;
+    }
+
+    fragColor.rgb *= lighting;
 }
@@ -4,16 +4,28 @@ layout(location=0) in vec3 position;
 layout(location=1) in vec3 color;
 layout(location=2) in vec2 tex_coords;
 
-layout(push_constant) uniform constants
+struct DrawData
 {
-    mat4 model;
-    mat4 view_proj;
-} pc;
+    mat4 mvp;
+    uint texture_index;
+    uint sampler_index;
+    uint joint_base;
+};
+
+layout(set=1, binding=0) readonly buffer Draws
+{
+    DrawData draws[];
+};
 
 layout(location=0) out vec2 out_coords;
+layout(location=1) flat out uint out_texture_index;
+layout(location=2) flat out uint out_sampler_index;
 
 void main()
 {
-    gl_Position = pc.view_proj * pc.model * vec4(position, 1.0);
+    DrawData draw = draws[gl_InstanceIndex];
+    gl_Position = draw.mvp * vec4(position, 1.0);
     out_coords = tex_coords;
+    out_texture_index = draw.texture_index;
+    out_sampler_index = draw.sampler_index;
 }
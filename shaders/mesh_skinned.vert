@@ -0,0 +1,51 @@
+#version 450
+
+layout(location=0) in vec3 position;
+layout(location=1) in vec3 color;
+layout(location=2) in vec2 tex_coords;
+layout(location=3) in uvec4 joint_indices;
+layout(location=4) in vec4 joint_weights;
+
+struct DrawData
+{
+    mat4 mvp;
+    uint texture_index;
+    uint sampler_index;
+    uint joint_base;
+};
+
+layout(set=1, binding=0) readonly buffer Draws
+{
+    DrawData draws[];
+};
+
+// The whole frame allocator buffer; a draw's joint matrices start at its
+// joint_base, four vec4 columns each.
+layout(set=1, binding=2) readonly buffer Joints
+{
+    vec4 joints[];
+};
+
+layout(location=0) out vec2 out_coords;
+layout(location=1) flat out uint out_texture_index;
+layout(location=2) flat out uint out_sampler_index;
+
+mat4 JointMatrix(uint base, uint joint)
+{
+    uint at = base + joint * 4;
+    return mat4(joints[at], joints[at + 1], joints[at + 2], joints[at + 3]);
+}
+
+void main()
+{
+    DrawData draw = draws[gl_InstanceIndex];
+    mat4 skin = JointMatrix(draw.joint_base, joint_indices.x) * joint_weights.x +
+                JointMatrix(draw.joint_base, joint_indices.y) * joint_weights.y +
+                JointMatrix(draw.joint_base, joint_indices.z) * joint_weights.z +
+                JointMatrix(draw.joint_base, joint_indices.w) * joint_weights.w;
+
+    gl_Position = draw.mvp * (skin * vec4(position, 1.0));
+    out_coords = tex_coords;
+    out_texture_index = draw.texture_index;
+    out_sampler_index = draw.sampler_index;
+}
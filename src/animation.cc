@@ -0,0 +1,323 @@
+#include <string.h>
+#include <math.h>
+#include "animation.hh"
+
+// Channels whose range over the clip is under this are kept constant.
+#define ANIM_CONSTANT_RANGE 1e-5f
+#define ANIM_KEY_MAX 65535.0f
+
+static u64 SkinParentsOffset(const CompiledSkin *skin)
+{
+    return sizeof(CompiledSkin) + (u64)skin->vertex_count * SKIN_VERTEX_SIZE;
+}
+
+static u64 SkinBindsOffset(const CompiledSkin *skin)
+{
+    return SkinParentsOffset(skin) + (((u64)skin->joint_count * sizeof(u16) + 15) & ~15ull);
+}
+
+// data is a whole compiled mesh, which starts with the sizes of its vertex
+// and index data.
+const CompiledSkin *FindCompiledSkin(const void *data, u64 size)
+{
+    u32 sizes[2];
+    if(size < sizeof(sizes))
+    {
+        return 0;
+    }
+
+    memcpy(sizes, data, sizeof(sizes));
+    u64 offset = sizeof(sizes) + (u64)sizes[0] + sizes[1];
+    if(offset + sizeof(CompiledSkin) > size)
+    {
+        return 0;
+    }
+
+    const CompiledSkin *skin = (const CompiledSkin *)((const u8 *)data + offset);
+    if(skin->magic != SKIN_MAGIC || skin->joint_count == 0 || skin->joint_count > MAX_JOINTS ||
+       (u64)skin->vertex_count * 16 != sizes[0])
+    {
+        return 0;
+    }
+
+    if(offset + SkinBindsOffset(skin) + (u64)skin->joint_count * sizeof(HMM_Mat4) > size)
+    {
+        return 0;
+    }
+
+    return skin;
+}
+
+const u8 *SkinVertices(const CompiledSkin *skin)
+{
+    return (const u8 *)(skin + 1);
+}
+
+bool LoadSkeleton(Arena *arena, const CompiledSkin *skin, Skeleton *skeleton)
+{
+    *skeleton = {};
+    u32 count = skin->joint_count;
+    const u8 *parents = (const u8 *)skin + SkinParentsOffset(skin);
+    const u8 *binds = (const u8 *)skin + SkinBindsOffset(skin);
+
+    skeleton->parents = (u16 *)ArenaAlloc(arena, sizeof(u16) * count, 16);
+    skeleton->inverse_binds = (HMM_Mat4 *)ArenaAlloc(arena, sizeof(HMM_Mat4) * count, 64);
+    if(!skeleton->parents || !skeleton->inverse_binds)
+    {
+        return false;
+    }
+
+    memcpy(skeleton->parents, parents, sizeof(u16) * count);
+    memcpy(skeleton->inverse_binds, binds, sizeof(HMM_Mat4) * count);
+    for(u32 joint = 0; joint < count; joint++)
+    {
+        u16 parent = skeleton->parents[joint];
+        if(parent != MATH_NO_PARENT && parent >= joint)
+        {
+            return false;
+        }
+    }
+
+    skeleton->joint_count = count;
+    skeleton->stride = (count + ANIM_SOA_WIDTH - 1) & ~(ANIM_SOA_WIDTH - 1);
+    return true;
+}
+
+// Local transforms that put every joint back where the skin was bound,
+// for clips to start from. The bind matrices must be free of shear. Arena
+// memory is not always 16 byte aligned, so they are copied out first.
+void AnimBindPose(const Skeleton *skeleton, float *pose)
+{
+    u32 stride = skeleton->stride;
+    memset(pose, 0, sizeof(float) * MATH_TRS_CHANNELS * stride);
+    for(u32 joint = 0; joint < skeleton->joint_count; joint++)
+    {
+        HMM_Mat4 inverse_bind;
+        memcpy(&inverse_bind, &skeleton->inverse_binds[joint], sizeof(HMM_Mat4));
+        HMM_Mat4 local = HMM_InvGeneralM4(inverse_bind);
+        u16 parent = skeleton->parents[joint];
+        if(parent != MATH_NO_PARENT)
+        {
+            HMM_Mat4 parent_inverse_bind;
+            memcpy(&parent_inverse_bind, &skeleton->inverse_binds[parent], sizeof(HMM_Mat4));
+            local = parent_inverse_bind * local;
+        }
+
+        float scale[3];
+        for(u32 c = 0; c < 3; c++)
+        {
+            scale[c] = HMM_LenV3(local.Columns[c].XYZ);
+            local.Columns[c] = local.Columns[c] / scale[c];
+            pose[(MATH_TX + c) * stride + joint] = local.Columns[3].Elements[c];
+            pose[(MATH_SX + c) * stride + joint] = scale[c];
+        }
+
+        HMM_Quat rotation = HMM_NormQ(HMM_M4ToQ_RH(local));
+        for(u32 c = 0; c < 4; c++)
+        {
+            pose[(MATH_QX + c) * stride + joint] = rotation.Elements[c];
+        }
+    }
+}
+
+// Whether the rotation of a joint at a frame is flipped, given whether it
+// was at the frame before. The first frame is never flipped.
+static bool AnimKeyFlipped(const float *poses, u32 pose_size, u32 stride, u32 joint, u32 frame, bool before)
+{
+    if(frame == 0)
+    {
+        return false;
+    }
+
+    const float *q0 = poses + (u64)(frame - 1) * pose_size + MATH_QX * stride + joint;
+    const float *q1 = q0 + pose_size;
+    float dot = 0;
+    for(u32 c = 0; c < 4; c++)
+    {
+        dot += q0[c * stride] * q1[c * stride];
+    }
+
+    return dot < 0 ? !before : before;
+}
+
+// poses holds frame_count whole poses of the skeleton, one after another.
+AnimClip *AnimCompressClip(Arena *arena, const Skeleton *skeleton, const float *poses,
+                           u32 frame_count, float frame_rate)
+{
+    if(frame_count == 0 || frame_rate <= 0)
+    {
+        return 0;
+    }
+
+    u32 stride = skeleton->stride;
+    u32 joint_count = skeleton->joint_count;
+    u32 pose_size = MATH_TRS_CHANNELS * stride;
+
+    float mins[MATH_TRS_CHANNELS * MAX_JOINTS];
+    float maxs[MATH_TRS_CHANNELS * MAX_JOINTS];
+    for(u32 joint = 0; joint < joint_count; joint++)
+    {
+        bool flipped = false;
+        for(u32 frame = 0; frame < frame_count; frame++)
+        {
+            flipped = AnimKeyFlipped(poses, pose_size, stride, joint, frame, flipped);
+            for(u32 c = 0; c < MATH_TRS_CHANNELS; c++)
+            {
+                float value = poses[(u64)frame * pose_size + c * stride + joint];
+                value = c >= MATH_QX && flipped ? -value : value;
+                u32 at = c * stride + joint;
+                mins[at] = frame == 0 || value < mins[at] ? value : mins[at];
+                maxs[at] = frame == 0 || value > maxs[at] ? value : maxs[at];
+            }
+        }
+    }
+
+    u32 track_count = 0;
+    for(u32 c = 0; c < MATH_TRS_CHANNELS; c++)
+    {
+        for(u32 joint = 0; joint < joint_count; joint++)
+        {
+            u32 at = c * stride + joint;
+            track_count += maxs[at] - mins[at] > ANIM_CONSTANT_RANGE;
+        }
+    }
+
+    AnimClip *clip = ArenaAllocStruct(arena, AnimClip);
+    if(!clip)
+    {
+        return 0;
+    }
+
+    *clip = {};
+    clip->joint_count = joint_count;
+    clip->stride = stride;
+    clip->frame_count = frame_count;
+    clip->frame_rate = frame_rate;
+    clip->duration = frame_count / frame_rate;
+    clip->track_count = track_count;
+    clip->base = (float *)ArenaAlloc(arena, sizeof(float) * pose_size, 64);
+    clip->tracks = (u16 *)ArenaAlloc(arena, sizeof(u16) * track_count, 16);
+    clip->track_min = (float *)ArenaAlloc(arena, sizeof(float) * track_count, 16);
+    clip->track_scale = (float *)ArenaAlloc(arena, sizeof(float) * track_count, 16);
+    clip->keys = (u16 *)ArenaAlloc(arena, sizeof(u16) * track_count * frame_count, 16);
+    if(!clip->base || (track_count && (!clip->tracks || !clip->track_min || !clip->track_scale || !clip->keys)))
+    {
+        return 0;
+    }
+
+    memset(clip->base, 0, sizeof(float) * pose_size);
+    u32 track = 0;
+    for(u32 c = 0; c < MATH_TRS_CHANNELS; c++)
+    {
+        for(u32 joint = 0; joint < joint_count; joint++)
+        {
+            u32 at = c * stride + joint;
+            clip->base[at] = poses[at];
+            float extent = maxs[at] - mins[at];
+            if(extent <= ANIM_CONSTANT_RANGE)
+            {
+                continue;
+            }
+
+            clip->tracks[track] = (u16)at;
+            clip->track_min[track] = mins[at];
+            clip->track_scale[track] = extent / ANIM_KEY_MAX;
+
+            bool flipped = false;
+            for(u32 frame = 0; frame < frame_count; frame++)
+            {
+                flipped = AnimKeyFlipped(poses, pose_size, stride, joint, frame, flipped);
+                float value = poses[(u64)frame * pose_size + at];
+                value = c >= MATH_QX && flipped ? -value : value;
+                float key = (value - mins[at]) / extent * ANIM_KEY_MAX + 0.5f;
+                clip->keys[(u64)frame * track_count + track] = (u16)(key < ANIM_KEY_MAX ? key : ANIM_KEY_MAX);
+            }
+
+            track++;
+        }
+    }
+
+    return clip;
+}
+
+static void AnimDecodeFrame(const AnimClip *clip, u32 frame, float *pose)
+{
+    memcpy(pose, clip->base, sizeof(float) * MATH_TRS_CHANNELS * clip->stride);
+    const u16 *keys = clip->keys + (u64)frame * clip->track_count;
+    for(u32 track = 0; track < clip->track_count; track++)
+    {
+        pose[clip->tracks[track]] = clip->track_min[track] + keys[track] * clip->track_scale[track];
+    }
+}
+
+// Both pose and scratch hold a whole pose of the clip's skeleton.
+void AnimSamplePose(const AnimClip *clip, float time, float *pose, float *scratch)
+{
+    time = fmodf(time, clip->duration);
+    time = time < 0 ? time + clip->duration : time;
+
+    float frame = time * clip->frame_rate;
+    u32 f0 = (u32)frame;
+    f0 = f0 < clip->frame_count ? f0 : clip->frame_count - 1;
+    u32 f1 = f0 + 1 < clip->frame_count ? f0 + 1 : 0;
+
+    AnimDecodeFrame(clip, f0, pose);
+    if(f1 == f0)
+    {
+        return;
+    }
+
+    AnimDecodeFrame(clip, f1, scratch);
+    MathBlendTRS(pose, pose, scratch, frame - f0, clip->stride, clip->joint_count);
+}
+
+void AnimBlendPoses(float *out, const float *a, const float *b, float weight, u32 stride, u32 count)
+{
+    MathBlendTRS(out, a, b, weight, stride, count);
+}
+
+// scratch holds one matrix per joint and ends up with the model space
+// transforms of the joints. The palette is written front to back and never
+// read, so it can go straight into frame memory.
+void AnimPoseToPalette(const Skeleton *skeleton, const float *pose, HMM_Mat4 *palette, HMM_Mat4 *scratch)
+{
+    u32 count = skeleton->joint_count;
+    MathComposeTRSSoA(scratch, pose, skeleton->stride, count);
+    MathMulMat4Hierarchy(scratch, scratch, skeleton->parents, count);
+    MathMulMat4Pairs(palette, scratch, skeleton->inverse_binds, count);
+}
+
+static void AnimateRange(void *data, u32 begin, u32 end)
+{
+    AnimInstance *instances = (AnimInstance *)data;
+    float pose[MATH_TRS_CHANNELS * MAX_JOINTS];
+    float other[MATH_TRS_CHANNELS * MAX_JOINTS];
+    float scratch[MATH_TRS_CHANNELS * MAX_JOINTS];
+    HMM_Mat4 model[MAX_JOINTS];
+
+    for(u32 i = begin; i < end; i++)
+    {
+        AnimInstance *instance = &instances[i];
+        const Skeleton *skeleton = instance->skeleton;
+        if(!instance->palette || !instance->clips[0])
+        {
+            continue;
+        }
+
+        AnimSamplePose(instance->clips[0], instance->times[0], pose, scratch);
+        if(instance->clips[1] && instance->weight > 0)
+        {
+            AnimSamplePose(instance->clips[1], instance->times[1], other, scratch);
+            AnimBlendPoses(pose, pose, other, instance->weight, skeleton->stride, skeleton->joint_count);
+        }
+
+        AnimPoseToPalette(skeleton, pose, instance->palette, model);
+    }
+}
+
+// Each instance writes only its own palette, so characters are animated a
+// few to a job with no ordering between them.
+void AnimUpdate(AnimInstance *instances, u32 count, JobQueue *jobs)
+{
+    JobsParallelFor(jobs, count, ANIM_BATCH, AnimateRange, instances);
+}
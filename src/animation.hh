@@ -0,0 +1,85 @@
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#define MAX_JOINTS 256
+#define SKIN_MAGIC 0x4e494b53
+#define SKIN_VERTEX_SIZE 8
+// Pose channels are padded to this many floats, so each starts on a cache
+// line.
+#define ANIM_SOA_WIDTH 16
+#define ANIM_BATCH 4
+
+#include "types.hh"
+#include "jobs.hh"
+#include "arena_alloc.hh"
+#include "simd_math.hh"
+#include "third_party/HandmadeMath.h"
+
+// Optional part of a compiled mesh, right after its indices. The header is
+// followed by four joint indices and four weights per vertex, all bytes,
+// which is the vertex stream the skinned shader reads; then the parent of
+// each joint as u16, padded to 16 bytes; then the inverse bind matrix of
+// each joint. Nothing in it is aligned past 4 bytes.
+struct CompiledSkin
+{
+    u32 magic;
+    u32 joint_count;
+    u32 vertex_count;
+    u32 padding;
+};
+
+// Joints are ordered parents first. Poses are structure-of-arrays
+// transforms in MathTRSChannel order, stride floats to a channel.
+struct Skeleton
+{
+    u32 joint_count;
+    u32 stride;
+    u16 *parents;
+    HMM_Mat4 *inverse_binds;
+};
+
+// Poses sampled at a fixed rate. A channel that never changes keeps its
+// value in the base pose; the others are tracks, quantized to 16 bits
+// within their range. The keys of a frame are stored together, so sampling
+// reads two short runs. Rotations are flipped where needed to stay on the
+// side of the key before, which keeps their ranges, and so the rounding,
+// small. Clips loop: the last frame blends back into the first.
+struct AnimClip
+{
+    u32 joint_count;
+    u32 stride;
+    u32 frame_count;
+    float frame_rate;
+    float duration;
+    float *base;
+    u32 track_count;
+    u16 *tracks;
+    float *track_min;
+    float *track_scale;
+    u16 *keys;
+};
+
+// One character: up to two clips, the second blended in by weight, turned
+// into the skinning matrices of its skeleton. Times wrap around the clips.
+struct AnimInstance
+{
+    const Skeleton *skeleton;
+    const AnimClip *clips[2];
+    float times[2];
+    float weight;
+    HMM_Mat4 *palette;
+};
+
+const CompiledSkin *FindCompiledSkin(const void *data, u64 size);
+const u8 *SkinVertices(const CompiledSkin *skin);
+bool LoadSkeleton(Arena *arena, const CompiledSkin *skin, Skeleton *skeleton);
+void AnimBindPose(const Skeleton *skeleton, float *pose);
+
+AnimClip *AnimCompressClip(Arena *arena, const Skeleton *skeleton, const float *poses,
+                           u32 frame_count, float frame_rate);
+void AnimSamplePose(const AnimClip *clip, float time, float *pose, float *scratch);
+void AnimBlendPoses(float *out, const float *a, const float *b, float weight, u32 stride, u32 count);
+void AnimPoseToPalette(const Skeleton *skeleton, const float *pose, HMM_Mat4 *palette, HMM_Mat4 *scratch);
+void AnimUpdate(AnimInstance *instances, u32 count, JobQueue *jobs);
+
+#endif //ANIMATION_H
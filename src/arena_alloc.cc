@@ -1,39 +1,52 @@
-#include <windows.h>
+#include "os.hh"
 #include "arena_alloc.hh"
 
 Arena CreateNewArena(Arena *parent, ptrdiff_t max_arena_capacity)
 {
     Arena arena = {};
-    SYSTEM_INFO sys_info;
-    GetSystemInfo(&sys_info);
-
-    ptrdiff_t page_size = sys_info.dwPageSize;
+    ptrdiff_t page_size = OsPageSize();
     if(max_arena_capacity > page_size)
     {
-        ptrdiff_t num_pages = (max_arena_capacity + 1) / page_size;
+        ptrdiff_t num_pages = (max_arena_capacity + page_size - 1) / page_size;
         max_arena_capacity = num_pages * page_size;
     }
 
     if(parent)
     {
+        arena.parent = parent;
         arena.memory = (char *)ArenaAlloc(parent, max_arena_capacity, 0);
     }
 
     else
     {
-        DWORD protect = PAGE_READWRITE;
-        DWORD alloc_type = MEM_RESERVE | MEM_COMMIT;
-        arena.memory = (char *)VirtualAlloc(0, max_arena_capacity, alloc_type, protect);
+        arena.memory = (char *)OsAllocMemory(max_arena_capacity);
     }
     
     arena.capacity = max_arena_capacity;
     return arena;
 }
 
+// A child only hands its memory back when it is still the parent's last
+// allocation; otherwise it goes when the parent does.
 void DestroyArena(Arena *arena)
 {
-    VirtualFree(arena->memory, arena->capacity, MEM_FREE);
-    arena->memory = 0;
+    if(!arena->memory)
+    {
+        return;
+    }
+
+    Arena *parent = arena->parent;
+    if(!parent)
+    {
+        OsFreeMemory(arena->memory, arena->capacity);
+    }
+
+    else if(arena->memory + arena->capacity == parent->memory + parent->used)
+    {
+        parent->used -= arena->capacity;
+    }
+
+    *arena = {};
 }
 
 void *ArenaAlloc(Arena *arena, ptrdiff_t allocation_size, ptrdiff_t allign)
@@ -7,8 +7,11 @@
 
 #include <stddef.h>
 
+// An arena made from a parent lives in the parent's memory and has no
+// pages of its own.
 struct Arena
 {
+    Arena *parent;
     char *memory;
     ptrdiff_t used;
     ptrdiff_t capacity;
@@ -21,7 +24,7 @@ struct TempArena
 };
 
 Arena CreateNewArena(Arena *parent, ptrdiff_t max_arena_capacity);
-void DestroyArena(Arena arena);
+void DestroyArena(Arena *arena);
 
 void *ArenaAlloc(Arena *arena, ptrdiff_t allocation_size, ptrdiff_t allign);
 #define ArenaAllocStruct(arena, type) (type *)ArenaAlloc((arena), sizeof (type), 0)
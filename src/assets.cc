@@ -0,0 +1,277 @@
+#include <string.h>
+#include "assets.hh"
+
+#define ASSET_TOMBSTONE 0xffffffff
+
+static u64 AssetMix(u64 hash)
+{
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+// Word at a time with four independent lanes so large files hash near
+// memory bandwidth.
+u64 AssetHashBytes(const void *data, u64 size)
+{
+    const u8 *bytes = (const u8 *)data;
+    u64 lanes[4] = {0x9e3779b97f4a7c15ull, 0xbf58476d1ce4e5b9ull, 0x94d049bb133111ebull, 0x2545f4914f6cdd1dull};
+
+    u64 offset = 0;
+    for(; offset + 32 <= size; offset += 32)
+    {
+        for(u32 i = 0; i < 4; i++)
+        {
+            u64 word;
+            memcpy(&word, bytes + offset + i * 8, 8);
+            lanes[i] = (lanes[i] ^ word) * 0x100000001b3ull;
+            lanes[i] = (lanes[i] << 29) | (lanes[i] >> 35);
+        }
+    }
+
+    u64 hash = size;
+    for(u32 i = 0; i < 4; i++)
+    {
+        hash = AssetMix(hash ^ lanes[i]);
+    }
+
+    for(; offset < size; offset++)
+    {
+        hash = (hash ^ bytes[offset]) * 0x100000001b3ull;
+    }
+
+    return AssetMix(hash);
+}
+
+static u64 ContentKey(AssetType type, u64 content_hash)
+{
+    return content_hash ^ ((u64)type * 0x9e3779b97f4a7c15ull);
+}
+
+static AssetSlot *TableFind(AssetSlot *table, u64 key)
+{
+    u32 mask = ASSET_TABLE_SIZE - 1;
+    u32 probe = (u32)AssetMix(key) & mask;
+    for(u32 step = 0; step < ASSET_TABLE_SIZE; step++, probe = (probe + 1) & mask)
+    {
+        AssetSlot *slot = &table[probe];
+        if(slot->entry == 0)
+        {
+            return 0;
+        }
+
+        if(slot->entry != ASSET_TOMBSTONE && slot->key == key)
+        {
+            return slot;
+        }
+    }
+
+    return 0;
+}
+
+// Returns the tombstone it reused, if any, so the caller can keep count.
+// A full table drops the key, which only costs a later lookup a miss.
+static u32 TableInsert(AssetSlot *table, u64 key, u32 entry)
+{
+    u32 mask = ASSET_TABLE_SIZE - 1;
+    u32 probe = (u32)AssetMix(key) & mask;
+    for(u32 step = 0; step < ASSET_TABLE_SIZE; step++, probe = (probe + 1) & mask)
+    {
+        AssetSlot *slot = &table[probe];
+        if(slot->entry == 0 || slot->entry == ASSET_TOMBSTONE)
+        {
+            u32 reused = slot->entry == ASSET_TOMBSTONE;
+            slot->key = key;
+            slot->entry = entry;
+            return reused;
+        }
+    }
+
+    return 0;
+}
+
+// Every live entry has exactly one content key, so the content table can be
+// rebuilt from the entries alone. That frees it to hold the live path slots,
+// aliases included, while the path table is rebuilt.
+static void AssetRebuildTables(AssetRegistry *registry)
+{
+    u32 path_count = 0;
+    for(u32 i = 0; i < ASSET_TABLE_SIZE; i++)
+    {
+        AssetSlot slot = registry->path_table[i];
+        if(slot.entry != 0 && slot.entry != ASSET_TOMBSTONE)
+        {
+            registry->content_table[path_count++] = slot;
+        }
+    }
+
+    memset(registry->path_table, 0, sizeof(registry->path_table));
+    for(u32 i = 0; i < path_count; i++)
+    {
+        TableInsert(registry->path_table, registry->content_table[i].key, registry->content_table[i].entry);
+    }
+
+    memset(registry->content_table, 0, sizeof(registry->content_table));
+    for(u32 i = 1; i < registry->entry_count; i++)
+    {
+        AssetEntry *entry = &registry->entries[i];
+        if(entry->type != ASSET_NONE)
+        {
+            TableInsert(registry->content_table, ContentKey(entry->type, entry->content_hash), i);
+        }
+    }
+
+    registry->tombstone_count = 0;
+}
+
+AssetRegistry *CreateAssetRegistry(Arena *arena)
+{
+    AssetRegistry *registry = ArenaAllocStruct(arena, AssetRegistry);
+    memset(registry, 0, sizeof(*registry));
+    registry->entry_count = 1;
+    return registry;
+}
+
+static AssetHandle AssetAcquireEntry(AssetRegistry *registry, u32 index)
+{
+    AssetEntry *entry = &registry->entries[index];
+    entry->refcount++;
+
+    AssetHandle handle = {};
+    handle.index = index;
+    handle.generation = entry->generation;
+    return handle;
+}
+
+AssetHandle AssetFind(AssetRegistry *registry, u64 path_hash)
+{
+    AssetSlot *slot = TableFind(registry->path_table, path_hash);
+    if(!slot)
+    {
+        return {};
+    }
+
+    return AssetAcquireEntry(registry, slot->entry);
+}
+
+// Different paths with identical bytes resolve to the same asset. The path
+// is recorded as an alias so the next load skips the read and the hash.
+AssetHandle AssetFindContent(AssetRegistry *registry, AssetType type, u64 content_hash, u64 path_hash)
+{
+    AssetSlot *slot = TableFind(registry->content_table, ContentKey(type, content_hash));
+    if(!slot)
+    {
+        return {};
+    }
+
+    u32 index = slot->entry;
+    registry->tombstone_count -= TableInsert(registry->path_table, path_hash, index);
+    return AssetAcquireEntry(registry, index);
+}
+
+AssetHandle AssetInsert(AssetRegistry *registry, AssetType type, u64 path_hash, u64 content_hash, u32 payload)
+{
+    u32 index;
+    if(registry->free_count)
+    {
+        index = registry->free_entries[--registry->free_count];
+    }
+
+    else if(registry->entry_count < MAX_ASSETS)
+    {
+        index = registry->entry_count++;
+    }
+
+    else
+    {
+        return {};
+    }
+
+    AssetEntry *entry = &registry->entries[index];
+    entry->path_hash = path_hash;
+    entry->content_hash = content_hash;
+    entry->type = type;
+    entry->refcount = 0;
+    entry->payload = payload;
+
+    registry->tombstone_count -= TableInsert(registry->path_table, path_hash, index);
+    registry->tombstone_count -= TableInsert(registry->content_table, ContentKey(type, content_hash), index);
+    return AssetAcquireEntry(registry, index);
+}
+
+AssetEntry *AssetGet(AssetRegistry *registry, AssetHandle handle)
+{
+    if(handle.index == 0 || handle.index >= registry->entry_count)
+    {
+        return 0;
+    }
+
+    AssetEntry *entry = &registry->entries[handle.index];
+    if(entry->generation != handle.generation || entry->type == ASSET_NONE)
+    {
+        return 0;
+    }
+
+    return entry;
+}
+
+void AssetAcquire(AssetRegistry *registry, AssetHandle handle)
+{
+    AssetEntry *entry = AssetGet(registry, handle);
+    if(entry)
+    {
+        entry->refcount++;
+    }
+}
+
+// Returns true when the last reference was dropped. The entry stays
+// findable so a later load is still a cache hit; it only goes away
+// through AssetRemove.
+bool AssetRelease(AssetRegistry *registry, AssetHandle handle)
+{
+    AssetEntry *entry = AssetGet(registry, handle);
+    if(!entry || entry->refcount == 0)
+    {
+        return false;
+    }
+
+    entry->refcount--;
+    return entry->refcount == 0;
+}
+
+void AssetRemove(AssetRegistry *registry, AssetHandle handle)
+{
+    AssetEntry *entry = AssetGet(registry, handle);
+    if(!entry)
+    {
+        return;
+    }
+
+    AssetSlot *slot = TableFind(registry->content_table, ContentKey(entry->type, entry->content_hash));
+    if(slot)
+    {
+        slot->entry = ASSET_TOMBSTONE;
+        registry->tombstone_count++;
+    }
+
+    // Aliases are rare enough that a sweep beats keeping reverse links.
+    for(u32 i = 0; i < ASSET_TABLE_SIZE; i++)
+    {
+        if(registry->path_table[i].entry == handle.index)
+        {
+            registry->path_table[i].entry = ASSET_TOMBSTONE;
+            registry->tombstone_count++;
+        }
+    }
+
+    entry->type = ASSET_NONE;
+    entry->generation++;
+    registry->free_entries[registry->free_count++] = handle.index;
+    if(registry->tombstone_count > ASSET_MAX_TOMBSTONES)
+    {
+        AssetRebuildTables(registry);
+    }
+}
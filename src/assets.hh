@@ -0,0 +1,93 @@
+#ifndef ASSETS_H
+#define ASSETS_H
+
+#define MAX_ASSETS 4096
+#define ASSET_TABLE_SIZE (MAX_ASSETS * 2)
+#define ASSET_MAX_TOMBSTONES (ASSET_TABLE_SIZE / 4)
+
+#include "types.hh"
+#include "arena_alloc.hh"
+
+enum AssetType
+{
+    ASSET_NONE,
+    ASSET_MESH,
+    ASSET_TEXTURE,
+    ASSET_SHADER,
+    ASSET_TYPE_COUNT,
+};
+
+// FNV-1a over the path. Written as a single expression so it folds at
+// compile time when the argument is a literal, see ASSET below.
+constexpr u64 AssetHashString(const char *str, u64 hash = 0xcbf29ce484222325ull)
+{
+    return *str ? AssetHashString(str + 1, (hash ^ (u8)*str) * 0x100000001b3ull) : hash;
+}
+
+template <u64 hash> struct AssetConstHash
+{
+    static const u64 value = hash;
+};
+
+struct AssetId
+{
+    u64 path_hash;
+    const char *path;
+};
+
+#define ASSET(path) AssetId{AssetConstHash<AssetHashString(path)>::value, (path)}
+
+// Index 0 is never handed out, so a zeroed handle is always invalid. The
+// generation changes every time a slot is reused, so handles to removed
+// assets fail lookup instead of aliasing whatever took their place.
+struct AssetHandle
+{
+    u32 index;
+    u32 generation;
+};
+
+struct AssetEntry
+{
+    u64 path_hash;
+    u64 content_hash;
+    AssetType type;
+    u32 generation;
+    u32 refcount;
+    u32 payload;
+};
+
+struct AssetSlot
+{
+    u64 key;
+    u32 entry;
+};
+
+struct AssetRegistry
+{
+    u32 entry_count;
+    AssetEntry entries[MAX_ASSETS];
+
+    u32 free_count;
+    u32 free_entries[MAX_ASSETS];
+
+    // Removed slots left in both tables. Lookups only stop at an empty
+    // slot, so past a quarter of the table they are cleared out.
+    u32 tombstone_count;
+    AssetSlot path_table[ASSET_TABLE_SIZE];
+    AssetSlot content_table[ASSET_TABLE_SIZE];
+};
+
+u64 AssetHashBytes(const void *data, u64 size);
+
+AssetRegistry *CreateAssetRegistry(Arena *arena);
+
+AssetHandle AssetFind(AssetRegistry *registry, u64 path_hash);
+AssetHandle AssetFindContent(AssetRegistry *registry, AssetType type, u64 content_hash, u64 path_hash);
+AssetHandle AssetInsert(AssetRegistry *registry, AssetType type, u64 path_hash, u64 content_hash, u32 payload);
+AssetEntry *AssetGet(AssetRegistry *registry, AssetHandle handle);
+
+void AssetAcquire(AssetRegistry *registry, AssetHandle handle);
+bool AssetRelease(AssetRegistry *registry, AssetHandle handle);
+void AssetRemove(AssetRegistry *registry, AssetHandle handle);
+
+#endif //ASSETS_H
@@ -0,0 +1,874 @@
+#include <emmintrin.h>
+#include <float.h>
+#include <math.h>
+#include <string.h>
+#include "bc_encode.hh"
+
+// Kernels are written against SSE2 only, which every x64 target has, so no
+// dispatch is needed. Pixels are kept as planar floats so each __m128 holds
+// one channel of four pixels.
+struct BlockF
+{
+    alignas(16) float c[4][16];
+};
+
+static const int bc7_weights4[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+static void LoadBlock(const u8 *block, BlockF *out)
+{
+    for(u32 i = 0; i < 16; i++)
+    {
+        out->c[0][i] = block[i * 4 + 0];
+        out->c[1][i] = block[i * 4 + 1];
+        out->c[2][i] = block[i * 4 + 2];
+        out->c[3][i] = block[i * 4 + 3];
+    }
+}
+
+static float HorizontalSum(__m128 v)
+{
+    __m128 shuf = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1));
+    __m128 sums = _mm_add_ps(v, shuf);
+    shuf = _mm_movehl_ps(shuf, sums);
+    sums = _mm_add_ss(sums, shuf);
+    return _mm_cvtss_f32(sums);
+}
+
+static float Clamp255(float v)
+{
+    return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
+
+// Picks the closest palette entry for all 16 pixels, four pixels per lane
+// group, and returns the summed squared error.
+static float SelectIndices(const float *const *planes, u32 channels, const float (*palette)[4],
+                           u32 palette_count, const float *weights, u8 *indices)
+{
+    __m128 total = _mm_setzero_ps();
+    for(u32 group = 0; group < 4; group++)
+    {
+        __m128 px[4];
+        for(u32 ch = 0; ch < channels; ch++)
+        {
+            px[ch] = _mm_load_ps(planes[ch] + group * 4);
+        }
+
+        __m128 best = _mm_set1_ps(FLT_MAX);
+        __m128i best_index = _mm_setzero_si128();
+        for(u32 p = 0; p < palette_count; p++)
+        {
+            __m128 dist = _mm_setzero_ps();
+            for(u32 ch = 0; ch < channels; ch++)
+            {
+                __m128 diff = _mm_sub_ps(px[ch], _mm_set1_ps(palette[p][ch]));
+                dist = _mm_add_ps(dist, _mm_mul_ps(diff, diff));
+            }
+
+            __m128i closer = _mm_castps_si128(_mm_cmplt_ps(dist, best));
+            best = _mm_min_ps(dist, best);
+            best_index = _mm_or_si128(_mm_and_si128(closer, _mm_set1_epi32(p)),
+                                      _mm_andnot_si128(closer, best_index));
+        }
+
+        if(weights)
+        {
+            best = _mm_mul_ps(best, _mm_loadu_ps(weights + group * 4));
+        }
+
+        alignas(16) i32 lanes[4];
+        _mm_store_si128((__m128i *)lanes, best_index);
+        for(u32 i = 0; i < 4; i++)
+        {
+            indices[group * 4 + i] = (u8)lanes[i];
+        }
+
+        total = _mm_add_ps(total, best);
+    }
+
+    return HorizontalSum(total);
+}
+
+static void ComputeEndpointsPCA(const BlockF *block, u32 channels, const float *weights,
+                                float *e0, float *e1)
+{
+    float mean[4] = {};
+    float total_weight = 0;
+    for(u32 i = 0; i < 16; i++)
+    {
+        float w = weights ? weights[i] : 1.0f;
+        total_weight += w;
+        for(u32 ch = 0; ch < channels; ch++)
+        {
+            mean[ch] += w * block->c[ch][i];
+        }
+    }
+
+    if(total_weight == 0)
+    {
+        memset(e0, 0, channels * sizeof(float));
+        memset(e1, 0, channels * sizeof(float));
+        return;
+    }
+
+    for(u32 ch = 0; ch < channels; ch++)
+    {
+        mean[ch] /= total_weight;
+    }
+
+    float cov[4][4] = {};
+    float range_min[4] = {255, 255, 255, 255};
+    float range_max[4] = {};
+    for(u32 i = 0; i < 16; i++)
+    {
+        float w = weights ? weights[i] : 1.0f;
+        if(w == 0) continue;
+
+        for(u32 a = 0; a < channels; a++)
+        {
+            float da = block->c[a][i] - mean[a];
+            for(u32 b = a; b < channels; b++)
+            {
+                cov[a][b] += w * da * (block->c[b][i] - mean[b]);
+            }
+
+            if(block->c[a][i] < range_min[a]) range_min[a] = block->c[a][i];
+            if(block->c[a][i] > range_max[a]) range_max[a] = block->c[a][i];
+        }
+    }
+
+    for(u32 a = 0; a < channels; a++)
+    {
+        for(u32 b = 0; b < a; b++)
+        {
+            cov[a][b] = cov[b][a];
+        }
+    }
+
+    float axis[4] = {};
+    for(u32 ch = 0; ch < channels; ch++)
+    {
+        axis[ch] = range_max[ch] - range_min[ch];
+    }
+
+    for(u32 iter = 0; iter < 8; iter++)
+    {
+        float next[4] = {};
+        float largest = 0;
+        for(u32 a = 0; a < channels; a++)
+        {
+            for(u32 b = 0; b < channels; b++)
+            {
+                next[a] += cov[a][b] * axis[b];
+            }
+
+            if(fabsf(next[a]) > largest) largest = fabsf(next[a]);
+        }
+
+        if(largest < 1e-6f) break;
+        for(u32 ch = 0; ch < channels; ch++)
+        {
+            axis[ch] = next[ch] / largest;
+        }
+    }
+
+    float length_sq = 0;
+    for(u32 ch = 0; ch < channels; ch++)
+    {
+        length_sq += axis[ch] * axis[ch];
+    }
+
+    float min_t = 0, max_t = 0;
+    if(length_sq > 1e-6f)
+    {
+        min_t = FLT_MAX;
+        max_t = -FLT_MAX;
+        for(u32 i = 0; i < 16; i++)
+        {
+            if(weights && weights[i] == 0) continue;
+
+            float t = 0;
+            for(u32 ch = 0; ch < channels; ch++)
+            {
+                t += (block->c[ch][i] - mean[ch]) * axis[ch];
+            }
+
+            if(t < min_t) min_t = t;
+            if(t > max_t) max_t = t;
+        }
+
+        min_t /= length_sq;
+        max_t /= length_sq;
+    }
+
+    for(u32 ch = 0; ch < channels; ch++)
+    {
+        e0[ch] = Clamp255(mean[ch] + axis[ch] * min_t);
+        e1[ch] = Clamp255(mean[ch] + axis[ch] * max_t);
+    }
+}
+
+// Least squares fit of both endpoints given the chosen indices, where
+// index_t maps an index to its interpolation factor between e0 and e1.
+static bool RefineEndpoints(const BlockF *block, u32 channels, const float *weights,
+                            const u8 *indices, const float *index_t, float *e0, float *e1)
+{
+    float aa = 0, ab = 0, bb = 0;
+    float ax[4] = {}, bx[4] = {};
+    for(u32 i = 0; i < 16; i++)
+    {
+        float w = weights ? weights[i] : 1.0f;
+        float t = index_t[indices[i]];
+        float a = 1.0f - t;
+        aa += w * a * a;
+        ab += w * a * t;
+        bb += w * t * t;
+        for(u32 ch = 0; ch < channels; ch++)
+        {
+            ax[ch] += w * a * block->c[ch][i];
+            bx[ch] += w * t * block->c[ch][i];
+        }
+    }
+
+    float det = aa * bb - ab * ab;
+    if(fabsf(det) < 1e-6f)
+    {
+        return false;
+    }
+
+    float inv = 1.0f / det;
+    for(u32 ch = 0; ch < channels; ch++)
+    {
+        e0[ch] = Clamp255((ax[ch] * bb - bx[ch] * ab) * inv);
+        e1[ch] = Clamp255((bx[ch] * aa - ax[ch] * ab) * inv);
+    }
+
+    return true;
+}
+
+static u16 PackRGB565(const float *c)
+{
+    int r = (int)(c[0] * 31.0f / 255.0f + 0.5f);
+    int g = (int)(c[1] * 63.0f / 255.0f + 0.5f);
+    int b = (int)(c[2] * 31.0f / 255.0f + 0.5f);
+    return (u16)((r << 11) | (g << 5) | b);
+}
+
+static void UnpackRGB565(u16 v, int *rgb)
+{
+    int r = (v >> 11) & 31;
+    int g = (v >> 5) & 63;
+    int b = v & 31;
+    rgb[0] = (r << 3) | (r >> 2);
+    rgb[1] = (g << 2) | (g >> 4);
+    rgb[2] = (b << 3) | (b >> 2);
+}
+
+static u32 BC1Palette(u16 c0, u16 c1, int (*palette)[4])
+{
+    UnpackRGB565(c0, palette[0]);
+    UnpackRGB565(c1, palette[1]);
+    palette[0][3] = palette[1][3] = 255;
+
+    for(u32 ch = 0; ch < 3; ch++)
+    {
+        if(c0 > c1)
+        {
+            palette[2][ch] = (2 * palette[0][ch] + palette[1][ch]) / 3;
+            palette[3][ch] = (palette[0][ch] + 2 * palette[1][ch]) / 3;
+        }
+
+        else
+        {
+            palette[2][ch] = (palette[0][ch] + palette[1][ch]) / 2;
+            palette[3][ch] = 0;
+        }
+    }
+
+    palette[2][3] = 255;
+    palette[3][3] = c0 > c1 ? 255 : 0;
+    return c0 > c1 ? 4 : 3;
+}
+
+struct BC1Candidate
+{
+    u16 c0;
+    u16 c1;
+    u8 indices[16];
+    float error;
+};
+
+static void BC1Evaluate(const BlockF *block, const float *weights, bool transparent,
+                        u16 c0, u16 c1, BC1Candidate *candidate)
+{
+    if((!transparent && c0 < c1) || (transparent && c0 > c1))
+    {
+        u16 swap = c0; c0 = c1; c1 = swap;
+    }
+
+    int ipalette[4][4];
+    u32 count = BC1Palette(c0, c1, ipalette);
+    if(!transparent && c0 == c1)
+    {
+        count = 1;
+    }
+
+    else if(transparent)
+    {
+        count = 3;
+    }
+
+    float palette[4][4];
+    for(u32 i = 0; i < 4; i++)
+    {
+        for(u32 ch = 0; ch < 4; ch++)
+        {
+            palette[i][ch] = (float)ipalette[i][ch];
+        }
+    }
+
+    const float *planes[3] = {block->c[0], block->c[1], block->c[2]};
+    candidate->c0 = c0;
+    candidate->c1 = c1;
+    candidate->error = SelectIndices(planes, 3, palette, count, weights, candidate->indices);
+
+    if(transparent)
+    {
+        for(u32 i = 0; i < 16; i++)
+        {
+            if(weights[i] == 0) candidate->indices[i] = 3;
+        }
+    }
+}
+
+void BCEncodeBC1(const u8 *block, u8 *out, u32 quality)
+{
+    BlockF pixels;
+    LoadBlock(block, &pixels);
+
+    float weights[16];
+    bool transparent = false;
+    bool opaque = false;
+    for(u32 i = 0; i < 16; i++)
+    {
+        bool cutout = block[i * 4 + 3] < 128;
+        weights[i] = cutout ? 0.0f : 1.0f;
+        transparent |= cutout;
+        opaque |= !cutout;
+    }
+
+    BC1Candidate best = {};
+    if(!opaque)
+    {
+        memset(best.indices, 3, sizeof(best.indices));
+    }
+
+    else
+    {
+        float e0[4], e1[4];
+        ComputeEndpointsPCA(&pixels, 3, weights, e0, e1);
+        BC1Evaluate(&pixels, weights, transparent, PackRGB565(e1), PackRGB565(e0), &best);
+
+        static const float four_t[4] = {0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f};
+        static const float three_t[4] = {0.0f, 1.0f, 0.5f, 0.0f};
+
+        u32 iterations = quality == BC_QUALITY_FAST ? 0 : (quality == BC_QUALITY_NORMAL ? 2 : 4);
+        for(u32 iter = 0; iter < iterations; iter++)
+        {
+            const float *index_t = best.c0 > best.c1 ? four_t : three_t;
+            if(!RefineEndpoints(&pixels, 3, weights, best.indices, index_t, e0, e1))
+            {
+                break;
+            }
+
+            BC1Candidate candidate;
+            BC1Evaluate(&pixels, weights, transparent, PackRGB565(e0), PackRGB565(e1), &candidate);
+            if(candidate.error >= best.error)
+            {
+                break;
+            }
+
+            best = candidate;
+        }
+
+        if(quality == BC_QUALITY_HIGH)
+        {
+            // One pass of coordinate descent over the 565 fields of each endpoint.
+            static const u16 steps[6] = {1 << 11, 1 << 5, 1, (u16)-(1 << 11), (u16)-(1 << 5), (u16)-1};
+            static const u16 masks[6] = {0xf800, 0x07e0, 0x001f, 0xf800, 0x07e0, 0x001f};
+            for(u32 endpoint = 0; endpoint < 2; endpoint++)
+            {
+                for(u32 s = 0; s < 6; s++)
+                {
+                    u16 value = endpoint ? best.c1 : best.c0;
+                    u16 field = (u16)((value & masks[s]) + steps[s]) & masks[s];
+                    if((steps[s] & 0x8000) ? field > (value & masks[s]) : field < (value & masks[s]))
+                    {
+                        continue;
+                    }
+
+                    u16 moved = (value & ~masks[s]) | field;
+                    BC1Candidate candidate;
+                    BC1Evaluate(&pixels, weights, transparent,
+                                endpoint ? best.c0 : moved,
+                                endpoint ? moved : best.c1, &candidate);
+                    if(candidate.error < best.error)
+                    {
+                        best = candidate;
+                    }
+                }
+            }
+        }
+    }
+
+    u32 bits = 0;
+    for(u32 i = 0; i < 16; i++)
+    {
+        bits |= (u32)best.indices[i] << (i * 2);
+    }
+
+    memcpy(out + 0, &best.c0, 2);
+    memcpy(out + 2, &best.c1, 2);
+    memcpy(out + 4, &bits, 4);
+}
+
+static u32 BC4Palette(int e0, int e1, float *palette)
+{
+    palette[0] = (float)e0;
+    palette[1] = (float)e1;
+    if(e0 > e1)
+    {
+        for(u32 i = 1; i < 7; i++)
+        {
+            palette[i + 1] = floorf(((7 - i) * e0 + i * e1) / 7.0f + 0.5f);
+        }
+
+        return 8;
+    }
+
+    for(u32 i = 1; i < 5; i++)
+    {
+        palette[i + 1] = floorf(((5 - i) * e0 + i * e1) / 5.0f + 0.5f);
+    }
+
+    palette[6] = 0.0f;
+    palette[7] = 255.0f;
+    return 8;
+}
+
+static float BC4Evaluate(const float *values, int e0, int e1, u8 *indices)
+{
+    float scalar[8];
+    BC4Palette(e0, e1, scalar);
+
+    float palette[8][4];
+    for(u32 i = 0; i < 8; i++)
+    {
+        palette[i][0] = scalar[i];
+    }
+
+    const float *planes[1] = {values};
+    return SelectIndices(planes, 1, palette, 8, 0, indices);
+}
+
+static void BC4EncodeChannel(const BlockF *block, u32 channel, u8 *out, u32 quality)
+{
+    const float *values = block->c[channel];
+
+    int min = 255, max = 0;
+    int inner_min = 255, inner_max = 0;
+    for(u32 i = 0; i < 16; i++)
+    {
+        int v = (int)values[i];
+        if(v < min) min = v;
+        if(v > max) max = v;
+        if(v > 0 && v < inner_min) inner_min = v;
+        if(v < 255 && v > inner_max) inner_max = v;
+    }
+
+    int best_e0 = max, best_e1 = min;
+    u8 best_indices[16] = {};
+    float best_error = 0;
+
+    if(min == max)
+    {
+        best_e1 = max > 0 ? max - 1 : 0;
+        best_e0 = best_e1 + 1;
+        best_error = BC4Evaluate(values, best_e0, best_e1, best_indices);
+    }
+
+    else
+    {
+        best_error = BC4Evaluate(values, max, min, best_indices);
+
+        int radius = quality == BC_QUALITY_FAST ? 0 : (quality == BC_QUALITY_NORMAL ? 1 : 3);
+        for(int d0 = -radius; d0 <= radius; d0++)
+        {
+            for(int d1 = -radius; d1 <= radius; d1++)
+            {
+                int e0 = max + d0;
+                int e1 = min + d1;
+                if((d0 == 0 && d1 == 0) || e0 > 255 || e1 < 0 || e0 <= e1)
+                {
+                    continue;
+                }
+
+                u8 indices[16];
+                float error = BC4Evaluate(values, e0, e1, indices);
+                if(error < best_error)
+                {
+                    best_error = error;
+                    best_e0 = e0;
+                    best_e1 = e1;
+                    memcpy(best_indices, indices, 16);
+                }
+            }
+        }
+
+        // The six value mode keeps exact 0 and 255, which helps masks and
+        // normal maps with saturated texels.
+        if(inner_min <= inner_max && (min == 0 || max == 255))
+        {
+            u8 indices[16];
+            float error = BC4Evaluate(values, inner_min, inner_max, indices);
+            if(error < best_error)
+            {
+                best_error = error;
+                best_e0 = inner_min;
+                best_e1 = inner_max;
+                memcpy(best_indices, indices, 16);
+            }
+        }
+    }
+
+    u64 bits = 0;
+    for(u32 i = 0; i < 16; i++)
+    {
+        bits |= (u64)best_indices[i] << (i * 3);
+    }
+
+    out[0] = (u8)best_e0;
+    out[1] = (u8)best_e1;
+    for(u32 i = 0; i < 6; i++)
+    {
+        out[2 + i] = (u8)(bits >> (i * 8));
+    }
+}
+
+void BCEncodeBC4(const u8 *block, u8 *out, u32 quality)
+{
+    BlockF pixels;
+    LoadBlock(block, &pixels);
+    BC4EncodeChannel(&pixels, 0, out, quality);
+}
+
+void BCEncodeBC5(const u8 *block, u8 *out, u32 quality)
+{
+    BlockF pixels;
+    LoadBlock(block, &pixels);
+    BC4EncodeChannel(&pixels, 0, out, quality);
+    BC4EncodeChannel(&pixels, 1, out + 8, quality);
+}
+
+struct BC7Candidate
+{
+    int q0[4];
+    int q1[4];
+    int p0;
+    int p1;
+    u8 indices[16];
+    float error;
+};
+
+static int BC7Quantize(float value, int pbit)
+{
+    int q = (int)((value - pbit) * 0.5f + 0.5f);
+    return q < 0 ? 0 : (q > 127 ? 127 : q);
+}
+
+static void BC7Evaluate(const BlockF *block, const float *e0, const float *e1,
+                        int p0, int p1, BC7Candidate *candidate)
+{
+    candidate->p0 = p0;
+    candidate->p1 = p1;
+
+    int v0[4], v1[4];
+    for(u32 ch = 0; ch < 4; ch++)
+    {
+        candidate->q0[ch] = BC7Quantize(e0[ch], p0);
+        candidate->q1[ch] = BC7Quantize(e1[ch], p1);
+        v0[ch] = (candidate->q0[ch] << 1) | p0;
+        v1[ch] = (candidate->q1[ch] << 1) | p1;
+    }
+
+    float palette[16][4];
+    for(u32 i = 0; i < 16; i++)
+    {
+        int w = bc7_weights4[i];
+        for(u32 ch = 0; ch < 4; ch++)
+        {
+            palette[i][ch] = (float)(((64 - w) * v0[ch] + w * v1[ch] + 32) >> 6);
+        }
+    }
+
+    const float *planes[4] = {block->c[0], block->c[1], block->c[2], block->c[3]};
+    candidate->error = SelectIndices(planes, 4, palette, 16, 0, candidate->indices);
+}
+
+static void BC7EvaluateBest(const BlockF *block, const float *e0, const float *e1,
+                            u32 quality, BC7Candidate *best)
+{
+    if(quality == BC_QUALITY_FAST)
+    {
+        float err[2][2] = {};
+        for(u32 ch = 0; ch < 4; ch++)
+        {
+            for(int p = 0; p < 2; p++)
+            {
+                float r0 = (float)((BC7Quantize(e0[ch], p) << 1) | p) - e0[ch];
+                float r1 = (float)((BC7Quantize(e1[ch], p) << 1) | p) - e1[ch];
+                err[0][p] += r0 * r0;
+                err[1][p] += r1 * r1;
+            }
+        }
+
+        BC7Evaluate(block, e0, e1, err[0][1] < err[0][0], err[1][1] < err[1][0], best);
+        return;
+    }
+
+    best->error = FLT_MAX;
+    for(int p0 = 0; p0 < 2; p0++)
+    {
+        for(int p1 = 0; p1 < 2; p1++)
+        {
+            BC7Candidate candidate;
+            BC7Evaluate(block, e0, e1, p0, p1, &candidate);
+            if(candidate.error < best->error)
+            {
+                *best = candidate;
+            }
+        }
+    }
+}
+
+struct BitWriter
+{
+    u8 *out;
+    u32 pos;
+};
+
+static void WriteBits(BitWriter *writer, u32 value, u32 count)
+{
+    for(u32 i = 0; i < count; i++, writer->pos++)
+    {
+        if((value >> i) & 1)
+        {
+            writer->out[writer->pos >> 3] |= (u8)(1 << (writer->pos & 7));
+        }
+    }
+}
+
+void BCEncodeBC7(const u8 *block, u8 *out, u32 quality)
+{
+    BlockF pixels;
+    LoadBlock(block, &pixels);
+
+    float e0[4], e1[4];
+    ComputeEndpointsPCA(&pixels, 4, 0, e0, e1);
+
+    BC7Candidate best;
+    BC7EvaluateBest(&pixels, e0, e1, quality, &best);
+
+    float index_t[16];
+    for(u32 i = 0; i < 16; i++)
+    {
+        index_t[i] = bc7_weights4[i] / 64.0f;
+    }
+
+    u32 iterations = quality == BC_QUALITY_FAST ? 0 : (quality == BC_QUALITY_NORMAL ? 1 : 3);
+    for(u32 iter = 0; iter < iterations; iter++)
+    {
+        if(!RefineEndpoints(&pixels, 4, 0, best.indices, index_t, e0, e1))
+        {
+            break;
+        }
+
+        BC7Candidate candidate;
+        BC7EvaluateBest(&pixels, e0, e1, quality, &candidate);
+        if(candidate.error >= best.error)
+        {
+            break;
+        }
+
+        best = candidate;
+    }
+
+    // Mode 6 stores the anchor index with an implicit zero high bit.
+    if(best.indices[0] & 8)
+    {
+        for(u32 ch = 0; ch < 4; ch++)
+        {
+            int swap = best.q0[ch]; best.q0[ch] = best.q1[ch]; best.q1[ch] = swap;
+        }
+
+        int swap = best.p0; best.p0 = best.p1; best.p1 = swap;
+        for(u32 i = 0; i < 16; i++)
+        {
+            best.indices[i] = 15 - best.indices[i];
+        }
+    }
+
+    memset(out, 0, 16);
+    BitWriter writer = {out, 0};
+    WriteBits(&writer, 1 << 6, 7);
+    for(u32 ch = 0; ch < 4; ch++)
+    {
+        WriteBits(&writer, best.q0[ch], 7);
+        WriteBits(&writer, best.q1[ch], 7);
+    }
+
+    WriteBits(&writer, best.p0, 1);
+    WriteBits(&writer, best.p1, 1);
+    WriteBits(&writer, best.indices[0], 3);
+    for(u32 i = 1; i < 16; i++)
+    {
+        WriteBits(&writer, best.indices[i], 4);
+    }
+}
+
+void BCEncodeBlock(DDSFormat format, const u8 *block, u8 *out, u32 quality)
+{
+    switch(format)
+    {
+        case DDS_FORMAT_BC1:
+        case DDS_FORMAT_BC1_SRGB:
+            BCEncodeBC1(block, out, quality);
+            break;
+
+        case DDS_FORMAT_BC4:
+            BCEncodeBC4(block, out, quality);
+            break;
+
+        case DDS_FORMAT_BC5:
+            BCEncodeBC5(block, out, quality);
+            break;
+
+        case DDS_FORMAT_BC7:
+        case DDS_FORMAT_BC7_SRGB:
+            BCEncodeBC7(block, out, quality);
+            break;
+
+        default:
+            break;
+    }
+}
+
+static void BC4DecodeChannel(const u8 *in, u8 *block, u32 channel)
+{
+    float palette[8];
+    BC4Palette(in[0], in[1], palette);
+
+    u64 bits = 0;
+    for(u32 i = 0; i < 6; i++)
+    {
+        bits |= (u64)in[2 + i] << (i * 8);
+    }
+
+    for(u32 i = 0; i < 16; i++)
+    {
+        block[i * 4 + channel] = (u8)palette[(bits >> (i * 3)) & 7];
+    }
+}
+
+static u32 ReadBits(const u8 *in, u32 *pos, u32 count)
+{
+    u32 value = 0;
+    for(u32 i = 0; i < count; i++, (*pos)++)
+    {
+        value |= (u32)((in[*pos >> 3] >> (*pos & 7)) & 1) << i;
+    }
+
+    return value;
+}
+
+// Only decodes the modes the encoder emits; anything else comes back magenta.
+void BCDecodeBlock(DDSFormat format, const u8 *in, u8 *block)
+{
+    for(u32 i = 0; i < 16; i++)
+    {
+        block[i * 4 + 0] = 0;
+        block[i * 4 + 1] = 0;
+        block[i * 4 + 2] = 0;
+        block[i * 4 + 3] = 255;
+    }
+
+    switch(format)
+    {
+        case DDS_FORMAT_BC1:
+        case DDS_FORMAT_BC1_SRGB:
+        {
+            u16 c0, c1; u32 bits;
+            memcpy(&c0, in, 2);
+            memcpy(&c1, in + 2, 2);
+            memcpy(&bits, in + 4, 4);
+
+            int palette[4][4];
+            BC1Palette(c0, c1, palette);
+            for(u32 i = 0; i < 16; i++)
+            {
+                int *c = palette[(bits >> (i * 2)) & 3];
+                for(u32 ch = 0; ch < 4; ch++)
+                {
+                    block[i * 4 + ch] = (u8)c[ch];
+                }
+            }
+        } break;
+
+        case DDS_FORMAT_BC4:
+        {
+            BC4DecodeChannel(in, block, 0);
+        } break;
+
+        case DDS_FORMAT_BC5:
+        {
+            BC4DecodeChannel(in, block, 0);
+            BC4DecodeChannel(in + 8, block, 1);
+        } break;
+
+        case DDS_FORMAT_BC7:
+        case DDS_FORMAT_BC7_SRGB:
+        {
+            u32 pos = 0;
+            if(ReadBits(in, &pos, 7) != (1 << 6))
+            {
+                for(u32 i = 0; i < 16; i++)
+                {
+                    block[i * 4 + 0] = 255;
+                    block[i * 4 + 2] = 255;
+                }
+
+                break;
+            }
+
+            int v0[4], v1[4];
+            for(u32 ch = 0; ch < 4; ch++)
+            {
+                v0[ch] = ReadBits(in, &pos, 7) << 1;
+                v1[ch] = ReadBits(in, &pos, 7) << 1;
+            }
+
+            int p0 = ReadBits(in, &pos, 1);
+            int p1 = ReadBits(in, &pos, 1);
+            for(u32 i = 0; i < 16; i++)
+            {
+                int w = bc7_weights4[ReadBits(in, &pos, i == 0 ? 3 : 4)];
+                for(u32 ch = 0; ch < 4; ch++)
+                {
+                    block[i * 4 + ch] = (u8)(((64 - w) * (v0[ch] | p0) + w * (v1[ch] | p1) + 32) >> 6);
+                }
+            }
+        } break;
+
+        default:
+            break;
+    }
+}
@@ -0,0 +1,21 @@
+#ifndef BC_ENCODE_H
+#define BC_ENCODE_H
+
+#include "types.hh"
+#include "dds.hh"
+
+#define BC_QUALITY_FAST 0
+#define BC_QUALITY_NORMAL 1
+#define BC_QUALITY_HIGH 2
+
+// Every block function works on a gathered 4x4 block of RGBA8 pixels
+// (64 bytes, row major). BC4 reads the red channel, BC5 red and green.
+void BCEncodeBC1(const u8 *block, u8 *out, u32 quality);
+void BCEncodeBC4(const u8 *block, u8 *out, u32 quality);
+void BCEncodeBC5(const u8 *block, u8 *out, u32 quality);
+void BCEncodeBC7(const u8 *block, u8 *out, u32 quality);
+
+void BCEncodeBlock(DDSFormat format, const u8 *block, u8 *out, u32 quality);
+void BCDecodeBlock(DDSFormat format, const u8 *in, u8 *block);
+
+#endif //BC_ENCODE_H
@@ -0,0 +1,619 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "os.hh"
+#include "engine.hh"
+#include "camera.hh"
+#include "transform.hh"
+#include "animation.hh"
+#include "assets.hh"
+#include "arena_alloc.hh"
+#include "third_party/HandmadeMath.h"
+
+#define MAX_BENCH_MODELS 8
+#define MAX_PATH_KEYS 256
+#define BENCH_CLIP_FRAMES 60
+
+enum BenchLayout
+{
+    BENCH_GRID,
+    BENCH_RANDOM,
+};
+
+struct PathKey
+{
+    HMM_Vec3 pos;
+    float yaw;
+    float pitch;
+};
+
+struct BenchSettings
+{
+    u32 model_count;
+    const char *models[MAX_BENCH_MODELS];
+    u32 instances;
+    BenchLayout layout;
+    float spacing;
+    u32 seed;
+
+    u32 frames;
+    u32 warmup;
+    u32 width;
+    u32 height;
+    u32 frames_in_flight;
+    float target_frame_ms;
+
+    const char *path_file;
+    const char *output_path;
+};
+
+// The skeleton of a skinned model and the two clips its instances blend.
+struct BenchSkin
+{
+    Skeleton skeleton;
+    AnimClip *clips[2];
+};
+
+struct BenchFrame
+{
+    u64 frame;
+    u64 begin;
+    u64 animate;
+    u64 record;
+    u64 end;
+    float gpu_ms;
+    float render_scale;
+};
+
+static void PrintUsage(void)
+{
+    printf("usage: bench [options]\n"
+           "  -model file.cmdl       model to instance, repeatable (default out.cmdl)\n"
+           "  -instances N           instance count (default 1024)\n"
+           "  -layout grid|random    placement (default grid)\n"
+           "  -spacing S             grid cell size in metres (default 3)\n"
+           "  -seed N                random layout seed (default 1)\n"
+           "  -frames N              measured frames (default 1000)\n"
+           "  -warmup N              frames run before measuring (default 60)\n"
+           "  -size W H              render size (default 1280 720)\n"
+           "  -inflight N            frames in flight (default 2)\n"
+           "  -dynres MS             dynamic resolution with this GPU frame time target\n"
+           "  -path file             camera keys, one \"x y z yaw pitch\" per line\n"
+           "  -o file.json           write the report here as well as stdout\n"
+           "Runs headless; set VK_ICD_FILENAMES to pick a software ICD.\n");
+}
+
+static bool ParseArgs(int argc, char **argv, BenchSettings *settings)
+{
+    *settings = {};
+    settings->instances = 1024;
+    settings->spacing = 3.0f;
+    settings->seed = 1;
+    settings->frames = 1000;
+    settings->warmup = 60;
+    settings->width = 1280;
+    settings->height = 720;
+    settings->frames_in_flight = 2;
+
+    for(int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        if(strcmp(arg, "-model") == 0 && i + 1 < argc)
+        {
+            if(settings->model_count == MAX_BENCH_MODELS) return false;
+            settings->models[settings->model_count++] = argv[++i];
+        }
+
+        else if(strcmp(arg, "-instances") == 0 && i + 1 < argc) settings->instances = atoi(argv[++i]);
+        else if(strcmp(arg, "-spacing") == 0 && i + 1 < argc) settings->spacing = atof(argv[++i]);
+        else if(strcmp(arg, "-seed") == 0 && i + 1 < argc) settings->seed = atoi(argv[++i]);
+        else if(strcmp(arg, "-frames") == 0 && i + 1 < argc) settings->frames = atoi(argv[++i]);
+        else if(strcmp(arg, "-warmup") == 0 && i + 1 < argc) settings->warmup = atoi(argv[++i]);
+        else if(strcmp(arg, "-inflight") == 0 && i + 1 < argc) settings->frames_in_flight = atoi(argv[++i]);
+        else if(strcmp(arg, "-dynres") == 0 && i + 1 < argc) settings->target_frame_ms = atof(argv[++i]);
+        else if(strcmp(arg, "-path") == 0 && i + 1 < argc) settings->path_file = argv[++i];
+        else if(strcmp(arg, "-o") == 0 && i + 1 < argc) settings->output_path = argv[++i];
+
+        else if(strcmp(arg, "-layout") == 0 && i + 1 < argc)
+        {
+            const char *layout = argv[++i];
+            if(strcmp(layout, "grid") == 0) settings->layout = BENCH_GRID;
+            else if(strcmp(layout, "random") == 0) settings->layout = BENCH_RANDOM;
+            else return false;
+        }
+
+        else if(strcmp(arg, "-size") == 0 && i + 2 < argc)
+        {
+            settings->width = atoi(argv[++i]);
+            settings->height = atoi(argv[++i]);
+        }
+
+        else return false;
+    }
+
+    if(settings->model_count == 0)
+    {
+        settings->models[settings->model_count++] = "out.cmdl";
+    }
+
+    return settings->frames > 0 && settings->width > 0 && settings->height > 0;
+}
+
+// xorshift32, so a seed gives the same scene on every platform.
+static float RandomUnit(u32 *state)
+{
+    u32 x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return (x >> 8) * (1.0f / 16777216.0f);
+}
+
+static void PlaceInstances(BenchSettings *settings, Model *models, Model *instances,
+                           TransformSystem *transforms, TransformHandle *handles, float *extent)
+{
+    u32 side = (u32)ceilf(sqrtf((float)settings->instances));
+    *extent = side * settings->spacing;
+    float origin = -0.5f * (side - 1) * settings->spacing;
+
+    u32 random = settings->seed ? settings->seed : 1;
+    for(u32 i = 0; i < settings->instances; i++)
+    {
+        Model *instance = &instances[i];
+        *instance = models[i % settings->model_count];
+
+        HMM_Vec3 pos;
+        float angle;
+        if(settings->layout == BENCH_GRID)
+        {
+            pos = HMM_V3(origin + (i % side) * settings->spacing, 0, origin + (i / side) * settings->spacing);
+            angle = 0;
+        }
+
+        else
+        {
+            pos = HMM_V3((RandomUnit(&random) - 0.5f) * *extent, 0, (RandomUnit(&random) - 0.5f) * *extent);
+            angle = RandomUnit(&random) * HMM_PI32 * 2;
+        }
+
+        handles[i] = TransformCreate(transforms, {});
+        TransformSetLocal(transforms, handles[i], pos, HMM_QFromAxisAngle_LH(HMM_V3(0, 1, 0), angle), HMM_V3(1, 1, 1));
+    }
+}
+
+// Skinned instances are moved to the end, each with a character to animate
+// it, so the rest still go out as one batch. Returns how many are left in
+// front.
+static u32 SetupCharacters(BenchSettings *settings, Model *models, BenchSkin *skins, Model *instances,
+                           TransformHandle *handles, AnimInstance *characters, u32 *character_count)
+{
+    u32 front = 0;
+    for(u32 i = 0; i < settings->instances; i++)
+    {
+        if(instances[i].mesh.joint_count == 0)
+        {
+            Model model = instances[i];
+            TransformHandle handle = handles[i];
+            instances[i] = instances[front];
+            handles[i] = handles[front];
+            instances[front] = model;
+            handles[front++] = handle;
+        }
+    }
+
+    *character_count = settings->instances - front;
+    for(u32 c = 0; c < *character_count; c++)
+    {
+        Model *instance = &instances[front + c];
+        BenchSkin *skin = &skins[0];
+        for(u32 m = 0; m < settings->model_count; m++)
+        {
+            if(models[m].mesh_asset.index == instance->mesh_asset.index)
+            {
+                skin = &skins[m];
+            }
+        }
+
+        AnimInstance *character = &characters[c];
+        *character = {};
+        character->skeleton = &skin->skeleton;
+        character->clips[0] = skin->clips[0];
+        character->clips[1] = skin->clips[1];
+        character->times[0] = c * 0.37f;
+        character->times[1] = c * 0.11f;
+        character->weight = (c % 5) / 4.0f;
+    }
+
+    return front;
+}
+
+// There are no clip files yet, so each skinned model gets two made up ones:
+// every joint swaying about its bind pose, on a different axis in each.
+static bool LoadBenchSkin(Arena *arena, const char *path, BenchSkin *skin)
+{
+    MappedFile file;
+    if(!OsMapFile(path, &file))
+    {
+        return false;
+    }
+
+    const CompiledSkin *compiled = FindCompiledSkin(file.data, file.size);
+    bool loaded = compiled && LoadSkeleton(arena, compiled, &skin->skeleton);
+    OsUnmapFile(&file);
+
+    Skeleton *skeleton = &skin->skeleton;
+    u32 pose_size = MATH_TRS_CHANNELS * skeleton->stride;
+    float *poses = loaded ? (float *)ArenaAlloc(arena, sizeof(float) * pose_size * BENCH_CLIP_FRAMES, 64) : 0;
+    for(u32 clip = 0; clip < 2 && poses; clip++)
+    {
+        HMM_Vec3 axis = clip ? HMM_V3(0, 0, 1) : HMM_V3(1, 0, 0);
+        for(u32 frame = 0; frame < BENCH_CLIP_FRAMES; frame++)
+        {
+            float *pose = poses + frame * pose_size;
+            AnimBindPose(skeleton, pose);
+            for(u32 joint = 0; joint < skeleton->joint_count; joint++)
+            {
+                float phase = (float)frame / BENCH_CLIP_FRAMES + joint * 0.05f;
+                HMM_Quat sway = HMM_QFromAxisAngle_RH(axis, 0.25f * HMM_SinF(phase * 2.0f * HMM_PI32));
+                float *q = pose + MATH_QX * skeleton->stride + joint;
+                HMM_Quat rotation = HMM_Q(q[0], q[skeleton->stride], q[2 * skeleton->stride], q[3 * skeleton->stride]);
+                rotation = HMM_MulQ(sway, rotation);
+                for(u32 c = 0; c < 4; c++)
+                {
+                    q[c * skeleton->stride] = rotation.Elements[c];
+                }
+            }
+        }
+
+        skin->clips[clip] = AnimCompressClip(arena, skeleton, poses, BENCH_CLIP_FRAMES, 30.0f);
+    }
+
+    return loaded && poses && skin->clips[0] && skin->clips[1];
+}
+
+// A slow orbit that dips toward the scene and back out, scaled to its size.
+static u32 DefaultPath(float extent, PathKey *keys)
+{
+    const u32 count = 16;
+    float radius = extent * 0.6f + 5.0f;
+    for(u32 i = 0; i < count; i++)
+    {
+        float t = (float)i / count * HMM_PI32 * 2;
+        float r = radius * (0.75f + 0.25f * HMM_CosF(t * 2));
+        keys[i].pos = HMM_V3(HMM_CosF(t) * r, 2.0f + extent * 0.1f * (1 + HMM_SinF(t * 2)), HMM_SinF(t) * r);
+        keys[i].yaw = t + HMM_PI32;
+        keys[i].pitch = -0.2f;
+    }
+
+    return count;
+}
+
+static u32 LoadPath(const char *path, PathKey *keys)
+{
+    MappedFile file;
+    if(!OsMapFile(path, &file))
+    {
+        return 0;
+    }
+
+    u32 count = 0;
+    const char *text = (const char *)file.data;
+    u64 pos = 0;
+    while(pos < file.size && count < MAX_PATH_KEYS)
+    {
+        char line[256];
+        u32 length = 0;
+        while(pos < file.size && text[pos] != '\n')
+        {
+            if(length < sizeof(line) - 1) line[length++] = text[pos];
+            pos++;
+        }
+        line[length] = 0;
+        pos++;
+
+        PathKey *key = &keys[count];
+        if(sscanf(line, "%f %f %f %f %f", &key->pos.X, &key->pos.Y, &key->pos.Z, &key->yaw, &key->pitch) == 5)
+        {
+            count++;
+        }
+    }
+
+    OsUnmapFile(&file);
+    return count;
+}
+
+// Catmull-Rom through the keys as a closed loop, one lap per measured run.
+static void SamplePath(PathKey *keys, u32 count, float t, Camera *camera)
+{
+    float f = t * count;
+    u32 i = (u32)f % count;
+    float s = f - floorf(f);
+
+    PathKey *k0 = &keys[(i + count - 1) % count];
+    PathKey *k1 = &keys[i];
+    PathKey *k2 = &keys[(i + 1) % count];
+    PathKey *k3 = &keys[(i + 2) % count];
+
+    float s2 = s * s;
+    float s3 = s2 * s;
+    float w0 = -0.5f * s3 + s2 - 0.5f * s;
+    float w1 = 1.5f * s3 - 2.5f * s2 + 1.0f;
+    float w2 = -1.5f * s3 + 2.0f * s2 + 0.5f * s;
+    float w3 = 0.5f * s3 - 0.5f * s2;
+
+    camera->cam_pos = k0->pos * w0 + k1->pos * w1 + k2->pos * w2 + k3->pos * w3;
+    float yaw_delta = k2->yaw - k1->yaw;
+    yaw_delta -= HMM_PI32 * 2 * floorf((yaw_delta + HMM_PI32) / (HMM_PI32 * 2));
+    camera->yaw = k1->yaw + yaw_delta * s;
+    camera->pitch = HMM_Lerp(k1->pitch, s, k2->pitch);
+
+    HMM_Vec3 dir;
+    dir.X = HMM_CosF(camera->yaw) * HMM_CosF(camera->pitch);
+    dir.Y = HMM_SinF(camera->pitch);
+    dir.Z = HMM_SinF(camera->yaw) * HMM_CosF(camera->pitch);
+    camera->cam_dir = HMM_NormV3(dir);
+
+    camera->prev_pos = camera->cam_pos;
+    camera->prev_dir = camera->cam_dir;
+    CameraInterpolate(camera, 1.0f);
+}
+
+static int CompareU64(const void *a, const void *b)
+{
+    u64 x = *(const u64 *)a;
+    u64 y = *(const u64 *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Nearest rank on a sorted array.
+static double Percentile(u64 *sorted, u32 count, double p)
+{
+    u32 rank = (u32)ceil(p * count);
+    return (double)sorted[rank ? rank - 1 : 0];
+}
+
+int main(int argc, char **argv)
+{
+    BenchSettings settings;
+    if(!ParseArgs(argc, argv, &settings))
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    u64 start = OsTimeNow();
+    Arena global_arena = CreateNewArena(0, 64 * MB);
+    Arena engine_arena = CreateNewArena(&global_arena, 4 * MB);
+
+    AssetId preload[MAX_BENCH_MODELS];
+    for(u32 i = 0; i < settings.model_count; i++)
+    {
+        preload[i] = AssetId{AssetHashString(settings.models[i]), settings.models[i]};
+    }
+
+    EngineConfig config = DefaultEngineConfig();
+    config.width = settings.width;
+    config.height = settings.height;
+    config.frames_in_flight = settings.frames_in_flight;
+    config.target_frame_ms = settings.target_frame_ms;
+    config.preload_models = preload;
+    config.preload_model_count = settings.model_count;
+    Engine engine = CreateEngine(&engine_arena, config);
+
+    Model models[MAX_BENCH_MODELS];
+    for(u32 i = 0; i < settings.model_count; i++)
+    {
+        models[i] = EngineLoadCompiledModel(&engine, preload[i]);
+        if(models[i].mesh.num_indices == 0)
+        {
+            printf("bench: failed to load %s\n", settings.models[i]);
+            return 1;
+        }
+    }
+
+    u64 models_end = OsTimeNow();
+    u64 first_frame = 0;
+
+    BenchSkin skins[MAX_BENCH_MODELS] = {};
+    for(u32 i = 0; i < settings.model_count; i++)
+    {
+        if(models[i].mesh.joint_count && !LoadBenchSkin(&global_arena, settings.models[i], &skins[i]))
+        {
+            printf("bench: failed to load the skin of %s\n", settings.models[i]);
+            return 1;
+        }
+    }
+
+    Model *instances = (Model *)ArenaAlloc(&global_arena, sizeof(Model) * settings.instances, 0);
+    TransformHandle *handles = (TransformHandle *)ArenaAlloc(&global_arena, sizeof(TransformHandle) * settings.instances, 0);
+    HMM_Mat4 *worlds = (HMM_Mat4 *)ArenaAlloc(&global_arena, sizeof(HMM_Mat4) * settings.instances, 0);
+    TransformSystem *transforms = CreateTransformSystem(&global_arena, settings.instances, engine.jobs);
+    BenchFrame *frames = (BenchFrame *)ArenaAlloc(&global_arena, sizeof(BenchFrame) * settings.frames, 0);
+    u64 *sorted = (u64 *)ArenaAlloc(&global_arena, sizeof(u64) * settings.frames, 0);
+    AnimInstance *characters = (AnimInstance *)ArenaAlloc(&global_arena, sizeof(AnimInstance) * settings.instances, 0);
+    u32 *joint_bases = (u32 *)ArenaAlloc(&global_arena, sizeof(u32) * settings.instances, 0);
+    if(!instances || !handles || !worlds || !transforms->capacity || !frames || !sorted || !characters || !joint_bases)
+    {
+        printf("bench: out of memory\n");
+        return 1;
+    }
+
+    float extent = 0;
+    PlaceInstances(&settings, models, instances, transforms, handles, &extent);
+    u32 character_count = 0;
+    u32 static_count = SetupCharacters(&settings, models, skins, instances, handles, characters, &character_count);
+
+    PathKey keys[MAX_PATH_KEYS];
+    u32 key_count = settings.path_file ? LoadPath(settings.path_file, keys) : DefaultPath(extent, keys);
+    if(key_count == 0)
+    {
+        printf("bench: failed to load camera path %s\n", settings.path_file);
+        return 1;
+    }
+
+    Camera camera = {};
+    camera.cam_up = {0, 1, 0};
+
+    ProjectionInfo proj_info = {};
+    proj_info.fov_rad = 1.57;
+    proj_info.width = settings.width;
+    proj_info.height = settings.height;
+    proj_info.near_plane = 0.01;
+    CameraSetProjection(&camera, proj_info);
+
+    // Draws beyond MAX_DRAWS are dropped by the engine, so counts come from
+    // what was actually recorded rather than the instance count.
+    u64 draws = 0;
+    u64 triangles = 0;
+    u32 total_frames = settings.warmup + settings.frames;
+    u64 last = OsTimeNow();
+    for(u32 f = 0; f < total_frames; f++)
+    {
+        u32 measured = f >= settings.warmup ? f - settings.warmup : 0;
+        SamplePath(keys, key_count, (float)measured / settings.frames, &camera);
+
+        u64 t0 = OsTimeNow();
+        u32 index = EngineBegin(&engine);
+        u64 t1 = OsTimeNow();
+
+        // Palettes go straight into the frame's region for the skinned
+        // draws to read. Characters that do not fit are left in bind pose.
+        for(u32 c = 0; c < character_count; c++)
+        {
+            AnimInstance *character = &characters[c];
+            character->times[0] += 1.0f / 60.0f;
+            character->times[1] += 1.0f / 60.0f;
+            character->palette = EngineAllocJoints(&engine, character->skeleton->joint_count, &joint_bases[c]);
+        }
+
+        AnimUpdate(characters, character_count, engine.jobs);
+        u64 t_animate = OsTimeNow();
+
+        TransformUpdate(transforms);
+        Texture target = EngineGetSceneTarget(&engine, index);
+        EngineBeginRendering(&engine, target, &engine.depth, {0.4, 0.5, 0.7, 1.0});
+        for(u32 i = 0; i < settings.instances; i++)
+        {
+            worlds[i] = TransformWorld(transforms, handles[i]);
+        }
+        EngineDrawModels(&engine, camera.transform, instances, worlds, static_count);
+        for(u32 c = 0; c < character_count; c++)
+        {
+            u32 i = static_count + c;
+            EngineDrawSkinnedModel(&engine, camera.transform, instances[i], worlds[i], joint_bases[c]);
+        }
+        EngineEndRendering(&engine);
+        u64 t2 = OsTimeNow();
+
+        if(f >= settings.warmup)
+        {
+            for(u32 i = 0; i < engine.draw_count; i++)
+            {
+                triangles += engine.draws[i].num_indices / 3;
+            }
+            draws += engine.draw_count;
+        }
+
+        EngineEnd(&engine, index);
+        u64 t3 = OsTimeNow();
+        if(f == 0)
+        {
+            first_frame = t3;
+        }
+
+        ReadbackFrame readback;
+        while(EngineReadback(&engine, &readback, false))
+        {
+        }
+
+        if(f >= settings.warmup)
+        {
+            BenchFrame *frame = &frames[measured];
+            frame->frame = t3 - last;
+            frame->begin = t1 - t0;
+            frame->animate = t_animate - t1;
+            frame->record = t2 - t_animate;
+            frame->end = t3 - t2;
+            frame->gpu_ms = EngineGetGpuTime(&engine);
+            frame->render_scale = EngineGetRenderScale(&engine);
+        }
+        last = t3;
+    }
+
+    GpuMemoryStats memory = EngineGetMemoryStats(&engine);
+    JobGraph *startup = engine.startup;
+    DestroyEngine(&engine);
+
+    double ms_per_tick = 1000.0 / OsTimeFrequency();
+    u32 count = settings.frames;
+    u64 frame_total = 0, begin_total = 0, animate_total = 0, record_total = 0, end_total = 0;
+    double gpu_total = 0, scale_total = 0;
+    float scale_min = 1.0f;
+    for(u32 i = 0; i < count; i++)
+    {
+        gpu_total += frames[i].gpu_ms;
+        scale_total += frames[i].render_scale;
+        if(frames[i].render_scale < scale_min) scale_min = frames[i].render_scale;
+        sorted[i] = frames[i].frame;
+        frame_total += frames[i].frame;
+        begin_total += frames[i].begin;
+        animate_total += frames[i].animate;
+        record_total += frames[i].record;
+        end_total += frames[i].end;
+    }
+    qsort(sorted, count, sizeof(u64), CompareU64);
+
+    char report[2048];
+    int size = snprintf(report, sizeof(report),
+                        "{\n"
+                        "  \"frames\": %u,\n"
+                        "  \"warmup\": %u,\n"
+                        "  \"instances\": %u,\n"
+                        "  \"characters\": %u,\n"
+                        "  \"layout\": \"%s\",\n"
+                        "  \"width\": %u,\n"
+                        "  \"height\": %u,\n"
+                        "  \"frames_in_flight\": %u,\n"
+                        "  \"startup_ms\": {\"engine\": %.4f, \"models\": %.4f, \"first_frame\": %.4f},\n"
+                        "  \"frame_ms\": {\"avg\": %.4f, \"min\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f},\n"
+                        "  \"cpu_ms\": {\"begin\": %.4f, \"animate\": %.4f, \"record\": %.4f, \"end\": %.4f},\n"
+                        "  \"gpu_ms\": %.4f,\n"
+                        "  \"render_scale\": {\"avg\": %.3f, \"min\": %.3f},\n"
+                        "  \"draws_per_frame\": %.1f,\n"
+                        "  \"triangles_per_frame\": %.1f,\n"
+                        "  \"vram_mb\": {\"usage\": %.1f, \"budget\": %.1f, \"mesh\": %.1f, \"texture\": %.1f, "
+                        "\"staging\": %.1f, \"render_target\": %.1f, \"frame\": %.1f}\n"
+                        "}\n",
+                        count, settings.warmup, settings.instances, character_count,
+                        settings.layout == BENCH_GRID ? "grid" : "random",
+                        settings.width, settings.height, settings.frames_in_flight,
+                        (startup->end - start) * ms_per_tick, (models_end - startup->end) * ms_per_tick,
+                        (first_frame - start) * ms_per_tick,
+                        frame_total * ms_per_tick / count, sorted[0] * ms_per_tick,
+                        Percentile(sorted, count, 0.50) * ms_per_tick,
+                        Percentile(sorted, count, 0.95) * ms_per_tick,
+                        Percentile(sorted, count, 0.99) * ms_per_tick,
+                        sorted[count - 1] * ms_per_tick,
+                        begin_total * ms_per_tick / count, animate_total * ms_per_tick / count,
+                        record_total * ms_per_tick / count,
+                        end_total * ms_per_tick / count,
+                        gpu_total / count, scale_total / count, scale_min,
+                        (double)draws / count, (double)triangles / count,
+                        (double)memory.vram_usage / (1 * MB), (double)memory.vram_budget / (1 * MB),
+                        (double)memory.categories[GPU_MEMORY_MESH].bytes / (1 * MB),
+                        (double)memory.categories[GPU_MEMORY_TEXTURE].bytes / (1 * MB),
+                        (double)memory.categories[GPU_MEMORY_STAGING].bytes / (1 * MB),
+                        (double)memory.categories[GPU_MEMORY_RENDER_TARGET].bytes / (1 * MB),
+                        (double)memory.categories[GPU_MEMORY_FRAME].bytes / (1 * MB));
+
+    fputs(report, stdout);
+    if(settings.output_path && !OsWriteFileAtomic(settings.output_path, report, size))
+    {
+        printf("bench: failed to write %s\n", settings.output_path);
+        return 1;
+    }
+
+    return 0;
+}
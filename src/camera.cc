@@ -1,4 +1,3 @@
-#include <windows.h>
 #include "camera.hh"
 #include "third_party/HandmadeMath.h"
 
@@ -14,27 +13,30 @@ void CameraSetProjection(Camera *camera, ProjectionInfo proj_info)
     proj->Elements[3][2] = proj_info.near_plane;
 }
 
-void CameraUpdate(Camera *camera, POINT cursor_delta)
+void CameraUpdate(Camera *camera, CameraInput input, float dt)
 {
-    const float cam_speed = 40 * 1.f/60;
-    
-    if(GetKeyState(0x57) & 0x8000)
+    const float cam_speed = 40 * dt;
+
+    camera->prev_pos = camera->cam_pos;
+    camera->prev_dir = camera->cam_dir;
+
+    if(input.forward)
     {
         camera->cam_pos += cam_speed * camera->cam_dir;
     }
 
-    if(GetKeyState(0x53) & 0x8000)
+    if(input.back)
     {
         camera->cam_pos -= cam_speed * camera->cam_dir;
     }
 
-    if(GetKeyState(0x41) & 0x8000)
+    if(input.left)
     {
         camera->cam_pos -= cam_speed * HMM_NormV3(HMM_Cross(camera->cam_dir,
                                                             camera->cam_up));
     }
 
-    if(GetKeyState(0x44) & 0x8000)
+    if(input.right)
     {
         camera->cam_pos += cam_speed * HMM_NormV3(HMM_Cross(camera->cam_dir,
                                                             camera->cam_up));
@@ -42,8 +44,8 @@ void CameraUpdate(Camera *camera, POINT cursor_delta)
 
     camera->cam_pos.Y = 1;
 
-    camera->yaw += 0.005 * cursor_delta.x;
-    camera->pitch -= 0.005 * cursor_delta.y;
+    camera->yaw += 0.005 * input.look_x;
+    camera->pitch -= 0.005 * input.look_y;
 
     camera->pitch = HMM_Clamp(-1.567, camera->pitch, 1.567);
 
@@ -58,11 +60,13 @@ void CameraUpdate(Camera *camera, POINT cursor_delta)
     direction.Z = sin_yaw * cos_pitch;
 
     camera->cam_dir = HMM_NormV3(direction);
+}
 
-    HMM_Mat4 view = HMM_LookAt_RH(camera->cam_pos,
-                                  camera->cam_pos +
-                                  camera->cam_dir,
-                                  camera->cam_up);
-    
-    camera->transform = camera->projection * view;
+void CameraInterpolate(Camera *camera, float alpha)
+{
+    HMM_Vec3 pos = HMM_LerpV3(camera->prev_pos, alpha, camera->cam_pos);
+    HMM_Vec3 dir = HMM_NormV3(HMM_LerpV3(camera->prev_dir, alpha, camera->cam_dir));
+
+    camera->view = HMM_LookAt_RH(pos, pos + dir, camera->cam_up);
+    camera->transform = camera->projection * camera->view;
 }
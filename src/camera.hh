@@ -1,7 +1,7 @@
 #ifndef CAMERA_H
 #define CAMERA_H
 
-#include <windows.h>
+#include "types.hh"
 #include "third_party/HandmadeMath.h"
 
 struct Camera
@@ -10,7 +10,12 @@ struct Camera
     HMM_Vec3 cam_dir;
     HMM_Vec3 cam_up;
     
+    // State at the start of the last simulation step, for interpolation.
+    HMM_Vec3 prev_pos;
+    HMM_Vec3 prev_dir;
+
     HMM_Mat4 projection;
+    HMM_Mat4 view;
     HMM_Mat4 transform;
 
     float yaw;
@@ -25,7 +30,22 @@ struct ProjectionInfo
     float near_plane;
 };
 
+// Filled by whatever drives the camera: the window layer from the keyboard
+// and mouse, or a script when running headless.
+struct CameraInput
+{
+    bool forward;
+    bool back;
+    bool left;
+    bool right;
+    i32 look_x;
+    i32 look_y;
+};
+
 void CameraSetProjection(Camera *camera, ProjectionInfo proj_info);
-void CameraUpdate(Camera *camera, POINT cursor_delta);
+// Advances the camera by one simulation step of dt seconds.
+void CameraUpdate(Camera *camera, CameraInput input, float dt);
+// Builds the view-projection between the last two steps, alpha in [0, 1].
+void CameraInterpolate(Camera *camera, float alpha);
 
 #endif //CAMERA_H
@@ -0,0 +1,460 @@
+#include <string.h>
+#include "capture.hh"
+
+bool CreateCapture(Capture *capture, u64 capacity, u32 width, u32 height, u32 frames_in_flight)
+{
+    *capture = {};
+    capture->data = (u8 *)OsAllocMemory(capacity);
+    if(!capture->data)
+    {
+        return false;
+    }
+
+    capture->capacity = capacity;
+    capture->header.magic = CAPTURE_MAGIC;
+    capture->header.version = CAPTURE_VERSION;
+    capture->header.width = width;
+    capture->header.height = height;
+    capture->header.frames_in_flight = frames_in_flight;
+    capture->size = sizeof(CaptureHeader);
+    capture->frame_end = capture->size;
+    return true;
+}
+
+void DestroyCapture(Capture *capture)
+{
+    if(capture->data)
+    {
+        OsFreeMemory(capture->data, capture->capacity);
+    }
+
+    *capture = {};
+}
+
+bool CaptureWrite(Capture *capture, const char *path)
+{
+    if(!capture->data)
+    {
+        return false;
+    }
+
+    capture->header.size = capture->frame_end;
+    memcpy(capture->data, &capture->header, sizeof(CaptureHeader));
+    return OsWriteFileAtomic(path, capture->data, capture->frame_end);
+}
+
+static u8 *CapturePush(Capture *capture, u64 size)
+{
+    if(capture->full || capture->size + size > capture->capacity)
+    {
+        capture->full = true;
+        return 0;
+    }
+
+    u8 *at = capture->data + capture->size;
+    capture->size += size;
+    return at;
+}
+
+static u8 *CapturePushOp(Capture *capture, CaptureOp op, u64 size)
+{
+    u8 *at = CapturePush(capture, 1 + size);
+    if(!at)
+    {
+        return 0;
+    }
+
+    at[0] = (u8)op;
+    return at + 1;
+}
+
+static bool CaptureIsAffine(HMM_Mat4 *m)
+{
+    return m->Columns[0].W == 0 && m->Columns[1].W == 0 && m->Columns[2].W == 0 && m->Columns[3].W == 1;
+}
+
+static void CaptureWriteItem(Capture *capture, u32 model, HMM_Mat4 world)
+{
+    bool affine = CaptureIsAffine(&world);
+    u8 *at = CapturePush(capture, sizeof(u32) + (affine ? 12 : 16) * sizeof(float));
+    if(!at)
+    {
+        return;
+    }
+
+    u32 tag = model | (affine ? 0 : CAPTURE_FULL_MATRIX);
+    memcpy(at, &tag, sizeof(u32));
+    at += sizeof(u32);
+    if(!affine)
+    {
+        memcpy(at, &world, sizeof(HMM_Mat4));
+        return;
+    }
+
+    for(u32 c = 0; c < 4; c++)
+    {
+        memcpy(at, &world.Columns[c], 3 * sizeof(float));
+        at += 3 * sizeof(float);
+    }
+}
+
+static void CaptureSetView(Capture *capture, HMM_Mat4 view)
+{
+    if(capture->has_view && memcmp(&view, &capture->view, sizeof(HMM_Mat4)) == 0)
+    {
+        return;
+    }
+
+    u8 *at = CapturePushOp(capture, CAPTURE_SET_VIEW, sizeof(HMM_Mat4));
+    if(at)
+    {
+        memcpy(at, &view, sizeof(HMM_Mat4));
+        capture->view = view;
+        capture->has_view = true;
+    }
+}
+
+// Ids keep counting once the capture is full, so they stay the same as the
+// engine's for the rest of the run.
+u32 CaptureLoadModel(Capture *capture, const char *path)
+{
+    u32 model = ++capture->model_count;
+    u64 length = path ? strlen(path) + 1 : 1;
+    if(length > 0xffff)
+    {
+        length = 1;
+    }
+
+    u8 *at = CapturePushOp(capture, CAPTURE_LOAD_MODEL, sizeof(u16) + length);
+    if(at)
+    {
+        u16 length16 = (u16)length;
+        memcpy(at, &length16, sizeof(u16));
+        memcpy(at + sizeof(u16), length > 1 ? path : "", length);
+    }
+
+    return model;
+}
+
+void CaptureReleaseModel(Capture *capture, u32 model)
+{
+    u8 *at = CapturePushOp(capture, CAPTURE_RELEASE_MODEL, sizeof(u32));
+    if(at)
+    {
+        memcpy(at, &model, sizeof(u32));
+    }
+}
+
+void CaptureBeginFrame(Capture *capture)
+{
+    CapturePushOp(capture, CAPTURE_BEGIN_FRAME, 0);
+}
+
+void CaptureEndFrame(Capture *capture)
+{
+    if(!CapturePushOp(capture, CAPTURE_END_FRAME, 0))
+    {
+        return;
+    }
+
+    capture->frame_end = capture->size;
+    capture->header.frame_count++;
+    capture->header.model_count = capture->model_count;
+}
+
+void CaptureBeginRendering(Capture *capture, bool depth, HMM_Vec4 clear)
+{
+    u8 *at = CapturePushOp(capture, CAPTURE_BEGIN_RENDERING, 1 + sizeof(HMM_Vec4));
+    if(at)
+    {
+        at[0] = depth ? 1 : 0;
+        memcpy(at + 1, &clear, sizeof(HMM_Vec4));
+    }
+}
+
+void CaptureEndRendering(Capture *capture)
+{
+    CapturePushOp(capture, CAPTURE_END_RENDERING, 0);
+}
+
+void CaptureDraw(Capture *capture, HMM_Mat4 view, u32 model, HMM_Mat4 world)
+{
+    CaptureSetView(capture, view);
+    if(CapturePushOp(capture, CAPTURE_DRAW, 0))
+    {
+        CaptureWriteItem(capture, model, world);
+    }
+}
+
+// Followed by exactly count calls to CaptureBatchItem.
+void CaptureBeginBatch(Capture *capture, HMM_Mat4 view, u32 count)
+{
+    CaptureSetView(capture, view);
+    u8 *at = CapturePushOp(capture, CAPTURE_DRAW_BATCH, sizeof(u32));
+    if(at)
+    {
+        memcpy(at, &count, sizeof(u32));
+    }
+}
+
+void CaptureBatchItem(Capture *capture, u32 model, HMM_Mat4 world)
+{
+    CaptureWriteItem(capture, model, world);
+}
+
+void CaptureSetLights(Capture *capture, HMM_Mat4 view, HMM_Mat4 projection, HMM_Vec3 ambient,
+                      const PointLight *lights, u32 count)
+{
+    count = count < CAPTURE_MAX_LIGHTS ? count : CAPTURE_MAX_LIGHTS;
+    u64 size = 2 * sizeof(HMM_Mat4) + sizeof(HMM_Vec3) + sizeof(u32) + sizeof(PointLight) * count;
+    u8 *at = CapturePushOp(capture, CAPTURE_SET_LIGHTS, size);
+    if(!at)
+    {
+        return;
+    }
+
+    memcpy(at, &view, sizeof(HMM_Mat4));
+    at += sizeof(HMM_Mat4);
+    memcpy(at, &projection, sizeof(HMM_Mat4));
+    at += sizeof(HMM_Mat4);
+    memcpy(at, &ambient, sizeof(HMM_Vec3));
+    at += sizeof(HMM_Vec3);
+    memcpy(at, &count, sizeof(u32));
+    at += sizeof(u32);
+    memcpy(at, lights, sizeof(PointLight) * count);
+}
+
+// Without joints the replay draws the model in its bind pose.
+void CaptureDrawSkinned(Capture *capture, HMM_Mat4 view, u32 model, HMM_Mat4 world,
+                        const HMM_Mat4 *joints, u32 joint_count)
+{
+    CaptureSetView(capture, view);
+    joint_count = joints && joint_count <= MAX_JOINTS ? joint_count : 0;
+    u8 *at = CapturePushOp(capture, CAPTURE_DRAW_SKINNED, sizeof(u32));
+    if(!at)
+    {
+        return;
+    }
+
+    memcpy(at, &joint_count, sizeof(u32));
+    CaptureWriteItem(capture, model, world);
+    at = CapturePush(capture, sizeof(HMM_Mat4) * joint_count);
+    if(at)
+    {
+        memcpy(at, joints, sizeof(HMM_Mat4) * joint_count);
+    }
+}
+
+bool OpenCapture(CaptureReader *reader, const char *path)
+{
+    *reader = {};
+    if(!OsMapFile(path, &reader->file))
+    {
+        return false;
+    }
+
+    CaptureHeader *header = &reader->header;
+    if(reader->file.size < sizeof(CaptureHeader))
+    {
+        OsUnmapFile(&reader->file);
+        return false;
+    }
+
+    memcpy(header, reader->file.data, sizeof(CaptureHeader));
+    if(header->magic != CAPTURE_MAGIC || header->version != CAPTURE_VERSION ||
+       header->size < sizeof(CaptureHeader) || header->size > reader->file.size)
+    {
+        OsUnmapFile(&reader->file);
+        return false;
+    }
+
+    reader->at = (const u8 *)reader->file.data + sizeof(CaptureHeader);
+    reader->end = (const u8 *)reader->file.data + header->size;
+    return true;
+}
+
+void CloseCapture(CaptureReader *reader)
+{
+    OsUnmapFile(&reader->file);
+    *reader = {};
+}
+
+static bool CaptureTake(CaptureReader *reader, void *out, u64 size)
+{
+    if((u64)(reader->end - reader->at) < size)
+    {
+        reader->error = true;
+        return false;
+    }
+
+    memcpy(out, reader->at, size);
+    reader->at += size;
+    return true;
+}
+
+static bool CaptureSkipDraws(CaptureReader *reader, u32 count)
+{
+    for(u32 i = 0; i < count; i++)
+    {
+        u32 tag;
+        if(!CaptureTake(reader, &tag, sizeof(u32)))
+        {
+            return false;
+        }
+
+        u64 size = (tag & CAPTURE_FULL_MATRIX ? 16 : 12) * sizeof(float);
+        if((u64)(reader->end - reader->at) < size)
+        {
+            reader->error = true;
+            return false;
+        }
+
+        reader->at += size;
+    }
+
+    return true;
+}
+
+// Returns false at the end of the stream, or with reader->error set when
+// the stream is malformed.
+bool CaptureRead(CaptureReader *reader, CaptureCommand *command)
+{
+    *command = {};
+    u8 op;
+    if(reader->at >= reader->end || !CaptureTake(reader, &op, 1))
+    {
+        return false;
+    }
+
+    command->op = (CaptureOp)op;
+    switch(op)
+    {
+        case CAPTURE_LOAD_MODEL:
+        {
+            u16 length;
+            if(!CaptureTake(reader, &length, sizeof(u16)) || length == 0 ||
+               (u64)(reader->end - reader->at) < length || reader->at[length - 1] != 0)
+            {
+                reader->error = true;
+                return false;
+            }
+
+            command->path = (const char *)reader->at;
+            command->model = ++reader->model_count;
+            reader->at += length;
+            return true;
+        }
+
+        case CAPTURE_RELEASE_MODEL:
+            return CaptureTake(reader, &command->model, sizeof(u32));
+
+        case CAPTURE_BEGIN_FRAME:
+        case CAPTURE_END_FRAME:
+        case CAPTURE_END_RENDERING:
+            return true;
+
+        case CAPTURE_BEGIN_RENDERING:
+        {
+            u8 depth;
+            if(!CaptureTake(reader, &depth, 1))
+            {
+                return false;
+            }
+
+            command->depth = depth != 0;
+            return CaptureTake(reader, &command->clear, sizeof(HMM_Vec4));
+        }
+
+        case CAPTURE_SET_VIEW:
+            return CaptureTake(reader, &command->view, sizeof(HMM_Mat4));
+
+        case CAPTURE_DRAW:
+            command->draw_count = 1;
+            command->draws = reader->at;
+            return CaptureSkipDraws(reader, 1);
+
+        case CAPTURE_DRAW_BATCH:
+            if(!CaptureTake(reader, &command->draw_count, sizeof(u32)))
+            {
+                return false;
+            }
+
+            command->draws = reader->at;
+            return CaptureSkipDraws(reader, command->draw_count);
+
+        case CAPTURE_SET_LIGHTS:
+        {
+            if(!CaptureTake(reader, &command->view, sizeof(HMM_Mat4)) ||
+               !CaptureTake(reader, &command->projection, sizeof(HMM_Mat4)) ||
+               !CaptureTake(reader, &command->ambient, sizeof(HMM_Vec3)) ||
+               !CaptureTake(reader, &command->light_count, sizeof(u32)))
+            {
+                return false;
+            }
+
+            u64 size = sizeof(PointLight) * (u64)command->light_count;
+            if(command->light_count > CAPTURE_MAX_LIGHTS || (u64)(reader->end - reader->at) < size)
+            {
+                reader->error = true;
+                return false;
+            }
+
+            command->lights = reader->at;
+            reader->at += size;
+            return true;
+        }
+
+        case CAPTURE_DRAW_SKINNED:
+        {
+            if(!CaptureTake(reader, &command->joint_count, sizeof(u32)))
+            {
+                return false;
+            }
+
+            command->draw_count = 1;
+            command->draws = reader->at;
+            if(command->joint_count > MAX_JOINTS || !CaptureSkipDraws(reader, 1))
+            {
+                reader->error = true;
+                return false;
+            }
+
+            u64 size = sizeof(HMM_Mat4) * (u64)command->joint_count;
+            if((u64)(reader->end - reader->at) < size)
+            {
+                reader->error = true;
+                return false;
+            }
+
+            command->joints = reader->at;
+            reader->at += size;
+            return true;
+        }
+    }
+
+    reader->error = true;
+    return false;
+}
+
+// Only for draws that came out of CaptureRead, which has checked them.
+const u8 *CaptureNextDraw(const u8 *at, u32 *model, HMM_Mat4 *world)
+{
+    u32 tag;
+    memcpy(&tag, at, sizeof(u32));
+    at += sizeof(u32);
+    *model = tag & ~CAPTURE_FULL_MATRIX;
+    if(tag & CAPTURE_FULL_MATRIX)
+    {
+        memcpy(world, at, sizeof(HMM_Mat4));
+        return at + sizeof(HMM_Mat4);
+    }
+
+    for(u32 c = 0; c < 4; c++)
+    {
+        memcpy(&world->Columns[c], at, 3 * sizeof(float));
+        world->Columns[c].W = c == 3 ? 1.0f : 0.0f;
+        at += 3 * sizeof(float);
+    }
+
+    return at;
+}
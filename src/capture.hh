@@ -0,0 +1,126 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#define CAPTURE_MAGIC 0x50414345
+#define CAPTURE_VERSION 3
+#define CAPTURE_DEFAULT_SIZE (256 * MB)
+#define CAPTURE_FULL_MATRIX 0x80000000u
+#define CAPTURE_MAX_LIGHTS (4 * MAX_CLUSTER_LIGHTS)
+
+#include "types.hh"
+#include "os.hh"
+#include "arena_alloc.hh"
+#include "light_cluster.hh"
+#include "animation.hh"
+#include "third_party/HandmadeMath.h"
+
+// A capture is a stream of the calls made to the engine's public surface,
+// one byte of opcode followed by its arguments, unaligned and little
+// endian. Models are referred to by the order they were loaded in, starting
+// at 1; 0 is a model that did not come from a load. The view-projection
+// matrix is only written when it changes, and world matrices without
+// projection go out as their top three rows. Lights are written whole,
+// up to CAPTURE_MAX_LIGHTS of them, and so are the joint matrices of
+// skinned draws.
+enum CaptureOp
+{
+    CAPTURE_LOAD_MODEL = 1,
+    CAPTURE_RELEASE_MODEL,
+    CAPTURE_BEGIN_FRAME,
+    CAPTURE_END_FRAME,
+    CAPTURE_BEGIN_RENDERING,
+    CAPTURE_END_RENDERING,
+    CAPTURE_SET_VIEW,
+    CAPTURE_DRAW,
+    CAPTURE_DRAW_BATCH,
+    CAPTURE_SET_LIGHTS,
+    CAPTURE_DRAW_SKINNED,
+    CAPTURE_OP_COUNT,
+};
+
+struct CaptureHeader
+{
+    u32 magic;
+    u32 version;
+    u32 width;
+    u32 height;
+    u32 frames_in_flight;
+    u32 frame_count;
+    u32 model_count;
+    u32 padding;
+    u64 size;
+};
+
+// Recording stops at the frame that does not fit; the stream written out
+// ends with the last complete frame.
+struct Capture
+{
+    CaptureHeader header;
+    u8 *data;
+    u64 capacity;
+    u64 size;
+    u64 frame_end;
+    bool full;
+
+    u32 model_count;
+    HMM_Mat4 view;
+    bool has_view;
+};
+
+bool CreateCapture(Capture *capture, u64 capacity, u32 width, u32 height, u32 frames_in_flight);
+void DestroyCapture(Capture *capture);
+bool CaptureWrite(Capture *capture, const char *path);
+
+u32 CaptureLoadModel(Capture *capture, const char *path);
+void CaptureReleaseModel(Capture *capture, u32 model);
+void CaptureBeginFrame(Capture *capture);
+void CaptureEndFrame(Capture *capture);
+void CaptureBeginRendering(Capture *capture, bool depth, HMM_Vec4 clear);
+void CaptureEndRendering(Capture *capture);
+void CaptureDraw(Capture *capture, HMM_Mat4 view, u32 model, HMM_Mat4 world);
+void CaptureBeginBatch(Capture *capture, HMM_Mat4 view, u32 count);
+void CaptureBatchItem(Capture *capture, u32 model, HMM_Mat4 world);
+void CaptureSetLights(Capture *capture, HMM_Mat4 view, HMM_Mat4 projection, HMM_Vec3 ambient,
+                      const PointLight *lights, u32 count);
+void CaptureDrawSkinned(Capture *capture, HMM_Mat4 view, u32 model, HMM_Mat4 world,
+                        const HMM_Mat4 *joints, u32 joint_count);
+
+// One decoded call. Draws are left encoded; CaptureNextDraw walks them.
+// Paths, lights and joints point into the mapped file, so they are
+// unaligned.
+struct CaptureCommand
+{
+    CaptureOp op;
+    u32 model;
+    const char *path;
+    bool depth;
+    HMM_Vec4 clear;
+    HMM_Mat4 view;
+    u32 draw_count;
+    const u8 *draws;
+    HMM_Mat4 projection;
+    HMM_Vec3 ambient;
+    u32 light_count;
+    const u8 *lights;
+    u32 joint_count;
+    const u8 *joints;
+};
+
+// Everything is bounds checked while reading, so a truncated or corrupt
+// file ends the replay instead of reading past the mapping.
+struct CaptureReader
+{
+    MappedFile file;
+    CaptureHeader header;
+    const u8 *at;
+    const u8 *end;
+    u32 model_count;
+    bool error;
+};
+
+bool OpenCapture(CaptureReader *reader, const char *path);
+void CloseCapture(CaptureReader *reader);
+bool CaptureRead(CaptureReader *reader, CaptureCommand *command);
+const u8 *CaptureNextDraw(const u8 *at, u32 *model, HMM_Mat4 *world);
+
+#endif //CAPTURE_H
@@ -0,0 +1,7 @@
+#include "arena_alloc.cc"
+#include "os.cc"
+#include "jobs.cc"
+#include "dds.cc"
+#include "image_io.cc"
+#include "bc_encode.cc"
+#include "texture_cooker.cc"
@@ -0,0 +1,157 @@
+#include <string.h>
+#include "dds.hh"
+
+u32 DDSBlockSize(DDSFormat format)
+{
+    switch(format)
+    {
+        case DDS_FORMAT_BC1:
+        case DDS_FORMAT_BC1_SRGB:
+        case DDS_FORMAT_BC4:
+            return 8;
+
+        case DDS_FORMAT_BC5:
+        case DDS_FORMAT_BC7:
+        case DDS_FORMAT_BC7_SRGB:
+            return 16;
+
+        default:
+            return 0;
+    }
+}
+
+u64 DDSMipSize(u32 width, u32 height, u32 block_size)
+{
+    u64 blocks_x = (width + 3) / 4;
+    u64 blocks_y = (height + 3) / 4;
+    return blocks_x * blocks_y * block_size;
+}
+
+static DDSFormat DDSFormatFromDXGI(u32 dxgi_format)
+{
+    switch(dxgi_format)
+    {
+        case DXGI_FORMAT_BC1_UNORM: return DDS_FORMAT_BC1;
+        case DXGI_FORMAT_BC1_UNORM_SRGB: return DDS_FORMAT_BC1_SRGB;
+        case DXGI_FORMAT_BC4_UNORM: return DDS_FORMAT_BC4;
+        case DXGI_FORMAT_BC5_UNORM: return DDS_FORMAT_BC5;
+        case DXGI_FORMAT_BC7_UNORM: return DDS_FORMAT_BC7;
+        case DXGI_FORMAT_BC7_UNORM_SRGB: return DDS_FORMAT_BC7_SRGB;
+        default: return DDS_FORMAT_UNKNOWN;
+    }
+}
+
+bool DDSParse(const void *file_data, u64 file_size, DDSInfo *info)
+{
+    *info = {};
+
+    const DDSFile *file = (const DDSFile *)file_data;
+    u64 header_size = sizeof(file->magic) + sizeof(DDSHeader);
+    if(file_size < header_size || memcmp(file->magic, "DDS ", 4) != 0)
+    {
+        return false;
+    }
+
+    const DDSHeader *header = &file->header;
+    u32 four_cc = header->ddspf.four_cc;
+
+    if(four_cc == DDS_FOURCC('D', 'X', '1', '0'))
+    {
+        if(file_size < header_size + sizeof(DDSHeaderDX10))
+        {
+            return false;
+        }
+
+        const DDSHeaderDX10 *dx10 = (const DDSHeaderDX10 *)((const u8 *)file_data + header_size);
+        info->format = DDSFormatFromDXGI(dx10->dxgi_format);
+        header_size += sizeof(DDSHeaderDX10);
+    }
+
+    else if(four_cc == DDS_FOURCC('D', 'X', 'T', '1'))
+    {
+        info->format = DDS_FORMAT_BC1;
+    }
+
+    else if(four_cc == DDS_FOURCC('A', 'T', 'I', '1') || four_cc == DDS_FOURCC('B', 'C', '4', 'U'))
+    {
+        info->format = DDS_FORMAT_BC4;
+    }
+
+    else if(four_cc == DDS_FOURCC('A', 'T', 'I', '2') || four_cc == DDS_FOURCC('B', 'C', '5', 'U'))
+    {
+        info->format = DDS_FORMAT_BC5;
+    }
+
+    if(info->format == DDS_FORMAT_UNKNOWN)
+    {
+        return false;
+    }
+
+    info->width = header->width;
+    info->height = header->height;
+    info->mip_count = header->mip_map_count ? header->mip_map_count : 1;
+    info->block_size = DDSBlockSize(info->format);
+    info->data = (const u8 *)file_data + header_size;
+
+    u32 w = info->width;
+    u32 h = info->height;
+    for(u32 i = 0; i < info->mip_count; i++)
+    {
+        info->data_size += DDSMipSize(w, h, info->block_size);
+        w = w > 1 ? w / 2 : 1;
+        h = h > 1 ? h / 2 : 1;
+    }
+
+    return header_size + info->data_size <= file_size;
+}
+
+u32 DDSWriteHeader(void *dst, DDSFormat format, u32 width, u32 height, u32 mip_count)
+{
+    u8 *out = (u8 *)dst;
+    memcpy(out, "DDS ", 4);
+
+    DDSHeader header = {};
+    header.size = sizeof(DDSHeader);
+    header.flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT |
+                   DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE;
+    header.height = height;
+    header.width = width;
+    header.pitch_or_linear_size = (u32)DDSMipSize(width, height, DDSBlockSize(format));
+    header.depth = 1;
+    header.mip_map_count = mip_count;
+    header.ddspf.size = sizeof(DDSPixelFormat);
+    header.ddspf.flags = DDPF_FOURCC;
+    header.caps = DDSCAPS_TEXTURE;
+    if(mip_count > 1)
+    {
+        header.caps |= DDSCAPS_COMPLEX | DDSCAPS_MIPMAP;
+    }
+
+    u32 dxgi_format = 0;
+    switch(format)
+    {
+        case DDS_FORMAT_BC1: header.ddspf.four_cc = DDS_FOURCC('D', 'X', 'T', '1'); break;
+        case DDS_FORMAT_BC4: header.ddspf.four_cc = DDS_FOURCC('B', 'C', '4', 'U'); break;
+        case DDS_FORMAT_BC5: header.ddspf.four_cc = DDS_FOURCC('B', 'C', '5', 'U'); break;
+        case DDS_FORMAT_BC1_SRGB: dxgi_format = DXGI_FORMAT_BC1_UNORM_SRGB; break;
+        case DDS_FORMAT_BC7: dxgi_format = DXGI_FORMAT_BC7_UNORM; break;
+        case DDS_FORMAT_BC7_SRGB: dxgi_format = DXGI_FORMAT_BC7_UNORM_SRGB; break;
+        default: break;
+    }
+
+    u32 written = 4 + sizeof(DDSHeader);
+    if(dxgi_format)
+    {
+        header.ddspf.four_cc = DDS_FOURCC('D', 'X', '1', '0');
+
+        DDSHeaderDX10 dx10 = {};
+        dx10.dxgi_format = dxgi_format;
+        dx10.resource_dimension = DDS_DIMENSION_TEXTURE2D;
+        dx10.array_size = 1;
+        memcpy(out + written, &dx10, sizeof(dx10));
+        written += sizeof(dx10);
+    }
+
+    memcpy(out + 4, &header, sizeof(header));
+    return written;
+}
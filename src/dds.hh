@@ -0,0 +1,103 @@
+#ifndef DDS_H
+#define DDS_H
+
+#include "types.hh"
+
+#define DDS_FOURCC(a, b, c, d) ((u32)(a) | ((u32)(b) << 8) | ((u32)(c) << 16) | ((u32)(d) << 24))
+
+#define DDSD_CAPS 0x1
+#define DDSD_HEIGHT 0x2
+#define DDSD_WIDTH 0x4
+#define DDSD_PIXELFORMAT 0x1000
+#define DDSD_MIPMAPCOUNT 0x20000
+#define DDSD_LINEARSIZE 0x80000
+
+#define DDPF_FOURCC 0x4
+
+#define DDSCAPS_COMPLEX 0x8
+#define DDSCAPS_TEXTURE 0x1000
+#define DDSCAPS_MIPMAP 0x400000
+
+#define DXGI_FORMAT_BC1_UNORM 71
+#define DXGI_FORMAT_BC1_UNORM_SRGB 72
+#define DXGI_FORMAT_BC4_UNORM 80
+#define DXGI_FORMAT_BC5_UNORM 83
+#define DXGI_FORMAT_BC7_UNORM 98
+#define DXGI_FORMAT_BC7_UNORM_SRGB 99
+
+#define DDS_DIMENSION_TEXTURE2D 3
+
+enum DDSFormat
+{
+    DDS_FORMAT_UNKNOWN,
+    DDS_FORMAT_BC1,
+    DDS_FORMAT_BC1_SRGB,
+    DDS_FORMAT_BC4,
+    DDS_FORMAT_BC5,
+    DDS_FORMAT_BC7,
+    DDS_FORMAT_BC7_SRGB,
+};
+
+struct DDSPixelFormat
+{
+    u32 size;
+    u32 flags;
+    u32 four_cc;
+    u32 rgb_bit_count;
+    u32 r_bit_mask;
+    u32 g_bit_mask;
+    u32 b_bit_mask;
+    u32 a_bit_mask;
+};
+
+struct DDSHeader
+{
+    u32 size;
+    u32 flags;
+    u32 height;
+    u32 width;
+    u32 pitch_or_linear_size;
+    u32 depth;
+    u32 mip_map_count;
+    u32 reserved1[11];
+    DDSPixelFormat ddspf;
+    u32 caps;
+    u32 caps2;
+    u32 caps3;
+    u32 caps4;
+    u32 reserved;
+};
+
+struct DDSHeaderDX10
+{
+    u32 dxgi_format;
+    u32 resource_dimension;
+    u32 misc_flag;
+    u32 array_size;
+    u32 misc_flags2;
+};
+
+struct DDSFile
+{
+    char magic[4];
+    DDSHeader header;
+    char data_begin;
+};
+
+struct DDSInfo
+{
+    DDSFormat format;
+    u32 width;
+    u32 height;
+    u32 mip_count;
+    u32 block_size;
+    const u8 *data;
+    u64 data_size;
+};
+
+bool DDSParse(const void *file_data, u64 file_size, DDSInfo *info);
+u32 DDSBlockSize(DDSFormat format);
+u64 DDSMipSize(u32 width, u32 height, u32 block_size);
+u32 DDSWriteHeader(void *dst, DDSFormat format, u32 width, u32 height, u32 mip_count);
+
+#endif //DDS_H
@@ -0,0 +1,184 @@
+#include "destroy_queue.hh"
+
+void CreateDestroyQueue(DestroyQueue *queue, Device device)
+{
+    queue->device = device;
+    queue->frame_value = 1;
+    queue->head = 0;
+    queue->count = 0;
+}
+
+// Everything queued from here on waits for this timeline value.
+void DestroyQueueSetFrame(DestroyQueue *queue, u64 frame_value)
+{
+    queue->frame_value = frame_value;
+}
+
+static void DestroyItemNow(Device device, DestroyItem *item)
+{
+    switch(item->type)
+    {
+        case DESTROY_BUFFER:
+        {
+            if(item->alloc)
+            {
+                GpuMemoryRelease(device, item->category, item->alloc);
+                vmaDestroyBuffer(device.allocator, item->buffer, item->alloc);
+            }
+
+            else
+            {
+                vkDestroyBuffer(device.device, item->buffer, 0);
+            }
+        } break;
+
+        case DESTROY_IMAGE:
+        {
+            if(item->alloc)
+            {
+                GpuMemoryRelease(device, item->category, item->alloc);
+                vmaDestroyImage(device.allocator, item->image, item->alloc);
+            }
+
+            else
+            {
+                vkDestroyImage(device.device, item->image, 0);
+            }
+        } break;
+
+        case DESTROY_IMAGE_VIEW:
+        {
+            vkDestroyImageView(device.device, item->view, 0);
+        } break;
+
+        case DESTROY_MEMORY:
+        {
+            GpuMemoryRelease(device, item->category, item->alloc);
+            vmaFreeMemory(device.allocator, item->alloc);
+        } break;
+
+        case DESTROY_SAMPLER:
+        {
+            vkDestroySampler(device.device, item->sampler, 0);
+        } break;
+
+        case DESTROY_PIPELINE:
+        {
+            vkDestroyPipeline(device.device, item->pipeline, 0);
+        } break;
+
+        case DESTROY_SLOT:
+        {
+            DestroySlot *slot = &item->slot;
+            slot->list[(*slot->count)++] = slot->index;
+        } break;
+    }
+}
+
+static void DestroyQueuePush(DestroyQueue *queue, DestroyItem *item)
+{
+    if(queue->count == MAX_DESTROY_ITEMS)
+    {
+        vkDeviceWaitIdle(queue->device.device);
+        DestroyQueueFlush(queue);
+    }
+
+    item->frame_value = queue->frame_value;
+    queue->items[(queue->head + queue->count) % MAX_DESTROY_ITEMS] = *item;
+    queue->count++;
+}
+
+void DestroyQueueBuffer(DestroyQueue *queue, VkBuffer buffer, VmaAllocation alloc, GpuMemoryCategory category)
+{
+    DestroyItem item = {};
+    item.type = DESTROY_BUFFER;
+    item.category = category;
+    item.alloc = alloc;
+    item.buffer = buffer;
+    DestroyQueuePush(queue, &item);
+}
+
+// Sparse images have no allocation of their own; their memory is queued
+// separately.
+void DestroyQueueImage(DestroyQueue *queue, VkImage image, VmaAllocation alloc, GpuMemoryCategory category)
+{
+    DestroyItem item = {};
+    item.type = DESTROY_IMAGE;
+    item.category = category;
+    item.alloc = alloc;
+    item.image = image;
+    DestroyQueuePush(queue, &item);
+}
+
+void DestroyQueueImageView(DestroyQueue *queue, VkImageView view)
+{
+    DestroyItem item = {};
+    item.type = DESTROY_IMAGE_VIEW;
+    item.view = view;
+    DestroyQueuePush(queue, &item);
+}
+
+void DestroyQueueMemory(DestroyQueue *queue, VmaAllocation alloc, GpuMemoryCategory category)
+{
+    DestroyItem item = {};
+    item.type = DESTROY_MEMORY;
+    item.category = category;
+    item.alloc = alloc;
+    DestroyQueuePush(queue, &item);
+}
+
+void DestroyQueueSampler(DestroyQueue *queue, VkSampler sampler)
+{
+    DestroyItem item = {};
+    item.type = DESTROY_SAMPLER;
+    item.sampler = sampler;
+    DestroyQueuePush(queue, &item);
+}
+
+void DestroyQueuePipeline(DestroyQueue *queue, VkPipeline pipeline)
+{
+    DestroyItem item = {};
+    item.type = DESTROY_PIPELINE;
+    item.pipeline = pipeline;
+    DestroyQueuePush(queue, &item);
+}
+
+// Pushes index onto list once the frame is done, so nothing new can take
+// the slot while a frame in flight still indexes it.
+void DestroyQueueSlot(DestroyQueue *queue, u32 *list, u32 *count, u32 index)
+{
+    DestroyItem item = {};
+    item.type = DESTROY_SLOT;
+    item.slot.list = list;
+    item.slot.count = count;
+    item.slot.index = index;
+    DestroyQueuePush(queue, &item);
+}
+
+// Destroys everything queued for frames up to completed_value. Returns how
+// many items went.
+u32 DestroyQueueRetire(DestroyQueue *queue, u64 completed_value)
+{
+    u32 retired = 0;
+    while(queue->count)
+    {
+        DestroyItem *item = &queue->items[queue->head];
+        if(item->frame_value > completed_value)
+        {
+            break;
+        }
+
+        DestroyItemNow(queue->device, item);
+        queue->head = (queue->head + 1) % MAX_DESTROY_ITEMS;
+        queue->count--;
+        retired++;
+    }
+
+    return retired;
+}
+
+// Only once the device is idle.
+void DestroyQueueFlush(DestroyQueue *queue)
+{
+    DestroyQueueRetire(queue, ~0ull);
+}
@@ -0,0 +1,78 @@
+#ifndef DESTROY_QUEUE_H
+#define DESTROY_QUEUE_H
+
+#define MAX_DESTROY_ITEMS 4096
+
+#include <vulkan/vulkan.h>
+
+#include "types.hh"
+#include "vk_utils.hh"
+#include "gpu_memory.hh"
+#include "third_party/vk_mem_alloc.h"
+
+enum DestroyType
+{
+    DESTROY_BUFFER,
+    DESTROY_IMAGE,
+    DESTROY_IMAGE_VIEW,
+    DESTROY_MEMORY,
+    DESTROY_SAMPLER,
+    DESTROY_PIPELINE,
+    DESTROY_SLOT,
+};
+
+// A slot index that goes back on a free list once no frame can still
+// reference it, e.g. a bindless texture slot or a mesh.
+struct DestroySlot
+{
+    u32 *list;
+    u32 *count;
+    u32 index;
+};
+
+struct DestroyItem
+{
+    DestroyType type;
+    GpuMemoryCategory category;
+    u64 frame_value;
+    VmaAllocation alloc;
+    union
+    {
+        VkBuffer buffer;
+        VkImage image;
+        VkImageView view;
+        VkSampler sampler;
+        VkPipeline pipeline;
+        DestroySlot slot;
+    };
+};
+
+// Objects still in use by the GPU are queued with the timeline value of
+// the first frame that can no longer reference them, which is the next one
+// submitted, and destroyed once the timeline has passed it. Values only
+// grow, so the queue is a ring retired from the front. A full queue waits
+// for the device instead of dropping anything.
+struct DestroyQueue
+{
+    Device device;
+    u64 frame_value;
+    u32 head;
+    u32 count;
+    DestroyItem items[MAX_DESTROY_ITEMS];
+};
+
+void CreateDestroyQueue(DestroyQueue *queue, Device device);
+void DestroyQueueSetFrame(DestroyQueue *queue, u64 frame_value);
+
+void DestroyQueueBuffer(DestroyQueue *queue, VkBuffer buffer, VmaAllocation alloc, GpuMemoryCategory category);
+void DestroyQueueImage(DestroyQueue *queue, VkImage image, VmaAllocation alloc, GpuMemoryCategory category);
+void DestroyQueueImageView(DestroyQueue *queue, VkImageView view);
+void DestroyQueueMemory(DestroyQueue *queue, VmaAllocation alloc, GpuMemoryCategory category);
+void DestroyQueueSampler(DestroyQueue *queue, VkSampler sampler);
+void DestroyQueuePipeline(DestroyQueue *queue, VkPipeline pipeline);
+void DestroyQueueSlot(DestroyQueue *queue, u32 *list, u32 *count, u32 index);
+
+u32 DestroyQueueRetire(DestroyQueue *queue, u64 completed_value);
+void DestroyQueueFlush(DestroyQueue *queue);
+
+#endif //DESTROY_QUEUE_H
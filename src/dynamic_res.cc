@@ -0,0 +1,97 @@
+#include <math.h>
+#include "dynamic_res.hh"
+
+// A target of zero leaves the scale at 1 for good.
+void CreateDynamicResolution(DynamicResolution *res, float target_ms, float min_scale, u32 latency_frames)
+{
+    *res = {};
+    res->enabled = target_ms > 0;
+    res->target_ms = target_ms;
+    res->min_scale = min_scale > 0.1f ? min_scale : 0.1f;
+    res->max_scale = 1.0f;
+    if(res->min_scale > res->max_scale)
+    {
+        res->min_scale = res->max_scale;
+    }
+
+    res->latency_frames = latency_frames;
+    res->scale = res->max_scale;
+}
+
+static float DynamicResolutionClamp(DynamicResolution *res, float scale)
+{
+    // Quantized so that tiny corrections do not change the extent every
+    // frame.
+    scale = floorf(scale * DYNRES_SCALE_QUANTUM) / DYNRES_SCALE_QUANTUM;
+    if(scale < res->min_scale) scale = res->min_scale;
+    if(scale > res->max_scale) scale = res->max_scale;
+    return scale;
+}
+
+void DynamicResolutionUpdate(DynamicResolution *res, float gpu_ms)
+{
+    if(!res->enabled || gpu_ms <= 0)
+    {
+        return;
+    }
+
+    if(res->settle_frames)
+    {
+        res->settle_frames--;
+        res->filtered_ms = gpu_ms;
+        return;
+    }
+
+    res->filtered_ms += (gpu_ms - res->filtered_ms) * DYNRES_SMOOTHING;
+
+    float budget = res->target_ms * DYNRES_HEADROOM;
+    float scale = res->scale;
+    if(gpu_ms > res->target_ms)
+    {
+        // Spikes are answered from the raw time; waiting for the filter
+        // to catch up is exactly the dropped frames this is meant to avoid.
+        scale = res->scale * sqrtf(budget / gpu_ms);
+        res->under_budget_frames = 0;
+    }
+
+    else if(res->filtered_ms < budget)
+    {
+        if(++res->under_budget_frames >= DYNRES_GROW_FRAMES)
+        {
+            float fit = res->scale * sqrtf(budget / res->filtered_ms);
+            float step = res->scale + DYNRES_MAX_STEP_UP;
+            scale = fit < step ? fit : step;
+            res->under_budget_frames = 0;
+        }
+    }
+
+    else
+    {
+        res->under_budget_frames = 0;
+    }
+
+    scale = DynamicResolutionClamp(res, scale);
+    if(scale != res->scale)
+    {
+        res->scale = scale;
+        res->settle_frames = res->latency_frames;
+    }
+}
+
+// Rounded to even sizes so that a half scale maps pixels exactly.
+VkExtent2D DynamicResolutionExtent(DynamicResolution *res, VkExtent2D full)
+{
+    if(!res->enabled)
+    {
+        return full;
+    }
+
+    VkExtent2D extent;
+    extent.width = ((u32)(full.width * res->scale) + 1) & ~1u;
+    extent.height = ((u32)(full.height * res->scale) + 1) & ~1u;
+    if(extent.width > full.width) extent.width = full.width;
+    if(extent.height > full.height) extent.height = full.height;
+    if(extent.width == 0) extent.width = 1;
+    if(extent.height == 0) extent.height = 1;
+    return extent;
+}
@@ -0,0 +1,43 @@
+#ifndef DYNAMIC_RES_H
+#define DYNAMIC_RES_H
+
+#define DYNRES_HEADROOM 0.9f
+#define DYNRES_SMOOTHING 0.1f
+#define DYNRES_MAX_STEP_UP 0.05f
+#define DYNRES_GROW_FRAMES 30
+#define DYNRES_SCALE_QUANTUM 64.0f
+
+#include <vulkan/vulkan.h>
+
+#include "types.hh"
+
+// Picks the render scale from measured GPU frame time. GPU time is taken to
+// grow with the pixel count, so the scale that fits the budget is the
+// current one times sqrt(budget / time). Going over budget drops the scale
+// right away; coming back up waits for a run of frames under budget and
+// climbs in small steps, so one cheap frame does not bounce it back into a
+// spike. The budget keeps some headroom below the target.
+//
+// Measurements arrive a few frames late, since a frame's timestamps are
+// only read once its slot comes around again. After every change the
+// controller ignores as many frames as are in flight, which were all
+// rendered at the old scale.
+struct DynamicResolution
+{
+    bool enabled;
+    float target_ms;
+    float min_scale;
+    float max_scale;
+    u32 latency_frames;
+
+    float scale;
+    float filtered_ms;
+    u32 settle_frames;
+    u32 under_budget_frames;
+};
+
+void CreateDynamicResolution(DynamicResolution *res, float target_ms, float min_scale, u32 latency_frames);
+void DynamicResolutionUpdate(DynamicResolution *res, float gpu_ms);
+VkExtent2D DynamicResolutionExtent(DynamicResolution *res, VkExtent2D full);
+
+#endif //DYNAMIC_RES_H
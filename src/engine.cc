@@ -1,48 +1,148 @@
 #include "engine.hh"
 #include "vk_utils.hh"
 #include "vk_pipeline.hh"
+#include "pipeline_library.hh"
+#include "profiler.hh"
+#include "simd_math.hh"
 #include "vulkan/vulkan_core.h"
 
 #include "third_party/HandmadeMath.h"
 
+PipelineDesc EngineMeshPipelineDesc(Engine *engine, u32 permutation)
+{
+    PipelineDesc desc = engine->mesh_desc;
+    desc.spec_constants[MESH_SPEC_ALPHA_TEST] = (permutation & MESH_ALPHA_TEST) != 0;
+    if(permutation & MESH_DOUBLE_SIDED)
+    {
+        desc.state.cull_mode = VK_CULL_MODE_NONE;
+    }
+
+    if(permutation & MESH_BLEND)
+    {
+        desc.state.blend_mode = BLEND_ALPHA;
+        desc.state.depth_write = VK_FALSE;
+    }
+
+    // Joint indices and weights come from a second vertex buffer.
+    if(permutation & MESH_SKINNED)
+    {
+        desc.vertex_shader_path = "compiled/mesh_skinned.vert.spv";
+
+        VertexLayout *vertex_layout = &desc.vertex_layout;
+        VkVertexInputBindingDescription *binding = &vertex_layout->bindings[vertex_layout->binding_count++];
+        binding->binding = 1;
+        binding->stride = SKIN_VERTEX_SIZE;
+        binding->inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+        VkVertexInputAttributeDescription *attr = &vertex_layout->attributes[vertex_layout->attribute_count];
+        vertex_layout->attribute_count += 2;
+        attr[0].location = 3;
+        attr[0].binding = 1;
+        attr[0].format = VK_FORMAT_R8G8B8A8_UINT;
+        attr[0].offset = 0;
+
+        attr[1].location = 4;
+        attr[1].binding = 1;
+        attr[1].format = VK_FORMAT_R8G8B8A8_UNORM;
+        attr[1].offset = 4;
+    }
+
+    return desc;
+}
+
 void CreateDefaultPipeline(Engine *engine, const char *vs_path, const char *fs_path,
                            VkFormat *target_format, VkFormat *depth_format)
 {
     VkDevice device = engine->device.device;
     
-    VkDescriptorSetLayoutBinding sampler_binding = {};
-    sampler_binding.binding = 0;
-    sampler_binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    sampler_binding.descriptorCount = 1;
-    sampler_binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    VkDescriptorSetLayoutBinding bindings[3] = {};
+    bindings[0].binding = 0;
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+    bindings[0].descriptorCount = MAX_BINDLESS_TEXTURES;
+    bindings[0].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+    bindings[1].binding = 1;
+    bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
+    bindings[1].descriptorCount = SAMPLER_COUNT;
+    bindings[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    bindings[1].pImmutableSamplers = engine->samplers;
+
+    bindings[2].binding = 2;
+    bindings[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[2].descriptorCount = 1;
+    bindings[2].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+    VkDescriptorBindingFlags binding_flags[3] = {};
+    binding_flags[0] = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT;
+
+    VkDescriptorSetLayoutBindingFlagsCreateInfo flags_info = {};
+    flags_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+    flags_info.bindingCount = 3;
+    flags_info.pBindingFlags = binding_flags;
     
     VkDescriptorSetLayoutCreateInfo ds_layout_info = {};
     ds_layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-    ds_layout_info.bindingCount = 1;
-    ds_layout_info.pBindings = &sampler_binding;
+    ds_layout_info.pNext = &flags_info;
+    ds_layout_info.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+    ds_layout_info.bindingCount = 3;
+    ds_layout_info.pBindings = bindings;
     
-    VkDescriptorSetLayout ds_layout;
-    vkCreateDescriptorSetLayout(device, &ds_layout_info, 0, &ds_layout);
+    VkDescriptorSetLayout ds_layouts[2];
+    vkCreateDescriptorSetLayout(device, &ds_layout_info, 0, &ds_layouts[0]);
+
+    // Set 1 is the frame allocator's buffer, once for the per draw data
+    // and once for the light clusters. Both sit at a different offset every
+    // frame, so they are dynamic bindings and the descriptors are written
+    // once. Joint matrices are found through the draw data instead, so the
+    // third binding is the whole buffer.
+    VkDescriptorSetLayoutBinding frame_bindings[3] = {};
+    frame_bindings[0].binding = 0;
+    frame_bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+    frame_bindings[0].descriptorCount = 1;
+    frame_bindings[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 
-    VkPushConstantRange push_constant = {};;
-    push_constant.size = sizeof(HMM_Mat4) * 2;
-    push_constant.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    frame_bindings[1].binding = 1;
+    frame_bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+    frame_bindings[1].descriptorCount = 1;
+    frame_bindings[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
+
+    frame_bindings[2].binding = 2;
+    frame_bindings[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    frame_bindings[2].descriptorCount = 1;
+    frame_bindings[2].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+    VkDescriptorSetLayoutCreateInfo frame_layout_info = {};
+    frame_layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    frame_layout_info.bindingCount = 3;
+    frame_layout_info.pBindings = frame_bindings;
+    vkCreateDescriptorSetLayout(device, &frame_layout_info, 0, &ds_layouts[1]);
 
     VkPipelineLayoutCreateInfo layout_info = {};
     layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    layout_info.setLayoutCount = 1;
-    layout_info.pSetLayouts = &ds_layout;
-    layout_info.pushConstantRangeCount = 1;
-    layout_info.pPushConstantRanges = &push_constant;
+    layout_info.setLayoutCount = 2;
+    layout_info.pSetLayouts = ds_layouts;
     
     PipelineLayout layout = CreatePipelineLayout(device, &layout_info);
 
-    VkVertexInputBindingDescription binding = {};
-    binding.binding = 0;
-    binding.stride = 16;
-    binding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+    PipelineDesc *desc = &engine->mesh_desc;
+    *desc = {};
+    desc->vertex_shader_path = vs_path;
+    desc->pixel_shader_path = fs_path;
+    desc->layout = layout;
+    desc->target_format = *target_format;
+    desc->depth_format = depth_format ? *depth_format : VK_FORMAT_UNDEFINED;
+    desc->state = DefaultPipelineState();
+    desc->spec_count = MESH_SPEC_COUNT;
+    desc->spec_constants[MESH_SPEC_SAMPLER_COUNT] = SAMPLER_COUNT;
 
-    VkVertexInputAttributeDescription attr[3] = {};
+    VertexLayout *vertex_layout = &desc->vertex_layout;
+    vertex_layout->binding_count = 1;
+    vertex_layout->bindings[0].binding = 0;
+    vertex_layout->bindings[0].stride = 16;
+    vertex_layout->bindings[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+    VkVertexInputAttributeDescription *attr = vertex_layout->attributes;
+    vertex_layout->attribute_count = 3;
     attr[0].location = 0;
     attr[0].binding = 0;
     attr[0].format = VK_FORMAT_R16G16B16A16_SFLOAT;
@@ -58,311 +158,2013 @@ void CreateDefaultPipeline(Engine *engine, const char *vs_path, const char *fs_p
     attr[2].format = VK_FORMAT_R16G16_SFLOAT;
     attr[2].offset = 12;
 
-    GraphicsPipelineCreateInfo pipeline_info = {};
-    pipeline_info.layout = layout;
-    pipeline_info.vertex_shader_path = "compiled/mesh.vert.spv";
-    pipeline_info.pixel_shader_path = "compiled/mesh.frag.spv";
-    pipeline_info.vertex_binding_count = 1;
-    pipeline_info.vertex_bindings = &binding;
-    pipeline_info.vertex_attribute_count = 3;
-    pipeline_info.vertex_attributes = attr;
-    pipeline_info.target_format = target_format;
-    pipeline_info.depth_format = depth_format;
-    
-    engine->mesh_pipeline = CreateGraphicsPipeline(device, &pipeline_info);
+    PipelineLibrarySetFallback(engine->pipelines, desc);
+    engine->mesh_pipeline = engine->pipelines->entries[engine->pipelines->fallback].pipeline;
+
+    PipelineDesc permutations[MESH_PERMUTATION_COUNT];
+    for(u32 i = 0; i < MESH_PERMUTATION_COUNT; i++)
+    {
+        permutations[i] = EngineMeshPipelineDesc(engine, i);
+    }
+
+    PipelineLibraryPrecompile(engine->pipelines, MESH_PERMUTATION_COUNT, permutations);
+
+    for(u32 i = 0; i < MESH_PERMUTATION_COUNT; i++)
+    {
+        engine->mesh_permutations[i].pipeline = PipelineLibraryFind(engine->pipelines, &permutations[i], true);
+        engine->mesh_permutations[i].state = permutations[i].state;
+    }
 }
 
-Engine CreateEngine(HWND window)
+void CreateSamplers(Engine *engine)
 {
-    Engine engine = {0};
-    engine.instance = CreateInstance();
-    engine.surface = CreateSurface(engine.instance, window);
-    engine.device = CreateDevice(engine.instance, engine.surface);
-    engine.swapchain = CreateSwapChain(engine.device, engine.surface);
+    VkSamplerCreateInfo sampler_info = {};
+    sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    sampler_info.maxLod = VK_LOD_CLAMP_NONE;
 
-    VkFormat depth_format = VK_FORMAT_D16_UNORM_S8_UINT;
-    VkImageUsageFlags depth_usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
-    u32 width = engine.swapchain.render_area.extent.width;
-    u32 height = engine.swapchain.render_area.extent.height;
-    
-    engine.depth = CreateTexture(engine.device, depth_format, depth_usage, width, height, 1);
-    engine.depth_format = depth_format;
-    
-    engine.sync = CreateSyncStructs(engine.device);
-    engine.command = CreateCommand(engine.device);
+    for(u32 i = 0; i < SAMPLER_COUNT; i++)
+    {
+        bool linear = i == SAMPLER_LINEAR_REPEAT || i == SAMPLER_LINEAR_CLAMP;
+        bool clamp = i == SAMPLER_LINEAR_CLAMP || i == SAMPLER_NEAREST_CLAMP;
+        VkSamplerAddressMode address = clamp ? VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE : VK_SAMPLER_ADDRESS_MODE_REPEAT;
 
-    CreateDefaultPipeline(&engine,
-                          "compiled/mesh.vert.spv",
-                          "compiled/mesh.frag.spv",
-                          &engine.swapchain.swap_format,
-                          &engine.depth_format);
-    
-    VkDescriptorPoolSize pool_size = {};
-    pool_size.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    pool_size.descriptorCount = 2;
-    
-    VkDescriptorPoolCreateInfo pool_info = {};
-    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-    pool_info.maxSets = 1;
-    pool_info.poolSizeCount = 1;
-    pool_info.pPoolSizes = &pool_size;
+        sampler_info.magFilter = linear ? VK_FILTER_LINEAR : VK_FILTER_NEAREST;
+        sampler_info.minFilter = sampler_info.magFilter;
+        sampler_info.mipmapMode = linear ? VK_SAMPLER_MIPMAP_MODE_LINEAR : VK_SAMPLER_MIPMAP_MODE_NEAREST;
+        sampler_info.addressModeU = address;
+        sampler_info.addressModeV = address;
+        sampler_info.addressModeW = address;
 
-    vkCreateDescriptorPool(engine.device.device, &pool_info, 0, &engine.mesh_pool);
-    return engine;
+        vkCreateSampler(engine->device.device, &sampler_info, 0, &engine->samplers[i]);
+    }
 }
 
-struct CompiledMDL
+EngineConfig DefaultEngineConfig(void)
 {
-    u32 vertex_size;
-    u32 index_size;
-    char data_begin;
-};
+    EngineConfig config = {};
+    config.width = 800;
+    config.height = 600;
+    config.frames_in_flight = 2;
+    config.present_mode = VK_PRESENT_MODE_FIFO_KHR;
+    config.low_latency = false;
+    config.min_render_scale = 0.5f;
+    config.light_far_plane = CLUSTER_DEFAULT_FAR;
+    return config;
+}
 
-Model EngineLoadCompiledModel(Engine *engine, const char *file_path)
+static void CreateReadbackRing(Engine *engine)
 {
-    Model model = {};
-    
-    Device device = engine->device;
-    Command command = engine->command;
-    VmaAllocator allocator = engine->device.allocator;
-    
-    u32 set_layout_count = engine->mesh_pipeline.layout.set_layout_count;
-    VkDescriptorSetLayout *set_layouts = engine->mesh_pipeline.layout.set_layouts;
+    VkExtent2D extent = engine->offscreen.rect.extent;
 
-    HANDLE hfile = CreateFile(file_path, GENERIC_READ, 0, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
-    LARGE_INTEGER fsize; GetFileSizeEx(hfile, &fsize);
-    HANDLE hmap = CreateFileMapping(hfile, 0, PAGE_READONLY, 0, 0, 0);
-    CompiledMDL *buffer = (CompiledMDL *)MapViewOfFile(hmap, FILE_MAP_READ, 0, 0, fsize.QuadPart);
-    
-    u32 vertex_size = buffer->vertex_size;
-    u32 index_size = buffer->index_size;
-    model.num_indices = index_size / sizeof(u32);
-    
-    char *vertex_data = &buffer->data_begin;
-    char *index_data = vertex_data + vertex_size;
-    
     VkBufferCreateInfo buff_info = {};
     buff_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
     buff_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-    buff_info.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
-    buff_info.size = vertex_size;
+    buff_info.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    buff_info.size = (VkDeviceSize)extent.width * extent.height * 4;
 
     VmaAllocationCreateInfo alloc_info = {};
-    alloc_info.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
-    alloc_info.preferredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    alloc_info.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
     alloc_info.usage = VMA_MEMORY_USAGE_AUTO;
 
-    vmaCreateBuffer(allocator, &buff_info, &alloc_info, &model.vbo, &model.vbo_alloc, 0);
-    
-    void *dst_data;
-    vmaMapMemory(allocator, model.vbo_alloc, &dst_data);
-    memcpy(dst_data, vertex_data, vertex_size);
+    for(u32 i = 0; i < READBACK_RING_SIZE; i++)
+    {
+        ReadbackBuffer *readback = &engine->readbacks[i];
+        VmaAllocationInfo info = {};
+        vmaCreateBuffer(engine->device.allocator, &buff_info, &alloc_info,
+                        &readback->buffer, &readback->alloc, &info);
+        GpuMemoryTrack(engine->device, GPU_MEMORY_STAGING, readback->alloc);
+        readback->mapped = info.pMappedData;
+    }
 
-    buff_info.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
-    buff_info.size = index_size;
+    engine->readback_next = 1;
+}
 
-    vmaCreateBuffer(allocator, &buff_info, &alloc_info, &model.ibo, &model.ibo_alloc, 0);
-    vmaMapMemory(allocator, model.ibo_alloc, &dst_data);
-    memcpy(dst_data, index_data, index_size);
-    
-    model.texture = LoadTextreFromDDS(device, command, "image.dds");
+static void CreateFrameQueries(Engine *engine)
+{
+    Device *device = &engine->device;
+    u32 family_count = 0;
+    VkQueueFamilyProperties families[16];
+    vkGetPhysicalDeviceQueueFamilyProperties(device->adapter, &family_count, 0);
+    if(family_count > 16) family_count = 16;
+    vkGetPhysicalDeviceQueueFamilyProperties(device->adapter, &family_count, families);
 
-    VkDescriptorSetAllocateInfo set_alloc_info = {};
-    set_alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    set_alloc_info.descriptorPool = engine->mesh_pool;
-    set_alloc_info.descriptorSetCount = set_layout_count;
-    set_alloc_info.pSetLayouts = set_layouts;
-    
-    vkAllocateDescriptorSets(device.device, &set_alloc_info, &model.set);
+    u32 valid_bits = families[device->queue_family_index].timestampValidBits;
+    if(valid_bits == 0)
+    {
+        return;
+    }
 
-    VkSamplerCreateInfo sampler_info = {};
-    sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
-    sampler_info.maxLod = model.texture.mip_count;
-   
-    vkCreateSampler(device.device, &sampler_info, 0, &model.tex_sampler);
-    
-    VkDescriptorImageInfo img_info = {};
-    img_info.sampler = model.tex_sampler;
-    img_info.imageView = model.texture.view;
-    img_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    VkPhysicalDeviceProperties props;
+    vkGetPhysicalDeviceProperties(device->adapter, &props);
 
-    VkWriteDescriptorSet write = {};
-    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    write.dstSet = model.set;
-    write.dstBinding = 0;
-    write.descriptorCount = 1;
-    write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    write.pImageInfo = &img_info;
+    VkQueryPoolCreateInfo pool_info = {};
+    pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    pool_info.queryCount = MAX_FRAMES * 2;
+    if(vkCreateQueryPool(device->device, &pool_info, 0, &engine->frame_queries) != VK_SUCCESS)
+    {
+        engine->frame_queries = 0;
+        return;
+    }
 
-    vkUpdateDescriptorSets(device.device, 1, &write, 0, 0);
-    
-    model.model_matrix = HMM_M4D(1.f);
-    
-    return model;
+    engine->ns_per_tick = props.limits.timestampPeriod;
+    engine->timestamp_mask = valid_bits >= 64 ? ~0ull : (1ull << valid_bits) - 1;
 }
 
-u32 EngineBegin(Engine *engine)
+// Dynamic resolution needs timestamps to measure with and a swapchain it
+// can blit into; without either it stays off.
+static void CreateSceneTarget(Engine *engine)
 {
-    VkDevice device = engine->device.device;
-    VkSwapchainKHR swapchain = engine->swapchain.swapchain;
-    VkFence fence = engine->sync.fences[engine->frame_idx];
-    VkSemaphore wait_sema = engine->sync.acq_semas[engine->frame_idx];
-    VkCommandBuffer cmd = engine->command.cmds[engine->frame_idx];
-    
-    vkWaitForFences(device, 1, &fence, 0, UINT64_MAX);
-    vkResetFences(device, 1, &fence);
+    VkFormatProperties props;
+    vkGetPhysicalDeviceFormatProperties(engine->device.adapter, engine->swapchain.swap_format, &props);
+    VkFormatFeatureFlags needed = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT |
+                                  VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    if(!engine->frame_queries || !(engine->swapchain.image_usage & VK_IMAGE_USAGE_TRANSFER_DST_BIT) ||
+       (props.optimalTilingFeatures & needed) != needed)
+    {
+        engine->dynres.enabled = false;
+        return;
+    }
 
-    uint32_t img_idx;
-    vkAcquireNextImageKHR(device, swapchain, UINT64_MAX, wait_sema, 0, &img_idx);
+    VkExtent2D extent = engine->swapchain.render_area.extent;
+    VkImageUsageFlags usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    engine->scene = CreateTexture(engine->device, engine->swapchain.swap_format, usage,
+                                  extent.width, extent.height, 1);
+    GpuMemoryTrack(engine->device, GPU_MEMORY_RENDER_TARGET, engine->scene.alloc);
+}
 
-    VkCommandBufferBeginInfo begin = {};
-    begin.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    begin.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-    vkBeginCommandBuffer(cmd, &begin);
+static void CreateComputeQueue(Engine *engine)
+{
+    Device *device = &engine->device;
+    if(!device->async_compute)
+    {
+        return;
+    }
 
-    VkImage swap_image = engine->swapchain.swap_images[img_idx];
-
-    TransitionImageInfo trans_info = {};
-    trans_info.image = swap_image;
-    trans_info.old_layout = VK_IMAGE_LAYOUT_UNDEFINED;
-    trans_info.new_layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-    trans_info.dst_access_mask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-    trans_info.aspect_mask = VK_IMAGE_ASPECT_COLOR_BIT;
-    trans_info.src_stage_mask = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-    trans_info.dst_stage_mask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    trans_info.mip_count = 1;
-    
-    TransitionImage(cmd, &trans_info);
-    
-    return img_idx;
+    engine->compute_command = CreateCommand(*device, device->compute_family_index);
+
+    VkSemaphoreTypeCreateInfo type_info = {};
+    type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+
+    VkSemaphoreCreateInfo sema_info = {};
+    sema_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    sema_info.pNext = &type_info;
+    vkCreateSemaphore(device->device, &sema_info, 0, &engine->compute_timeline);
 }
 
-void EngineEnd(Engine *engine, uint32_t img_idx)
+struct EngineStartup
 {
-    VkQueue queue = engine->device.queue;
-    VkSwapchainKHR swapchain = engine->swapchain.swapchain;
-    VkImage swap_image = engine->swapchain.swap_images[img_idx];
-    VkFence fence = engine->sync.fences[engine->frame_idx];
-    VkSemaphore wait_sema = engine->sync.acq_semas[engine->frame_idx];
-    VkSemaphore sign_sema = engine->sync.pres_semas[engine->frame_idx];
-    VkCommandBuffer cmd = engine->command.cmds[engine->frame_idx];
-    
-    TransitionImageInfo trans_info = {};
-    trans_info.image = swap_image;
-    trans_info.old_layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-    trans_info.new_layout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-    trans_info.src_access_mask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-    trans_info.aspect_mask = VK_IMAGE_ASPECT_COLOR_BIT;
-    trans_info.src_stage_mask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    trans_info.dst_stage_mask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-    trans_info.mip_count = 1;
-    
-    TransitionImage(cmd, &trans_info);
-    
-    vkEndCommandBuffer(cmd);
-    
-    VkPipelineStageFlags wait_dst_stage[1] = {VK_PIPELINE_STAGE_TRANSFER_BIT};
-    VkSubmitInfo submit = {};
-    submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submit.waitSemaphoreCount = 1;
-    submit.pWaitSemaphores = &wait_sema;
-    submit.pWaitDstStageMask = wait_dst_stage;
-    submit.commandBufferCount = 1;
-    submit.pCommandBuffers = &cmd;
-    submit.signalSemaphoreCount = 1;
-    submit.pSignalSemaphores = &sign_sema;
-    
-    vkQueueSubmit(queue, 1, &submit, fence);
+    Engine *engine;
+    EngineConfig *config;
+    Arena *arena;
+    GpuMemory *memory;
+};
 
-    VkPresentInfoKHR pres_info = {};
-    pres_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-    pres_info.waitSemaphoreCount = 1;
-    pres_info.pWaitSemaphores = &sign_sema;
-    pres_info.swapchainCount = 1;
-    pres_info.pSwapchains = &swapchain;
-    pres_info.pImageIndices = &img_idx;
-    vkQueuePresentKHR(queue, &pres_info);
+static void StartupInstance(void *data)
+{
+    EngineStartup *startup = (EngineStartup *)data;
+    Engine *engine = startup->engine;
+    engine->instance = CreateInstance(!engine->headless);
+}
 
-    engine->frame_idx = (engine->frame_idx + 1) % MAX_FRAMES;
+static void StartupWindow(void *data)
+{
+    EngineStartup *startup = (EngineStartup *)data;
+    EngineConfig *config = startup->config;
+    config->window = config->create_window(config->window_data);
 }
 
-Texture EngineGetSwapChainImage(Engine *engine, u32 img_idx)
+static void StartupDevice(void *data)
 {
-    Texture swap_texture = {};
-    swap_texture.image = engine->swapchain.swap_images[img_idx];
-    swap_texture.view = engine->swapchain.swap_views[img_idx];
-    swap_texture.rect = engine->swapchain.render_area;
-    return swap_texture;
+    EngineStartup *startup = (EngineStartup *)data;
+    Engine *engine = startup->engine;
+    engine->surface = engine->headless ? 0 : CreateSurface(engine->instance, startup->config->window);
+    engine->device = CreateDevice(engine->instance, engine->surface);
+    engine->device.memory = startup->memory;
+    CreateGpuMemory(engine->device.memory, engine->device, startup->config->vram_budget);
+    engine->depth_format = ChooseDepthFormat(engine->device);
 }
 
-void EngineBeginRendering(Engine *engine, Texture target, Texture *depth, VkClearValue clear_color)
+static void StartupSwapChain(void *data)
 {
-    u32 frame_idx = engine->frame_idx;
-    VkCommandBuffer cmd = engine->command.cmds[frame_idx];
-    
-    VkRenderingAttachmentInfo color_attachment = {};
-    color_attachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
-    color_attachment.imageView = target.view;
-    color_attachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-    color_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-    color_attachment.clearValue = clear_color;
+    EngineStartup *startup = (EngineStartup *)data;
+    Engine *engine = startup->engine;
+    EngineConfig *config = startup->config;
 
-    VkRenderingAttachmentInfo *depth_attachment = 0;
-    VkRenderingAttachmentInfo _depth_attachment;
-    if(depth)
+    // Headless, the offscreen target stands in as a one-image swapchain so
+    // the rest of the frame does not care which mode it is in.
+    if(engine->headless)
     {
-        _depth_attachment = {};
-        _depth_attachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
-        _depth_attachment.imageView = depth->view;
-        _depth_attachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL;
-        _depth_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-        _depth_attachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-        depth_attachment = &_depth_attachment;
+        VkImageUsageFlags usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+                                  VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+        engine->offscreen = CreateTexture(engine->device, HEADLESS_FORMAT, usage, config->width, config->height, 1);
+        GpuMemoryTrack(engine->device, GPU_MEMORY_RENDER_TARGET, engine->offscreen.alloc);
+        engine->swapchain.swap_images[0] = engine->offscreen.image;
+        engine->swapchain.swap_views[0] = engine->offscreen.view;
+        engine->swapchain.render_area = engine->offscreen.rect;
+        engine->swapchain.swap_format = HEADLESS_FORMAT;
+        engine->swapchain.image_usage = usage;
+        engine->swapchain.image_count = 1;
+        CreateReadbackRing(engine);
     }
 
-    VkRenderingInfo render_info = {};
-    render_info.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
-    render_info.renderArea = target.rect;
-    render_info.layerCount = 1;
-    render_info.colorAttachmentCount = 1;
-    render_info.pColorAttachments = &color_attachment;
-    render_info.pDepthAttachment = depth_attachment;
+    else
+    {
+        engine->swapchain = CreateSwapChain(engine->device, engine->surface, config->present_mode);
+    }
 
-    vkCmdBeginRendering(cmd, &render_info);
+    VkImageUsageFlags depth_usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+    u32 width = engine->swapchain.render_area.extent.width;
+    u32 height = engine->swapchain.render_area.extent.height;
+
+    engine->depth = CreateTexture(engine->device, engine->depth_format, depth_usage, width, height, 1);
+    GpuMemoryTrack(engine->device, GPU_MEMORY_RENDER_TARGET, engine->depth.alloc);
 }
 
-void EngineEndRendering(Engine *engine)
+// Everything else that allocates GPU memory, which is tracked without
+// locking and so stays on one node at a time.
+static void StartupResources(void *data)
 {
-    u32 frame_idx = engine->frame_idx;
-    VkCommandBuffer cmd = engine->command.cmds[frame_idx];
-    vkCmdEndRendering(cmd);
+    EngineStartup *startup = (EngineStartup *)data;
+    Engine *engine = startup->engine;
+    EngineConfig *config = startup->config;
+
+    engine->sync = CreateSyncStructs(engine->device);
+    engine->command = CreateCommand(engine->device, engine->device.queue_family_index);
+    CreateComputeQueue(engine);
+
+    CreateFrameQueries(engine);
+    CreateDynamicResolution(&engine->dynres, config->target_frame_ms, config->min_render_scale, engine->frames_in_flight);
+    if(engine->dynres.enabled)
+    {
+        CreateSceneTarget(engine);
+    }
+
+    CreateDestroyQueue(engine->destroy, engine->device);
+    CreateTextureStreamer(&engine->streamer, engine->device, TEXTURE_BUDGET);
+    CreateFrameAllocator(&engine->frame_alloc, engine->device, FRAME_ALLOC_SIZE, engine->frames_in_flight);
 }
 
-void EngineDrawModel(Engine *engine, HMM_Mat4 transform, Model model)
+static void StartupPipelines(void *data)
 {
-    VkCommandBuffer cmd = engine->command.cmds[engine->frame_idx];
-    VkPipeline mesh_pipeline = engine->mesh_pipeline.pipeline;
-    VkPipelineLayout mesh_layout = engine->mesh_pipeline.layout.pipe_layout;
+    EngineStartup *startup = (EngineStartup *)data;
+    Engine *engine = startup->engine;
 
-    VkViewport viewport = {};
-    viewport.width = engine->swapchain.render_area.extent.width;
-    viewport.height = engine->swapchain.render_area.extent.height;
-    viewport.maxDepth = 1.0f;
-    
-    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mesh_pipeline);
-    vkCmdSetViewport(cmd, 0, 1, &viewport);
-    vkCmdSetScissor(cmd, 0, 1, &engine->swapchain.render_area);
+    engine->pipeline_cache = CreatePipelineCache(engine->device.adapter, engine->device.device, PIPELINE_CACHE_PATH);
+    engine->pipelines = CreatePipelineLibrary(startup->arena, engine->device.device, engine->pipeline_cache,
+                                              engine->jobs, engine->device.extended_dynamic_state);
+
+    CreateSamplers(engine);
+    CreateDefaultPipeline(engine,
+                          "compiled/mesh.vert.spv",
+                          "compiled/mesh.frag.spv",
+                          &engine->swapchain.swap_format,
+                          &engine->depth_format);
+
+    // Shares the mesh layout, since all it binds is set 1.
+    if(startup->config->gpu_light_binning)
+    {
+        engine->light_pipeline = CreateComputePipeline(engine->device.device, engine->pipeline_cache,
+                                                       &engine->mesh_desc.layout,
+                                                       "compiled/light_cluster.comp.spv");
+    }
+}
+
+static void StartupDescriptors(void *data)
+{
+    EngineStartup *startup = (EngineStartup *)data;
+    Engine *engine = startup->engine;
 
-    HMM_Mat4 push_constants[2] = {model.model_matrix, transform};
-    vkCmdPushConstants(cmd, mesh_layout, VK_SHADER_STAGE_VERTEX_BIT, 0,
-                       sizeof(push_constants), push_constants);
+    VkDescriptorPoolSize pool_sizes[4] = {};
+    pool_sizes[0].type = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+    pool_sizes[0].descriptorCount = MAX_BINDLESS_TEXTURES;
+    pool_sizes[1].type = VK_DESCRIPTOR_TYPE_SAMPLER;
+    pool_sizes[1].descriptorCount = SAMPLER_COUNT;
+    pool_sizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    pool_sizes[2].descriptorCount = 2;
+    pool_sizes[3].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+    pool_sizes[3].descriptorCount = 2;
     
-    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mesh_layout,
-                            0, 1, &model.set, 0, 0);
+    VkDescriptorPoolCreateInfo pool_info = {};
+    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+    pool_info.maxSets = 2;
+    pool_info.poolSizeCount = 4;
+    pool_info.pPoolSizes = pool_sizes;
+
+    vkCreateDescriptorPool(engine->device.device, &pool_info, 0, &engine->bindless_pool);
+
+    VkDescriptorSetAllocateInfo set_alloc_info = {};
+    set_alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    set_alloc_info.descriptorPool = engine->bindless_pool;
+    set_alloc_info.descriptorSetCount = 2;
+    set_alloc_info.pSetLayouts = engine->mesh_pipeline.layout.set_layouts;
+
+    VkDescriptorSet sets[2];
+    vkAllocateDescriptorSets(engine->device.device, &set_alloc_info, sets);
+    engine->bindless_set = sets[0];
+    engine->frame_set = sets[1];
+
+    VkDescriptorBufferInfo lod_info = StreamerLodDescriptor(&engine->streamer);
+
+    // The range runs to the end of the buffer from wherever the dynamic
+    // offset points, so one descriptor covers every frame's region.
+    VkDescriptorBufferInfo frame_info = {};
+    frame_info.buffer = engine->frame_alloc.buffer;
+    frame_info.range = VK_WHOLE_SIZE;
+
+    VkWriteDescriptorSet writes[4] = {};
+    writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[0].dstSet = engine->bindless_set;
+    writes[0].dstBinding = 2;
+    writes[0].descriptorCount = 1;
+    writes[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    writes[0].pBufferInfo = &lod_info;
+    writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[1].dstSet = engine->frame_set;
+    writes[1].dstBinding = 0;
+    writes[1].descriptorCount = 1;
+    writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+    writes[1].pBufferInfo = &frame_info;
+    writes[2] = writes[1];
+    writes[2].dstBinding = 1;
+    writes[3] = writes[1];
+    writes[3].dstBinding = 2;
+    writes[3].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+
+    vkUpdateDescriptorSets(engine->device.device, 4, writes, 0, 0);
+}
+
+// Mapping and hashing touches every page, which is the actual disk read.
+static void StartupReadFile(void *data)
+{
+    PreloadedFile *preload = (PreloadedFile *)data;
+    if(OsMapFile(preload->asset.path, &preload->file))
+    {
+        preload->content_hash = AssetHashBytes(preload->file.data, preload->file.size);
+    }
+}
+
+// Every model uses the same texture until the compiled format names its own.
+static AssetId ModelTexture(AssetId model)
+{
+    return ASSET("image.dds");
+}
+
+static void EngineAddPreload(Engine *engine, AssetId asset)
+{
+    for(u32 i = 0; i < engine->preload_count; i++)
+    {
+        if(engine->preloads[i].asset.path_hash == asset.path_hash)
+        {
+            return;
+        }
+    }
+
+    if(engine->preload_count < MAX_PRELOADS)
+    {
+        PreloadedFile *preload = &engine->preloads[engine->preload_count++];
+        *preload = {};
+        preload->asset = asset;
+    }
+}
+
+Engine CreateEngine(Arena *arena, EngineConfig config)
+{
+    Engine engine = {0};
+    MathInit();
+    engine.arena = arena;
+    engine.frames_in_flight = config.frames_in_flight;
+    if(engine.frames_in_flight < 1) engine.frames_in_flight = 1;
+    if(engine.frames_in_flight > MAX_FRAMES) engine.frames_in_flight = MAX_FRAMES;
+    engine.low_latency = config.low_latency;
+    engine.assets = CreateAssetRegistry(arena);
+    engine.meshes = (Mesh *)ArenaAlloc(arena, sizeof(Mesh) * MAX_MESHES, 0);
+    engine.free_meshes = (u32 *)ArenaAlloc(arena, sizeof(u32) * MAX_MESHES, 0);
+    engine.destroy = ArenaAllocStruct(arena, DestroyQueue);
+    engine.jobs = CreateJobQueue(arena, 0);
+    engine.graph = ArenaAllocStruct(arena, RenderGraph);
+    engine.draws = (DrawItem *)ArenaAlloc(arena, sizeof(DrawItem) * MAX_DRAWS, 0);
+    engine.lights = CreateLightClusters(arena);
+    engine.light_far_plane = config.light_far_plane;
+    engine.headless = config.window == 0 && config.create_window == 0;
+
+    for(u32 i = 0; i < config.preload_model_count; i++)
+    {
+        EngineAddPreload(&engine, config.preload_models[i]);
+        EngineAddPreload(&engine, ModelTexture(config.preload_models[i]));
+    }
+
+    // The instance, the window and the file reads overlap, and the rest
+    // waits only on what it uses. Only main thread nodes touch the arena.
+    // Pipelines queue their compiles as jobs, so they are one of them.
+    EngineStartup startup = {};
+    startup.engine = &engine;
+    startup.config = &config;
+    startup.arena = arena;
+    startup.memory = ArenaAllocStruct(arena, GpuMemory);
+
+    JobGraph *graph = CreateJobGraph(arena, engine.jobs);
+    u32 instance = JobGraphAdd(graph, "instance", StartupInstance, &startup, false);
+    u32 device = JobGraphAdd(graph, "device", StartupDevice, &startup, false);
+    u32 swapchain = JobGraphAdd(graph, "swapchain", StartupSwapChain, &startup, false);
+    u32 resources = JobGraphAdd(graph, "resources", StartupResources, &startup, false);
+    u32 pipelines = JobGraphAdd(graph, "pipelines", StartupPipelines, &startup, true);
+    u32 descriptors = JobGraphAdd(graph, "descriptors", StartupDescriptors, &startup, true);
+    JobGraphDepend(graph, device, instance);
+    JobGraphDepend(graph, swapchain, device);
+    JobGraphDepend(graph, resources, swapchain);
+    JobGraphDepend(graph, pipelines, swapchain);
+    JobGraphDepend(graph, descriptors, pipelines);
+    JobGraphDepend(graph, descriptors, resources);
+
+    if(!config.window && config.create_window)
+    {
+        u32 window = JobGraphAdd(graph, "window", StartupWindow, &startup, true);
+        JobGraphDepend(graph, device, window);
+    }
+
+    for(u32 i = 0; i < engine.preload_count; i++)
+    {
+        PreloadedFile *preload = &engine.preloads[i];
+        JobGraphAdd(graph, preload->asset.path, StartupReadFile, preload, false);
+    }
+
+    JobGraphRun(graph);
+    engine.startup = graph;
+    PROFILE_GPU_INIT(engine.device);
+
+    if(config.capture_path)
+    {
+        Capture *capture = ArenaAllocStruct(arena, Capture);
+        VkExtent2D extent = engine.swapchain.render_area.extent;
+        if(CreateCapture(capture, CAPTURE_DEFAULT_SIZE, extent.width, extent.height, engine.frames_in_flight))
+        {
+            engine.capture = capture;
+            engine.capture_path = config.capture_path;
+        }
+    }
+
+    if(config.telemetry_name)
+    {
+        CreateTelemetry(&engine.telemetry, config.telemetry_name);
+    }
+
+    return engine;
+}
+
+void DestroyEngine(Engine *engine)
+{
+    EngineEndCapture(engine);
+    DestroyTelemetry(&engine->telemetry);
+    for(u32 i = 0; i < engine->preload_count; i++)
+    {
+        OsUnmapFile(&engine->preloads[i].file);
+    }
+
+    PipelineLibraryWait(engine->pipelines);
+    vkDeviceWaitIdle(engine->device.device);
+    PROFILE_GPU_SHUTDOWN();
+
+    GpuMemory *memory = engine->device.memory;
+    if(memory->pass_open)
+    {
+        for(u32 i = 0; i < engine->defrag_retired_count; i++)
+        {
+            vkDestroyBuffer(engine->device.device, engine->defrag_retired[i], 0);
+        }
+
+        engine->defrag_retired_count = 0;
+        vmaEndDefragmentationPass(engine->device.allocator, memory->defrag, &memory->pass);
+    }
+
+    GpuMemoryEndDefrag(memory);
+
+    // Nothing is in flight any more, so everything goes right away, in the
+    // reverse order it was made.
+    Device device = engine->device;
+    DestroyQueueFlush(engine->destroy);
+    for(u32 i = 0; i < engine->mesh_count; i++)
+    {
+        Mesh *mesh = &engine->meshes[i];
+        if(mesh->vbo)
+        {
+            GpuMemoryRelease(device, GPU_MEMORY_MESH, mesh->vbo_alloc);
+            vmaDestroyBuffer(device.allocator, mesh->vbo, mesh->vbo_alloc);
+            GpuMemoryRelease(device, GPU_MEMORY_MESH, mesh->ibo_alloc);
+            vmaDestroyBuffer(device.allocator, mesh->ibo, mesh->ibo_alloc);
+        }
+
+        if(mesh->skin_vbo)
+        {
+            GpuMemoryRelease(device, GPU_MEMORY_MESH, mesh->skin_alloc);
+            vmaDestroyBuffer(device.allocator, mesh->skin_vbo, mesh->skin_alloc);
+        }
+
+        *mesh = {};
+    }
+
+    engine->mesh_count = 0;
+    engine->free_mesh_count = 0;
+    DestroyTextureStreamer(&engine->streamer);
+    DestroyFrameAllocator(&engine->frame_alloc, device);
+    DestroyRenderGraph(engine->graph, device);
+
+    if(engine->headless)
+    {
+        for(u32 i = 0; i < READBACK_RING_SIZE; i++)
+        {
+            ReadbackBuffer *readback = &engine->readbacks[i];
+            GpuMemoryRelease(device, GPU_MEMORY_STAGING, readback->alloc);
+            vmaDestroyBuffer(device.allocator, readback->buffer, readback->alloc);
+            *readback = {};
+        }
+
+        GpuMemoryRelease(device, GPU_MEMORY_RENDER_TARGET, engine->offscreen.alloc);
+        DestroyTexture(device, &engine->offscreen);
+        engine->swapchain = {};
+    }
+
+    else
+    {
+        DestroySwapChain(device, &engine->swapchain);
+    }
+
+    if(engine->scene.image)
+    {
+        GpuMemoryRelease(device, GPU_MEMORY_RENDER_TARGET, engine->scene.alloc);
+        DestroyTexture(device, &engine->scene);
+    }
+
+    GpuMemoryRelease(device, GPU_MEMORY_RENDER_TARGET, engine->depth.alloc);
+    DestroyTexture(device, &engine->depth);
+
+    if(engine->frame_queries)
+    {
+        vkDestroyQueryPool(device.device, engine->frame_queries, 0);
+    }
+
+    if(engine->compute_timeline)
+    {
+        vkDestroySemaphore(device.device, engine->compute_timeline, 0);
+        vkDestroyCommandPool(device.device, engine->compute_command.pool, 0);
+    }
+
+    DestroyCommand(device, &engine->command);
+    DestroySyncStructs(device, &engine->sync);
+
+    SavePipelineCache(device.adapter, device.device, engine->pipeline_cache, PIPELINE_CACHE_PATH);
+    vkDestroyPipelineCache(device.device, engine->pipeline_cache, 0);
+    DestroyPipelineLibrary(engine->pipelines);
+    if(engine->light_pipeline)
+    {
+        vkDestroyPipeline(device.device, engine->light_pipeline, 0);
+        engine->light_pipeline = 0;
+    }
+
+    DestroyPipelineLayout(device.device, &engine->mesh_desc.layout);
+    engine->mesh_pipeline = {};
+
+    vkDestroyDescriptorPool(device.device, engine->bindless_pool, 0);
+    for(u32 i = 0; i < SAMPLER_COUNT; i++)
+    {
+        vkDestroySampler(device.device, engine->samplers[i], 0);
+    }
+
+    DestroyDevice(&engine->device);
+    if(engine->surface)
+    {
+        vkDestroySurfaceKHR(engine->instance, engine->surface, 0);
+    }
+
+    vkDestroyInstance(engine->instance, 0);
+    engine->surface = 0;
+    engine->instance = 0;
+}
+
+struct CompiledMDL
+{
+    u32 vertex_size;
+    u32 index_size;
+    char data_begin;
+};
+
+static float HalfToFloat(u16 h)
+{
+    u32 sign = (u32)(h & 0x8000) << 16;
+    u32 exponent = (h >> 10) & 0x1f;
+    u32 mantissa = h & 0x3ff;
+
+    if(exponent == 0)
+    {
+        float value = mantissa * (1.0f / 16777216.0f);
+        return sign ? -value : value;
+    }
+
+    u32 bits = sign | ((exponent == 31 ? 255 : exponent + 112) << 23) | (mantissa << 13);
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static float ModelBoundsRadius(const char *vertex_data, u32 vertex_size)
+{
+    float max_sq = 0.0f;
+    for(u32 offset = 0; offset + 16 <= vertex_size; offset += 16)
+    {
+        u16 *position = (u16 *)(vertex_data + offset);
+        float x = HalfToFloat(position[0]);
+        float y = HalfToFloat(position[1]);
+        float z = HalfToFloat(position[2]);
+        float sq = x*x + y*y + z*z;
+        if(sq > max_sq) max_sq = sq;
+    }
+
+    return HMM_SqrtF(max_sq);
+}
+
+static u32 EngineCreateMesh(Engine *engine, CompiledMDL *buffer, u64 file_size)
+{
+    u32 mesh_index = engine->free_mesh_count ? engine->free_meshes[--engine->free_mesh_count] : engine->mesh_count++;
+    Mesh *mesh = &engine->meshes[mesh_index];
+    VmaAllocator allocator = engine->device.allocator;
+    
+    u32 vertex_size = buffer->vertex_size;
+    u32 index_size = buffer->index_size;
+    mesh->num_indices = index_size / sizeof(u32);
+    mesh->vertex_bytes = vertex_size;
+    
+    char *vertex_data = &buffer->data_begin;
+    char *index_data = vertex_data + vertex_size;
+    
+    VkBufferCreateInfo buff_info = {};
+    buff_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buff_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    buff_info.usage = MESH_VERTEX_USAGE;
+    buff_info.size = vertex_size;
+
+    // The mesh is the allocation's user data, which is how defragmentation
+    // finds the buffer to recreate when it moves the memory.
+    VmaAllocationCreateInfo alloc_info = {};
+    alloc_info.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
+    alloc_info.preferredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    alloc_info.usage = VMA_MEMORY_USAGE_AUTO;
+    alloc_info.pUserData = mesh;
+
+    vmaCreateBuffer(allocator, &buff_info, &alloc_info, &mesh->vbo, &mesh->vbo_alloc, 0);
+    GpuMemoryTrack(engine->device, GPU_MEMORY_MESH, mesh->vbo_alloc);
+    
+    void *dst_data;
+    vmaMapMemory(allocator, mesh->vbo_alloc, &dst_data);
+    memcpy(dst_data, vertex_data, vertex_size);
+    vmaUnmapMemory(allocator, mesh->vbo_alloc);
+
+    buff_info.usage = MESH_INDEX_USAGE;
+    buff_info.size = index_size;
+
+    vmaCreateBuffer(allocator, &buff_info, &alloc_info, &mesh->ibo, &mesh->ibo_alloc, 0);
+    GpuMemoryTrack(engine->device, GPU_MEMORY_MESH, mesh->ibo_alloc);
+    vmaMapMemory(allocator, mesh->ibo_alloc, &dst_data);
+    memcpy(dst_data, index_data, index_size);
+    vmaUnmapMemory(allocator, mesh->ibo_alloc);
+    engine->uploaded_bytes += vertex_size + index_size;
+
+    const CompiledSkin *skin = FindCompiledSkin(buffer, file_size);
+    if(skin)
+    {
+        u32 skin_size = skin->vertex_count * SKIN_VERTEX_SIZE;
+        buff_info.usage = MESH_VERTEX_USAGE;
+        buff_info.size = skin_size;
+
+        vmaCreateBuffer(allocator, &buff_info, &alloc_info, &mesh->skin_vbo, &mesh->skin_alloc, 0);
+        GpuMemoryTrack(engine->device, GPU_MEMORY_MESH, mesh->skin_alloc);
+        vmaMapMemory(allocator, mesh->skin_alloc, &dst_data);
+        memcpy(dst_data, SkinVertices(skin), skin_size);
+        vmaUnmapMemory(allocator, mesh->skin_alloc);
+        mesh->joint_count = skin->joint_count;
+        engine->uploaded_bytes += skin_size;
+    }
+    
+    mesh->bounds_radius = ModelBoundsRadius(vertex_data, vertex_size);
+    return mesh_index;
+}
+
+// A file read during startup is handed over once; otherwise it is mapped
+// and hashed here.
+static bool EngineMapAsset(Engine *engine, AssetId asset, MappedFile *file, u64 *content_hash)
+{
+    for(u32 i = 0; i < engine->preload_count; i++)
+    {
+        PreloadedFile *preload = &engine->preloads[i];
+        if(preload->asset.path_hash == asset.path_hash && preload->file.data)
+        {
+            *file = preload->file;
+            *content_hash = preload->content_hash;
+            preload->file = {};
+            return true;
+        }
+    }
+
+    if(!OsMapFile(asset.path, file))
+    {
+        return false;
+    }
+
+    *content_hash = AssetHashBytes(file->data, file->size);
+    return true;
+}
+
+// Path lookups hit without touching the file. On a miss the file is hashed
+// so a copy under another name still resolves to the resident asset.
+static AssetHandle EngineLoadMesh(Engine *engine, AssetId asset)
+{
+    AssetHandle handle = AssetFind(engine->assets, asset.path_hash);
+    if(handle.index || (engine->mesh_count >= MAX_MESHES && engine->free_mesh_count == 0))
+    {
+        return handle;
+    }
+
+    MappedFile file;
+    u64 content_hash;
+    if(!EngineMapAsset(engine, asset, &file, &content_hash))
+    {
+        return handle;
+    }
+
+    CompiledMDL *buffer = (CompiledMDL *)file.data;
+    handle = AssetFindContent(engine->assets, ASSET_MESH, content_hash, asset.path_hash);
+    if(!handle.index)
+    {
+        u32 mesh_index = EngineCreateMesh(engine, buffer, file.size);
+        handle = AssetInsert(engine->assets, ASSET_MESH, asset.path_hash, content_hash, mesh_index);
+    }
+
+    OsUnmapFile(&file);
+    return handle;
+}
+
+static AssetHandle EngineLoadTexture(Engine *engine, AssetId asset)
+{
+    AssetHandle handle = AssetFind(engine->assets, asset.path_hash);
+    if(handle.index)
+    {
+        return handle;
+    }
+
+    MappedFile file;
+    u64 content_hash;
+    if(!EngineMapAsset(engine, asset, &file, &content_hash))
+    {
+        return {};
+    }
+
+    handle = AssetFindContent(engine->assets, ASSET_TEXTURE, content_hash, asset.path_hash);
+    if(handle.index)
+    {
+        OsUnmapFile(&file);
+        return handle;
+    }
+
+    u32 slot = StreamerLoadTexture(&engine->streamer, &file);
+    if(slot == STREAM_INVALID_SLOT)
+    {
+        return {};
+    }
+
+    // The set is update-after-bind, so writing a new slot is fine while
+    // earlier frames that index other slots are still in flight.
+    VkDescriptorImageInfo img_info = {};
+    img_info.imageView = engine->streamer.textures[slot].texture.view;
+    img_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+    VkWriteDescriptorSet write = {};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = engine->bindless_set;
+    write.dstBinding = 0;
+    write.dstArrayElement = slot;
+    write.descriptorCount = 1;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+    write.pImageInfo = &img_info;
+
+    vkUpdateDescriptorSets(engine->device.device, 1, &write, 0, 0);
+    return AssetInsert(engine->assets, ASSET_TEXTURE, asset.path_hash, content_hash, slot);
+}
+
+Model EngineLoadCompiledModel(Engine *engine, AssetId asset)
+{
+    Model model = {};
+
+    model.mesh_asset = EngineLoadMesh(engine, asset);
+    AssetEntry *mesh_entry = AssetGet(engine->assets, model.mesh_asset);
+    if(mesh_entry)
+    {
+        model.mesh = engine->meshes[mesh_entry->payload];
+    }
+
+    model.texture_asset = EngineLoadTexture(engine, ModelTexture(asset));
+    AssetEntry *texture_entry = AssetGet(engine->assets, model.texture_asset);
+    if(texture_entry)
+    {
+        u32 slot = texture_entry->payload;
+        model.texture = engine->streamer.textures[slot].texture;
+        model.material.texture_index = slot;
+    }
+
+    model.material.sampler_index = SAMPLER_LINEAR_REPEAT;
+    if(engine->capture)
+    {
+        model.capture_id = CaptureLoadModel(engine->capture, asset.path);
+    }
+
+    return model;
+}
+
+// GPU resources stay resident once unreferenced so that reloading is a
+// cache hit; the registry only tracks who still holds them. Unloading is
+// a separate step, see below.
+void EngineReleaseModel(Engine *engine, Model *model)
+{
+    if(engine->capture)
+    {
+        CaptureReleaseModel(engine->capture, model->capture_id);
+    }
+
+    AssetRelease(engine->assets, model->mesh_asset);
+    AssetRelease(engine->assets, model->texture_asset);
+    model->mesh_asset = {};
+    model->texture_asset = {};
+    model->mesh = {};
+    model->texture = {};
+}
+
+static void EngineUnloadMesh(Engine *engine, u32 mesh_index)
+{
+    Mesh *mesh = &engine->meshes[mesh_index];
+    DestroyQueueBuffer(engine->destroy, mesh->vbo, mesh->vbo_alloc, GPU_MEMORY_MESH);
+    DestroyQueueBuffer(engine->destroy, mesh->ibo, mesh->ibo_alloc, GPU_MEMORY_MESH);
+    if(mesh->skin_vbo)
+    {
+        DestroyQueueBuffer(engine->destroy, mesh->skin_vbo, mesh->skin_alloc, GPU_MEMORY_MESH);
+    }
+
+    *mesh = {};
+    DestroyQueueSlot(engine->destroy, engine->free_meshes, &engine->free_mesh_count, mesh_index);
+}
+
+// Only assets nobody holds go, and nothing goes while a defragmentation is
+// running, since its moves may name any mesh buffer; the asset stays cached
+// and a later call picks it up.
+static bool EngineUnloadAsset(Engine *engine, AssetHandle handle)
+{
+    AssetEntry *entry = AssetGet(engine->assets, handle);
+    if(!entry || entry->refcount || engine->device.memory->defrag)
+    {
+        return false;
+    }
+
+    if(entry->type == ASSET_MESH)
+    {
+        EngineUnloadMesh(engine, entry->payload);
+    }
+
+    else if(entry->type == ASSET_TEXTURE)
+    {
+        StreamerUnloadTexture(&engine->streamer, entry->payload, engine->destroy);
+    }
+
+    AssetRemove(engine->assets, handle);
+    return true;
+}
+
+// Releases the model and unloads its mesh and texture unless another model
+// still uses them. Copies of the model taken earlier draw nothing from
+// here on.
+void EngineUnloadModel(Engine *engine, Model *model)
+{
+    AssetHandle mesh = model->mesh_asset;
+    AssetHandle texture = model->texture_asset;
+    EngineReleaseModel(engine, model);
+    EngineUnloadAsset(engine, mesh);
+    EngineUnloadAsset(engine, texture);
+}
+
+// Unloads everything no model holds any more, e.g. once a level has been
+// released. Returns how many assets went.
+u32 EngineUnloadUnused(Engine *engine)
+{
+    AssetRegistry *assets = engine->assets;
+    u32 unloaded = 0;
+    for(u32 i = 1; i < assets->entry_count; i++)
+    {
+        AssetEntry *entry = &assets->entries[i];
+        AssetHandle handle = {i, entry->generation};
+        if(entry->type != ASSET_NONE && entry->refcount == 0 && EngineUnloadAsset(engine, handle))
+        {
+            unloaded++;
+        }
+    }
+
+    return unloaded;
+}
+
+// Streamed textures get whatever the rest of the frame leaves of the VRAM
+// budget, so growth elsewhere evicts mips instead of spilling to system
+// memory.
+static void EngineUpdateMemory(Engine *engine)
+{
+    GpuMemory *memory = engine->device.memory;
+    GpuMemoryUpdate(memory, engine->frame_number);
+
+    GpuMemoryStats *stats = &memory->stats;
+    u64 texture_bytes = memory->categories[GPU_MEMORY_TEXTURE].bytes;
+    u64 other_bytes = stats->vram_usage > texture_bytes ? stats->vram_usage - texture_bytes : 0;
+    u64 budget = stats->vram_budget > other_bytes ? stats->vram_budget - other_bytes : 0;
+    if(budget < GPU_MIN_TEXTURE_BUDGET) budget = GPU_MIN_TEXTURE_BUDGET;
+    if(budget > TEXTURE_BUDGET) budget = TEXTURE_BUDGET;
+    engine->streamer.budget = budget;
+}
+
+// Runs one defragmentation pass at a time. Only mesh buffers are moved:
+// a new buffer is bound at the destination and filled by a copy at the
+// start of this frame, and the mesh is pointed at it so every draw from
+// here on uses the new place. Frames still in flight keep reading the old
+// buffer, which is destroyed and its memory released once this frame has
+// retired. Anything else VMA wants to move is left where it is.
+static void EngineDefragStep(Engine *engine, VkCommandBuffer cmd)
+{
+    GpuMemory *memory = engine->device.memory;
+    VmaAllocator allocator = engine->device.allocator;
+    VkDevice device = engine->device.device;
+
+    if(memory->pass_open)
+    {
+        u64 completed = 0;
+        vkGetSemaphoreCounterValue(device, engine->sync.timeline, &completed);
+        if(completed < memory->pass_frame)
+        {
+            return;
+        }
+
+        for(u32 i = 0; i < engine->defrag_retired_count; i++)
+        {
+            vkDestroyBuffer(device, engine->defrag_retired[i], 0);
+        }
+
+        engine->defrag_retired_count = 0;
+        memory->pass_open = false;
+        memory->stats.defrag_passes++;
+        if(vmaEndDefragmentationPass(allocator, memory->defrag, &memory->pass) == VK_SUCCESS)
+        {
+            GpuMemoryEndDefrag(memory);
+            return;
+        }
+    }
+
+    else if(!memory->defrag)
+    {
+        if(!GpuMemoryWantsDefrag(memory, engine->frame_number) || !GpuMemoryBeginDefrag(memory))
+        {
+            return;
+        }
+    }
+
+    if(vmaBeginDefragmentationPass(allocator, memory->defrag, &memory->pass) == VK_SUCCESS)
+    {
+        GpuMemoryEndDefrag(memory);
+        return;
+    }
+
+    PROFILE_ZONE("Defragment");
+    u32 barrier_count = 0;
+    VkBufferMemoryBarrier2 barriers[GPU_DEFRAG_MAX_MOVES_PER_PASS];
+    for(u32 i = 0; i < memory->pass.moveCount; i++)
+    {
+        VmaDefragmentationMove *move = &memory->pass.pMoves[i];
+        VmaAllocationInfo info;
+        vmaGetAllocationInfo(allocator, move->srcAllocation, &info);
+
+        Mesh *mesh = (Mesh *)info.pUserData;
+        if(!mesh || engine->defrag_retired_count >= GPU_DEFRAG_MAX_MOVES_PER_PASS)
+        {
+            move->operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE;
+            continue;
+        }
+
+        bool skin = move->srcAllocation == mesh->skin_alloc;
+        bool vertices = skin || move->srcAllocation == mesh->vbo_alloc;
+        VkBuffer *buffer = skin ? &mesh->skin_vbo : vertices ? &mesh->vbo : &mesh->ibo;
+
+        VkBufferCreateInfo buff_info = {};
+        buff_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        buff_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        buff_info.usage = vertices ? MESH_VERTEX_USAGE : MESH_INDEX_USAGE;
+        buff_info.size = vertices ? mesh->vertex_bytes : mesh->num_indices * sizeof(u32);
+        buff_info.size = skin ? mesh->vertex_bytes / 16 * SKIN_VERTEX_SIZE : buff_info.size;
+
+        VkBuffer moved;
+        if(vkCreateBuffer(device, &buff_info, 0, &moved) != VK_SUCCESS)
+        {
+            move->operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE;
+            continue;
+        }
+
+        vmaBindBufferMemory(allocator, move->dstTmpAllocation, moved);
+
+        VkBufferCopy region = {};
+        region.size = buff_info.size;
+        vkCmdCopyBuffer(cmd, *buffer, moved, 1, &region);
+
+        VkBufferMemoryBarrier2 *barrier = &barriers[barrier_count++];
+        *barrier = {};
+        barrier->sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2;
+        barrier->srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+        barrier->srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+        barrier->dstStageMask = VK_PIPELINE_STAGE_2_VERTEX_INPUT_BIT;
+        barrier->dstAccessMask = vertices ? VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT : VK_ACCESS_2_INDEX_READ_BIT;
+        barrier->srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier->dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier->buffer = moved;
+        barrier->size = VK_WHOLE_SIZE;
+
+        engine->defrag_retired[engine->defrag_retired_count++] = *buffer;
+        *buffer = moved;
+    }
+
+    if(barrier_count)
+    {
+        VkDependencyInfo dependency = {};
+        dependency.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+        dependency.bufferMemoryBarrierCount = barrier_count;
+        dependency.pBufferMemoryBarriers = barriers;
+        vkCmdPipelineBarrier2(cmd, &dependency);
+    }
+
+    memory->pass_open = true;
+    memory->pass_frame = engine->frame_number + 1;
+}
+
+// Only called once the slot's previous frame has finished, so the results
+// are there without waiting.
+static void EngineReadGpuTime(Engine *engine)
+{
+    u32 slot = engine->frame_idx;
+    if(!engine->frame_query_pending[slot])
+    {
+        return;
+    }
+
+    engine->frame_query_pending[slot] = false;
+    u64 ticks[2];
+    VkResult result = vkGetQueryPoolResults(engine->device.device, engine->frame_queries, slot * 2, 2,
+                                            sizeof(ticks), ticks, sizeof(u64), VK_QUERY_RESULT_64_BIT);
+    if(result != VK_SUCCESS)
+    {
+        return;
+    }
+
+    u64 delta = (ticks[1] - ticks[0]) & engine->timestamp_mask;
+    engine->gpu_ms = (float)(delta * engine->ns_per_tick / 1000000.0);
+    DynamicResolutionUpdate(&engine->dynres, engine->gpu_ms);
+}
+
+u32 EngineBegin(Engine *engine)
+{
+    PROFILE_ZONE("EngineBegin");
+    engine->frame_start = OsTimeNow();
+    engine->stats = {};
+    if(engine->capture)
+    {
+        CaptureBeginFrame(engine->capture);
+    }
+
+    VkDevice device = engine->device.device;
+    VkSwapchainKHR swapchain = engine->swapchain.swapchain;
+    VkSemaphore wait_sema = engine->sync.acq_semas[engine->frame_idx];
+    VkCommandBuffer cmd = engine->command.cmds[engine->frame_idx];
+
+    // The slot's compute command buffer is waited on as well, since a frame
+    // without handoffs does not make its graphics work wait for it.
+    VkSemaphore timelines[2] = {engine->sync.timeline, engine->compute_timeline};
+    u64 values[2] = {engine->sync.frame_values[engine->frame_idx], engine->compute_values[engine->frame_idx]};
+
+    VkSemaphoreWaitInfo wait_info = {};
+    wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    wait_info.semaphoreCount = engine->compute_timeline ? 2 : 1;
+    wait_info.pSemaphores = timelines;
+    wait_info.pValues = values;
+    double ms_per_tick = 1000.0 / OsTimeFrequency();
+    {
+        PROFILE_ZONE("WaitFrame");
+        u64 wait_start = OsTimeNow();
+        vkWaitSemaphores(device, &wait_info, UINT64_MAX);
+        engine->stats.fence_wait_ms = (float)((OsTimeNow() - wait_start) * ms_per_tick);
+    }
+
+    // Every frame up to the slot's last one has finished on both queues.
+    // Retiring is held off while a defragmentation runs, like unloading.
+    if(!engine->device.memory->defrag)
+    {
+        DestroyQueueRetire(engine->destroy, engine->sync.frame_values[engine->frame_idx]);
+    }
+
+    EngineReadGpuTime(engine);
+    EngineUpdateMemory(engine);
+    StreamerUpdate(&engine->streamer);
+
+    // The slot's last frame has finished, so its region can be reused. Draw
+    // data and lights take blocks large enough for a full draw list and a
+    // full light list up front; the rest of the region is left for other
+    // per frame data.
+    FrameAllocBegin(&engine->frame_alloc, engine->frame_idx);
+    engine->draw_data = (MeshDrawData *)FrameAlloc(&engine->frame_alloc, sizeof(MeshDrawData) * MAX_DRAWS,
+                                                   &engine->draw_data_offset);
+    engine->light_block = (ClusterBlock *)FrameAlloc(&engine->frame_alloc, sizeof(ClusterBlock),
+                                                     &engine->light_offset);
+    engine->light_resource = GRAPH_INVALID;
+    if(engine->light_block)
+    {
+        ClusterHeader header = {};
+        header.ambient = HMM_V4(1, 1, 1, 1);
+        engine->light_block->header = header;
+    }
+
+    uint32_t img_idx = 0;
+    if(!engine->headless)
+    {
+        PROFILE_ZONE("Acquire");
+        u64 acquire_start = OsTimeNow();
+        vkAcquireNextImageKHR(device, swapchain, UINT64_MAX, wait_sema, 0, &img_idx);
+        engine->stats.acquire_ms = (float)((OsTimeNow() - acquire_start) * ms_per_tick);
+    }
+
+    VkCommandBufferBeginInfo begin = {};
+    begin.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(cmd, &begin);
+    if(engine->frame_queries)
+    {
+        vkCmdResetQueryPool(cmd, engine->frame_queries, engine->frame_idx * 2, 2);
+        vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT, engine->frame_queries, engine->frame_idx * 2);
+    }
+
+    PROFILE_GPU_BEGIN_FRAME(cmd, engine->frame_idx);
+    PROFILE_GPU_BEGIN(cmd, "Frame");
+    EngineDefragStep(engine, cmd);
+
+    VkDescriptorSet sets[2] = {engine->bindless_set, engine->frame_set};
+    u32 offsets[2] = {engine->draw_data_offset, engine->light_offset};
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, engine->mesh_pipeline.layout.pipe_layout,
+                            0, 2, sets, 2, offsets);
+    engine->stats.descriptor_binds++;
+
+    // The acquire semaphore is waited on at color output, so that is the
+    // stage the swapchain image is considered last used in, plus transfer
+    // when the upscale blit may write it first. The offscreen target was
+    // last read by the previous frame's readback copy.
+    RenderGraph *graph = engine->graph;
+    RenderGraphReset(graph);
+    engine->draw_count = 0;
+    engine->render_pass_count = 0;
+    engine->current_pass = 0;
+    engine->scene_rendered = false;
+    engine->compute_submitted = false;
+    engine->compute_wait_stages = VK_PIPELINE_STAGE_2_NONE;
+    engine->compute_handoff_count = 0;
+
+    engine->swap_resource = RenderGraphImportImage(graph, engine->swapchain.swap_images[img_idx],
+                                                   engine->swapchain.swap_views[img_idx],
+                                                   engine->swapchain.swap_format,
+                                                   engine->swapchain.render_area.extent,
+                                                   VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
+                                                   VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT |
+                                                   (engine->headless || engine->dynres.enabled ?
+                                                    VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT : 0));
+    RenderGraphSetOutput(graph, engine->swap_resource,
+                         engine->headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+                         VK_PIPELINE_STAGE_2_NONE);
+
+    // The scene target was last read by the previous frame's upscale blit.
+    // Importing it here, before any pass does, sets that as its entry state.
+    if(engine->dynres.enabled)
+    {
+        engine->scene_extent = DynamicResolutionExtent(&engine->dynres, engine->scene.rect.extent);
+        engine->scene_resource = RenderGraphImportImage(graph, engine->scene.image, engine->scene.view,
+                                                        engine->swapchain.swap_format, engine->scene.rect.extent,
+                                                        VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
+                                                        VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT |
+                                                        VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT);
+    }
+    
+    return img_idx;
+}
+
+// Copies the finished frame into this frame's ring slot and makes the
+// copy visible to the host before the timeline signal.
+static void EngineReadbackPass(RenderGraph *graph, VkCommandBuffer cmd, void *data)
+{
+    Engine *engine = (Engine *)data;
+    ReadbackBuffer *readback = &engine->readbacks[(engine->frame_number + 1) % READBACK_RING_SIZE];
+    GraphResource *target = &graph->resources[engine->swap_resource];
+
+    VkBufferImageCopy region = {};
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.layerCount = 1;
+    region.imageExtent.width = target->extent.width;
+    region.imageExtent.height = target->extent.height;
+    region.imageExtent.depth = 1;
+    vkCmdCopyImageToBuffer(cmd, target->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                           readback->buffer, 1, &region);
+
+    VkBufferMemoryBarrier2 barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2;
+    barrier.srcStageMask = VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT;
+    barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+    barrier.dstStageMask = VK_PIPELINE_STAGE_2_HOST_BIT;
+    barrier.dstAccessMask = VK_ACCESS_2_HOST_READ_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = readback->buffer;
+    barrier.size = VK_WHOLE_SIZE;
+
+    VkDependencyInfo dependency = {};
+    dependency.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    dependency.bufferMemoryBarrierCount = 1;
+    dependency.pBufferMemoryBarriers = &barrier;
+    vkCmdPipelineBarrier2(cmd, &dependency);
+
+    readback->frame = engine->frame_number + 1;
+}
+
+// Stretches the scaled rectangle of the scene target over the whole
+// swapchain image with a linear filter.
+static void EngineUpscalePass(RenderGraph *graph, VkCommandBuffer cmd, void *data)
+{
+    Engine *engine = (Engine *)data;
+    GraphResource *scene = &graph->resources[engine->scene_resource];
+    GraphResource *target = &graph->resources[engine->swap_resource];
+
+    VkImageBlit region = {};
+    region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.srcSubresource.layerCount = 1;
+    region.srcOffsets[1].x = engine->scene_extent.width;
+    region.srcOffsets[1].y = engine->scene_extent.height;
+    region.srcOffsets[1].z = 1;
+    region.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.dstSubresource.layerCount = 1;
+    region.dstOffsets[1].x = target->extent.width;
+    region.dstOffsets[1].y = target->extent.height;
+    region.dstOffsets[1].z = 1;
+    vkCmdBlitImage(cmd, scene->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                   target->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region, VK_FILTER_LINEAR);
+}
+
+// CPU time runs from the start of EngineBegin to the submit, so it leaves
+// out the present and whatever the caller does between frames.
+static void EngineFinishStats(Engine *engine, u64 frame_value)
+{
+    TelemetryFrame *stats = &engine->stats;
+    u64 uploaded = engine->uploaded_bytes + engine->streamer.uploaded_bytes;
+    GpuMemoryStats *memory = &engine->device.memory->stats;
+
+    stats->frame = frame_value;
+    stats->render_passes = engine->render_pass_count;
+    stats->upload_bytes = uploaded - engine->uploaded_reported;
+    stats->frame_data_bytes = engine->frame_alloc.used;
+    stats->cpu_ms = (float)((OsTimeNow() - engine->frame_start) * 1000.0 / OsTimeFrequency());
+    stats->gpu_ms = engine->gpu_ms;
+    stats->render_scale = EngineGetRenderScale(engine);
+    stats->arena_used = engine->arena->used;
+    stats->arena_capacity = engine->arena->capacity;
+    stats->vram_usage = memory->vram_usage;
+    stats->vram_budget = memory->vram_budget;
+    engine->uploaded_reported = uploaded;
+
+    TelemetryPublish(&engine->telemetry, stats);
+}
+
+void EngineEnd(Engine *engine, uint32_t img_idx)
+{
+    PROFILE_ZONE("EngineEnd");
+    if(engine->capture)
+    {
+        CaptureEndFrame(engine->capture);
+    }
+
+    VkQueue queue = engine->device.queue;
+    VkSwapchainKHR swapchain = engine->swapchain.swapchain;
+    VkSemaphore wait_sema = engine->sync.acq_semas[engine->frame_idx];
+    VkSemaphore sign_sema = engine->sync.pres_semas[img_idx];
+    VkCommandBuffer cmd = engine->command.cmds[engine->frame_idx];
+    
+    EngineEndCompute(engine);
+    for(u32 i = 0; i < engine->compute_handoff_count; i++)
+    {
+        QueueAcquire(cmd, &engine->compute_handoffs[i]);
+    }
+
+    RenderGraph *graph = engine->graph;
+    if(engine->scene_rendered)
+    {
+        u32 pass = RenderGraphAddPass(graph, "upscale", EngineUpscalePass, engine);
+        RenderGraphAccess(graph, pass, engine->scene_resource, GRAPH_TRANSFER_SRC);
+        RenderGraphAccess(graph, pass, engine->swap_resource, GRAPH_TRANSFER_DST);
+    }
+
+    if(engine->headless)
+    {
+        u32 pass = RenderGraphAddPass(graph, "readback", EngineReadbackPass, engine);
+        RenderGraphAccess(graph, pass, engine->swap_resource, GRAPH_TRANSFER_SRC);
+        RenderGraphSetSideEffect(graph, pass);
+    }
+
+    FrameAllocFlush(&engine->frame_alloc, engine->device, cmd);
+    if(RenderGraphCompile(graph))
+    {
+        RenderGraphRealize(graph, engine->device);
+        RenderGraphExecute(graph, cmd);
+    }
+
+    PROFILE_GPU_END_FRAME(cmd);
+    if(engine->frame_queries)
+    {
+        vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, engine->frame_queries,
+                             engine->frame_idx * 2 + 1);
+        engine->frame_query_pending[engine->frame_idx] = true;
+    }
+
+    vkEndCommandBuffer(cmd);
+    
+    u64 frame_value = ++engine->frame_number;
+    engine->sync.frame_values[engine->frame_idx] = frame_value;
+    DestroyQueueSetFrame(engine->destroy, frame_value + 1);
+
+    // The swapchain image is first touched by the color attachment clear,
+    // or by the upscale blit, which is the stage that has to wait for the
+    // acquire. Compute results are waited for where they are first read.
+    u32 wait_count = 0;
+    VkSemaphoreSubmitInfo wait_infos[2] = {};
+    if(!engine->headless)
+    {
+        wait_infos[wait_count].sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+        wait_infos[wait_count].semaphore = wait_sema;
+        wait_infos[wait_count].stageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT |
+                                           (engine->dynres.enabled ? VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT : 0);
+        wait_count++;
+    }
+
+    if(engine->compute_submitted && engine->compute_wait_stages)
+    {
+        wait_infos[wait_count].sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+        wait_infos[wait_count].semaphore = engine->compute_timeline;
+        wait_infos[wait_count].value = engine->compute_value;
+        wait_infos[wait_count].stageMask = engine->compute_wait_stages;
+        wait_count++;
+    }
+
+    VkSemaphoreSubmitInfo signal_infos[2] = {};
+    signal_infos[0].sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+    signal_infos[0].semaphore = engine->sync.timeline;
+    signal_infos[0].value = frame_value;
+    signal_infos[0].stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+    signal_infos[1].sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+    signal_infos[1].semaphore = sign_sema;
+    signal_infos[1].stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+
+    VkCommandBufferSubmitInfo cmd_info = {};
+    cmd_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
+    cmd_info.commandBuffer = cmd;
+
+    VkSubmitInfo2 submit = {};
+    submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
+    submit.waitSemaphoreInfoCount = wait_count;
+    submit.pWaitSemaphoreInfos = wait_infos;
+    submit.commandBufferInfoCount = 1;
+    submit.pCommandBufferInfos = &cmd_info;
+    submit.signalSemaphoreInfoCount = engine->headless ? 1 : 2;
+    submit.pSignalSemaphoreInfos = signal_infos;
+    
+    vkQueueSubmit2(queue, 1, &submit, 0);
+    EngineFinishStats(engine, frame_value);
+    engine->frame_idx = (engine->frame_idx + 1) % engine->frames_in_flight;
+    if(engine->headless)
+    {
+        return;
+    }
+
+    VkPresentIdKHR present_id = {};
+    present_id.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+    present_id.swapchainCount = 1;
+    present_id.pPresentIds = &frame_value;
+
+    VkPresentInfoKHR pres_info = {};
+    pres_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+    pres_info.pNext = engine->device.wait_for_present ? &present_id : 0;
+    pres_info.waitSemaphoreCount = 1;
+    pres_info.pWaitSemaphores = &sign_sema;
+    pres_info.swapchainCount = 1;
+    pres_info.pSwapchains = &swapchain;
+    pres_info.pImageIndices = &img_idx;
+
+    PROFILE_ZONE("Present");
+    vkQueuePresentKHR(queue, &pres_info);
+}
+
+// Hands out finished frames oldest first. Frames the ring has already
+// overwritten are skipped. Without wait this never blocks; with it, it
+// blocks for the next frame only if that frame has been submitted.
+bool EngineReadback(Engine *engine, ReadbackFrame *frame, bool wait)
+{
+    if(!engine->headless)
+    {
+        return false;
+    }
+
+    if(engine->frame_number >= READBACK_RING_SIZE &&
+       engine->readback_next <= engine->frame_number - READBACK_RING_SIZE)
+    {
+        engine->readback_next = engine->frame_number - READBACK_RING_SIZE + 1;
+    }
+
+    u64 next = engine->readback_next;
+    if(next > engine->frame_number)
+    {
+        return false;
+    }
+
+    if(wait)
+    {
+        PROFILE_ZONE("WaitReadback");
+        VkSemaphoreWaitInfo wait_info = {};
+        wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+        wait_info.semaphoreCount = 1;
+        wait_info.pSemaphores = &engine->sync.timeline;
+        wait_info.pValues = &next;
+        vkWaitSemaphores(engine->device.device, &wait_info, UINT64_MAX);
+    }
+
+    u64 completed = 0;
+    vkGetSemaphoreCounterValue(engine->device.device, engine->sync.timeline, &completed);
+    if(completed < next)
+    {
+        return false;
+    }
+
+    ReadbackBuffer *readback = &engine->readbacks[next % READBACK_RING_SIZE];
+    engine->readback_next = next + 1;
+    if(readback->frame != next)
+    {
+        return false;
+    }
+
+    vmaInvalidateAllocation(engine->device.allocator, readback->alloc, 0, VK_WHOLE_SIZE);
+    frame->frame = next;
+    frame->width = engine->offscreen.rect.extent.width;
+    frame->height = engine->offscreen.rect.extent.height;
+    frame->row_pitch = frame->width * 4;
+    frame->pixels = readback->mapped;
+    return true;
+}
+
+// Called before input is sampled. In latency mode this blocks until the
+// previous frame is on screen, or at least finished on the GPU when the
+// driver cannot report presents, so the next frame starts from fresh input
+// instead of queueing behind older ones.
+void EngineWaitLatency(Engine *engine)
+{
+    if(!engine->low_latency || engine->frame_number == 0)
+    {
+        return;
+    }
+
+    PROFILE_ZONE("WaitLatency");
+    if(engine->device.wait_for_present)
+    {
+        engine->device.wait_for_present(engine->device.device, engine->swapchain.swapchain,
+                                        engine->frame_number, UINT64_MAX);
+        return;
+    }
+
+    VkSemaphoreWaitInfo wait_info = {};
+    wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    wait_info.semaphoreCount = 1;
+    wait_info.pSemaphores = &engine->sync.timeline;
+    wait_info.pValues = &engine->frame_number;
+    vkWaitSemaphores(engine->device.device, &wait_info, UINT64_MAX);
+}
+
+Texture EngineGetSwapChainImage(Engine *engine, u32 img_idx)
+{
+    Texture swap_texture = {};
+    swap_texture.image = engine->swapchain.swap_images[img_idx];
+    swap_texture.view = engine->swapchain.swap_views[img_idx];
+    swap_texture.rect = engine->swapchain.render_area;
+    return swap_texture;
+}
+
+// Where the 3D scene should be rendered this frame: the swapchain image, or
+// with dynamic resolution the scaled rectangle of the scene target, which
+// EngineEnd upscales to the swapchain image.
+Texture EngineGetSceneTarget(Engine *engine, u32 img_idx)
+{
+    if(!engine->dynres.enabled)
+    {
+        return EngineGetSwapChainImage(engine, img_idx);
+    }
+
+    Texture scene = engine->scene;
+    scene.rect.extent = engine->scene_extent;
+    return scene;
+}
+
+float EngineGetGpuTime(Engine *engine)
+{
+    return engine->gpu_ms;
+}
+
+float EngineGetRenderScale(Engine *engine)
+{
+    return engine->dynres.enabled ? engine->dynres.scale : 1.0f;
+}
+
+// Counters of the last finished frame, until the next EngineBegin.
+TelemetryFrame EngineGetFrameStats(Engine *engine)
+{
+    return engine->stats;
+}
+
+static void EngineMeshPass(RenderGraph *graph, VkCommandBuffer cmd, void *data)
+{
+    RenderPassData *pass = (RenderPassData *)data;
+    Engine *engine = pass->engine;
+    
+    VkRenderingAttachmentInfo color_attachment = {};
+    color_attachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+    color_attachment.imageView = RenderGraphGetView(graph, pass->target);
+    color_attachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    color_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    color_attachment.clearValue = pass->clear;
+
+    VkRenderingAttachmentInfo *depth_attachment = 0;
+    VkRenderingAttachmentInfo _depth_attachment;
+    if(pass->depth != GRAPH_INVALID)
+    {
+        _depth_attachment = {};
+        _depth_attachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+        _depth_attachment.imageView = RenderGraphGetView(graph, pass->depth);
+        _depth_attachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL;
+        _depth_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        _depth_attachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        depth_attachment = &_depth_attachment;
+    }
+
+    VkRenderingInfo render_info = {};
+    render_info.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+    render_info.renderArea = pass->area;
+    render_info.layerCount = 1;
+    render_info.colorAttachmentCount = 1;
+    render_info.pColorAttachments = &color_attachment;
+    render_info.pDepthAttachment = depth_attachment;
+
+    vkCmdBeginRendering(cmd, &render_info);
+
+    VkViewport viewport = {};
+    viewport.x = pass->area.offset.x;
+    viewport.y = pass->area.offset.y;
+    viewport.width = pass->area.extent.width;
+    viewport.height = pass->area.extent.height;
+    viewport.maxDepth = 1.0f;
+
+    vkCmdSetViewport(cmd, 0, 1, &viewport);
+    vkCmdSetScissor(cmd, 0, 1, &pass->area);
+
+    VkPipeline bound_pipeline = 0;
+    u32 bound_permutation = MESH_PERMUTATION_COUNT;
+    for(u32 i = pass->first_draw; i < pass->first_draw + pass->draw_count; i++)
+    {
+        DrawItem *draw = &engine->draws[i];
+        MeshPermutation *mesh_permutation = &engine->mesh_permutations[draw->permutation];
+        Pipeline *pipeline = PipelineLibraryResolve(engine->pipelines, mesh_permutation->pipeline);
+        if(pipeline->pipeline != bound_pipeline)
+        {
+            vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->pipeline);
+            bound_pipeline = pipeline->pipeline;
+            engine->stats.pipeline_binds++;
+        }
+
+        if(engine->device.extended_dynamic_state && draw->permutation != bound_permutation)
+        {
+            CmdSetPipelineState(cmd, &mesh_permutation->state);
+            bound_permutation = draw->permutation;
+        }
+
+        VkBuffer vertex_buffers[2] = {draw->vbo, draw->skin_vbo};
+        VkDeviceSize offsets[2] = {};
+        u32 vertex_buffer_count = draw->skin_vbo ? 2 : 1;
+        vkCmdBindVertexBuffers(cmd, 0, vertex_buffer_count, vertex_buffers, offsets);
+        vkCmdBindIndexBuffer(cmd, draw->ibo, 0, VK_INDEX_TYPE_UINT32);
+        vkCmdDrawIndexed(cmd, draw->num_indices, 1, 0, 0, i);
+        engine->stats.buffer_binds += 1 + vertex_buffer_count;
+        engine->stats.draw_calls++;
+        engine->stats.triangles += draw->num_indices / 3;
+    }
+
+    vkCmdEndRendering(cmd);
+}
+
+// Declares a pass on the frame graph; nothing is recorded until EngineEnd.
+// The depth buffer is imported as undefined every frame since it is cleared
+// and never stored.
+void EngineBeginRendering(Engine *engine, Texture target, Texture *depth, VkClearValue clear_color)
+{
+    if(engine->capture)
+    {
+        float *clear = clear_color.color.float32;
+        CaptureBeginRendering(engine->capture, depth != 0, HMM_V4(clear[0], clear[1], clear[2], clear[3]));
+    }
+
+    if(engine->render_pass_count >= MAX_RENDER_PASSES)
+    {
+        return;
+    }
+
+    RenderGraph *graph = engine->graph;
+    if(engine->scene.image && target.image == engine->scene.image)
+    {
+        engine->scene_rendered = true;
+    }
+
+    RenderPassData *pass = &engine->render_passes[engine->render_pass_count++];
+    pass->engine = engine;
+    pass->area = target.rect;
+    pass->clear = clear_color;
+    pass->first_draw = engine->draw_count;
+    pass->draw_count = 0;
+    pass->target = RenderGraphImportImage(graph, target.image, target.view, VK_FORMAT_UNDEFINED,
+                                          target.rect.extent, VK_IMAGE_ASPECT_COLOR_BIT,
+                                          VK_IMAGE_LAYOUT_UNDEFINED,
+                                          VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT);
+    pass->depth = GRAPH_INVALID;
+    if(depth)
+    {
+        pass->depth = RenderGraphImportImage(graph, depth->image, depth->view, engine->depth_format,
+                                             depth->rect.extent, VK_IMAGE_ASPECT_DEPTH_BIT,
+                                             VK_IMAGE_LAYOUT_UNDEFINED,
+                                             VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT |
+                                             VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT);
+    }
+
+    u32 graph_pass = RenderGraphAddPass(graph, "mesh", EngineMeshPass, pass);
+    RenderGraphAccess(graph, graph_pass, pass->target, GRAPH_COLOR_ATTACHMENT);
+    if(engine->light_resource != GRAPH_INVALID)
+    {
+        RenderGraphAccess(graph, graph_pass, engine->light_resource, GRAPH_STORAGE_READ);
+    }
+    if(pass->depth != GRAPH_INVALID)
+    {
+        RenderGraphAccess(graph, graph_pass, pass->depth, GRAPH_DEPTH_ATTACHMENT);
+    }
+
+    // Targets the graph does not know as outputs are someone else's to
+    // consume, so passes into them must not be culled.
+    if(!graph->resources[pass->target].output)
+    {
+        RenderGraphSetSideEffect(graph, graph_pass);
+    }
+
+    engine->current_pass = pass;
+}
+
+void EngineEndRendering(Engine *engine)
+{
+    if(engine->capture)
+    {
+        CaptureEndRendering(engine->capture);
+    }
+
+    engine->current_pass = 0;
+}
+
+// Called between EngineBegin and EngineEnd. Without a separate compute
+// queue, or once the frame's compute work has been submitted, this is the
+// frame's graphics command buffer, and the work runs before the frame's
+// passes instead of next to them. Whatever the compute work binds is its
+// own; the frame's descriptor sets are only bound for graphics. Resources
+// it shares with graphics should be per frame slot, so that the graphics
+// frame that last read them is known to be done.
+VkCommandBuffer EngineBeginCompute(Engine *engine)
+{
+    if(!engine->device.async_compute || engine->compute_submitted)
+    {
+        return engine->command.cmds[engine->frame_idx];
+    }
+
+    VkCommandBuffer cmd = engine->compute_command.cmds[engine->frame_idx];
+    if(!engine->compute_recording)
+    {
+        VkCommandBufferBeginInfo begin = {};
+        begin.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        begin.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        vkBeginCommandBuffer(cmd, &begin);
+        engine->compute_recording = true;
+    }
+
+    return cmd;
+}
+
+// Hands a resource written by this frame's compute work to graphics. The
+// caller describes the last compute access and the first graphics access;
+// the queue families are filled in here. Returns false when the frame has
+// no room for more handoffs, in which case nothing was recorded.
+bool EngineComputeHandoff(Engine *engine, QueueTransfer transfer)
+{
+    if(engine->compute_handoff_count >= MAX_COMPUTE_HANDOFFS)
+    {
+        return false;
+    }
+
+    VkCommandBuffer cmd = EngineBeginCompute(engine);
+    transfer.src_family = engine->device.queue_family_index;
+    transfer.dst_family = engine->device.queue_family_index;
+    if(!engine->compute_recording)
+    {
+        QueueRelease(cmd, &transfer);
+        return true;
+    }
+
+    transfer.src_family = engine->device.compute_family_index;
+    QueueRelease(cmd, &transfer);
+    if(transfer.src_family != transfer.dst_family)
+    {
+        engine->compute_handoffs[engine->compute_handoff_count++] = transfer;
+    }
+
+    engine->compute_wait_stages |= transfer.dst_stages;
+    return true;
+}
+
+// Submits the frame's compute work. EngineEnd calls this if the caller did
+// not, but submitting as soon as the work is recorded lets it start while
+// the CPU is still recording graphics.
+void EngineEndCompute(Engine *engine)
+{
+    if(!engine->compute_recording)
+    {
+        return;
+    }
+
+    VkCommandBuffer cmd = engine->compute_command.cmds[engine->frame_idx];
+    vkEndCommandBuffer(cmd);
+    engine->compute_recording = false;
+    engine->compute_submitted = true;
+
+    u64 value = ++engine->compute_value;
+    engine->compute_values[engine->frame_idx] = value;
+
+    VkSemaphoreSubmitInfo signal_info = {};
+    signal_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+    signal_info.semaphore = engine->compute_timeline;
+    signal_info.value = value;
+    signal_info.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+
+    VkCommandBufferSubmitInfo cmd_info = {};
+    cmd_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
+    cmd_info.commandBuffer = cmd;
+
+    VkSubmitInfo2 submit = {};
+    submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
+    submit.commandBufferInfoCount = 1;
+    submit.pCommandBufferInfos = &cmd_info;
+    submit.signalSemaphoreInfoCount = 1;
+    submit.pSignalSemaphoreInfos = &signal_info;
+    vkQueueSubmit2(engine->device.compute_queue, 1, &submit, 0);
+}
+
+// The vertex shader only gets the final matrix, so model and view-projection
+// are multiplied once per draw here instead of once per vertex. Shader data
+// goes straight into the frame allocator; the draw index doubles as the
+// instance index the shaders read it with. Only meshes with a skin are
+// drawn skinned; the others ignore joint_base.
+static void EngineRecordDraw(Engine *engine, RenderPassData *pass, Model *model, HMM_Mat4 mvp, u32 joint_base)
+{
+    // Projected diameter of the bounding sphere in pixels drives which mip
+    // level the streamer keeps resident for this model's texture.
+    float height = pass->area.extent.height;
+    float w = mvp.Columns[3].W;
+    float scale_y = HMM_LenV3(HMM_V3(mvp.Elements[0][1], mvp.Elements[1][1], mvp.Elements[2][1]));
+    Mesh *mesh = &model->mesh;
+    AssetEntry *mesh_entry = AssetGet(engine->assets, model->mesh_asset);
+    if(mesh_entry)
+    {
+        mesh = &engine->meshes[mesh_entry->payload];
+    }
+
+    // A copy of a model whose mesh has been unloaded, or a released one.
+    else if(model->mesh_asset.index || !mesh->num_indices)
+    {
+        return;
+    }
+
+    float screen_size = w > mesh->bounds_radius ?
+        mesh->bounds_radius * scale_y / w * height : height * 16.0f;
+    StreamerRequest(&engine->streamer, model->material.texture_index, screen_size);
+
+    bool skinned = mesh->skin_vbo && joint_base != MESH_NO_JOINTS;
+    MeshDrawData *data = &engine->draw_data[engine->draw_count];
+    data->mvp = mvp;
+    data->material = model->material;
+    data->joint_base = joint_base;
+
+    DrawItem *draw = &engine->draws[engine->draw_count++];
+    draw->vbo = mesh->vbo;
+    draw->ibo = mesh->ibo;
+    draw->skin_vbo = skinned ? mesh->skin_vbo : 0;
+    draw->num_indices = mesh->num_indices;
+    draw->permutation = (model->permutation & ~MESH_SKINNED) % MESH_PERMUTATION_COUNT;
+    draw->permutation |= skinned ? MESH_SKINNED : 0;
+    pass->draw_count++;
+}
+
+void EngineDrawModel(Engine *engine, HMM_Mat4 transform, Model model, HMM_Mat4 world)
+{
+    if(engine->capture)
+    {
+        CaptureDraw(engine->capture, transform, model.capture_id, world);
+    }
+
+    RenderPassData *pass = engine->current_pass;
+    if(!pass || !engine->draw_data || engine->draw_count >= MAX_DRAWS)
+    {
+        return;
+    }
+
+    EngineRecordDraw(engine, pass, &model, transform * world, MESH_NO_JOINTS);
+}
+
+// Same as calling EngineDrawModel per model, with the matrix products done
+// in batches by the SIMD kernels.
+void EngineDrawModels(Engine *engine, HMM_Mat4 transform, Model *models, HMM_Mat4 *worlds, u32 count)
+{
+    if(engine->capture)
+    {
+        CaptureBeginBatch(engine->capture, transform, count);
+        for(u32 i = 0; i < count; i++)
+        {
+            CaptureBatchItem(engine->capture, models[i].capture_id, worlds[i]);
+        }
+    }
+
+    RenderPassData *pass = engine->current_pass;
+    if(!pass || !engine->draw_data)
+    {
+        return;
+    }
+
+    HMM_Mat4 mvps[DRAW_BATCH];
+    for(u32 first = 0; first < count; first += DRAW_BATCH)
+    {
+        u32 batch = count - first < DRAW_BATCH ? count - first : DRAW_BATCH;
+        MathMulMat4(mvps, transform, worlds + first, batch);
+        for(u32 i = 0; i < batch && engine->draw_count < MAX_DRAWS; i++)
+        {
+            EngineRecordDraw(engine, pass, &models[first + i], mvps[i], MESH_NO_JOINTS);
+        }
+    }
+}
+
+// Room for count joint matrices in this frame's region, for the palette of
+// a skinned draw; AnimUpdate can write straight into it. Returns 0 when the
+// region is full or outside EngineBegin and EngineEnd.
+HMM_Mat4 *EngineAllocJoints(Engine *engine, u32 count, u32 *joint_base)
+{
+    if(!engine->draw_data)
+    {
+        return 0;
+    }
+
+    u32 offset;
+    HMM_Mat4 *joints = (HMM_Mat4 *)FrameAlloc(&engine->frame_alloc, sizeof(HMM_Mat4) * count, &offset);
+    *joint_base = joints ? offset / sizeof(HMM_Vec4) : MESH_NO_JOINTS;
+    return joints;
+}
+
+// joint_base is from EngineAllocJoints this frame, with one matrix per
+// joint of the model's skin filled in. Without joints the mesh is drawn in
+// its bind pose.
+void EngineDrawSkinnedModel(Engine *engine, HMM_Mat4 transform, Model model, HMM_Mat4 world, u32 joint_base)
+{
+    // The capture reads the matrices back out of the frame region, which
+    // is slow from write-combined memory but only happens while capturing.
+    if(engine->capture)
+    {
+        const HMM_Mat4 *joints = 0;
+        u32 joint_count = 0;
+        if(joint_base != MESH_NO_JOINTS)
+        {
+            joints = (const HMM_Mat4 *)(engine->frame_alloc.mapped + (u64)joint_base * sizeof(HMM_Vec4));
+            joint_count = model.mesh.joint_count;
+        }
+
+        CaptureDrawSkinned(engine->capture, transform, model.capture_id, world, joints, joint_count);
+    }
+
+    RenderPassData *pass = engine->current_pass;
+    if(!pass || !engine->draw_data || engine->draw_count >= MAX_DRAWS)
+    {
+        return;
+    }
+
+    EngineRecordDraw(engine, pass, &model, transform * world, joint_base);
+}
+
+static void EngineLightPass(RenderGraph *graph, VkCommandBuffer cmd, void *data)
+{
+    Engine *engine = (Engine *)data;
+    u32 offsets[2] = {engine->draw_data_offset, engine->light_offset};
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, engine->light_pipeline);
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, engine->mesh_pipeline.layout.pipe_layout,
+                            1, 1, &engine->frame_set, 2, offsets);
+    vkCmdDispatch(cmd, (CLUSTER_COUNT + 63) / 64, 1, 1);
+    engine->stats.pipeline_binds++;
+    engine->stats.descriptor_binds++;
+}
+
+// Called between EngineBegin and the first EngineBeginRendering that should
+// be lit. The projection has to be a CameraSetProjection one, which keeps
+// the near plane in its last column. Lights are binned on the workers
+// before this returns, or with GPU binning by a compute pass ahead of the
+// frame's mesh passes, on the graphics queue since it is short and the
+// passes wait for it anyway.
+void EngineSetLights(Engine *engine, HMM_Mat4 view, HMM_Mat4 projection, HMM_Vec3 ambient,
+                     const PointLight *lights, u32 count)
+{
+    if(engine->capture)
+    {
+        CaptureSetLights(engine->capture, view, projection, ambient, lights, count);
+    }
+
+    if(!engine->light_block || !engine->lights)
+    {
+        return;
+    }
+
+    VkExtent2D extent = engine->dynres.enabled ? engine->scene_extent : engine->swapchain.render_area.extent;
+    LightClustersSetView(engine->lights, extent.width, extent.height, projection,
+                         projection.Elements[3][2], engine->light_far_plane);
+    LightClustersCull(engine->lights, view, ambient, lights, count, engine->light_block);
+
+    // Set twice in a frame, the pass already there bins the new lights. A
+    // mesh pass declared before the first call would read the clusters
+    // before a compute pass wrote them, so that goes to the workers.
+    if(engine->light_resource != GRAPH_INVALID)
+    {
+        return;
+    }
+
+    RenderGraph *graph = engine->graph;
+    u32 resource = GRAPH_INVALID;
+    u32 pass = GRAPH_INVALID;
+    if(engine->light_pipeline && engine->render_pass_count == 0)
+    {
+        resource = RenderGraphImportBuffer(graph, engine->frame_alloc.buffer);
+        pass = resource != GRAPH_INVALID ? RenderGraphAddPass(graph, "light clusters", EngineLightPass, engine) :
+                                           GRAPH_INVALID;
+    }
+
+    if(pass == GRAPH_INVALID)
+    {
+        LightClustersBin(engine->lights, engine->jobs);
+        return;
+    }
+
+    RenderGraphAccess(graph, pass, resource, GRAPH_STORAGE_WRITE);
+    engine->light_resource = resource;
+}
+
+GpuMemoryStats EngineGetMemoryStats(Engine *engine)
+{
+    return engine->device.memory->stats;
+}
+
+// Starts compacting now instead of waiting for fragmentation to cross the
+// threshold, e.g. after a level unload. Passes still run one per frame.
+void EngineDefragment(Engine *engine)
+{
+    GpuMemoryBeginDefrag(engine->device.memory);
+}
+
+// Writes out everything up to the last complete frame and stops
+// recording. DestroyEngine does this too, but cannot report a failure.
+bool EngineEndCapture(Engine *engine)
+{
+    if(!engine->capture)
+    {
+        return false;
+    }
 
-    VkDeviceSize offset = 0;
-    vkCmdBindVertexBuffers(cmd, 0, 1, &model.vbo, &offset);
-    vkCmdBindIndexBuffer(cmd, model.ibo, 0, VK_INDEX_TYPE_UINT32);
-    vkCmdDrawIndexed(cmd, model.num_indices, 1, 0, 0, 0);
+    bool ok = CaptureWrite(engine->capture, engine->capture_path);
+    DestroyCapture(engine->capture);
+    engine->capture = 0;
+    return ok;
 }
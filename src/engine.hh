@@ -1,13 +1,179 @@
 #ifndef ENGINE_H
 #define ENGINE_H
 
+#define TEXTURE_BUDGET (256 * MB)
+#define MAX_BINDLESS_TEXTURES MAX_STREAMED_TEXTURES
+#define MAX_MESHES 1024
+#define PIPELINE_CACHE_PATH "pipeline_cache.bin"
+#define MAX_DRAWS 4096
+#define DRAW_BATCH 64
+#define MAX_RENDER_PASSES 16
+#define MAX_COMPUTE_HANDOFFS 32
+#define MAX_PRELOADS 32
+#define READBACK_RING_SIZE (MAX_FRAMES + 1)
+#define HEADLESS_FORMAT VK_FORMAT_R8G8B8A8_UNORM
+#define MESH_VERTEX_USAGE (VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT)
+#define MESH_INDEX_USAGE (VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT)
+#define MESH_NO_JOINTS 0xffffffff
+
 #include "types.hh"
 #include "vk_utils.hh"
 #include "vk_pipeline.hh"
+#include "pipeline_library.hh"
+#include "render_graph.hh"
+#include "texture_stream.hh"
+#include "gpu_memory.hh"
+#include "destroy_queue.hh"
+#include "light_cluster.hh"
+#include "frame_alloc.hh"
+#include "dynamic_res.hh"
+#include "capture.hh"
+#include "telemetry.hh"
+#include "assets.hh"
+#include "jobs.hh"
+#include "arena_alloc.hh"
+#include "animation.hh"
 
 #include "third_party/vk_mem_alloc.h"
 #include "third_party/HandmadeMath.h"
 
+enum SamplerType
+{
+    SAMPLER_LINEAR_REPEAT,
+    SAMPLER_LINEAR_CLAMP,
+    SAMPLER_NEAREST_REPEAT,
+    SAMPLER_NEAREST_CLAMP,
+    SAMPLER_COUNT,
+};
+
+// Indices into the bindless texture array and the sampler table. Pushed per
+// draw, so changing material never touches a descriptor set.
+struct Material
+{
+    u32 texture_index;
+    u32 sampler_index;
+};
+
+enum MeshPermutationFlags
+{
+    MESH_ALPHA_TEST = 1 << 0,
+    MESH_DOUBLE_SIDED = 1 << 1,
+    MESH_BLEND = 1 << 2,
+    MESH_SKINNED = 1 << 3,
+    MESH_PERMUTATION_COUNT = 1 << 4,
+};
+
+enum MeshSpecConstant
+{
+    MESH_SPEC_ALPHA_TEST,
+    MESH_SPEC_SAMPLER_COUNT,
+    MESH_SPEC_COUNT,
+};
+
+struct MeshPermutation
+{
+    u32 pipeline;
+    PipelineState state;
+};
+
+// Per draw shader data, written into the frame allocator as draws are
+// recorded. Laid out as the std430 array the mesh shaders index with the
+// instance index. A skinned draw's joint matrices are in the frame
+// allocator's buffer at joint_base, counted in vec4s.
+struct MeshDrawData
+{
+    HMM_Mat4 mvp;
+    Material material;
+    u32 joint_base;
+    u32 padding;
+};
+
+// Draws are recorded into a list while a pass is open and replayed into the
+// command buffer when the frame graph executes that pass. Draw i reads
+// entry i of the frame's MeshDrawData block.
+struct DrawItem
+{
+    VkBuffer vbo;
+    VkBuffer ibo;
+    VkBuffer skin_vbo;
+    u32 num_indices;
+    u32 permutation;
+};
+
+struct Engine;
+
+struct RenderPassData
+{
+    Engine *engine;
+    u32 target;
+    u32 depth;
+    VkRect2D area;
+    VkClearValue clear;
+    u32 first_draw;
+    u32 draw_count;
+};
+
+// Throughput versus latency. More frames in flight keep the GPU busier,
+// fewer frames and the latency wait keep input closer to the screen.
+// Without a window the engine renders headless into an offscreen target of
+// the given size. A VRAM budget of zero takes whatever the driver reports;
+// either way streamed textures are squeezed to keep usage under it.
+// A target frame time turns on dynamic resolution: the scene is rendered
+// at a scale, down to the minimum, that keeps GPU time under the target.
+// A capture path records every call to the API below for the replayer.
+// A telemetry name publishes per-frame counters in shared memory under it.
+// Without a window, create_window is called on the calling thread while
+// the device is being created, so the two overlap. The files of preloaded
+// models are read on workers during startup; loading them afterwards then
+// skips the disk. Lights are binned into clusters out to light_far_plane,
+// on workers or, with gpu_light_binning, in a compute pass.
+struct EngineConfig
+{
+    void *window;
+    void *(*create_window)(void *data);
+    void *window_data;
+    u32 width;
+    u32 height;
+    u32 frames_in_flight;
+    VkPresentModeKHR present_mode;
+    bool low_latency;
+    u64 vram_budget;
+    float target_frame_ms;
+    float min_render_scale;
+    const char *capture_path;
+    const char *telemetry_name;
+    const AssetId *preload_models;
+    u32 preload_model_count;
+    float light_far_plane;
+    bool gpu_light_binning;
+};
+
+// A file read and hashed during startup, waiting for the load that uses it.
+struct PreloadedFile
+{
+    AssetId asset;
+    MappedFile file;
+    u64 content_hash;
+};
+
+struct ReadbackBuffer
+{
+    VkBuffer buffer;
+    VmaAllocation alloc;
+    void *mapped;
+    u64 frame;
+};
+
+// Tightly packed HEADLESS_FORMAT pixels, valid until the next EngineEnd.
+struct ReadbackFrame
+{
+    u64 frame;
+    u32 width;
+    u32 height;
+    u32 row_pitch;
+    void *pixels;
+};
+
 struct Engine
 {
     VkInstance instance;
@@ -21,13 +187,114 @@ struct Engine
     SyncStructs sync;
     Command command;
 
-    VkDescriptorPool mesh_pool;
+    VkDescriptorPool bindless_pool;
+    VkDescriptorSet bindless_set;
+    VkDescriptorSet frame_set;
+    FrameAllocator frame_alloc;
+    VkSampler samplers[SAMPLER_COUNT];
+    TextureStreamer streamer;
+
+    // Unloaded objects are queued until every frame that could use them has
+    // retired, and their mesh and texture slots only come free then.
+    AssetRegistry *assets;
+    u32 mesh_count;
+    Mesh *meshes;
+    u32 free_mesh_count;
+    u32 *free_meshes;
+    DestroyQueue *destroy;
 
     u32 frame_idx;
+    u32 frames_in_flight;
+    u64 frame_number;
+    bool low_latency;
+
+    bool headless;
+    Texture offscreen;
+    u64 readback_next;
+    ReadbackBuffer readbacks[READBACK_RING_SIZE];
+    JobQueue *jobs;
+    VkPipelineCache pipeline_cache;
+    PipelineLibrary *pipelines;
+
+    PipelineDesc mesh_desc;
     Pipeline mesh_pipeline;
+    MeshPermutation mesh_permutations[MESH_PERMUTATION_COUNT];
+
+    RenderGraph *graph;
+    u32 swap_resource;
+    u32 draw_count;
+    DrawItem *draws;
+    MeshDrawData *draw_data;
+    u32 draw_data_offset;
+    u32 render_pass_count;
+    RenderPassData render_passes[MAX_RENDER_PASSES];
+    RenderPassData *current_pass;
+
+    // The frame's lights go into a block of the frame allocator that the
+    // fragment shader reads through set 1. Until EngineSetLights is called
+    // the block has no lights and full ambient, which leaves textures as
+    // they are.
+    LightClusters *lights;
+    ClusterBlock *light_block;
+    u32 light_offset;
+    u32 light_resource;
+    float light_far_plane;
+    VkPipeline light_pipeline;
+
+    u32 defrag_retired_count;
+    VkBuffer defrag_retired[GPU_DEFRAG_MAX_MOVES_PER_PASS];
+
+    // Two timestamps per frame slot bracket the whole frame. They are read
+    // when the slot comes around again, after its wait.
+    VkQueryPool frame_queries;
+    bool frame_query_pending[MAX_FRAMES];
+    u64 timestamp_mask;
+    float ns_per_tick;
+    float gpu_ms;
+
+    // With dynamic resolution the scene goes into a full size offscreen
+    // target, of which only the scaled rectangle is used, and is blitted
+    // up to the swapchain image at the end of the frame.
+    DynamicResolution dynres;
+    Texture scene;
+    VkExtent2D scene_extent;
+    u32 scene_resource;
+    bool scene_rendered;
+
+    // Compute work of a frame goes into its own command buffer on the
+    // compute queue and is submitted ahead of the frame's graphics work, so
+    // it runs alongside whatever graphics work is still in flight. A second
+    // timeline counts compute submits; the graphics submit waits on it only
+    // at the stages that consume handed off resources.
+    Command compute_command;
+    VkSemaphore compute_timeline;
+    u64 compute_value;
+    u64 compute_values[MAX_FRAMES];
+    bool compute_recording;
+    bool compute_submitted;
+    VkPipelineStageFlags2 compute_wait_stages;
+    u32 compute_handoff_count;
+    QueueTransfer compute_handoffs[MAX_COMPUTE_HANDOFFS];
+
+    Capture *capture;
+    const char *capture_path;
+
+    // Counters for the frame being recorded, published at the end of
+    // EngineEnd when telemetry is on.
+    Arena *arena;
+    Telemetry telemetry;
+    TelemetryFrame stats;
+    u64 frame_start;
+    u64 uploaded_bytes;
+    u64 uploaded_reported;
+
+    // How long each part of CreateEngine took, kept for reporting.
+    JobGraph *startup;
+    u32 preload_count;
+    PreloadedFile preloads[MAX_PRELOADS];
 };
 
-struct Model
+struct Mesh
 {
     VkBuffer vbo;
     VmaAllocation vbo_alloc;
@@ -35,24 +302,68 @@ struct Model
     VkBuffer ibo;
     VmaAllocation ibo_alloc;
     u32 num_indices;
+    u32 vertex_bytes;
 
-    Texture texture;
-    VkSampler tex_sampler;
-    VkDescriptorSet set;
+    // Joint indices and weights, when the file has a skin.
+    VkBuffer skin_vbo;
+    VmaAllocation skin_alloc;
+    u32 joint_count;
 
-    HMM_Mat4 model_matrix;
+    float bounds_radius;
 };
 
-Engine CreateEngine(HWND window);
-Model EngineLoadCompiledModel(Engine *engine, const char *file_path);
+// Models loaded from the same file, or from files with identical contents,
+// share one Mesh and one texture through the asset registry. Drawing goes
+// through the registry too, since defragmentation can move the buffers
+// after the copy here was taken. Where a model is placed is not part of
+// it; world matrices come from a TransformSystem or the caller.
+struct Model
+{
+    AssetHandle mesh_asset;
+    AssetHandle texture_asset;
+
+    Mesh mesh;
+    Texture texture;
+    Material material;
+    u32 permutation;
+    u32 capture_id;
+};
+
+EngineConfig DefaultEngineConfig(void);
+Engine CreateEngine(Arena *arena, EngineConfig config);
+void DestroyEngine(Engine *engine);
+PipelineDesc EngineMeshPipelineDesc(Engine *engine, u32 permutation);
+Model EngineLoadCompiledModel(Engine *engine, AssetId asset);
+void EngineReleaseModel(Engine *engine, Model *model);
+void EngineUnloadModel(Engine *engine, Model *model);
+u32 EngineUnloadUnused(Engine *engine);
 
 u32 EngineBegin(Engine *engine);
 void EngineEnd(Engine *engine, uint32_t img_idx);
+void EngineWaitLatency(Engine *engine);
+bool EngineReadback(Engine *engine, ReadbackFrame *frame, bool wait);
 
 Texture EngineGetSwapChainImage(Engine *engine, u32 img_idx);
+Texture EngineGetSceneTarget(Engine *engine, u32 img_idx);
+float EngineGetGpuTime(Engine *engine);
+float EngineGetRenderScale(Engine *engine);
+TelemetryFrame EngineGetFrameStats(Engine *engine);
 void EngineBeginRendering(Engine *engine, Texture target, Texture *depth, VkClearValue clear_color);
 void EngineEndRendering(Engine *engine);
 
-void EngineDrawModel(Engine *engine, HMM_Mat4 transform, Model model);
+VkCommandBuffer EngineBeginCompute(Engine *engine);
+bool EngineComputeHandoff(Engine *engine, QueueTransfer transfer);
+void EngineEndCompute(Engine *engine);
+
+void EngineDrawModel(Engine *engine, HMM_Mat4 transform, Model model, HMM_Mat4 world);
+void EngineDrawModels(Engine *engine, HMM_Mat4 transform, Model *models, HMM_Mat4 *worlds, u32 count);
+HMM_Mat4 *EngineAllocJoints(Engine *engine, u32 count, u32 *joint_base);
+void EngineDrawSkinnedModel(Engine *engine, HMM_Mat4 transform, Model model, HMM_Mat4 world, u32 joint_base);
+void EngineSetLights(Engine *engine, HMM_Mat4 view, HMM_Mat4 projection, HMM_Vec3 ambient,
+                     const PointLight *lights, u32 count);
+
+GpuMemoryStats EngineGetMemoryStats(Engine *engine);
+void EngineDefragment(Engine *engine);
+bool EngineEndCapture(Engine *engine);
 
 #endif //ENGINE_H
@@ -0,0 +1,179 @@
+#include "frame_alloc.hh"
+#include "gpu_memory.hh"
+
+static VkBuffer CreateFrameBuffer(Device device, VkDeviceSize size, VkBufferUsageFlags usage,
+                                  VmaAllocationCreateFlags flags, VmaMemoryUsage memory_usage,
+                                  VmaAllocation *alloc, void **mapped)
+{
+    VkBufferCreateInfo buff_info = {};
+    buff_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buff_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    buff_info.usage = usage;
+    buff_info.size = size;
+
+    VmaAllocationCreateInfo alloc_info = {};
+    alloc_info.flags = flags;
+    alloc_info.usage = memory_usage;
+
+    VkBuffer buffer = 0;
+    VmaAllocationInfo info = {};
+    if(vmaCreateBuffer(device.allocator, &buff_info, &alloc_info, &buffer, alloc, &info) != VK_SUCCESS)
+    {
+        *alloc = 0;
+        return 0;
+    }
+
+    GpuMemoryTrack(device, GPU_MEMORY_FRAME, *alloc);
+    *mapped = info.pMappedData;
+    return buffer;
+}
+
+// VMA picks device local, host visible memory when there is any and falls
+// back to plain device memory otherwise, in which case a host visible
+// staging twin is created for the writes.
+void CreateFrameAllocator(FrameAllocator *allocator, Device device, u64 frame_size, u32 frame_count)
+{
+    *allocator = {};
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(device.adapter, &properties);
+    u64 alignment = 16;
+    if(properties.limits.minUniformBufferOffsetAlignment > alignment)
+    {
+        alignment = properties.limits.minUniformBufferOffsetAlignment;
+    }
+
+    if(properties.limits.minStorageBufferOffsetAlignment > alignment)
+    {
+        alignment = properties.limits.minStorageBufferOffsetAlignment;
+    }
+
+    allocator->alignment = (u32)alignment;
+    allocator->frame_count = frame_count;
+    allocator->frame_size = (frame_size + alignment - 1) & ~(alignment - 1);
+
+    void *mapped = 0;
+    VkDeviceSize size = allocator->frame_size * frame_count;
+    allocator->buffer = CreateFrameBuffer(device, size, FRAME_ALLOC_USAGE | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                          VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT |
+                                          VMA_ALLOCATION_CREATE_HOST_ACCESS_ALLOW_TRANSFER_INSTEAD_BIT |
+                                          VMA_ALLOCATION_CREATE_MAPPED_BIT,
+                                          VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE, &allocator->alloc, &mapped);
+    if(!allocator->buffer)
+    {
+        return;
+    }
+
+    VkMemoryPropertyFlags memory_flags = 0;
+    vmaGetAllocationMemoryProperties(device.allocator, allocator->alloc, &memory_flags);
+    if(!(memory_flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT))
+    {
+        allocator->staging = CreateFrameBuffer(device, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                               VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT |
+                                               VMA_ALLOCATION_CREATE_MAPPED_BIT,
+                                               VMA_MEMORY_USAGE_AUTO, &allocator->staging_alloc, &mapped);
+    }
+
+    allocator->mapped = (u8 *)mapped;
+}
+
+void DestroyFrameAllocator(FrameAllocator *allocator, Device device)
+{
+    if(allocator->staging)
+    {
+        GpuMemoryRelease(device, GPU_MEMORY_FRAME, allocator->staging_alloc);
+        vmaDestroyBuffer(device.allocator, allocator->staging, allocator->staging_alloc);
+    }
+
+    if(allocator->buffer)
+    {
+        GpuMemoryRelease(device, GPU_MEMORY_FRAME, allocator->alloc);
+        vmaDestroyBuffer(device.allocator, allocator->buffer, allocator->alloc);
+    }
+
+    *allocator = {};
+}
+
+// Called once the frame slot's previous submission has finished on the GPU.
+void FrameAllocBegin(FrameAllocator *allocator, u32 frame)
+{
+    allocator->frame = frame % allocator->frame_count;
+    allocator->begin = allocator->frame * allocator->frame_size;
+    allocator->head = allocator->begin;
+    allocator->used = 0;
+}
+
+// Returns 0 when the frame's region is full; the caller drops whatever it
+// wanted to write. Failures are counted so the region size can be tuned.
+void *FrameAlloc(FrameAllocator *allocator, u64 size, u32 *offset)
+{
+    if(!allocator->mapped)
+    {
+        return 0;
+    }
+
+    u64 mask = allocator->alignment - 1;
+    u64 start = (allocator->head + mask) & ~mask;
+    if(start + size > allocator->begin + allocator->frame_size)
+    {
+        allocator->failed++;
+        return 0;
+    }
+
+    allocator->head = start + size;
+    allocator->used = allocator->head - allocator->begin;
+    if(allocator->used > allocator->peak)
+    {
+        allocator->peak = allocator->used;
+    }
+
+    *offset = (u32)start;
+    return allocator->mapped + start;
+}
+
+// Recorded after the last allocation of the frame and before anything that
+// reads it. Mapped memory written before the submit is visible to the GPU
+// without a barrier; only the staging copy needs one, which also covers
+// compute passes that fill in parts of a block afterwards.
+void FrameAllocFlush(FrameAllocator *allocator, Device device, VkCommandBuffer cmd)
+{
+    u64 size = allocator->head - allocator->begin;
+    if(size == 0)
+    {
+        return;
+    }
+
+    if(!allocator->staging)
+    {
+        vmaFlushAllocation(device.allocator, allocator->alloc, allocator->begin, size);
+        return;
+    }
+
+    vmaFlushAllocation(device.allocator, allocator->staging_alloc, allocator->begin, size);
+
+    VkBufferCopy region = {};
+    region.srcOffset = allocator->begin;
+    region.dstOffset = allocator->begin;
+    region.size = size;
+    vkCmdCopyBuffer(cmd, allocator->staging, allocator->buffer, 1, &region);
+
+    VkBufferMemoryBarrier2 barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2;
+    barrier.srcStageMask = VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT;
+    barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+    barrier.dstStageMask = VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT |
+                           VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+    barrier.dstAccessMask = VK_ACCESS_2_UNIFORM_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_READ_BIT |
+                            VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = allocator->buffer;
+    barrier.offset = allocator->begin;
+    barrier.size = size;
+
+    VkDependencyInfo dependency = {};
+    dependency.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    dependency.bufferMemoryBarrierCount = 1;
+    dependency.pBufferMemoryBarriers = &barrier;
+    vkCmdPipelineBarrier2(cmd, &dependency);
+}
@@ -0,0 +1,55 @@
+#ifndef FRAME_ALLOC_H
+#define FRAME_ALLOC_H
+
+#define FRAME_ALLOC_SIZE (4 * MB)
+#define FRAME_ALLOC_USAGE (VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT)
+
+#include <vulkan/vulkan.h>
+
+#include "types.hh"
+#include "vk_utils.hh"
+#include "arena_alloc.hh"
+#include "third_party/vk_mem_alloc.h"
+
+// Linear allocator for data that lives for one frame: uniforms, per draw
+// and per instance data. One buffer is split into a region per frame in
+// flight and stays mapped for the engine's lifetime. A region is reset
+// once the timeline says the frame that last used it has finished, so
+// allocating is a pointer bump and nothing is created or freed per frame.
+//
+// Offsets are relative to the start of the buffer and aligned for both
+// uniform and storage dynamic offsets. Memory may be write-combined: write
+// it sequentially and never read it back.
+//
+// The buffer is device local and host visible where the device has such
+// memory. Otherwise writes go to a host side twin of the buffer and
+// FrameAllocFlush records a copy of the used range before the frame's
+// draws.
+struct FrameAllocator
+{
+    VkBuffer buffer;
+    VmaAllocation alloc;
+    VkBuffer staging;
+    VmaAllocation staging_alloc;
+    u8 *mapped;
+
+    u64 frame_size;
+    u32 frame_count;
+    u32 alignment;
+
+    u32 frame;
+    u64 begin;
+    u64 head;
+
+    u64 used;
+    u64 peak;
+    u32 failed;
+};
+
+void CreateFrameAllocator(FrameAllocator *allocator, Device device, u64 frame_size, u32 frame_count);
+void DestroyFrameAllocator(FrameAllocator *allocator, Device device);
+void FrameAllocBegin(FrameAllocator *allocator, u32 frame);
+void *FrameAlloc(FrameAllocator *allocator, u64 size, u32 *offset);
+void FrameAllocFlush(FrameAllocator *allocator, Device device, VkCommandBuffer cmd);
+
+#endif //FRAME_ALLOC_H
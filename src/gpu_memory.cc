@@ -0,0 +1,158 @@
+#include "gpu_memory.hh"
+
+void CreateGpuMemory(GpuMemory *memory, Device device, u64 budget)
+{
+    *memory = {};
+    memory->allocator = device.allocator;
+    memory->budget = budget;
+    GpuMemoryUpdate(memory, 0);
+}
+
+void GpuMemoryTrack(Device device, GpuMemoryCategory category, VmaAllocation alloc)
+{
+    if(!device.memory || !alloc)
+    {
+        return;
+    }
+
+    VmaAllocationInfo info;
+    vmaGetAllocationInfo(device.allocator, alloc, &info);
+
+    GpuCategoryStats *stats = &device.memory->categories[category];
+    stats->bytes += info.size;
+    stats->allocations++;
+    if(stats->bytes > stats->peak_bytes)
+    {
+        stats->peak_bytes = stats->bytes;
+    }
+}
+
+// Has to be called before the allocation is freed.
+void GpuMemoryRelease(Device device, GpuMemoryCategory category, VmaAllocation alloc)
+{
+    if(!device.memory || !alloc)
+    {
+        return;
+    }
+
+    VmaAllocationInfo info;
+    vmaGetAllocationInfo(device.allocator, alloc, &info);
+
+    GpuCategoryStats *stats = &device.memory->categories[category];
+    stats->bytes -= info.size;
+    stats->allocations--;
+}
+
+// Once per frame. The frame index lets VMA refresh its cached budget from
+// the driver instead of querying it on every call.
+void GpuMemoryUpdate(GpuMemory *memory, u64 frame)
+{
+    vmaSetCurrentFrameIndex(memory->allocator, (u32)frame);
+
+    const VkPhysicalDeviceMemoryProperties *properties;
+    vmaGetMemoryProperties(memory->allocator, &properties);
+
+    VmaBudget budgets[VK_MAX_MEMORY_HEAPS];
+    vmaGetHeapBudgets(memory->allocator, budgets);
+
+    GpuMemoryStats *stats = &memory->stats;
+    stats->heap_count = properties->memoryHeapCount;
+    stats->vram_budget = 0;
+    stats->vram_usage = 0;
+    for(u32 i = 0; i < properties->memoryHeapCount; i++)
+    {
+        GpuHeapStats *heap = &stats->heaps[i];
+        heap->device_local = (properties->memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+        heap->size = properties->memoryHeaps[i].size;
+        heap->budget = budgets[i].budget;
+        heap->usage = budgets[i].usage;
+        heap->block_bytes = budgets[i].statistics.blockBytes;
+        heap->allocation_bytes = budgets[i].statistics.allocationBytes;
+
+        if(heap->device_local)
+        {
+            stats->vram_budget += heap->budget;
+            stats->vram_usage += heap->usage;
+        }
+    }
+
+    if(memory->budget && memory->budget < stats->vram_budget)
+    {
+        stats->vram_budget = memory->budget;
+    }
+
+    stats->over_budget = stats->vram_usage > stats->vram_budget;
+    stats->defragmenting = memory->defrag != 0;
+    for(u32 i = 0; i < GPU_MEMORY_CATEGORY_COUNT; i++)
+    {
+        stats->categories[i] = memory->categories[i];
+    }
+}
+
+// Worth compacting when a good share of the device local blocks is free
+// space. Checked at an interval so that waste held by allocations nobody
+// can move does not restart a fruitless defragmentation every frame.
+bool GpuMemoryWantsDefrag(GpuMemory *memory, u64 frame)
+{
+    if(memory->defrag || frame < memory->last_check_frame + GPU_DEFRAG_CHECK_FRAMES)
+    {
+        return false;
+    }
+
+    memory->last_check_frame = frame;
+
+    u64 block_bytes = 0;
+    u64 allocation_bytes = 0;
+    for(u32 i = 0; i < memory->stats.heap_count; i++)
+    {
+        GpuHeapStats *heap = &memory->stats.heaps[i];
+        if(heap->device_local)
+        {
+            block_bytes += heap->block_bytes;
+            allocation_bytes += heap->allocation_bytes;
+        }
+    }
+
+    u64 waste = block_bytes - allocation_bytes;
+    return waste > GPU_DEFRAG_MIN_WASTE && waste > block_bytes / 4;
+}
+
+bool GpuMemoryBeginDefrag(GpuMemory *memory)
+{
+    if(memory->defrag)
+    {
+        return true;
+    }
+
+    VmaDefragmentationInfo info = {};
+    info.flags = VMA_DEFRAGMENTATION_FLAG_ALGORITHM_BALANCED_BIT;
+    info.maxBytesPerPass = GPU_DEFRAG_MAX_BYTES_PER_PASS;
+    info.maxAllocationsPerPass = GPU_DEFRAG_MAX_MOVES_PER_PASS;
+
+    if(vmaBeginDefragmentation(memory->allocator, &info, &memory->defrag) != VK_SUCCESS)
+    {
+        memory->defrag = 0;
+        return false;
+    }
+
+    memory->pass_open = false;
+    memory->stats.defrag_passes = 0;
+    memory->stats.defrag_bytes_moved = 0;
+    memory->stats.defrag_allocations_moved = 0;
+    return true;
+}
+
+void GpuMemoryEndDefrag(GpuMemory *memory)
+{
+    if(!memory->defrag)
+    {
+        return;
+    }
+
+    VmaDefragmentationStats result = {};
+    vmaEndDefragmentation(memory->allocator, memory->defrag, &result);
+    memory->defrag = 0;
+    memory->pass_open = false;
+    memory->stats.defrag_bytes_moved = result.bytesMoved;
+    memory->stats.defrag_allocations_moved = result.allocationsMoved;
+}
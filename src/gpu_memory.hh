@@ -0,0 +1,93 @@
+#ifndef GPU_MEMORY_H
+#define GPU_MEMORY_H
+
+#define GPU_DEFRAG_CHECK_FRAMES 120
+#define GPU_DEFRAG_MIN_WASTE (32 * MB)
+#define GPU_DEFRAG_MAX_BYTES_PER_PASS (16 * MB)
+#define GPU_DEFRAG_MAX_MOVES_PER_PASS 64
+#define GPU_MIN_TEXTURE_BUDGET (16 * MB)
+
+#include <vulkan/vulkan.h>
+
+#include "types.hh"
+#include "vk_utils.hh"
+#include "arena_alloc.hh"
+#include "third_party/vk_mem_alloc.h"
+
+enum GpuMemoryCategory
+{
+    GPU_MEMORY_MESH,
+    GPU_MEMORY_TEXTURE,
+    GPU_MEMORY_STAGING,
+    GPU_MEMORY_RENDER_TARGET,
+    GPU_MEMORY_FRAME,
+    GPU_MEMORY_CATEGORY_COUNT,
+};
+
+struct GpuCategoryStats
+{
+    u64 bytes;
+    u64 peak_bytes;
+    u32 allocations;
+};
+
+// Budget and usage come from VK_EXT_memory_budget when the driver has it,
+// otherwise VMA estimates them from its own blocks and the heap size.
+// Block bytes are what VMA holds from the driver, allocation bytes what is
+// handed out of them; the difference is free space inside the blocks.
+struct GpuHeapStats
+{
+    bool device_local;
+    u64 size;
+    u64 budget;
+    u64 usage;
+    u64 block_bytes;
+    u64 allocation_bytes;
+};
+
+struct GpuMemoryStats
+{
+    u32 heap_count;
+    GpuHeapStats heaps[VK_MAX_MEMORY_HEAPS];
+    GpuCategoryStats categories[GPU_MEMORY_CATEGORY_COUNT];
+
+    // Summed over the device local heaps. Budget is the configured one
+    // when set, clamped to what the driver reports.
+    u64 vram_budget;
+    u64 vram_usage;
+    bool over_budget;
+
+    bool defragmenting;
+    u32 defrag_passes;
+    u64 defrag_bytes_moved;
+    u32 defrag_allocations_moved;
+};
+
+// Allocations are tagged with a category where they are made, so that the
+// per-category numbers are exact rather than derived from heap totals.
+// Device carries a pointer to this so every module can report into it.
+struct GpuMemory
+{
+    VmaAllocator allocator;
+    u64 budget;
+    GpuCategoryStats categories[GPU_MEMORY_CATEGORY_COUNT];
+    GpuMemoryStats stats;
+
+    // An incremental defragmentation moves at most one pass per frame. A
+    // pass is ended once the frame that copied its allocations retires.
+    VmaDefragmentationContext defrag;
+    VmaDefragmentationPassMoveInfo pass;
+    bool pass_open;
+    u64 pass_frame;
+    u64 last_check_frame;
+};
+
+void CreateGpuMemory(GpuMemory *memory, Device device, u64 budget);
+void GpuMemoryTrack(Device device, GpuMemoryCategory category, VmaAllocation alloc);
+void GpuMemoryRelease(Device device, GpuMemoryCategory category, VmaAllocation alloc);
+void GpuMemoryUpdate(GpuMemory *memory, u64 frame);
+bool GpuMemoryWantsDefrag(GpuMemory *memory, u64 frame);
+bool GpuMemoryBeginDefrag(GpuMemory *memory);
+void GpuMemoryEndDefrag(GpuMemory *memory);
+
+#endif //GPU_MEMORY_H
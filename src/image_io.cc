@@ -0,0 +1,706 @@
+#include <windows.h>
+#include <string.h>
+#include "image_io.hh"
+
+struct InflateState
+{
+    const u8 *in;
+    u64 in_size;
+    u64 in_pos;
+    u32 bit_buf;
+    u32 bit_count;
+
+    u8 *out;
+    u64 out_size;
+    u64 out_pos;
+    bool error;
+};
+
+struct Huffman
+{
+    u16 counts[16];
+    u16 symbols[288];
+};
+
+static const u16 length_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+
+static const u16 length_extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+
+static const u16 dist_base[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+    8193, 12289, 16385, 24577
+};
+
+static const u16 dist_extra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+static u32 InflateBits(InflateState *s, u32 need)
+{
+    u32 value = s->bit_buf;
+    while(s->bit_count < need)
+    {
+        if(s->in_pos >= s->in_size)
+        {
+            s->error = true;
+            return 0;
+        }
+
+        value |= (u32)s->in[s->in_pos++] << s->bit_count;
+        s->bit_count += 8;
+    }
+
+    s->bit_buf = (u32)((u64)value >> need);
+    s->bit_count -= need;
+    return value & (u32)((1ull << need) - 1);
+}
+
+static bool HuffmanBuild(Huffman *h, const u8 *lengths, u32 count)
+{
+    memset(h->counts, 0, sizeof(h->counts));
+    for(u32 i = 0; i < count; i++)
+    {
+        h->counts[lengths[i]]++;
+    }
+
+    if(h->counts[0] == count)
+    {
+        return true;
+    }
+
+    int left = 1;
+    for(u32 len = 1; len < 16; len++)
+    {
+        left <<= 1;
+        left -= h->counts[len];
+        if(left < 0)
+        {
+            return false;
+        }
+    }
+
+    u16 offsets[16];
+    offsets[1] = 0;
+    for(u32 len = 1; len < 15; len++)
+    {
+        offsets[len + 1] = offsets[len] + h->counts[len];
+    }
+
+    for(u32 i = 0; i < count; i++)
+    {
+        if(lengths[i])
+        {
+            h->symbols[offsets[lengths[i]]++] = (u16)i;
+        }
+    }
+
+    return true;
+}
+
+static int HuffmanDecode(InflateState *s, Huffman *h)
+{
+    int code = 0;
+    int first = 0;
+    int index = 0;
+    for(u32 len = 1; len < 16; len++)
+    {
+        code |= InflateBits(s, 1);
+        int count = h->counts[len];
+        if(code - count < first)
+        {
+            return h->symbols[index + (code - first)];
+        }
+
+        index += count;
+        first += count;
+        first <<= 1;
+        code <<= 1;
+    }
+
+    s->error = true;
+    return -1;
+}
+
+static bool InflateStored(InflateState *s)
+{
+    s->bit_buf = 0;
+    s->bit_count = 0;
+
+    if(s->in_pos + 4 > s->in_size)
+    {
+        return false;
+    }
+
+    u32 len = s->in[s->in_pos] | (s->in[s->in_pos + 1] << 8);
+    u32 nlen = s->in[s->in_pos + 2] | (s->in[s->in_pos + 3] << 8);
+    s->in_pos += 4;
+
+    if(len != (~nlen & 0xffff) || s->in_pos + len > s->in_size || s->out_pos + len > s->out_size)
+    {
+        return false;
+    }
+
+    memcpy(s->out + s->out_pos, s->in + s->in_pos, len);
+    s->in_pos += len;
+    s->out_pos += len;
+    return true;
+}
+
+static bool InflateCodes(InflateState *s, Huffman *lit, Huffman *dist)
+{
+    for(;;)
+    {
+        int symbol = HuffmanDecode(s, lit);
+        if(s->error || symbol < 0)
+        {
+            return false;
+        }
+
+        if(symbol < 256)
+        {
+            if(s->out_pos >= s->out_size)
+            {
+                return false;
+            }
+
+            s->out[s->out_pos++] = (u8)symbol;
+        }
+
+        else if(symbol == 256)
+        {
+            return true;
+        }
+
+        else
+        {
+            symbol -= 257;
+            if(symbol >= 29)
+            {
+                return false;
+            }
+
+            u32 length = length_base[symbol] + InflateBits(s, length_extra[symbol]);
+
+            int dist_symbol = HuffmanDecode(s, dist);
+            if(s->error || dist_symbol < 0 || dist_symbol >= 30)
+            {
+                return false;
+            }
+
+            u32 distance = dist_base[dist_symbol] + InflateBits(s, dist_extra[dist_symbol]);
+            if(s->error || distance > s->out_pos || s->out_pos + length > s->out_size)
+            {
+                return false;
+            }
+
+            u8 *dst = s->out + s->out_pos;
+            u8 *src = dst - distance;
+            for(u32 i = 0; i < length; i++)
+            {
+                dst[i] = src[i];
+            }
+
+            s->out_pos += length;
+        }
+    }
+}
+
+static bool InflateFixed(InflateState *s)
+{
+    u8 lengths[288 + 30];
+    u32 i = 0;
+    for(; i < 144; i++) lengths[i] = 8;
+    for(; i < 256; i++) lengths[i] = 9;
+    for(; i < 280; i++) lengths[i] = 7;
+    for(; i < 288; i++) lengths[i] = 8;
+    for(; i < 288 + 30; i++) lengths[i] = 5;
+
+    Huffman lit, dist;
+    HuffmanBuild(&lit, lengths, 288);
+    HuffmanBuild(&dist, lengths + 288, 30);
+    return InflateCodes(s, &lit, &dist);
+}
+
+static bool InflateDynamic(InflateState *s)
+{
+    static const u8 order[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+    u32 lit_count = InflateBits(s, 5) + 257;
+    u32 dist_count = InflateBits(s, 5) + 1;
+    u32 code_count = InflateBits(s, 4) + 4;
+    if(lit_count > 286 || dist_count > 30)
+    {
+        return false;
+    }
+
+    u8 lengths[288 + 32] = {};
+    for(u32 i = 0; i < code_count; i++)
+    {
+        lengths[order[i]] = (u8)InflateBits(s, 3);
+    }
+
+    Huffman code_lengths;
+    if(!HuffmanBuild(&code_lengths, lengths, 19))
+    {
+        return false;
+    }
+
+    u32 index = 0;
+    while(index < lit_count + dist_count)
+    {
+        int symbol = HuffmanDecode(s, &code_lengths);
+        if(s->error || symbol < 0)
+        {
+            return false;
+        }
+
+        if(symbol < 16)
+        {
+            lengths[index++] = (u8)symbol;
+            continue;
+        }
+
+        u8 value = 0;
+        u32 repeat = 0;
+        if(symbol == 16)
+        {
+            if(index == 0)
+            {
+                return false;
+            }
+
+            value = lengths[index - 1];
+            repeat = 3 + InflateBits(s, 2);
+        }
+
+        else if(symbol == 17)
+        {
+            repeat = 3 + InflateBits(s, 3);
+        }
+
+        else
+        {
+            repeat = 11 + InflateBits(s, 7);
+        }
+
+        if(index + repeat > lit_count + dist_count)
+        {
+            return false;
+        }
+
+        while(repeat--)
+        {
+            lengths[index++] = value;
+        }
+    }
+
+    Huffman lit, dist;
+    if(!HuffmanBuild(&lit, lengths, lit_count) ||
+       !HuffmanBuild(&dist, lengths + lit_count, dist_count))
+    {
+        return false;
+    }
+
+    return InflateCodes(s, &lit, &dist);
+}
+
+static bool Inflate(const u8 *in, u64 in_size, u8 *out, u64 out_size)
+{
+    InflateState s = {};
+    s.in = in;
+    s.in_size = in_size;
+    s.out = out;
+    s.out_size = out_size;
+
+    u32 last = 0;
+    while(!last)
+    {
+        last = InflateBits(&s, 1);
+        u32 type = InflateBits(&s, 2);
+
+        bool ok = false;
+        switch(type)
+        {
+            case 0: ok = InflateStored(&s); break;
+            case 1: ok = InflateFixed(&s); break;
+            case 2: ok = InflateDynamic(&s); break;
+            default: break;
+        }
+
+        if(!ok || s.error)
+        {
+            return false;
+        }
+    }
+
+    return s.out_pos == out_size;
+}
+
+static u32 ReadBE32(const u8 *p)
+{
+    return ((u32)p[0] << 24) | ((u32)p[1] << 16) | ((u32)p[2] << 8) | p[3];
+}
+
+static u8 PaethPredictor(int a, int b, int c)
+{
+    int p = a + b - c;
+    int pa = p > a ? p - a : a - p;
+    int pb = p > b ? p - b : b - p;
+    int pc = p > c ? p - c : c - p;
+    if(pa <= pb && pa <= pc) return (u8)a;
+    if(pb <= pc) return (u8)b;
+    return (u8)c;
+}
+
+static bool PNGUnfilter(u8 *data, u32 height, u32 stride, u32 bpp)
+{
+    u8 *prev = 0;
+    for(u32 y = 0; y < height; y++)
+    {
+        u8 filter = data[y * (stride + 1)];
+        u8 *row = data + y * (stride + 1) + 1;
+
+        for(u32 x = 0; x < stride; x++)
+        {
+            int a = x >= bpp ? row[x - bpp] : 0;
+            int b = prev ? prev[x] : 0;
+            int c = (prev && x >= bpp) ? prev[x - bpp] : 0;
+
+            switch(filter)
+            {
+                case 0: break;
+                case 1: row[x] += (u8)a; break;
+                case 2: row[x] += (u8)b; break;
+                case 3: row[x] += (u8)((a + b) >> 1); break;
+                case 4: row[x] += PaethPredictor(a, b, c); break;
+                default: return false;
+            }
+        }
+
+        prev = row;
+    }
+
+    return true;
+}
+
+bool ImageDecodePNG(Arena *arena, const u8 *data, u64 size, Image *image)
+{
+    static const u8 signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+    if(size < 33 || memcmp(data, signature, 8) != 0 || memcmp(data + 12, "IHDR", 4) != 0)
+    {
+        return false;
+    }
+
+    const u8 *ihdr = data + 16;
+    u32 width = ReadBE32(ihdr);
+    u32 height = ReadBE32(ihdr + 4);
+    u8 bit_depth = ihdr[8];
+    u8 color_type = ihdr[9];
+    u8 interlace = ihdr[12];
+
+    u32 channels = 0;
+    switch(color_type)
+    {
+        case 0: channels = 1; break;
+        case 2: channels = 3; break;
+        case 3: channels = 1; break;
+        case 4: channels = 2; break;
+        case 6: channels = 4; break;
+        default: return false;
+    }
+
+    bool depth_ok = bit_depth == 8 || (bit_depth == 16 && color_type != 3) ||
+                    ((bit_depth == 1 || bit_depth == 2 || bit_depth == 4) &&
+                     (color_type == 0 || color_type == 3));
+    if(!width || !height || !depth_ok || interlace)
+    {
+        return false;
+    }
+
+    u64 idat_size = 0;
+    for(u64 pos = 8; pos + 12 <= size;)
+    {
+        u32 length = ReadBE32(data + pos);
+        if(pos + 12 + length > size)
+        {
+            return false;
+        }
+
+        if(memcmp(data + pos + 4, "IDAT", 4) == 0)
+        {
+            idat_size += length;
+        }
+
+        pos += 12 + length;
+    }
+
+    if(idat_size < 6)
+    {
+        return false;
+    }
+
+    u8 *pixels = (u8 *)ArenaAlloc(arena, (u64)width * height * 4, 0);
+    if(!pixels)
+    {
+        return false;
+    }
+
+    TempArena temp = BeginTempArena(arena);
+
+    u32 bits_per_pixel = channels * bit_depth;
+    u32 stride = (width * bits_per_pixel + 7) / 8;
+    u32 bpp = (bits_per_pixel + 7) / 8;
+    u64 raw_size = (u64)height * (stride + 1);
+
+    u8 *idat = (u8 *)ArenaAlloc(arena, idat_size, 0);
+    u8 *raw = (u8 *)ArenaAlloc(arena, raw_size, 0);
+    if(!idat || !raw)
+    {
+        EndTempArena(temp);
+        return false;
+    }
+
+    u8 palette[256 * 4];
+    memset(palette, 0xff, sizeof(palette));
+
+    u64 idat_pos = 0;
+    for(u64 pos = 8; pos + 12 <= size;)
+    {
+        u32 length = ReadBE32(data + pos);
+        const u8 *type = data + pos + 4;
+        const u8 *chunk = data + pos + 8;
+
+        if(memcmp(type, "PLTE", 4) == 0)
+        {
+            for(u32 i = 0; i < length / 3 && i < 256; i++)
+            {
+                palette[i * 4 + 0] = chunk[i * 3 + 0];
+                palette[i * 4 + 1] = chunk[i * 3 + 1];
+                palette[i * 4 + 2] = chunk[i * 3 + 2];
+            }
+        }
+
+        else if(memcmp(type, "tRNS", 4) == 0 && color_type == 3)
+        {
+            for(u32 i = 0; i < length && i < 256; i++)
+            {
+                palette[i * 4 + 3] = chunk[i];
+            }
+        }
+
+        else if(memcmp(type, "IDAT", 4) == 0)
+        {
+            memcpy(idat + idat_pos, chunk, length);
+            idat_pos += length;
+        }
+
+        else if(memcmp(type, "IEND", 4) == 0)
+        {
+            break;
+        }
+
+        pos += 12 + length;
+    }
+
+    if(!Inflate(idat + 2, idat_size - 2, raw, raw_size) ||
+       !PNGUnfilter(raw, height, stride, bpp))
+    {
+        EndTempArena(temp);
+        return false;
+    }
+
+    for(u32 y = 0; y < height; y++)
+    {
+        const u8 *row = raw + (u64)y * (stride + 1) + 1;
+        u8 *dst = pixels + (u64)y * width * 4;
+        for(u32 x = 0; x < width; x++, dst += 4)
+        {
+            u8 rgba[4] = {0, 0, 0, 255};
+            if(bit_depth < 8)
+            {
+                u32 bit = x * bit_depth;
+                u32 max = (1 << bit_depth) - 1;
+                u32 value = (row[bit / 8] >> (8 - bit_depth - bit % 8)) & max;
+                if(color_type == 3)
+                {
+                    memcpy(rgba, palette + value * 4, 4);
+                }
+
+                else
+                {
+                    rgba[0] = rgba[1] = rgba[2] = (u8)(value * 255 / max);
+                }
+            }
+
+            else
+            {
+                u32 step = bit_depth / 8;
+                const u8 *src = row + (u64)x * channels * step;
+                u8 c[4];
+                for(u32 i = 0; i < channels; i++)
+                {
+                    c[i] = src[i * step];
+                }
+
+                switch(color_type)
+                {
+                    case 0: rgba[0] = rgba[1] = rgba[2] = c[0]; break;
+                    case 2: rgba[0] = c[0]; rgba[1] = c[1]; rgba[2] = c[2]; break;
+                    case 3: memcpy(rgba, palette + c[0] * 4, 4); break;
+                    case 4: rgba[0] = rgba[1] = rgba[2] = c[0]; rgba[3] = c[1]; break;
+                    case 6: memcpy(rgba, c, 4); break;
+                }
+            }
+
+            memcpy(dst, rgba, 4);
+        }
+    }
+
+    EndTempArena(temp);
+
+    image->width = width;
+    image->height = height;
+    image->pixels = pixels;
+    return true;
+}
+
+bool ImageDecodeTGA(Arena *arena, const u8 *data, u64 size, Image *image)
+{
+    if(size < 18)
+    {
+        return false;
+    }
+
+    u8 id_length = data[0];
+    u8 colormap_type = data[1];
+    u8 image_type = data[2];
+    u32 colormap_length = data[5] | (data[6] << 8);
+    u32 colormap_bits = data[7];
+    u32 width = data[12] | (data[13] << 8);
+    u32 height = data[14] | (data[15] << 8);
+    u32 bits = data[16];
+    u8 descriptor = data[17];
+
+    bool rle = image_type >= 9;
+    u32 base_type = rle ? image_type - 8 : image_type;
+    if(base_type != 2 && base_type != 3)
+    {
+        return false;
+    }
+
+    if(bits != 8 && bits != 24 && bits != 32)
+    {
+        return false;
+    }
+
+    u64 pos = 18 + id_length;
+    if(colormap_type)
+    {
+        pos += colormap_length * ((colormap_bits + 7) / 8);
+    }
+
+    u32 bytes = bits / 8;
+    u64 pixel_count = (u64)width * height;
+    u8 *pixels = (u8 *)ArenaAlloc(arena, pixel_count * 4, 0);
+    if(!pixels || !width || !height)
+    {
+        return false;
+    }
+
+    bool top_down = (descriptor & 0x20) != 0;
+
+    u64 written = 0;
+    while(written < pixel_count)
+    {
+        u32 run = 1;
+        bool repeat = false;
+        if(rle)
+        {
+            if(pos >= size)
+            {
+                return false;
+            }
+
+            u8 packet = data[pos++];
+            run = (packet & 0x7f) + 1;
+            repeat = (packet & 0x80) != 0;
+        }
+
+        for(u32 i = 0; i < run && written < pixel_count; i++)
+        {
+            if(pos + bytes > size)
+            {
+                return false;
+            }
+
+            const u8 *src = data + pos;
+            u8 rgba[4];
+            if(bytes == 1)
+            {
+                rgba[0] = rgba[1] = rgba[2] = src[0];
+                rgba[3] = 255;
+            }
+
+            else
+            {
+                rgba[0] = src[2];
+                rgba[1] = src[1];
+                rgba[2] = src[0];
+                rgba[3] = bytes == 4 ? src[3] : 255;
+            }
+
+            u64 x = written % width;
+            u64 y = written / width;
+            if(!top_down)
+            {
+                y = height - 1 - y;
+            }
+
+            memcpy(pixels + (y * width + x) * 4, rgba, 4);
+            written++;
+
+            if(!repeat || i == run - 1)
+            {
+                pos += bytes;
+            }
+        }
+    }
+
+    image->width = width;
+    image->height = height;
+    image->pixels = pixels;
+    return true;
+}
+
+bool ImageLoad(Arena *arena, const char *file_path, Image *image)
+{
+    HANDLE hfile = CreateFile(file_path, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, 0, 0);
+    if(hfile == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    LARGE_INTEGER fsize; GetFileSizeEx(hfile, &fsize);
+    HANDLE hmap = CreateFileMapping(hfile, 0, PAGE_READONLY, 0, 0, 0);
+    u8 *buffer = (u8 *)MapViewOfFile(hmap, FILE_MAP_READ, 0, 0, fsize.QuadPart);
+
+    bool loaded = false;
+    if(buffer)
+    {
+        loaded = ImageDecodePNG(arena, buffer, fsize.QuadPart, image) ||
+                 ImageDecodeTGA(arena, buffer, fsize.QuadPart, image);
+        UnmapViewOfFile(buffer);
+    }
+
+    CloseHandle(hmap);
+    CloseHandle(hfile);
+    return loaded;
+}
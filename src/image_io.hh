@@ -0,0 +1,19 @@
+#ifndef IMAGE_IO_H
+#define IMAGE_IO_H
+
+#include "types.hh"
+#include "arena_alloc.hh"
+
+// Decoded images are always 8-bit RGBA, top row first.
+struct Image
+{
+    u32 width;
+    u32 height;
+    u8 *pixels;
+};
+
+bool ImageDecodePNG(Arena *arena, const u8 *data, u64 size, Image *image);
+bool ImageDecodeTGA(Arena *arena, const u8 *data, u64 size, Image *image);
+bool ImageLoad(Arena *arena, const char *file_path, Image *image);
+
+#endif //IMAGE_IO_H
@@ -0,0 +1,262 @@
+#include "os.hh"
+#include "jobs.hh"
+#include "profiler.hh"
+
+#define MAX_RANGE_JOBS 256
+
+struct RangeJob
+{
+    JobRangeProc *proc;
+    void *data;
+    u32 begin;
+    u32 end;
+};
+
+static bool JobsRunNext(JobQueue *queue)
+{
+    i32 read = queue->next_read;
+    if(read == queue->next_write)
+    {
+        return false;
+    }
+
+    // Copied before claiming: once next_read moves on, JobsAdd may reuse the
+    // slot. If another worker got here first the copy is just dropped.
+    OsMemoryBarrier();
+    Job job = queue->jobs[read % MAX_JOBS];
+    if(OsAtomicCompareExchange(&queue->next_read, read + 1, read) == read)
+    {
+        PROFILE_ZONE("Job");
+        job.proc(job.data);
+        if(job.counter)
+        {
+            OsAtomicDecrement(&job.counter->pending);
+        }
+    }
+
+    return true;
+}
+
+static OS_THREAD_PROC(JobsWorkerProc)
+{
+    JobQueue *queue = (JobQueue *)data;
+    PROFILE_THREAD("Worker");
+    for(;;)
+    {
+        if(!JobsRunNext(queue))
+        {
+            OsWaitSemaphore(&queue->semaphore);
+        }
+    }
+}
+
+u32 JobsHardwareThreads(void)
+{
+    return OsProcessorCount();
+}
+
+JobQueue *CreateJobQueue(Arena *arena, u32 worker_count)
+{
+    JobQueue *queue = ArenaAllocStruct(arena, JobQueue);
+    *queue = {};
+
+    if(worker_count == 0)
+    {
+        u32 threads = JobsHardwareThreads();
+        worker_count = threads > 1 ? threads - 1 : 0;
+    }
+
+    if(worker_count > MAX_WORKERS)
+    {
+        worker_count = MAX_WORKERS;
+    }
+
+    OsCreateSemaphore(&queue->semaphore, MAX_JOBS);
+    queue->worker_count = worker_count;
+    for(u32 i = 0; i < worker_count; i++)
+    {
+        queue->workers[i] = OsCreateThread(JobsWorkerProc, queue);
+    }
+
+    return queue;
+}
+
+void JobsAdd(JobQueue *queue, JobProc *proc, void *data, JobCounter *counter)
+{
+    while(queue->next_write - queue->next_read >= MAX_JOBS)
+    {
+        JobsRunNext(queue);
+    }
+
+    if(counter)
+    {
+        OsAtomicIncrement(&counter->pending);
+    }
+
+    Job *job = &queue->jobs[queue->next_write % MAX_JOBS];
+    job->proc = proc;
+    job->data = data;
+    job->counter = counter;
+
+    OsMemoryBarrier();
+    OsAtomicIncrement(&queue->next_write);
+    OsSignalSemaphore(&queue->semaphore);
+}
+
+void JobsWait(JobQueue *queue, JobCounter *counter)
+{
+    while(counter->pending > 0)
+    {
+        if(!JobsRunNext(queue))
+        {
+            OsPause();
+        }
+    }
+}
+
+static void RunRangeJob(void *data)
+{
+    RangeJob *range = (RangeJob *)data;
+    range->proc(range->data, range->begin, range->end);
+}
+
+void JobsParallelFor(JobQueue *queue, u32 count, u32 batch_size, JobRangeProc *proc, void *data)
+{
+    if(batch_size == 0) batch_size = 1;
+    if((count + batch_size - 1) / batch_size > MAX_RANGE_JOBS)
+    {
+        batch_size = (count + MAX_RANGE_JOBS - 1) / MAX_RANGE_JOBS;
+    }
+
+    if(!queue || count <= batch_size)
+    {
+        proc(data, 0, count);
+        return;
+    }
+
+    RangeJob ranges[MAX_RANGE_JOBS];
+    JobCounter counter = {};
+
+    u32 range_count = 0;
+    for(u32 begin = 0; begin < count; begin += batch_size)
+    {
+        RangeJob *range = &ranges[range_count++];
+        range->proc = proc;
+        range->data = data;
+        range->begin = begin;
+        range->end = begin + batch_size < count ? begin + batch_size : count;
+        JobsAdd(queue, RunRangeJob, range, &counter);
+    }
+
+    JobsWait(queue, &counter);
+}
+
+JobGraph *CreateJobGraph(Arena *arena, JobQueue *queue)
+{
+    JobGraph *graph = ArenaAllocStruct(arena, JobGraph);
+    *graph = {};
+    graph->queue = queue;
+    return graph;
+}
+
+// Returns the node index to depend on, or JOB_GRAPH_NONE when full.
+u32 JobGraphAdd(JobGraph *graph, const char *name, JobProc *proc, void *data, bool main_thread)
+{
+    if(graph->node_count >= MAX_GRAPH_NODES)
+    {
+        return JOB_GRAPH_NONE;
+    }
+
+    u32 index = graph->node_count++;
+    JobGraphNode *node = &graph->nodes[index];
+    *node = {};
+    node->graph = graph;
+    node->name = name;
+    node->proc = proc;
+    node->data = data;
+    node->main_thread = main_thread;
+    return index;
+}
+
+void JobGraphDepend(JobGraph *graph, u32 node, u32 dependency)
+{
+    if(node >= graph->node_count || dependency >= graph->node_count)
+    {
+        return;
+    }
+
+    JobGraphNode *before = &graph->nodes[dependency];
+    if(before->dependent_count < MAX_GRAPH_DEPENDENTS)
+    {
+        before->dependents[before->dependent_count++] = node;
+        graph->nodes[node].remaining++;
+    }
+}
+
+static void RunGraphNode(void *data)
+{
+    JobGraphNode *node = (JobGraphNode *)data;
+    PROFILE_ZONE(node->name);
+    node->start = OsTimeNow();
+    node->proc(node->data);
+    node->end = OsTimeNow();
+
+    JobGraph *graph = node->graph;
+    for(u32 i = 0; i < node->dependent_count; i++)
+    {
+        OsAtomicDecrement(&graph->nodes[node->dependents[i]].remaining);
+    }
+
+    OsMemoryBarrier();
+    OsAtomicStore(&node->finished, 1);
+}
+
+// The calling thread hands ready nodes to the workers, runs the main
+// thread ones itself, and helps with the queue while it waits.
+void JobGraphRun(JobGraph *graph)
+{
+    graph->start = OsTimeNow();
+    for(;;)
+    {
+        u32 finished = 0;
+        bool started = false;
+        for(u32 i = 0; i < graph->node_count; i++)
+        {
+            JobGraphNode *node = &graph->nodes[i];
+            if(node->finished)
+            {
+                finished++;
+                continue;
+            }
+
+            if(node->started || node->remaining > 0)
+            {
+                continue;
+            }
+
+            node->started = true;
+            started = true;
+            if(node->main_thread)
+            {
+                RunGraphNode(node);
+            }
+
+            else
+            {
+                JobsAdd(graph->queue, RunGraphNode, node, 0);
+            }
+        }
+
+        if(finished == graph->node_count)
+        {
+            break;
+        }
+
+        if(!started && !JobsRunNext(graph->queue))
+        {
+            OsPause();
+        }
+    }
+
+    graph->end = OsTimeNow();
+}
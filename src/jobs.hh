@@ -0,0 +1,89 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#define MAX_JOBS 1024
+#define MAX_WORKERS 64
+#define MAX_GRAPH_NODES 32
+#define MAX_GRAPH_DEPENDENTS 16
+#define JOB_GRAPH_NONE 0xffffffff
+
+#include "os.hh"
+#include "types.hh"
+#include "arena_alloc.hh"
+
+typedef void JobProc(void *data);
+typedef void JobRangeProc(void *data, u32 begin, u32 end);
+
+struct JobCounter
+{
+    OsAtomic pending;
+};
+
+struct Job
+{
+    JobProc *proc;
+    void *data;
+    JobCounter *counter;
+};
+
+// Single producer, many consumers: only the thread that created the queue
+// may add jobs. Workers and the producer (inside JobsWait) drain it.
+struct JobQueue
+{
+    Job jobs[MAX_JOBS];
+    OsAtomic next_write;
+    OsAtomic next_read;
+    OsSemaphore semaphore;
+
+    u32 worker_count;
+    OsThread workers[MAX_WORKERS];
+};
+
+struct JobGraph;
+
+// Runs once every node it depends on has finished. Main thread nodes run
+// on the thread that runs the graph, which is also the only one allowed to
+// add jobs, so a node that queues work of its own has to be one of them.
+// Times are OsTimeNow ticks.
+struct JobGraphNode
+{
+    JobGraph *graph;
+    const char *name;
+    JobProc *proc;
+    void *data;
+    bool main_thread;
+    bool started;
+
+    OsAtomic remaining;
+    OsAtomic finished;
+    u32 dependent_count;
+    u32 dependents[MAX_GRAPH_DEPENDENTS];
+
+    u64 start;
+    u64 end;
+};
+
+// Built up front, run once, and kept around afterwards for its timings.
+// The dependencies must not form a cycle.
+struct JobGraph
+{
+    JobQueue *queue;
+    u64 start;
+    u64 end;
+    u32 node_count;
+    JobGraphNode nodes[MAX_GRAPH_NODES];
+};
+
+JobQueue *CreateJobQueue(Arena *arena, u32 worker_count);
+u32 JobsHardwareThreads(void);
+
+void JobsAdd(JobQueue *queue, JobProc *proc, void *data, JobCounter *counter);
+void JobsWait(JobQueue *queue, JobCounter *counter);
+void JobsParallelFor(JobQueue *queue, u32 count, u32 batch_size, JobRangeProc *proc, void *data);
+
+JobGraph *CreateJobGraph(Arena *arena, JobQueue *queue);
+u32 JobGraphAdd(JobGraph *graph, const char *name, JobProc *proc, void *data, bool main_thread);
+void JobGraphDepend(JobGraph *graph, u32 node, u32 dependency);
+void JobGraphRun(JobGraph *graph);
+
+#endif //JOBS_H
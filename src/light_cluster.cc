@@ -0,0 +1,329 @@
+#include <string.h>
+#include <math.h>
+#include "light_cluster.hh"
+
+// Tile and slice ranges are widened by this much, in tiles, so rounding
+// never leaves out a cluster the exact test would accept.
+#define CLUSTER_RANGE_MARGIN 0.01f
+
+LightClusters *CreateLightClusters(Arena *arena)
+{
+    LightClusters *clusters = ArenaAllocStruct(arena, LightClusters);
+    if(!clusters)
+    {
+        return 0;
+    }
+
+    memset(clusters, 0, sizeof(LightClusters));
+    clusters->header.ambient = HMM_V4(1, 1, 1, 1);
+    return clusters;
+}
+
+// The projection is the camera's: x and y scales on the diagonal, view
+// depth in w. Only those two scales are used, so near and far are the
+// grid's rather than the projection's.
+void LightClustersSetView(LightClusters *clusters, u32 width, u32 height, HMM_Mat4 projection,
+                          float near_plane, float far_plane)
+{
+    ClusterHeader *header = &clusters->header;
+    header->tile_scale[0] = (float)CLUSTER_X / width;
+    header->tile_scale[1] = (float)CLUSTER_Y / height;
+    header->ndc_scale[0] = 2.0f / width;
+    header->ndc_scale[1] = 2.0f / height;
+    header->inv_proj[0] = 1.0f / projection.Elements[0][0];
+    header->inv_proj[1] = 1.0f / projection.Elements[1][1];
+    header->near_plane = near_plane;
+    header->z_scale = CLUSTER_Z / logf(far_plane / near_plane);
+    header->z_bias = -logf(near_plane) * header->z_scale;
+    clusters->far_plane = far_plane;
+
+    for(u32 x = 0; x <= CLUSTER_X; x++)
+    {
+        clusters->edge_x[x] = ((float)x / CLUSTER_X * 2.0f - 1.0f) * header->inv_proj[0];
+    }
+
+    for(u32 y = 0; y <= CLUSTER_Y; y++)
+    {
+        clusters->edge_y[y] = ((float)y / CLUSTER_Y * 2.0f - 1.0f) * header->inv_proj[1];
+    }
+
+    for(u32 z = 0; z <= CLUSTER_Z; z++)
+    {
+        clusters->edge_z[z] = near_plane * powf(far_plane / near_plane, (float)z / CLUSTER_Z);
+    }
+}
+
+static float Min4(float a, float b, float c, float d)
+{
+    float ab = a < b ? a : b;
+    float cd = c < d ? c : d;
+    return ab < cd ? ab : cd;
+}
+
+static float Max4(float a, float b, float c, float d)
+{
+    float ab = a > b ? a : b;
+    float cd = c > d ? c : d;
+    return ab > cd ? ab : cd;
+}
+
+// Both ends of a tile at both ends of a slice, since x / depth is extreme
+// at the corners.
+static void ClusterBounds(LightClusters *clusters, u32 x, u32 y, u32 z, HMM_Vec3 *min, HMM_Vec3 *max)
+{
+    float near_depth = clusters->edge_z[z];
+    float far_depth = clusters->edge_z[z + 1];
+    float x0 = clusters->edge_x[x];
+    float x1 = clusters->edge_x[x + 1];
+    float y0 = clusters->edge_y[y];
+    float y1 = clusters->edge_y[y + 1];
+
+    min->X = Min4(x0 * near_depth, x0 * far_depth, x1 * near_depth, x1 * far_depth);
+    max->X = Max4(x0 * near_depth, x0 * far_depth, x1 * near_depth, x1 * far_depth);
+    min->Y = Min4(y0 * near_depth, y0 * far_depth, y1 * near_depth, y1 * far_depth);
+    max->Y = Max4(y0 * near_depth, y0 * far_depth, y1 * near_depth, y1 * far_depth);
+    min->Z = -far_depth;
+    max->Z = -near_depth;
+}
+
+static bool SphereTouchesBox(HMM_Vec4 sphere, HMM_Vec3 min, HMM_Vec3 max)
+{
+    float distance = 0.0f;
+    for(u32 i = 0; i < 3; i++)
+    {
+        float d = 0.0f;
+        if(sphere.Elements[i] < min.Elements[i]) d = min.Elements[i] - sphere.Elements[i];
+        if(sphere.Elements[i] > max.Elements[i]) d = sphere.Elements[i] - max.Elements[i];
+        distance += d * d;
+    }
+
+    return distance <= sphere.W * sphere.W;
+}
+
+// A cluster's box reaches past its tile on the far side, so a light also
+// has to cover the tile on screen. Binning makes the same two tests; this
+// is one cluster and one light at a time, to check it against.
+bool LightClusterTouches(LightClusters *clusters, u32 cluster, u32 light)
+{
+    u32 x = cluster % CLUSTER_X;
+    u32 y = cluster / CLUSTER_X % CLUSTER_Y;
+    u32 z = cluster / (CLUSTER_X * CLUSTER_Y);
+
+    ClusterRange *range = &clusters->ranges[light];
+    if(x < range->min_x || x > range->max_x || y < range->min_y || y > range->max_y ||
+       z < range->min_z || z > range->max_z)
+    {
+        return false;
+    }
+
+    HMM_Vec3 min, max;
+    ClusterBounds(clusters, x, y, z, &min, &max);
+    return SphereTouchesBox(clusters->lights[light].sphere, min, max);
+}
+
+static bool ClampRange(float lo, float hi, u32 count, u8 *min, u8 *max)
+{
+    lo -= CLUSTER_RANGE_MARGIN;
+    hi += CLUSTER_RANGE_MARGIN;
+    if(hi < 0.0f || lo >= (float)count)
+    {
+        return false;
+    }
+
+    *min = lo <= 0.0f ? 0 : (u8)lo;
+    *max = hi >= (float)count ? (u8)(count - 1) : (u8)hi;
+    return true;
+}
+
+// Tiles covered by [lo, hi] in x or y anywhere between the two depths.
+static bool TileRange(float lo, float hi, float near_depth, float far_depth, float inv_proj, u32 tiles,
+                      u8 *min, u8 *max)
+{
+    float a = lo / near_depth / inv_proj;
+    float b = lo / far_depth / inv_proj;
+    float c = hi / near_depth / inv_proj;
+    float d = hi / far_depth / inv_proj;
+    float ndc_min = Min4(a, b, c, d);
+    float ndc_max = Max4(a, b, c, d);
+    return ClampRange((ndc_min * 0.5f + 0.5f) * tiles, (ndc_max * 0.5f + 0.5f) * tiles, tiles, min, max);
+}
+
+static bool LightRange(LightClusters *clusters, HMM_Vec4 sphere, ClusterRange *range)
+{
+    ClusterHeader *header = &clusters->header;
+    float depth = -sphere.Z;
+    float near_depth = depth - sphere.W;
+    float far_depth = depth + sphere.W;
+    if(far_depth < header->near_plane || near_depth > clusters->far_plane)
+    {
+        return false;
+    }
+
+    near_depth = near_depth < header->near_plane ? header->near_plane : near_depth;
+    far_depth = far_depth > clusters->far_plane ? clusters->far_plane : far_depth;
+
+    float slice_min = logf(near_depth) * header->z_scale + header->z_bias;
+    float slice_max = logf(far_depth) * header->z_scale + header->z_bias;
+    return ClampRange(slice_min, slice_max, CLUSTER_Z, &range->min_z, &range->max_z) &&
+           TileRange(sphere.X - sphere.W, sphere.X + sphere.W, near_depth, far_depth, header->inv_proj[0],
+                     CLUSTER_X, &range->min_x, &range->max_x) &&
+           TileRange(sphere.Y - sphere.W, sphere.Y + sphere.W, near_depth, far_depth, header->inv_proj[1],
+                     CLUSTER_Y, &range->min_y, &range->max_y);
+}
+
+// Transforms the lights into view space and keeps those that reach into
+// the grid, in order, up to MAX_CLUSTER_LIGHTS. Writes the header and the
+// lights to the block; the clusters are left to LightClustersBin or the
+// GPU. Returns how many lights were kept.
+u32 LightClustersCull(LightClusters *clusters, HMM_Mat4 view, HMM_Vec3 ambient,
+                      const PointLight *lights, u32 count, ClusterBlock *block)
+{
+    u32 kept = 0;
+    for(u32 i = 0; i < count && kept < MAX_CLUSTER_LIGHTS; i++)
+    {
+        const PointLight *light = &lights[i];
+        HMM_Vec4 position = view * HMM_V4V(light->position, 1.0f);
+        HMM_Vec4 sphere = HMM_V4(position.X, position.Y, position.Z, light->radius);
+        if(light->radius <= 0.0f || !LightRange(clusters, sphere, &clusters->ranges[kept]))
+        {
+            continue;
+        }
+
+        ClusterLight *out = &clusters->lights[kept++];
+        out->sphere = sphere;
+        out->color = HMM_V4V(light->color * light->intensity, 0.0f);
+    }
+
+    // Buckets the lights by slice, so a row only looks at lights at its
+    // depth.
+    memset(clusters->slice_starts, 0, sizeof(clusters->slice_starts));
+    for(u32 i = 0; i < kept; i++)
+    {
+        for(u32 z = clusters->ranges[i].min_z; z <= clusters->ranges[i].max_z; z++)
+        {
+            clusters->slice_starts[z + 1]++;
+        }
+    }
+
+    u32 slice_ends[CLUSTER_Z];
+    for(u32 z = 0; z < CLUSTER_Z; z++)
+    {
+        clusters->slice_starts[z + 1] += clusters->slice_starts[z];
+        slice_ends[z] = clusters->slice_starts[z];
+    }
+
+    for(u32 i = 0; i < kept; i++)
+    {
+        for(u32 z = clusters->ranges[i].min_z; z <= clusters->ranges[i].max_z; z++)
+        {
+            clusters->slice_lights[slice_ends[z]++] = (u16)i;
+        }
+    }
+
+    clusters->light_count = kept;
+    clusters->header.light_count = kept;
+    clusters->header.ambient = HMM_V4V(ambient, 1.0f);
+    clusters->block = block;
+    block->header = clusters->header;
+    memcpy(block->lights, clusters->lights, sizeof(ClusterLight) * kept);
+    return kept;
+}
+
+// Counts the row's light references, or with write set fills in its
+// clusters and as many of the references as fit between its offsets.
+static u32 BinRow(LightClusters *clusters, u32 row, bool write)
+{
+    u32 y = row % CLUSTER_Y;
+    u32 z = row / CLUSTER_Y;
+
+    // The row's lights under each tile they may cover, in light order.
+    u16 tile_lights[CLUSTER_X][MAX_CLUSTER_LIGHTS];
+    u32 tile_counts[CLUSTER_X] = {};
+    for(u32 i = clusters->slice_starts[z]; i < clusters->slice_starts[z + 1]; i++)
+    {
+        u16 light = clusters->slice_lights[i];
+        ClusterRange *range = &clusters->ranges[light];
+        if(y < range->min_y || y > range->max_y)
+        {
+            continue;
+        }
+
+        for(u32 x = range->min_x; x <= range->max_x; x++)
+        {
+            tile_lights[x][tile_counts[x]++] = light;
+        }
+    }
+
+    ClusterBlock *block = clusters->block;
+    u32 at = write ? clusters->row_offsets[row] : 0;
+    u32 end = write ? clusters->row_offsets[row + 1] : 0;
+    u32 count = 0;
+    for(u32 x = 0; x < CLUSTER_X; x++)
+    {
+        HMM_Vec3 min, max;
+        ClusterBounds(clusters, x, y, z, &min, &max);
+
+        u32 first = at;
+        for(u32 i = 0; i < tile_counts[x]; i++)
+        {
+            u32 light = tile_lights[x][i];
+            if(!SphereTouchesBox(clusters->lights[light].sphere, min, max))
+            {
+                continue;
+            }
+
+            count++;
+            if(write && at < end)
+            {
+                block->indices[at++] = (u16)light;
+            }
+        }
+
+        if(write)
+        {
+            u32 cluster = row * CLUSTER_X + x;
+            block->clusters[cluster][0] = first;
+            block->clusters[cluster][1] = at - first;
+        }
+    }
+
+    return count;
+}
+
+static void CountRows(void *data, u32 begin, u32 end)
+{
+    LightClusters *clusters = (LightClusters *)data;
+    for(u32 row = begin; row < end; row++)
+    {
+        clusters->row_counts[row] = BinRow(clusters, row, false);
+    }
+}
+
+static void FillRows(void *data, u32 begin, u32 end)
+{
+    LightClusters *clusters = (LightClusters *)data;
+    for(u32 row = begin; row < end; row++)
+    {
+        BinRow(clusters, row, true);
+    }
+}
+
+// Runs on the caller's thread when jobs is null. The result does not
+// depend on how the rows were split up.
+void LightClustersBin(LightClusters *clusters, JobQueue *jobs)
+{
+    JobsParallelFor(jobs, CLUSTER_ROWS, CLUSTER_ROW_BATCH, CountRows, clusters);
+
+    u32 total = 0;
+    clusters->row_offsets[0] = 0;
+    for(u32 row = 0; row < CLUSTER_ROWS; row++)
+    {
+        total += clusters->row_counts[row];
+        clusters->row_offsets[row + 1] = total < MAX_CLUSTER_INDICES ? total : MAX_CLUSTER_INDICES;
+    }
+
+    clusters->index_count = clusters->row_offsets[CLUSTER_ROWS];
+    clusters->dropped = total - clusters->index_count;
+
+    JobsParallelFor(jobs, CLUSTER_ROWS, CLUSTER_ROW_BATCH, FillRows, clusters);
+}
@@ -0,0 +1,115 @@
+#ifndef LIGHT_CLUSTER_H
+#define LIGHT_CLUSTER_H
+
+// Must match shaders/mesh.frag and shaders/light_cluster.comp.
+#define CLUSTER_X 16
+#define CLUSTER_Y 9
+#define CLUSTER_Z 24
+#define CLUSTER_COUNT (CLUSTER_X * CLUSTER_Y * CLUSTER_Z)
+#define CLUSTER_ROWS (CLUSTER_Y * CLUSTER_Z)
+#define CLUSTER_ROW_BATCH 4
+#define MAX_CLUSTER_LIGHTS 1024
+#define MAX_CLUSTER_INDICES (64 * 1024)
+// Each cluster's share of the index list when the GPU bins: even, and
+// small enough for every cluster to fit.
+#define CLUSTER_GPU_CAPACITY 18
+#define CLUSTER_DEFAULT_FAR 300.0f
+
+#include "types.hh"
+#include "jobs.hh"
+#include "arena_alloc.hh"
+#include "third_party/HandmadeMath.h"
+
+// World space. The light falls off to nothing at radius.
+struct PointLight
+{
+    HMM_Vec3 position;
+    float radius;
+    HMM_Vec3 color;
+    float intensity;
+};
+
+// View space position and radius, and color scaled by intensity.
+struct ClusterLight
+{
+    HMM_Vec4 sphere;
+    HMM_Vec4 color;
+};
+
+// How the fragment shader finds its cluster. Tiles are scaled from the
+// framebuffer position; depth comes from gl_FragCoord.z, which for the
+// camera's reverse-Z infinite projection is near / view depth. Slices are
+// spaced exponentially: slice = log(depth) * z_scale + z_bias.
+struct ClusterHeader
+{
+    float tile_scale[2];
+    float ndc_scale[2];
+    float inv_proj[2];
+    float near_plane;
+    float z_scale;
+    float z_bias;
+    u32 light_count;
+    u32 padding[2];
+    HMM_Vec4 ambient;
+};
+
+// What the shaders read, as one std430 block. Cluster c lists its lights
+// at indices[clusters[c][0]] onwards, clusters[c][1] of them, two 16 bit
+// light indices to a word. Clusters are ordered x fastest, then y, then z.
+struct ClusterBlock
+{
+    ClusterHeader header;
+    ClusterLight lights[MAX_CLUSTER_LIGHTS];
+    u32 clusters[CLUSTER_COUNT][2];
+    u16 indices[MAX_CLUSTER_INDICES];
+};
+
+// Screen and depth ranges of a light's bounding box, in tiles and slices.
+struct ClusterRange
+{
+    u8 min_x;
+    u8 max_x;
+    u8 min_y;
+    u8 max_y;
+    u8 min_z;
+    u8 max_z;
+};
+
+// Lights are transformed to view space and cut down to those inside the
+// grid, then binned a few rows of clusters per job: each row counts its
+// lights first, the counts are summed into offsets, and each row then
+// writes its own part of the output in order. The block is written front
+// to back and never read, so it can be write-combined GPU memory. When the
+// index list overflows, the rows furthest away lose lights first.
+struct LightClusters
+{
+    ClusterHeader header;
+    float far_plane;
+
+    // Tile edges as view space x and y at depth 1, slice edges as depths.
+    float edge_x[CLUSTER_X + 1];
+    float edge_y[CLUSTER_Y + 1];
+    float edge_z[CLUSTER_Z + 1];
+
+    u32 light_count;
+    ClusterLight lights[MAX_CLUSTER_LIGHTS];
+    ClusterRange ranges[MAX_CLUSTER_LIGHTS];
+    u32 slice_starts[CLUSTER_Z + 1];
+    u16 slice_lights[MAX_CLUSTER_LIGHTS * CLUSTER_Z];
+
+    ClusterBlock *block;
+    u32 row_counts[CLUSTER_ROWS];
+    u32 row_offsets[CLUSTER_ROWS + 1];
+    u32 index_count;
+    u32 dropped;
+};
+
+LightClusters *CreateLightClusters(Arena *arena);
+void LightClustersSetView(LightClusters *clusters, u32 width, u32 height, HMM_Mat4 projection,
+                          float near_plane, float far_plane);
+u32 LightClustersCull(LightClusters *clusters, HMM_Mat4 view, HMM_Vec3 ambient,
+                      const PointLight *lights, u32 count, ClusterBlock *block);
+void LightClustersBin(LightClusters *clusters, JobQueue *jobs);
+bool LightClusterTouches(LightClusters *clusters, u32 cluster, u32 light);
+
+#endif //LIGHT_CLUSTER_H
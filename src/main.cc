@@ -1,19 +1,272 @@
-#include <windows.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "os.hh"
 #include "engine.hh"
 #include "camera.hh"
-#include "platform.hh"
+#include "transform.hh"
+#include "profiler.hh"
 #include "arena_alloc.hh"
 #include "third_party/HandmadeMath.h"
 
-int main(void)
+#ifdef _WIN32
+#include "platform.hh"
+#endif
+
+#define SIM_HZ 60
+#define MAX_SIM_STEPS 8
+#define MAX_SCENE_TRANSFORMS 1024
+#define SCENE_LIGHT_RING 8.0f
+
+struct AppOptions
+{
+    EngineConfig engine;
+    bool headless;
+    u32 run_frames;
+    u32 max_fps;
+    const char *dump_path;
+    const char *trace_path;
+    bool print_startup;
+    u32 light_count;
+};
+
+// Simulation state that is stepped at SIM_HZ and interpolated for drawing.
+struct SimState
 {
+    float angle;
+    float prev_angle;
+};
+
+// -frames <1-3>  -present <fifo|relaxed|mailbox|immediate>  -latency
+// -headless  -size <w> <h>  -run <frames>  -dump <file.ppm>  -fps <cap>
+// -vram <MB>  -dynres <target ms>  -capture <file.cap>  -telemetry <name>
+// -startup  -trace <file.json> (profiling builds)  -lights <count>  -gpu_lights
+static AppOptions ParseOptions(int argc, char **argv)
+{
+    AppOptions options = {};
+    options.engine = DefaultEngineConfig();
+    options.run_frames = 300;
+#ifndef _WIN32
+    options.headless = true;
+#endif
+
+    EngineConfig *config = &options.engine;
+    for(int i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "-frames") == 0 && i + 1 < argc)
+        {
+            config->frames_in_flight = atoi(argv[++i]);
+        }
+
+        else if(strcmp(argv[i], "-present") == 0 && i + 1 < argc)
+        {
+            char *mode = argv[++i];
+            if(strcmp(mode, "relaxed") == 0) config->present_mode = VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+            else if(strcmp(mode, "mailbox") == 0) config->present_mode = VK_PRESENT_MODE_MAILBOX_KHR;
+            else if(strcmp(mode, "immediate") == 0) config->present_mode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+            else config->present_mode = VK_PRESENT_MODE_FIFO_KHR;
+        }
+
+        else if(strcmp(argv[i], "-latency") == 0)
+        {
+            config->low_latency = true;
+        }
+
+        else if(strcmp(argv[i], "-headless") == 0)
+        {
+            options.headless = true;
+        }
+
+        else if(strcmp(argv[i], "-size") == 0 && i + 2 < argc)
+        {
+            config->width = atoi(argv[++i]);
+            config->height = atoi(argv[++i]);
+        }
+
+        else if(strcmp(argv[i], "-run") == 0 && i + 1 < argc)
+        {
+            options.run_frames = atoi(argv[++i]);
+        }
+
+        else if(strcmp(argv[i], "-dump") == 0 && i + 1 < argc)
+        {
+            options.dump_path = argv[++i];
+        }
+
+        else if(strcmp(argv[i], "-fps") == 0 && i + 1 < argc)
+        {
+            options.max_fps = atoi(argv[++i]);
+        }
+
+        else if(strcmp(argv[i], "-vram") == 0 && i + 1 < argc)
+        {
+            config->vram_budget = (u64)atoi(argv[++i]) * MB;
+        }
+
+        else if(strcmp(argv[i], "-dynres") == 0 && i + 1 < argc)
+        {
+            config->target_frame_ms = (float)atof(argv[++i]);
+        }
+
+        else if(strcmp(argv[i], "-capture") == 0 && i + 1 < argc)
+        {
+            config->capture_path = argv[++i];
+        }
+
+        else if(strcmp(argv[i], "-telemetry") == 0 && i + 1 < argc)
+        {
+            config->telemetry_name = argv[++i];
+        }
+
+        else if(strcmp(argv[i], "-startup") == 0)
+        {
+            options.print_startup = true;
+        }
+
+        else if(strcmp(argv[i], "-trace") == 0 && i + 1 < argc)
+        {
+            options.trace_path = argv[++i];
+        }
+
+        else if(strcmp(argv[i], "-lights") == 0 && i + 1 < argc)
+        {
+            options.light_count = atoi(argv[++i]);
+            if(options.light_count > MAX_CLUSTER_LIGHTS) options.light_count = MAX_CLUSTER_LIGHTS;
+        }
+
+        else if(strcmp(argv[i], "-gpu_lights") == 0)
+        {
+            config->gpu_light_binning = true;
+        }
+    }
+
+    return options;
+}
+
+// Lights on rings around the models, turning with the simulation, in a
+// few alternating colors.
+static void PlaceLights(PointLight *lights, u32 count, float angle)
+{
+    HMM_Vec3 colors[3] = {HMM_V3(1.0f, 0.6f, 0.3f), HMM_V3(0.3f, 0.6f, 1.0f), HMM_V3(0.5f, 1.0f, 0.4f)};
+    for(u32 i = 0; i < count; i++)
+    {
+        float ring = SCENE_LIGHT_RING * (1 + i % 4);
+        float theta = angle + HMM_PI32 * 2.0f * i / count;
+        lights[i].position = HMM_V3(HMM_CosF(theta) * ring, 0.5f + (i % 3), HMM_SinF(theta) * ring);
+        lights[i].radius = SCENE_LIGHT_RING;
+        lights[i].color = colors[i % 3];
+        lights[i].intensity = 2.0f;
+    }
+}
+
+// Binary PPM: no dependencies and every image diff tool reads it.
+static bool WritePPM(const char *path, ReadbackFrame *frame)
+{
+    char header[64];
+    int header_size = snprintf(header, sizeof(header), "P6\n%u %u\n255\n", frame->width, frame->height);
+    u64 size = header_size + (u64)frame->width * frame->height * 3;
+
+    u8 *memory = (u8 *)OsAllocMemory(size);
+    if(!memory)
+    {
+        return false;
+    }
+
+    memcpy(memory, header, header_size);
+    u8 *dst = memory + header_size;
+    for(u32 y = 0; y < frame->height; y++)
+    {
+        u8 *src = (u8 *)frame->pixels + (u64)y * frame->row_pitch;
+        for(u32 x = 0; x < frame->width; x++)
+        {
+            *dst++ = src[x * 4 + 0];
+            *dst++ = src[x * 4 + 1];
+            *dst++ = src[x * 4 + 2];
+        }
+    }
+
+    bool ok = OsWriteFileAtomic(path, memory, size);
+    OsFreeMemory(memory, size);
+    return ok;
+}
+
+// Start and end of every startup step, in ms since main started. The
+// model loads are where the preloaded files are joined, and the first
+// frame is done once it has been submitted.
+static void PrintStartup(JobGraph *graph, u64 start, u64 models_start, u64 models_end, u64 first_frame)
+{
+    double ms_per_tick = 1000.0 / OsTimeFrequency();
+    printf("%-24s %9s %9s %9s\n", "startup", "start", "end", "ms");
+    for(u32 i = 0; i < graph->node_count; i++)
+    {
+        JobGraphNode *node = &graph->nodes[i];
+        printf("%-24s %9.2f %9.2f %9.2f\n", node->name, (node->start - start) * ms_per_tick,
+               (node->end - start) * ms_per_tick, (node->end - node->start) * ms_per_tick);
+    }
+
+    printf("%-24s %9.2f %9.2f %9.2f\n", "models", (models_start - start) * ms_per_tick,
+           (models_end - start) * ms_per_tick, (models_end - models_start) * ms_per_tick);
+    printf("%-24s %9s %9.2f\n", "first frame", "", (first_frame - start) * ms_per_tick);
+}
+
+#ifdef _WIN32
+struct WindowRequest
+{
+    Arena *arena;
+    u32 width;
+    u32 height;
+    Platform *platform;
+};
+
+// Called by CreateEngine on this thread, while the device is created.
+static void *CreateMainWindow(void *data)
+{
+    WindowRequest *request = (WindowRequest *)data;
+    request->platform = CreatePlatform(request->arena, request->width, request->height, "This works too");
+    return request->platform->window;
+}
+#endif
+
+int main(int argc, char **argv)
+{
+    u64 start = OsTimeNow();
+    PROFILE_INIT();
+    AppOptions options = ParseOptions(argc, argv);
     Arena global_arena = CreateNewArena(0, 10 * MB);
-    Arena platform_arena = CreateNewArena(&global_arena, sizeof(Platform));
-    Platform *platform = CreatePlatform(&platform_arena, 800, 600, "This works too");
 
-    Engine engine = CreateEngine(platform->window);
-    Model model = EngineLoadCompiledModel(&engine, "out.cmdl");
-    Model model2 = model;
+#ifdef _WIN32
+    Arena platform_arena = {};
+    WindowRequest window = {};
+    if(!options.headless)
+    {
+        platform_arena = CreateNewArena(&global_arena, sizeof(Platform));
+        window.arena = &platform_arena;
+        window.width = options.engine.width;
+        window.height = options.engine.height;
+        options.engine.create_window = CreateMainWindow;
+        options.engine.window_data = &window;
+    }
+#endif
+
+    AssetId preload[] = {ASSET("out.cmdl")};
+    options.engine.preload_models = preload;
+    options.engine.preload_model_count = 1;
+
+    Arena engine_arena = CreateNewArena(&global_arena, 4 * MB);
+    Engine engine = CreateEngine(&engine_arena, options.engine);
+#ifdef _WIN32
+    Platform *platform = window.platform;
+#endif
+
+    u64 models_start = OsTimeNow();
+    Model model = EngineLoadCompiledModel(&engine, ASSET("out.cmdl"));
+    Model model2 = EngineLoadCompiledModel(&engine, ASSET("out.cmdl"));
+    u64 models_end = OsTimeNow();
+
+    TransformSystem *transforms = CreateTransformSystem(&engine_arena, MAX_SCENE_TRANSFORMS, engine.jobs);
+    TransformHandle model_transform = TransformCreate(transforms, {});
+    TransformHandle model2_transform = TransformCreate(transforms, {});
+    TransformSetPosition(transforms, model2_transform, HMM_V3(0, 2, 0));
 
     Camera camera = {};
     camera.cam_pos = {0, 1, -3};
@@ -22,33 +275,165 @@ int main(void)
 
     ProjectionInfo proj_info = {};
     proj_info.fov_rad = 1.57;
-    proj_info.width = 800;
-    proj_info.height = 600;
+    proj_info.width = options.engine.width;
+    proj_info.height = options.engine.height;
     proj_info.near_plane = 0.01;
     CameraSetProjection(&camera, proj_info);
 
-    float i = 0;
-    while(true)
+    camera.prev_pos = camera.cam_pos;
+    camera.prev_dir = camera.cam_dir;
+
+    PointLight *lights = 0;
+    if(options.light_count)
     {
-        PlatformPollEvents(platform);
+        lights = (PointLight *)ArenaAlloc(&global_arena, sizeof(PointLight) * options.light_count, 0);
+    }
+
+    SimState sim = {};
+
+    const float dt = 1.0f / SIM_HZ;
+    u64 frequency = OsTimeFrequency();
+    u64 step_ticks = frequency / SIM_HZ;
+    u64 frame_ticks = options.max_fps ? frequency / options.max_fps : 0;
+    u64 accumulator = 0;
+    u64 last_time = OsTimeNow();
+
+    u32 frame_count = 0;
+    CameraInput input = {};
+    ReadbackFrame readback = {};
+    for(;;)
+    {
+        PROFILE_ZONE("Frame");
+        u64 frame_start = OsTimeNow();
+        accumulator += frame_start - last_time;
+        last_time = frame_start;
+
+        if(options.headless)
+        {
+            if(frame_count++ >= options.run_frames)
+            {
+                break;
+            }
+
+            // One step per frame so that captures are reproducible
+            // regardless of how fast the device is.
+            accumulator = step_ticks;
+        }
 
-        CameraUpdate(&camera, platform->cursor_delta);
+#ifdef _WIN32
+        else
+        {
+            EngineWaitLatency(&engine);
+            {
+                PROFILE_ZONE("PollEvents");
+                PlatformPollEvents(platform);
+            }
+
+            if(platform->quit)
+            {
+                break;
+            }
+
+            input.forward = (GetKeyState('W') & 0x8000) != 0;
+            input.back = (GetKeyState('S') & 0x8000) != 0;
+            input.left = (GetKeyState('A') & 0x8000) != 0;
+            input.right = (GetKeyState('D') & 0x8000) != 0;
+            input.look_x += platform->cursor_delta.x;
+            input.look_y += platform->cursor_delta.y;
+        }
+#endif
+
+        // Drop time we cannot catch up on rather than spiralling after a
+        // long stall such as a window drag or a breakpoint.
+        if(accumulator > MAX_SIM_STEPS * step_ticks)
+        {
+            accumulator = MAX_SIM_STEPS * step_ticks;
+        }
+
+        while(accumulator >= step_ticks)
+        {
+            PROFILE_ZONE("Simulate");
+            CameraUpdate(&camera, input, dt);
+            sim.prev_angle = sim.angle;
+            sim.angle += dt;
+
+            // Mouse deltas are consumed by the first step; they carry over
+            // to the next frame when no step runs.
+            input.look_x = 0;
+            input.look_y = 0;
+            accumulator -= step_ticks;
+        }
+
+        float alpha = (float)accumulator / step_ticks;
+        CameraInterpolate(&camera, alpha);
+        float angle = HMM_Lerp(sim.prev_angle, alpha, sim.angle);
 
         u32 index = EngineBegin(&engine);
-        
-        i += 1.0/60;
-        model.model_matrix = HMM_Rotate_LH(i, {0, 1, 0});
-        model2.model_matrix = HMM_Translate({0, 2, 0}) * HMM_Rotate_LH(-i, {0, 1, 0});
-        
-        Texture swap_texture = EngineGetSwapChainImage(&engine, index);
-        EngineBeginRendering(&engine, swap_texture, &engine.depth, {0.4, 0.5, 0.7, 1.0});
-        
-        EngineDrawModel(&engine, camera.transform, model);
-        EngineDrawModel(&engine, camera.transform, model2);
-        
+
+        TransformSetRotation(transforms, model_transform, HMM_QFromAxisAngle_LH(HMM_V3(0, 1, 0), angle));
+        TransformSetRotation(transforms, model2_transform, HMM_QFromAxisAngle_LH(HMM_V3(0, 1, 0), -angle));
+        TransformUpdate(transforms);
+
+        if(lights)
+        {
+            PlaceLights(lights, options.light_count, angle);
+            EngineSetLights(&engine, camera.view, camera.projection, HMM_V3(0.2f, 0.2f, 0.25f),
+                            lights, options.light_count);
+        }
+
+        Texture scene_target = EngineGetSceneTarget(&engine, index);
+        EngineBeginRendering(&engine, scene_target, &engine.depth, {0.4, 0.5, 0.7, 1.0});
+
+        EngineDrawModel(&engine, camera.transform, model, TransformWorld(transforms, model_transform));
+        EngineDrawModel(&engine, camera.transform, model2, TransformWorld(transforms, model2_transform));
+
         EngineEndRendering(&engine);
         EngineEnd(&engine, index);
+        if(options.print_startup && engine.frame_number == 1)
+        {
+            PrintStartup(engine.startup, start, models_start, models_end, OsTimeNow());
+        }
+
+        while(EngineReadback(&engine, &readback, false))
+        {
+        }
+
+        if(frame_ticks && !options.headless)
+        {
+            PROFILE_ZONE("Sleep");
+            OsSleepUntil(frame_start + frame_ticks);
+        }
+    }
+
+    if(options.headless)
+    {
+        while(EngineReadback(&engine, &readback, true))
+        {
+        }
+
+        if(options.dump_path && readback.pixels && !WritePPM(options.dump_path, &readback))
+        {
+            printf("failed to write %s\n", options.dump_path);
+        }
+    }
+
+    EngineUnloadModel(&engine, &model);
+    EngineUnloadModel(&engine, &model2);
+    if(options.engine.capture_path && !EngineEndCapture(&engine))
+    {
+        printf("failed to write %s\n", options.engine.capture_path);
+    }
+
+    DestroyEngine(&engine);
+#ifdef PROFILE
+    if(options.trace_path && !ProfilerWriteTrace(options.trace_path))
+    {
+        printf("failed to write %s\n", options.trace_path);
     }
+#endif
 
+#ifdef _WIN32
     ExitProcess(0);
+#endif
+    return 0;
 }
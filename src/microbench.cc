@@ -0,0 +1,1534 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "os.hh"
+#include "dds.hh"
+#include "engine.hh"
+#include "camera.hh"
+#include "transform.hh"
+#include "simd_math.hh"
+#include "light_cluster.hh"
+#include "animation.hh"
+#include "render_graph.hh"
+#include "assets.hh"
+#include "arena_alloc.hh"
+#include "third_party/HandmadeMath.h"
+
+#define MAX_MICRO_BENCHES 48
+#define MAX_MICRO_REPS 101
+#define MICRO_REP_SECONDS 0.01
+#define MICRO_WARMUP_SECONDS 0.05
+#define MICRO_TRANSFORM_ROOTS 1024
+#define MICRO_TRANSFORM_NODES (MICRO_TRANSFORM_ROOTS * 16)
+#define MICRO_KERNEL_ELEMENTS 1024
+#define MICRO_KERNEL_TOLERANCE 1e-4f
+#define MICRO_LIGHTS 512
+#define MICRO_ANIM_CHARACTERS 256
+#define MICRO_ANIM_JOINTS 64
+#define MICRO_ANIM_FRAMES 60
+
+typedef void MicroBenchProc(void *data, u32 iterations);
+
+struct MicroBench
+{
+    const char *name;
+    MicroBenchProc *proc;
+    void *data;
+    // Work items per call, so results read as time per vertex, per byte...
+    u32 ops_per_call;
+};
+
+struct MicroResult
+{
+    const char *name;
+    u32 iterations;
+    u32 reps;
+    double median_ns;
+    double mean_ns;
+    double stddev_ns;
+    double min_ns;
+};
+
+struct MicroSettings
+{
+    u32 reps;
+    const char *filter;
+    const char *output_path;
+    const char *baseline_path;
+    double tolerance;
+
+    const char *cmdl_path;
+    u32 cmdl_vertices;
+    u32 cmdl_joints;
+    const char *dds_path;
+    u32 dds_size;
+};
+
+// Stores results somewhere the optimizer cannot see through.
+static volatile float micro_sink;
+
+static void PrintUsage(void)
+{
+    printf("usage: microbench [options]\n"
+           "  -filter text            only run benchmarks whose name contains text\n"
+           "  -reps N                 timed repetitions per benchmark (default 15)\n"
+           "  -o file.json            write results\n"
+           "  -baseline file.json     compare against earlier results, fail on regression\n"
+           "  -tolerance F            allowed slowdown over the baseline (default 0.10)\n"
+           "  -gen-cmdl file N        write a synthetic CMDL with N vertices and exit\n"
+           "  -skin J                 give the generated CMDL a skin of J joints\n"
+           "  -gen-dds file S         write a synthetic SxS BC7 DDS with mips and exit\n");
+}
+
+static bool ParseArgs(int argc, char **argv, MicroSettings *settings)
+{
+    *settings = {};
+    settings->reps = 15;
+    settings->tolerance = 0.10;
+
+    for(int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        if(strcmp(arg, "-filter") == 0 && i + 1 < argc) settings->filter = argv[++i];
+        else if(strcmp(arg, "-reps") == 0 && i + 1 < argc) settings->reps = atoi(argv[++i]);
+        else if(strcmp(arg, "-o") == 0 && i + 1 < argc) settings->output_path = argv[++i];
+        else if(strcmp(arg, "-baseline") == 0 && i + 1 < argc) settings->baseline_path = argv[++i];
+        else if(strcmp(arg, "-tolerance") == 0 && i + 1 < argc) settings->tolerance = atof(argv[++i]);
+        else if(strcmp(arg, "-skin") == 0 && i + 1 < argc) settings->cmdl_joints = atoi(argv[++i]);
+
+        else if(strcmp(arg, "-gen-cmdl") == 0 && i + 2 < argc)
+        {
+            settings->cmdl_path = argv[++i];
+            settings->cmdl_vertices = atoi(argv[++i]);
+        }
+
+        else if(strcmp(arg, "-gen-dds") == 0 && i + 2 < argc)
+        {
+            settings->dds_path = argv[++i];
+            settings->dds_size = atoi(argv[++i]);
+        }
+
+        else return false;
+    }
+
+    if(settings->reps == 0) settings->reps = 1;
+    if(settings->reps > MAX_MICRO_REPS) settings->reps = MAX_MICRO_REPS;
+    return true;
+}
+
+// Synthetic CMDL: 16-byte vertices with half-float positions on a sphere of
+// radius 2 and a triangle list over consecutive vertices. With joints, a
+// skin of a chain of joints running up the sphere, each vertex weighted
+// between the two joints nearest its height.
+static u64 GenerateCMDL(Arena *arena, u32 vertex_count, u32 joint_count, void **out)
+{
+    u32 index_count = (vertex_count / 3) * 3;
+    u32 vertex_size = vertex_count * 16;
+    u32 index_size = index_count * sizeof(u32);
+    u64 size = sizeof(u32) * 2 + vertex_size + index_size;
+    u64 skin_size = 0;
+    if(joint_count > MAX_JOINTS)
+    {
+        return 0;
+    }
+
+    if(joint_count)
+    {
+        skin_size = sizeof(CompiledSkin) + (u64)vertex_count * SKIN_VERTEX_SIZE +
+                    ((joint_count * sizeof(u16) + 15) & ~15) + joint_count * sizeof(HMM_Mat4);
+    }
+
+    size += skin_size;
+
+    u8 *data = (u8 *)ArenaAlloc(arena, size, 0);
+    if(!data)
+    {
+        return 0;
+    }
+
+    CompiledMDL *mdl = (CompiledMDL *)data;
+    mdl->vertex_size = vertex_size;
+    mdl->index_size = index_size;
+
+    u8 *vertices = (u8 *)&mdl->data_begin;
+    u32 *indices = (u32 *)(vertices + vertex_size);
+    for(u32 i = 0; i < vertex_count; i++)
+    {
+        float theta = i * 2.399963f;
+        float y = 1.0f - 2.0f * (i + 0.5f) / vertex_count;
+        float r = HMM_SqrtF(1.0f - y * y);
+        float position[3] = {2.0f * r * HMM_CosF(theta), 2.0f * y, 2.0f * r * HMM_SinF(theta)};
+
+        u16 *vertex = (u16 *)(vertices + i * 16);
+        memset(vertex, 0, 16);
+        for(u32 c = 0; c < 3; c++)
+        {
+            // Truncating float to half conversion; exact enough for bounds.
+            u32 bits;
+            memcpy(&bits, &position[c], 4);
+            i32 exponent = (i32)((bits >> 23) & 0xff) - 127 + 15;
+            u16 half = (u16)((bits >> 16) & 0x8000);
+            if(exponent > 0 && exponent < 31)
+            {
+                half |= (u16)((exponent << 10) | ((bits >> 13) & 0x3ff));
+            }
+            vertex[c] = half;
+        }
+    }
+
+    for(u32 i = 0; i < index_count; i++)
+    {
+        indices[i] = i;
+    }
+
+    if(joint_count)
+    {
+        CompiledSkin skin = {SKIN_MAGIC, joint_count, vertex_count, 0};
+        u8 *at = (u8 *)(indices + index_count);
+        memcpy(at, &skin, sizeof(CompiledSkin));
+        at += sizeof(CompiledSkin);
+
+        float spacing = joint_count > 1 ? 4.0f / (joint_count - 1) : 0.0f;
+        for(u32 i = 0; i < vertex_count; i++)
+        {
+            float y = 2.0f - 4.0f * (i + 0.5f) / vertex_count;
+            float along = joint_count > 1 ? (y + 2.0f) / spacing : 0.0f;
+            u32 joint = (u32)along < joint_count - 1 ? (u32)along : joint_count - 1;
+            u32 next = joint + 1 < joint_count ? joint + 1 : joint;
+            u8 weight = (u8)((along - joint) * 255.0f + 0.5f);
+            u8 vertex[SKIN_VERTEX_SIZE] = {(u8)joint, (u8)next, 0, 0, (u8)(255 - weight), weight, 0, 0};
+            memcpy(at, vertex, SKIN_VERTEX_SIZE);
+            at += SKIN_VERTEX_SIZE;
+        }
+
+        u8 *parents = at;
+        memset(parents, 0, (joint_count * sizeof(u16) + 15) & ~15);
+        at += (joint_count * sizeof(u16) + 15) & ~15;
+        for(u32 joint = 0; joint < joint_count; joint++)
+        {
+            u16 parent = joint ? (u16)(joint - 1) : MATH_NO_PARENT;
+            HMM_Mat4 inverse_bind = HMM_Translate(HMM_V3(0, 2.0f - joint * spacing, 0));
+            memcpy(parents + joint * sizeof(u16), &parent, sizeof(u16));
+            memcpy(at + joint * sizeof(HMM_Mat4), &inverse_bind, sizeof(HMM_Mat4));
+        }
+    }
+
+    *out = data;
+    return size;
+}
+
+// Synthetic DDS: DX10 header, BC7, full mip chain, zeroed blocks.
+static u64 GenerateDDS(Arena *arena, u32 size, void **out)
+{
+    u32 mip_count = 1;
+    while((size >> mip_count) > 0) mip_count++;
+
+    u32 block_size = DDSBlockSize(DDS_FORMAT_BC7);
+    u64 data_size = 0;
+    for(u32 i = 0; i < mip_count; i++)
+    {
+        u32 s = size >> i ? size >> i : 1;
+        data_size += DDSMipSize(s, s, block_size);
+    }
+
+    u8 header[256];
+    u32 header_size = DDSWriteHeader(header, DDS_FORMAT_BC7, size, size, mip_count);
+    u8 *data = (u8 *)ArenaAlloc(arena, header_size + data_size, 0);
+    if(!data)
+    {
+        return 0;
+    }
+
+    memcpy(data, header, header_size);
+    memset(data + header_size, 0, data_size);
+    *out = data;
+    return header_size + data_size;
+}
+
+struct ArenaBench
+{
+    Arena arena;
+};
+
+static void BenchArenaAlloc(void *data, u32 iterations)
+{
+    ArenaBench *bench = (ArenaBench *)data;
+    for(u32 i = 0; i < iterations; i++)
+    {
+        if(!ArenaAlloc(&bench->arena, 16, 0))
+        {
+            ArenaClear(&bench->arena);
+        }
+    }
+}
+
+static void BenchArenaAllocAligned(void *data, u32 iterations)
+{
+    ArenaBench *bench = (ArenaBench *)data;
+    for(u32 i = 0; i < iterations; i++)
+    {
+        if(!ArenaAlloc(&bench->arena, 24, 64))
+        {
+            ArenaClear(&bench->arena);
+        }
+    }
+}
+
+static void BenchTempArena(void *data, u32 iterations)
+{
+    ArenaBench *bench = (ArenaBench *)data;
+    for(u32 i = 0; i < iterations; i++)
+    {
+        TempArena temp = BeginTempArena(&bench->arena);
+        ArenaAlloc(&bench->arena, 64, 0);
+        ArenaAlloc(&bench->arena, 256, 16);
+        EndTempArena(temp);
+    }
+}
+
+struct MathBench
+{
+    HMM_Mat4 a;
+    HMM_Mat4 b;
+    Camera camera;
+};
+
+static void BenchMat4Mul(void *data, u32 iterations)
+{
+    MathBench *bench = (MathBench *)data;
+    HMM_Mat4 m = bench->a;
+    for(u32 i = 0; i < iterations; i++)
+    {
+        m = m * bench->b;
+    }
+    micro_sink = m.Elements[3][3];
+}
+
+static void BenchLookAt(void *data, u32 iterations)
+{
+    HMM_Vec3 eye = {0, 1, -3};
+    float sum = 0;
+    for(u32 i = 0; i < iterations; i++)
+    {
+        eye.X += 0.001f;
+        HMM_Mat4 view = HMM_LookAt_RH(eye, HMM_V3(0, 0, 0), HMM_V3(0, 1, 0));
+        sum += view.Elements[3][0];
+    }
+    micro_sink = sum;
+}
+
+static void BenchCameraUpdate(void *data, u32 iterations)
+{
+    MathBench *bench = (MathBench *)data;
+    CameraInput input = {};
+    input.forward = true;
+    input.look_x = 1;
+    for(u32 i = 0; i < iterations; i++)
+    {
+        CameraUpdate(&bench->camera, input, 1.0f / 60);
+        CameraInterpolate(&bench->camera, 0.5f);
+    }
+    micro_sink = bench->camera.transform.Elements[0][0];
+}
+
+struct FileBench
+{
+    void *data;
+    u64 size;
+};
+
+static void BenchDDSParse(void *data, u32 iterations)
+{
+    FileBench *bench = (FileBench *)data;
+    u64 total = 0;
+    for(u32 i = 0; i < iterations; i++)
+    {
+        DDSInfo info;
+        DDSParse(bench->data, bench->size, &info);
+        total += info.data_size;
+    }
+    micro_sink = (float)total;
+}
+
+static void BenchDDSMipSizes(void *data, u32 iterations)
+{
+    u64 total = 0;
+    for(u32 i = 0; i < iterations; i++)
+    {
+        u32 w = 4096 + (i & 1);
+        u32 h = 2048;
+        while(w > 1 || h > 1)
+        {
+            total += DDSMipSize(w, h, 16);
+            w = w > 1 ? w / 2 : 1;
+            h = h > 1 ? h / 2 : 1;
+        }
+    }
+    micro_sink = (float)total;
+}
+
+static void BenchCMDLBounds(void *data, u32 iterations)
+{
+    FileBench *bench = (FileBench *)data;
+    CompiledMDL *mdl = (CompiledMDL *)bench->data;
+    float sum = 0;
+    for(u32 i = 0; i < iterations; i++)
+    {
+        sum += ModelBoundsRadius(&mdl->data_begin, mdl->vertex_size);
+    }
+    micro_sink = sum;
+}
+
+static void BenchAssetHash(void *data, u32 iterations)
+{
+    FileBench *bench = (FileBench *)data;
+    u64 hash = 0;
+    for(u32 i = 0; i < iterations; i++)
+    {
+        hash ^= AssetHashBytes(bench->data, bench->size);
+    }
+    micro_sink = (float)hash;
+}
+
+struct DrawBench
+{
+    Engine *engine;
+    RenderPassData pass;
+    Model model;
+    HMM_Mat4 world;
+    HMM_Mat4 view_proj;
+};
+
+static void BenchDrawModel(void *data, u32 iterations)
+{
+    DrawBench *bench = (DrawBench *)data;
+    Engine *engine = bench->engine;
+    for(u32 i = 0; i < iterations; i++)
+    {
+        if(engine->draw_count == MAX_DRAWS)
+        {
+            engine->draw_count = 0;
+            bench->pass.draw_count = 0;
+        }
+
+        EngineDrawModel(engine, bench->view_proj, bench->model, bench->world);
+    }
+}
+
+// Roots with three children of four children each. Single threaded, so
+// the numbers are the per node cost rather than the machine's core count.
+struct TransformBench
+{
+    TransformSystem *system;
+    TransformHandle roots[MICRO_TRANSFORM_ROOTS];
+    float angle;
+};
+
+static void BenchTransformClean(void *data, u32 iterations)
+{
+    TransformBench *bench = (TransformBench *)data;
+    for(u32 i = 0; i < iterations; i++)
+    {
+        TransformUpdate(bench->system);
+    }
+    micro_sink = bench->system->worlds[0].Elements[3][0];
+}
+
+static void BenchTransformDirty(void *data, u32 iterations)
+{
+    TransformBench *bench = (TransformBench *)data;
+    for(u32 i = 0; i < iterations; i++)
+    {
+        bench->angle += 0.001f;
+        HMM_Quat rotation = HMM_QFromAxisAngle_LH(HMM_V3(0, 1, 0), bench->angle);
+        for(u32 r = 0; r < MICRO_TRANSFORM_ROOTS; r++)
+        {
+            TransformSetRotation(bench->system, bench->roots[r], rotation);
+        }
+        TransformUpdate(bench->system);
+    }
+    micro_sink = bench->system->worlds[MICRO_TRANSFORM_NODES - 1].Elements[3][0];
+}
+
+// Inputs shared by the batched kernel benchmarks of every instruction set.
+struct KernelData
+{
+    HMM_Mat4 *left;
+    HMM_Mat4 *right;
+    HMM_Vec3 *positions;
+    HMM_Quat *rotations;
+    HMM_Vec3 *scales;
+    HMM_Vec4 *spheres;
+    HMM_Mat4 *out;
+    HMM_Vec4 *out_spheres;
+
+    // Structure-of-arrays transforms, MICRO_KERNEL_ELEMENTS to a channel,
+    // and parents in chains of four.
+    float *trs_a;
+    float *trs_b;
+    float *trs_out;
+    u16 *parents;
+};
+
+struct KernelBench
+{
+    KernelData *data;
+    MathKernels kernels;
+    char names[6][32];
+};
+
+static void BenchKernelMulMat4(void *data, u32 iterations)
+{
+    KernelBench *bench = (KernelBench *)data;
+    KernelData *d = bench->data;
+    for(u32 i = 0; i < iterations; i++)
+    {
+        bench->kernels.mul_mat4(d->out, d->left[i % MICRO_KERNEL_ELEMENTS], d->right, MICRO_KERNEL_ELEMENTS);
+    }
+    micro_sink = d->out[0].Elements[3][0];
+}
+
+static void BenchKernelComposeTRS(void *data, u32 iterations)
+{
+    KernelBench *bench = (KernelBench *)data;
+    KernelData *d = bench->data;
+    for(u32 i = 0; i < iterations; i++)
+    {
+        bench->kernels.compose_trs(d->out, d->positions, d->rotations, d->scales, MICRO_KERNEL_ELEMENTS);
+    }
+    micro_sink = d->out[0].Elements[0][0];
+}
+
+static void BenchKernelSpheres(void *data, u32 iterations)
+{
+    KernelBench *bench = (KernelBench *)data;
+    KernelData *d = bench->data;
+    for(u32 i = 0; i < iterations; i++)
+    {
+        bench->kernels.transform_spheres(d->out_spheres, d->left, d->spheres, MICRO_KERNEL_ELEMENTS);
+    }
+    micro_sink = d->out_spheres[0].W;
+}
+
+static void BenchKernelBlendTRS(void *data, u32 iterations)
+{
+    KernelBench *bench = (KernelBench *)data;
+    KernelData *d = bench->data;
+    for(u32 i = 0; i < iterations; i++)
+    {
+        bench->kernels.blend_trs(d->trs_out, d->trs_a, d->trs_b, 0.3f, MICRO_KERNEL_ELEMENTS, MICRO_KERNEL_ELEMENTS);
+    }
+    micro_sink = d->trs_out[0];
+}
+
+static void BenchKernelComposeTRSSoA(void *data, u32 iterations)
+{
+    KernelBench *bench = (KernelBench *)data;
+    KernelData *d = bench->data;
+    for(u32 i = 0; i < iterations; i++)
+    {
+        bench->kernels.compose_trs_soa(d->out, d->trs_a, MICRO_KERNEL_ELEMENTS, MICRO_KERNEL_ELEMENTS);
+    }
+    micro_sink = d->out[0].Elements[0][0];
+}
+
+static void BenchKernelHierarchy(void *data, u32 iterations)
+{
+    KernelBench *bench = (KernelBench *)data;
+    KernelData *d = bench->data;
+    for(u32 i = 0; i < iterations; i++)
+    {
+        bench->kernels.mul_mat4_hierarchy(d->out, d->right, d->parents, MICRO_KERNEL_ELEMENTS);
+    }
+    micro_sink = d->out[0].Elements[3][0];
+}
+
+static float KernelRandom(u32 *state)
+{
+    *state = *state * 1664525 + 1013904223;
+    return (float)(*state >> 8) / (float)(1 << 24) * 2.0f - 1.0f;
+}
+
+static bool CreateKernelData(Arena *arena, KernelData *data)
+{
+    u32 count = MICRO_KERNEL_ELEMENTS;
+    data->left = (HMM_Mat4 *)ArenaAlloc(arena, sizeof(HMM_Mat4) * count, 64);
+    data->right = (HMM_Mat4 *)ArenaAlloc(arena, sizeof(HMM_Mat4) * count, 64);
+    data->positions = (HMM_Vec3 *)ArenaAlloc(arena, sizeof(HMM_Vec3) * count, 64);
+    data->rotations = (HMM_Quat *)ArenaAlloc(arena, sizeof(HMM_Quat) * count, 64);
+    data->scales = (HMM_Vec3 *)ArenaAlloc(arena, sizeof(HMM_Vec3) * count, 64);
+    data->spheres = (HMM_Vec4 *)ArenaAlloc(arena, sizeof(HMM_Vec4) * count, 64);
+    data->out = (HMM_Mat4 *)ArenaAlloc(arena, sizeof(HMM_Mat4) * count, 64);
+    data->out_spheres = (HMM_Vec4 *)ArenaAlloc(arena, sizeof(HMM_Vec4) * count, 64);
+    data->trs_a = (float *)ArenaAlloc(arena, sizeof(float) * MATH_TRS_CHANNELS * count, 64);
+    data->trs_b = (float *)ArenaAlloc(arena, sizeof(float) * MATH_TRS_CHANNELS * count, 64);
+    data->trs_out = (float *)ArenaAlloc(arena, sizeof(float) * MATH_TRS_CHANNELS * count, 64);
+    data->parents = (u16 *)ArenaAlloc(arena, sizeof(u16) * count, 64);
+    if(!data->left || !data->right || !data->positions || !data->rotations ||
+       !data->scales || !data->spheres || !data->out || !data->out_spheres ||
+       !data->trs_a || !data->trs_b || !data->trs_out || !data->parents)
+    {
+        return false;
+    }
+
+    u32 state = 1;
+    for(u32 i = 0; i < count; i++)
+    {
+        for(u32 j = 0; j < 16; j++)
+        {
+            data->left[i].Elements[j / 4][j % 4] = KernelRandom(&state);
+            data->right[i].Elements[j / 4][j % 4] = KernelRandom(&state);
+        }
+
+        data->positions[i] = HMM_V3(KernelRandom(&state), KernelRandom(&state), KernelRandom(&state)) * 10.0f;
+        data->rotations[i] = HMM_Q(KernelRandom(&state), KernelRandom(&state), KernelRandom(&state), KernelRandom(&state) + 2.0f);
+        data->scales[i] = HMM_V3(KernelRandom(&state), KernelRandom(&state), KernelRandom(&state)) + HMM_V3(2, 2, 2);
+        data->spheres[i] = HMM_V4(KernelRandom(&state), KernelRandom(&state), KernelRandom(&state), KernelRandom(&state) + 2.0f);
+        data->parents[i] = i % 4 ? (u16)(i - 1) : MATH_NO_PARENT;
+
+        float *trs[2] = {data->trs_a, data->trs_b};
+        for(u32 t = 0; t < 2; t++)
+        {
+            HMM_Quat rotation = HMM_NormQ(HMM_Q(KernelRandom(&state), KernelRandom(&state),
+                                                KernelRandom(&state), KernelRandom(&state) + 0.1f));
+            for(u32 c = 0; c < 3; c++)
+            {
+                trs[t][(MATH_TX + c) * count + i] = KernelRandom(&state) * 10.0f;
+                trs[t][(MATH_SX + c) * count + i] = KernelRandom(&state) + 2.0f;
+            }
+
+            for(u32 c = 0; c < 4; c++)
+            {
+                trs[t][(MATH_QX + c) * count + i] = rotation.Elements[c];
+            }
+        }
+    }
+
+    return true;
+}
+
+static bool KernelMatches(const char *kernel, const char *isa, const float *a, const float *b, u32 count)
+{
+    for(u32 i = 0; i < count; i++)
+    {
+        if(fabsf(a[i] - b[i]) > MICRO_KERNEL_TOLERANCE * (1.0f + fabsf(b[i])))
+        {
+            printf("microbench: %s %s differs from scalar at float %u: %f vs %f\n", kernel, isa, i, a[i], b[i]);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Only the first count elements of each channel are written.
+static bool KernelTRSMatches(const char *kernel, const char *isa, const float *a, const float *b, u32 stride, u32 count)
+{
+    bool passed = true;
+    for(u32 c = 0; c < MATH_TRS_CHANNELS && passed; c++)
+    {
+        passed = KernelMatches(kernel, isa, a + c * stride, b + c * stride, count);
+    }
+
+    return passed;
+}
+
+// Every instruction set the CPU has must agree with the scalar HandmadeMath
+// results before any of them is timed. Odd counts exercise the tails.
+static bool CheckKernels(Arena *arena, KernelData *data)
+{
+    TempArena temp = BeginTempArena(arena);
+    u32 count = MICRO_KERNEL_ELEMENTS - 3;
+    HMM_Mat4 *expected = (HMM_Mat4 *)ArenaAlloc(arena, sizeof(HMM_Mat4) * count, 64);
+    HMM_Vec4 *expected_spheres = (HMM_Vec4 *)ArenaAlloc(arena, sizeof(HMM_Vec4) * count, 64);
+    float *expected_trs = (float *)ArenaAlloc(arena, sizeof(float) * MATH_TRS_CHANNELS * MICRO_KERNEL_ELEMENTS, 64);
+    if(!expected || !expected_spheres || !expected_trs)
+    {
+        EndTempArena(temp);
+        return false;
+    }
+
+    MathKernels scalar;
+    MathGetKernels(MATH_SCALAR, &scalar);
+
+    bool passed = true;
+    for(u32 isa = MATH_SCALAR + 1; isa < MATH_ISA_COUNT; isa++)
+    {
+        MathKernels kernels;
+        if(!MathGetKernels((MathIsa)isa, &kernels))
+        {
+            continue;
+        }
+
+        scalar.mul_mat4(expected, data->left[0], data->right, count);
+        kernels.mul_mat4(data->out, data->left[0], data->right, count);
+        passed &= KernelMatches("mul_mat4", kernels.name, (float *)data->out, (float *)expected, count * 16);
+
+        scalar.mul_mat4_pairs(expected, data->left, data->right, count);
+        kernels.mul_mat4_pairs(data->out, data->left, data->right, count);
+        passed &= KernelMatches("mul_mat4_pairs", kernels.name, (float *)data->out, (float *)expected, count * 16);
+
+        scalar.compose_trs(expected, data->positions, data->rotations, data->scales, count);
+        kernels.compose_trs(data->out, data->positions, data->rotations, data->scales, count);
+        passed &= KernelMatches("compose_trs", kernels.name, (float *)data->out, (float *)expected, count * 16);
+
+        scalar.transform_spheres(expected_spheres, data->left, data->spheres, count);
+        kernels.transform_spheres(data->out_spheres, data->left, data->spheres, count);
+        passed &= KernelMatches("transform_spheres", kernels.name, (float *)data->out_spheres,
+                                (float *)expected_spheres, count * 4);
+
+        // The blend goes to the output first and then in place over the
+        // first input's copy, which must give the same.
+        u32 stride = MICRO_KERNEL_ELEMENTS;
+        scalar.blend_trs(expected_trs, data->trs_a, data->trs_b, 0.3f, stride, count);
+        kernels.blend_trs(data->trs_out, data->trs_a, data->trs_b, 0.3f, stride, count);
+        passed &= KernelTRSMatches("blend_trs", kernels.name, data->trs_out, expected_trs, stride, count);
+        memcpy(data->trs_out, data->trs_a, sizeof(float) * MATH_TRS_CHANNELS * stride);
+        kernels.blend_trs(data->trs_out, data->trs_out, data->trs_b, 0.3f, stride, count);
+        passed &= KernelTRSMatches("blend_trs in place", kernels.name, data->trs_out, expected_trs, stride, count);
+
+        scalar.compose_trs_soa(expected, expected_trs, stride, count);
+        kernels.compose_trs_soa(data->out, expected_trs, stride, count);
+        passed &= KernelMatches("compose_trs_soa", kernels.name, (float *)data->out, (float *)expected, count * 16);
+
+        scalar.mul_mat4_hierarchy(expected, data->right, data->parents, count);
+        kernels.mul_mat4_hierarchy(data->out, data->right, data->parents, count);
+        passed &= KernelMatches("mul_mat4_hierarchy", kernels.name, (float *)data->out, (float *)expected, count * 16);
+    }
+
+    EndTempArena(temp);
+    return passed;
+}
+
+// Lights scattered in front of a camera at the origin, binned on this
+// thread or on the job queue.
+struct LightBench
+{
+    LightClusters *clusters;
+    JobQueue *jobs;
+    ClusterBlock *block;
+    PointLight *lights;
+    HMM_Mat4 view;
+};
+
+static void BenchLightBin(void *data, u32 iterations)
+{
+    LightBench *bench = (LightBench *)data;
+    for(u32 i = 0; i < iterations; i++)
+    {
+        LightClustersCull(bench->clusters, bench->view, HMM_V3(0, 0, 0), bench->lights, MICRO_LIGHTS, bench->block);
+        LightClustersBin(bench->clusters, bench->jobs);
+    }
+    micro_sink = (float)bench->clusters->index_count;
+}
+
+static bool CreateLightBench(Arena *arena, HMM_Mat4 projection, LightBench *bench)
+{
+    bench->clusters = CreateLightClusters(arena);
+    bench->block = (ClusterBlock *)ArenaAlloc(arena, sizeof(ClusterBlock), 64);
+    bench->lights = (PointLight *)ArenaAlloc(arena, sizeof(PointLight) * MICRO_LIGHTS, 64);
+    if(!bench->clusters || !bench->block || !bench->lights)
+    {
+        return false;
+    }
+
+    LightClustersSetView(bench->clusters, 1280, 720, projection, 0.01f, CLUSTER_DEFAULT_FAR);
+    bench->view = HMM_M4D(1.0f);
+
+    u32 state = 1;
+    for(u32 i = 0; i < MICRO_LIGHTS; i++)
+    {
+        PointLight *light = &bench->lights[i];
+        light->position = HMM_V3(KernelRandom(&state) * 40.0f, KernelRandom(&state) * 10.0f,
+                                 KernelRandom(&state) * 60.0f - 62.0f);
+        light->radius = KernelRandom(&state) * 3.0f + 5.0f;
+        light->color = HMM_V3(1, 1, 1);
+        light->intensity = 1.0f;
+    }
+
+    return true;
+}
+
+// Binning on the job queue must give the same block as on one thread, and
+// both must list exactly the lights that testing every light against every
+// cluster finds, in light order.
+static bool CheckLightBinning(Arena *arena, LightBench *bench)
+{
+    TempArena temp = BeginTempArena(arena);
+    ClusterBlock *expected = (ClusterBlock *)ArenaAlloc(arena, sizeof(ClusterBlock), 64);
+    if(!expected)
+    {
+        EndTempArena(temp);
+        return false;
+    }
+
+    LightClusters *clusters = bench->clusters;
+    memset(expected, 0, sizeof(ClusterBlock));
+    LightClustersCull(clusters, bench->view, HMM_V3(0, 0, 0), bench->lights, MICRO_LIGHTS, expected);
+    LightClustersBin(clusters, 0);
+
+    memset(bench->block, 0, sizeof(ClusterBlock));
+    LightClustersCull(clusters, bench->view, HMM_V3(0, 0, 0), bench->lights, MICRO_LIGHTS, bench->block);
+    LightClustersBin(clusters, bench->jobs);
+
+    bool passed = memcmp(expected, bench->block, sizeof(ClusterBlock)) == 0;
+    if(!passed)
+    {
+        printf("microbench: light binning on jobs differs from one thread\n");
+    }
+
+    for(u32 cluster = 0; cluster < CLUSTER_COUNT && passed; cluster++)
+    {
+        u32 at = expected->clusters[cluster][0];
+        u32 end = at + expected->clusters[cluster][1];
+        for(u32 light = 0; light < clusters->light_count && passed; light++)
+        {
+            if(LightClusterTouches(clusters, cluster, light))
+            {
+                passed = at < end && expected->indices[at++] == light;
+            }
+        }
+
+        if(!passed || at != end)
+        {
+            printf("microbench: light binning differs from brute force at cluster %u\n", cluster);
+            passed = false;
+        }
+    }
+
+    if(clusters->dropped || !clusters->index_count)
+    {
+        printf("microbench: light binning dropped %u of %u references\n", clusters->dropped,
+               clusters->index_count + clusters->dropped);
+        passed = false;
+    }
+
+    EndTempArena(temp);
+    return passed;
+}
+
+// Characters sharing the skeleton of a generated skin, each blending two
+// looping clips at its own times, animated on this thread or on the job
+// queue.
+struct AnimBench
+{
+    Skeleton skeleton;
+    AnimClip *clips[2];
+    AnimInstance *instances;
+    HMM_Mat4 *palettes;
+    JobQueue *jobs;
+};
+
+static void BenchAnimUpdate(void *data, u32 iterations)
+{
+    AnimBench *bench = (AnimBench *)data;
+    for(u32 i = 0; i < iterations; i++)
+    {
+        for(u32 c = 0; c < MICRO_ANIM_CHARACTERS; c++)
+        {
+            bench->instances[c].times[0] += 1.0f / 60.0f;
+            bench->instances[c].times[1] += 1.0f / 60.0f;
+        }
+
+        AnimUpdate(bench->instances, MICRO_ANIM_CHARACTERS, bench->jobs);
+    }
+    micro_sink = bench->palettes[0].Elements[3][1];
+}
+
+// Every joint sways about its bind pose, a different phase per joint and
+// a different axis per clip.
+static bool CreateAnimBench(Arena *arena, AnimBench *bench)
+{
+    void *cmdl = 0;
+    u64 size = GenerateCMDL(arena, 3 * 256, MICRO_ANIM_JOINTS, &cmdl);
+    const CompiledSkin *skin = size ? FindCompiledSkin(cmdl, size) : 0;
+    if(!skin || !LoadSkeleton(arena, skin, &bench->skeleton))
+    {
+        return false;
+    }
+
+    Skeleton *skeleton = &bench->skeleton;
+    u32 pose_size = MATH_TRS_CHANNELS * skeleton->stride;
+    float *poses = (float *)ArenaAlloc(arena, sizeof(float) * pose_size * MICRO_ANIM_FRAMES, 64);
+    bench->instances = (AnimInstance *)ArenaAlloc(arena, sizeof(AnimInstance) * MICRO_ANIM_CHARACTERS, 64);
+    bench->palettes = (HMM_Mat4 *)ArenaAlloc(arena, sizeof(HMM_Mat4) * skeleton->joint_count * MICRO_ANIM_CHARACTERS, 64);
+    if(!poses || !bench->instances || !bench->palettes)
+    {
+        return false;
+    }
+
+    for(u32 clip = 0; clip < 2; clip++)
+    {
+        HMM_Vec3 axis = clip ? HMM_V3(1, 0, 0) : HMM_V3(0, 0, 1);
+        for(u32 frame = 0; frame < MICRO_ANIM_FRAMES; frame++)
+        {
+            float *pose = poses + frame * pose_size;
+            AnimBindPose(skeleton, pose);
+            for(u32 joint = 0; joint < skeleton->joint_count; joint++)
+            {
+                float phase = (float)frame / MICRO_ANIM_FRAMES + joint * 0.1f + clip * 0.25f;
+                HMM_Quat sway = HMM_QFromAxisAngle_RH(axis, 0.3f * HMM_SinF(phase * 2.0f * HMM_PI32));
+                HMM_Quat rotation;
+                for(u32 c = 0; c < 4; c++)
+                {
+                    rotation.Elements[c] = pose[(MATH_QX + c) * skeleton->stride + joint];
+                }
+
+                rotation = HMM_MulQ(sway, rotation);
+                for(u32 c = 0; c < 4; c++)
+                {
+                    pose[(MATH_QX + c) * skeleton->stride + joint] = rotation.Elements[c];
+                }
+            }
+        }
+
+        bench->clips[clip] = AnimCompressClip(arena, skeleton, poses, MICRO_ANIM_FRAMES, 30.0f);
+        if(!bench->clips[clip])
+        {
+            return false;
+        }
+    }
+
+    for(u32 c = 0; c < MICRO_ANIM_CHARACTERS; c++)
+    {
+        AnimInstance *instance = &bench->instances[c];
+        *instance = {};
+        instance->skeleton = skeleton;
+        instance->clips[0] = bench->clips[0];
+        instance->clips[1] = bench->clips[1];
+        instance->times[0] = c * 0.37f;
+        instance->times[1] = c * 0.11f;
+        instance->weight = (c % 5) / 4.0f;
+        instance->palette = bench->palettes + c * skeleton->joint_count;
+    }
+
+    return true;
+}
+
+// A clip that holds the bind pose must give identity skinning matrices,
+// which takes the skin's layout, the bind pose, compression and the
+// palette kernels all agreeing. Animating on the job queue must give the
+// same palettes as on one thread.
+static bool CheckAnimation(Arena *arena, AnimBench *bench)
+{
+    TempArena temp = BeginTempArena(arena);
+    Skeleton *skeleton = &bench->skeleton;
+    u32 count = skeleton->joint_count;
+    u32 pose_size = MATH_TRS_CHANNELS * skeleton->stride;
+    u64 palettes_size = sizeof(HMM_Mat4) * count * MICRO_ANIM_CHARACTERS;
+    float *poses = (float *)ArenaAlloc(arena, sizeof(float) * pose_size * 2, 64);
+    HMM_Mat4 *expected = (HMM_Mat4 *)ArenaAlloc(arena, palettes_size, 64);
+    if(!poses || !expected)
+    {
+        EndTempArena(temp);
+        return false;
+    }
+
+    AnimBindPose(skeleton, poses);
+    AnimBindPose(skeleton, poses + pose_size);
+    AnimClip *clip = AnimCompressClip(arena, skeleton, poses, 2, 30.0f);
+    bool passed = clip != 0;
+    if(clip)
+    {
+        HMM_Mat4 identity = HMM_M4D(1.0f);
+        for(u32 joint = 0; joint < count; joint++)
+        {
+            memcpy(&expected[joint], &identity, sizeof(HMM_Mat4));
+        }
+
+        AnimSamplePose(clip, 0.02f, poses, poses + pose_size);
+        AnimPoseToPalette(skeleton, poses, bench->palettes, expected + count);
+        passed = KernelMatches("anim bind pose", "palette", (float *)bench->palettes, (float *)expected, count * 16);
+    }
+
+    AnimUpdate(bench->instances, MICRO_ANIM_CHARACTERS, 0);
+    memcpy(expected, bench->palettes, palettes_size);
+    AnimUpdate(bench->instances, MICRO_ANIM_CHARACTERS, bench->jobs);
+    if(memcmp(expected, bench->palettes, palettes_size) != 0)
+    {
+        printf("microbench: animation on jobs differs from one thread\n");
+        passed = false;
+    }
+
+    EndTempArena(temp);
+    return passed;
+}
+
+static bool GraphBarrierIs(RenderGraph *graph, u32 index, const char *what, u32 resource,
+                           VkPipelineStageFlags2 src_stages, VkAccessFlags2 src_access,
+                           VkPipelineStageFlags2 dst_stages, VkAccessFlags2 dst_access,
+                           VkImageLayout old_layout, VkImageLayout new_layout)
+{
+    GraphBarrier *barrier = index < graph->barrier_count ? &graph->barriers[index] : 0;
+    if(!barrier || barrier->resource != resource ||
+       barrier->src_stages != src_stages || barrier->src_access != src_access ||
+       barrier->dst_stages != dst_stages || barrier->dst_access != dst_access ||
+       barrier->old_layout != old_layout || barrier->new_layout != new_layout)
+    {
+        printf("microbench: render graph %s barrier is wrong\n", what);
+        return false;
+    }
+
+    return true;
+}
+
+// Graphs built by hand, checked against the barriers and placement worked
+// out on paper. Nothing here touches a device.
+static bool CheckRenderGraph(Arena *arena)
+{
+    TempArena temp = BeginTempArena(arena);
+    RenderGraph *graph = ArenaAllocStruct(arena, RenderGraph);
+    if(!graph)
+    {
+        EndTempArena(temp);
+        return false;
+    }
+
+    // A color target drawn, sampled twice, then copied into an imported
+    // image that leaves the graph ready to present. A pass drawing into
+    // an image nothing reads sits in between.
+    memset(graph, 0, sizeof(RenderGraph));
+    VkExtent2D extent = {64, 64};
+    VkFormat format = VK_FORMAT_R8G8B8A8_UNORM;
+    u32 color = RenderGraphCreateImage(graph, format, extent, VK_IMAGE_ASPECT_COLOR_BIT);
+    u32 unused = RenderGraphCreateImage(graph, format, extent, VK_IMAGE_ASPECT_COLOR_BIT);
+    u32 target = RenderGraphImportImage(graph, VK_NULL_HANDLE, VK_NULL_HANDLE, format, extent,
+                                        VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, 0);
+    RenderGraphSetOutput(graph, target, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT);
+
+    u32 draw = RenderGraphAddPass(graph, "draw", 0, 0);
+    RenderGraphAccess(graph, draw, color, GRAPH_COLOR_ATTACHMENT);
+    u32 dead = RenderGraphAddPass(graph, "dead", 0, 0);
+    RenderGraphAccess(graph, dead, unused, GRAPH_COLOR_ATTACHMENT);
+    u32 read_a = RenderGraphAddPass(graph, "read_a", 0, 0);
+    RenderGraphAccess(graph, read_a, color, GRAPH_SAMPLED);
+    RenderGraphSetSideEffect(graph, read_a);
+    u32 read_b = RenderGraphAddPass(graph, "read_b", 0, 0);
+    RenderGraphAccess(graph, read_b, color, GRAPH_SAMPLED);
+    RenderGraphSetSideEffect(graph, read_b);
+    u32 copy = RenderGraphAddPass(graph, "copy", 0, 0);
+    RenderGraphAccess(graph, copy, color, GRAPH_TRANSFER_SRC);
+    RenderGraphAccess(graph, copy, target, GRAPH_TRANSFER_DST);
+
+    bool passed = RenderGraphCompile(graph);
+    if(!passed || !graph->passes[dead].culled || graph->resources[unused].used ||
+       graph->passes[draw].culled || graph->passes[read_a].culled || graph->passes[read_b].culled ||
+       graph->passes[copy].culled)
+    {
+        printf("microbench: render graph culled the wrong passes\n");
+        passed = false;
+    }
+
+    VkPipelineStageFlags2 sampled_stages = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+    GraphPass *passes = graph->passes;
+    if(passed && (passes[draw].barrier_count != 1 || passes[dead].barrier_count != 0 ||
+                  passes[read_a].barrier_count != 1 || passes[read_b].barrier_count != 0 ||
+                  passes[copy].barrier_count != 2 || graph->final_barrier_count != 1))
+    {
+        printf("microbench: render graph placed the wrong number of barriers\n");
+        passed = false;
+    }
+
+    passed = passed &&
+             GraphBarrierIs(graph, passes[draw].first_barrier, "first write", color,
+                            VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, VK_ACCESS_2_MEMORY_WRITE_BIT,
+                            VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+                            VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+                            VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL) &&
+             GraphBarrierIs(graph, passes[read_a].first_barrier, "color to sampled", color,
+                            VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+                            sampled_stages, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+                            VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) &&
+             GraphBarrierIs(graph, passes[copy].first_barrier, "sampled to transfer", color,
+                            sampled_stages, 0, VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_READ_BIT,
+                            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL) &&
+             GraphBarrierIs(graph, passes[copy].first_barrier + 1, "import", target,
+                            0, 0, VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                            VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) &&
+             GraphBarrierIs(graph, graph->final_barrier, "final", target,
+                            VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                            VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, 0,
+                            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+
+    // Three transients: first lives in pass 0 only, second in passes 1 and
+    // 2, third in pass 2 only. The first two can share memory, the last two
+    // cannot.
+    RenderGraphReset(graph);
+    u32 images[3];
+    u64 sizes[3] = {2048, 4096, 1024};
+    for(u32 i = 0; i < 3; i++)
+    {
+        images[i] = RenderGraphCreateImage(graph, format, extent, VK_IMAGE_ASPECT_COLOR_BIT);
+        GraphResource *resource = &graph->resources[images[i]];
+        resource->size = sizes[i];
+        resource->alignment = 256;
+        resource->memory_type_bits = 0x7 << i;
+    }
+
+    u32 first = RenderGraphAddPass(graph, "first", 0, 0);
+    RenderGraphAccess(graph, first, images[0], GRAPH_COLOR_ATTACHMENT);
+    RenderGraphSetSideEffect(graph, first);
+    u32 second = RenderGraphAddPass(graph, "second", 0, 0);
+    RenderGraphAccess(graph, second, images[1], GRAPH_COLOR_ATTACHMENT);
+    u32 third = RenderGraphAddPass(graph, "third", 0, 0);
+    RenderGraphAccess(graph, third, images[1], GRAPH_SAMPLED);
+    RenderGraphAccess(graph, third, images[2], GRAPH_COLOR_ATTACHMENT);
+    RenderGraphSetSideEffect(graph, third);
+
+    if(!RenderGraphCompile(graph))
+    {
+        printf("microbench: render graph failed to compile\n");
+        passed = false;
+    }
+
+    RenderGraphPlaceTransients(graph);
+    GraphResource *placed = graph->resources;
+    bool shared = placed[images[0]].offset == 0 && placed[images[1]].offset == 0;
+    bool apart = placed[images[2]].offset >= placed[images[1]].offset + placed[images[1]].size;
+    if(!shared || !apart || graph->transient_size != 4096 + 1024 || graph->transient_memory_bits != 0x4)
+    {
+        printf("microbench: render graph transient placement is wrong\n");
+        passed = false;
+    }
+
+    EndTempArena(temp);
+    return passed;
+}
+
+static u64 AssetCheckKey(u64 kind, u64 index)
+{
+    u64 words[2] = {kind, index};
+    return AssetHashBytes(words, sizeof(words));
+}
+
+static bool AssetHandleIs(AssetHandle handle, AssetHandle expected, const char *what)
+{
+    if(handle.index != expected.index || handle.generation != expected.generation)
+    {
+        printf("microbench: asset registry %s found the wrong entry\n", what);
+        return false;
+    }
+
+    return true;
+}
+
+// One asset looked up every way there is, removed, then enough assets
+// streamed in and out that the tables get rebuilt under a set that stays
+// loaded. Each of those must still be found by path, alias and content.
+static bool CheckAssetRegistry(Arena *arena)
+{
+    TempArena temp = BeginTempArena(arena);
+    AssetRegistry *registry = CreateAssetRegistry(arena);
+    if(!registry)
+    {
+        EndTempArena(temp);
+        return false;
+    }
+
+    u64 path = AssetHashString("meshes/check.cmdl");
+    u64 alias = AssetHashString("meshes/check_copy.cmdl");
+    u64 content = AssetHashString("check content");
+    AssetHandle handle = AssetInsert(registry, ASSET_MESH, path, content, 7);
+    AssetEntry *entry = AssetGet(registry, handle);
+    bool passed = entry && entry->payload == 7 &&
+                  AssetHandleIs(AssetFind(registry, path), handle, "path") &&
+                  AssetHandleIs(AssetFindContent(registry, ASSET_MESH, content, alias), handle, "content") &&
+                  AssetHandleIs(AssetFind(registry, alias), handle, "alias") &&
+                  AssetHandleIs(AssetFindContent(registry, ASSET_TEXTURE, content, 0), {}, "other type");
+
+    AssetRemove(registry, handle);
+    if(AssetGet(registry, handle) || AssetFind(registry, path).index || AssetFind(registry, alias).index ||
+       AssetFindContent(registry, ASSET_MESH, content, path).index)
+    {
+        printf("microbench: asset registry still finds a removed asset\n");
+        passed = false;
+    }
+
+    AssetHandle kept[64];
+    for(u64 i = 0; i < 64; i++)
+    {
+        kept[i] = AssetInsert(registry, ASSET_TEXTURE, AssetCheckKey(0, i), AssetCheckKey(1, i), (u32)i);
+        AssetFindContent(registry, ASSET_TEXTURE, AssetCheckKey(1, i), AssetCheckKey(2, i));
+    }
+
+    // Every cycle leaves a path, an alias and a content tombstone.
+    bool rebuilt = false;
+    for(u64 i = 0; i < 2 * ASSET_MAX_TOMBSTONES && passed; i++)
+    {
+        passed = AssetFind(registry, AssetCheckKey(3, i)).index == 0;
+        AssetHandle streamed = AssetInsert(registry, ASSET_MESH, AssetCheckKey(3, i), AssetCheckKey(4, i), 0);
+        AssetFindContent(registry, ASSET_MESH, AssetCheckKey(4, i), AssetCheckKey(5, i));
+
+        u32 tombstones = registry->tombstone_count;
+        AssetRemove(registry, streamed);
+        rebuilt |= registry->tombstone_count < tombstones;
+        passed = passed && streamed.index && registry->tombstone_count <= ASSET_MAX_TOMBSTONES;
+    }
+
+    if(!passed || !rebuilt)
+    {
+        printf("microbench: asset registry tombstones were not cleared\n");
+        passed = false;
+    }
+
+    for(u64 i = 0; i < 64 && passed; i++)
+    {
+        u64 content_key = AssetCheckKey(1, i);
+        passed = AssetHandleIs(AssetFind(registry, AssetCheckKey(0, i)), kept[i], "path after rebuild") &&
+                 AssetHandleIs(AssetFind(registry, AssetCheckKey(2, i)), kept[i], "alias after rebuild") &&
+                 AssetHandleIs(AssetFindContent(registry, ASSET_TEXTURE, content_key, AssetCheckKey(2, i)), kept[i],
+                               "content after rebuild");
+    }
+
+    EndTempArena(temp);
+    return passed;
+}
+
+static double TicksToNs(u64 ticks, u32 count)
+{
+    return (double)ticks * 1000000000.0 / OsTimeFrequency() / count;
+}
+
+// Warms up, then picks an iteration count that makes one repetition last
+// about MICRO_REP_SECONDS, so timer resolution never dominates.
+static MicroResult RunMicroBench(MicroBench *bench, u32 reps)
+{
+    u64 frequency = OsTimeFrequency();
+    u32 iterations = 1;
+    u64 warmup_end = OsTimeNow() + (u64)(MICRO_WARMUP_SECONDS * frequency);
+    for(;;)
+    {
+        u64 begin = OsTimeNow();
+        bench->proc(bench->data, iterations);
+        u64 elapsed = OsTimeNow() - begin;
+
+        if(elapsed < MICRO_REP_SECONDS * frequency && iterations < (1u << 30))
+        {
+            iterations *= 2;
+        }
+
+        else if(OsTimeNow() >= warmup_end)
+        {
+            break;
+        }
+    }
+
+    double samples[MAX_MICRO_REPS];
+    for(u32 r = 0; r < reps; r++)
+    {
+        u64 begin = OsTimeNow();
+        bench->proc(bench->data, iterations);
+        samples[r] = TicksToNs(OsTimeNow() - begin, iterations * bench->ops_per_call);
+    }
+
+    for(u32 i = 1; i < reps; i++)
+    {
+        double value = samples[i];
+        u32 j = i;
+        for(; j > 0 && samples[j - 1] > value; j--)
+        {
+            samples[j] = samples[j - 1];
+        }
+        samples[j] = value;
+    }
+
+    MicroResult result = {};
+    result.name = bench->name;
+    result.iterations = iterations;
+    result.reps = reps;
+    result.min_ns = samples[0];
+    result.median_ns = reps & 1 ? samples[reps / 2] : 0.5 * (samples[reps / 2 - 1] + samples[reps / 2]);
+
+    for(u32 r = 0; r < reps; r++)
+    {
+        result.mean_ns += samples[r] / reps;
+    }
+
+    for(u32 r = 0; r < reps; r++)
+    {
+        double d = samples[r] - result.mean_ns;
+        result.stddev_ns += d * d / reps;
+    }
+    result.stddev_ns = sqrt(result.stddev_ns);
+    return result;
+}
+
+// Results are written one benchmark per line so the baseline can be read
+// back without a JSON parser.
+static u64 FormatResults(MicroResult *results, u32 count, char *out, u64 capacity)
+{
+    u64 size = snprintf(out, capacity, "{\"results\": [\n");
+    for(u32 i = 0; i < count && size < capacity; i++)
+    {
+        MicroResult *r = &results[i];
+        size += snprintf(out + size, capacity - size,
+                         "  {\"name\": \"%s\", \"median_ns\": %.4f, \"mean_ns\": %.4f, \"stddev_ns\": %.4f, "
+                         "\"min_ns\": %.4f, \"iterations\": %u, \"reps\": %u}%s\n",
+                         r->name, r->median_ns, r->mean_ns, r->stddev_ns, r->min_ns,
+                         r->iterations, r->reps, i + 1 < count ? "," : "");
+    }
+
+    if(size < capacity)
+    {
+        size += snprintf(out + size, capacity - size, "]}\n");
+    }
+
+    return size < capacity ? size : capacity;
+}
+
+static bool FindBaseline(const char *text, u64 size, const char *name, double *median_ns)
+{
+    char key[128];
+    snprintf(key, sizeof(key), "\"name\": \"%s\"", name);
+    u64 key_length = strlen(key);
+
+    for(u64 i = 0; i + key_length <= size; i++)
+    {
+        if(memcmp(text + i, key, key_length) != 0)
+        {
+            continue;
+        }
+
+        const char *field = "\"median_ns\": ";
+        u64 field_length = strlen(field);
+        for(u64 j = i + key_length; j + field_length < size && text[j] != '\n'; j++)
+        {
+            if(memcmp(text + j, field, field_length) == 0)
+            {
+                *median_ns = atof(text + j + field_length);
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+// A benchmark fails when its median is slower than the baseline median by
+// more than the tolerance. Benchmarks missing from the baseline are new and
+// only reported.
+static bool CompareBaseline(MicroSettings *settings, MicroResult *results, u32 count)
+{
+    MappedFile file;
+    if(!OsMapFile(settings->baseline_path, &file))
+    {
+        printf("microbench: failed to read baseline %s\n", settings->baseline_path);
+        return false;
+    }
+
+    bool passed = true;
+    printf("\n%-24s %12s %12s %8s\n", "baseline", "before ns", "after ns", "change");
+    for(u32 i = 0; i < count; i++)
+    {
+        double before = 0;
+        if(!FindBaseline((const char *)file.data, file.size, results[i].name, &before) || before <= 0)
+        {
+            printf("%-24s %12s %12.3f %8s\n", results[i].name, "-", results[i].median_ns, "new");
+            continue;
+        }
+
+        double change = results[i].median_ns / before - 1.0;
+        bool regressed = change > settings->tolerance;
+        passed &= !regressed;
+        printf("%-24s %12.3f %12.3f %+7.1f%%%s\n", results[i].name, before, results[i].median_ns,
+               change * 100.0, regressed ? "  REGRESSED" : "");
+    }
+
+    OsUnmapFile(&file);
+    return passed;
+}
+
+int main(int argc, char **argv)
+{
+    MicroSettings settings;
+    if(!ParseArgs(argc, argv, &settings))
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    Arena arena = CreateNewArena(0, 128 * MB);
+    MathInit();
+
+    if(settings.cmdl_path || settings.dds_path)
+    {
+        void *data = 0;
+        u64 size = settings.cmdl_path ? GenerateCMDL(&arena, settings.cmdl_vertices, settings.cmdl_joints, &data) :
+                                        GenerateDDS(&arena, settings.dds_size, &data);
+        const char *path = settings.cmdl_path ? settings.cmdl_path : settings.dds_path;
+        if(!size || !OsWriteFileAtomic(path, data, size))
+        {
+            printf("microbench: failed to write %s\n", path);
+            return 1;
+        }
+
+        return 0;
+    }
+
+    ArenaBench arena_bench = {};
+    arena_bench.arena = CreateNewArena(&arena, 16 * MB);
+
+    MathBench math_bench = {};
+    math_bench.a = HMM_Rotate_RH(0.3f, HMM_V3(0, 1, 0));
+    math_bench.b = HMM_Translate(HMM_V3(0.001f, 0, 0)) * HMM_Rotate_RH(0.001f, HMM_V3(1, 0, 0));
+    math_bench.camera.cam_pos = {0, 1, -3};
+    math_bench.camera.cam_up = {0, 1, 0};
+    ProjectionInfo proj_info = {1280, 720, 1.57f, 0.01f};
+    CameraSetProjection(&math_bench.camera, proj_info);
+
+    const u32 cmdl_vertices = 1 << 20;
+    FileBench cmdl = {};
+    cmdl.size = GenerateCMDL(&arena, cmdl_vertices, 0, &cmdl.data);
+
+    FileBench dds = {};
+    dds.size = GenerateDDS(&arena, 4096, &dds.data);
+
+    // Only the CPU side of the engine is touched: the draw list and its
+    // shader data, the pass and the streamer's request table.
+    DrawBench draw_bench = {};
+    draw_bench.engine = ArenaAllocStruct(&arena, Engine);
+    memset(draw_bench.engine, 0, sizeof(Engine));
+    draw_bench.engine->draws = (DrawItem *)ArenaAlloc(&arena, sizeof(DrawItem) * MAX_DRAWS, 0);
+    draw_bench.engine->draw_data = (MeshDrawData *)ArenaAlloc(&arena, sizeof(MeshDrawData) * MAX_DRAWS, 0);
+    draw_bench.engine->streamer.texture_count = 1;
+    draw_bench.pass.engine = draw_bench.engine;
+    draw_bench.pass.area.extent = {1280, 720};
+    draw_bench.engine->current_pass = &draw_bench.pass;
+    draw_bench.world = HMM_Translate(HMM_V3(0, 0, 5));
+    draw_bench.model.mesh.bounds_radius = 1.0f;
+    draw_bench.model.mesh.num_indices = 36;
+    draw_bench.view_proj = math_bench.camera.projection;
+
+    TransformBench *transform_bench = ArenaAllocStruct(&arena, TransformBench);
+    *transform_bench = {};
+    transform_bench->system = CreateTransformSystem(&arena, MICRO_TRANSFORM_NODES, 0);
+    for(u32 r = 0; r < MICRO_TRANSFORM_ROOTS; r++)
+    {
+        TransformHandle root = TransformCreate(transform_bench->system, {});
+        TransformSetPosition(transform_bench->system, root, HMM_V3((float)r, 0, 0));
+        transform_bench->roots[r] = root;
+        for(u32 c = 0; c < 3; c++)
+        {
+            TransformHandle child = TransformCreate(transform_bench->system, root);
+            TransformSetPosition(transform_bench->system, child, HMM_V3(0, 1, (float)c));
+            for(u32 g = 0; g < 4; g++)
+            {
+                TransformHandle grandchild = TransformCreate(transform_bench->system, child);
+                TransformSetPosition(transform_bench->system, grandchild, HMM_V3((float)g, 0.5f, 0));
+            }
+        }
+    }
+    TransformUpdate(transform_bench->system);
+
+    KernelData kernel_data = {};
+    bool kernels_allocated = CreateKernelData(&arena, &kernel_data);
+
+    LightBench light_bench = {};
+    bool lights_allocated = CreateLightBench(&arena, math_bench.camera.projection, &light_bench);
+    LightBench light_jobs_bench = light_bench;
+    light_jobs_bench.jobs = CreateJobQueue(&arena, 0);
+
+    AnimBench anim_bench = {};
+    bool anim_allocated = CreateAnimBench(&arena, &anim_bench);
+    AnimBench anim_jobs_bench = anim_bench;
+    anim_jobs_bench.jobs = light_jobs_bench.jobs;
+
+    if(!cmdl.size || !dds.size || !draw_bench.engine->draws || !draw_bench.engine->draw_data || !transform_bench->system->capacity || !kernels_allocated ||
+       !lights_allocated || !anim_allocated)
+    {
+        printf("microbench: out of memory\n");
+        return 1;
+    }
+
+    if(!CheckKernels(&arena, &kernel_data) || !CheckLightBinning(&arena, &light_jobs_bench) ||
+       !CheckAnimation(&arena, &anim_jobs_bench) || !CheckRenderGraph(&arena) ||
+       !CheckAssetRegistry(&arena))
+    {
+        return 1;
+    }
+
+    MicroBench fixed_benches[] =
+    {
+        {"arena_alloc_16", BenchArenaAlloc, &arena_bench, 1},
+        {"arena_alloc_align64", BenchArenaAllocAligned, &arena_bench, 1},
+        {"temp_arena_push_pop", BenchTempArena, &arena_bench, 1},
+        {"hmm_mat4_mul", BenchMat4Mul, &math_bench, 1},
+        {"hmm_lookat_rh", BenchLookAt, &math_bench, 1},
+        {"camera_update", BenchCameraUpdate, &math_bench, 1},
+        {"dds_parse_4k_bc7", BenchDDSParse, &dds, 1},
+        {"dds_mip_chain_sizes", BenchDDSMipSizes, 0, 1},
+        {"cmdl_bounds_per_vertex", BenchCMDLBounds, &cmdl, cmdl_vertices},
+        {"asset_hash_per_kb", BenchAssetHash, &cmdl, (u32)(cmdl.size / KB)},
+        {"engine_draw_model", BenchDrawModel, &draw_bench, 1},
+        {"transform_clean_per_node", BenchTransformClean, transform_bench, MICRO_TRANSFORM_NODES},
+        {"transform_dirty_per_node", BenchTransformDirty, transform_bench, MICRO_TRANSFORM_NODES},
+        {"light_bin_per_light", BenchLightBin, &light_bench, MICRO_LIGHTS},
+        {"light_bin_jobs_per_light", BenchLightBin, &light_jobs_bench, MICRO_LIGHTS},
+        {"anim_per_character", BenchAnimUpdate, &anim_bench, MICRO_ANIM_CHARACTERS},
+        {"anim_jobs_per_character", BenchAnimUpdate, &anim_jobs_bench, MICRO_ANIM_CHARACTERS},
+    };
+
+    MicroBench benches[MAX_MICRO_BENCHES];
+    u32 bench_count = sizeof(fixed_benches) / sizeof(fixed_benches[0]);
+    memcpy(benches, fixed_benches, sizeof(fixed_benches));
+
+    // One set of kernel benchmarks per instruction set this CPU runs.
+    KernelBench kernel_benches[MATH_ISA_COUNT];
+    for(u32 isa = 0; isa < MATH_ISA_COUNT; isa++)
+    {
+        KernelBench *kb = &kernel_benches[isa];
+        kb->data = &kernel_data;
+        if(!MathGetKernels((MathIsa)isa, &kb->kernels) || bench_count + 6 > MAX_MICRO_BENCHES)
+        {
+            continue;
+        }
+
+        snprintf(kb->names[0], sizeof(kb->names[0]), "mat4_batch_%s", kb->kernels.name);
+        snprintf(kb->names[1], sizeof(kb->names[1]), "compose_trs_%s", kb->kernels.name);
+        snprintf(kb->names[2], sizeof(kb->names[2]), "spheres_batch_%s", kb->kernels.name);
+        benches[bench_count++] = {kb->names[0], BenchKernelMulMat4, kb, MICRO_KERNEL_ELEMENTS};
+        benches[bench_count++] = {kb->names[1], BenchKernelComposeTRS, kb, MICRO_KERNEL_ELEMENTS};
+        benches[bench_count++] = {kb->names[2], BenchKernelSpheres, kb, MICRO_KERNEL_ELEMENTS};
+
+        snprintf(kb->names[3], sizeof(kb->names[3]), "blend_trs_%s", kb->kernels.name);
+        snprintf(kb->names[4], sizeof(kb->names[4]), "compose_trs_soa_%s", kb->kernels.name);
+        snprintf(kb->names[5], sizeof(kb->names[5]), "hierarchy_%s", kb->kernels.name);
+        benches[bench_count++] = {kb->names[3], BenchKernelBlendTRS, kb, MICRO_KERNEL_ELEMENTS};
+        benches[bench_count++] = {kb->names[4], BenchKernelComposeTRSSoA, kb, MICRO_KERNEL_ELEMENTS};
+        benches[bench_count++] = {kb->names[5], BenchKernelHierarchy, kb, MICRO_KERNEL_ELEMENTS};
+    }
+
+    u32 result_count = 0;
+    MicroResult results[MAX_MICRO_BENCHES];
+    printf("%-24s %12s %12s %12s %12s\n", "benchmark", "median ns", "mean ns", "stddev ns", "min ns");
+    for(u32 i = 0; i < bench_count; i++)
+    {
+        if(settings.filter && !strstr(benches[i].name, settings.filter))
+        {
+            continue;
+        }
+
+        MicroResult *r = &results[result_count++];
+        *r = RunMicroBench(&benches[i], settings.reps);
+        printf("%-24s %12.3f %12.3f %12.3f %12.3f\n", r->name, r->median_ns, r->mean_ns, r->stddev_ns, r->min_ns);
+    }
+
+    if(settings.output_path)
+    {
+        char report[16384];
+        u64 size = FormatResults(results, result_count, report, sizeof(report));
+        if(!OsWriteFileAtomic(settings.output_path, report, size))
+        {
+            printf("microbench: failed to write %s\n", settings.output_path);
+            return 1;
+        }
+    }
+
+    if(settings.baseline_path && !CompareBaseline(&settings, results, result_count))
+    {
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,570 @@
+#include <stdio.h>
+#include "os.hh"
+
+// Leaf 1 ECX and leaf 7 EBX from CPUID, and XCR0 for what the OS saves.
+static u32 OsDecodeCpuFeatures(u32 ecx1, u32 ebx7, u64 xcr0)
+{
+    bool ymm = (xcr0 & 0x06) == 0x06;
+    bool zmm = (xcr0 & 0xe6) == 0xe6;
+    bool fma = (ecx1 & (1 << 12)) != 0;
+
+    u32 features = 0;
+    if(ecx1 & (1 << 19)) features |= OS_CPU_SSE41;
+    if(ymm && fma && (ebx7 & (1 << 5))) features |= OS_CPU_AVX2;
+    if(zmm && (ebx7 & (1 << 16))) features |= OS_CPU_AVX512;
+    return features;
+}
+
+#ifdef _WIN32
+
+#include <intrin.h>
+
+bool OsMapFile(const char *path, MappedFile *file)
+{
+    *file = {};
+    HANDLE hfile = CreateFile(path, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+    if(hfile == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    LARGE_INTEGER fsize; GetFileSizeEx(hfile, &fsize);
+    HANDLE hmap = fsize.QuadPart ? CreateFileMapping(hfile, 0, PAGE_READONLY, 0, 0, 0) : 0;
+    if(hmap)
+    {
+        file->data = MapViewOfFile(hmap, FILE_MAP_READ, 0, 0, fsize.QuadPart);
+        file->size = file->data ? fsize.QuadPart : 0;
+        CloseHandle(hmap);
+    }
+
+    CloseHandle(hfile);
+    return file->data != 0;
+}
+
+void OsUnmapFile(MappedFile *file)
+{
+    if(file->data) UnmapViewOfFile(file->data);
+    *file = {};
+}
+
+// Written to a temporary file and moved into place so a crash mid-write
+// leaves the previous contents intact.
+bool OsWriteFileAtomic(const char *path, const void *data, u64 size)
+{
+    char temp_path[MAX_PATH];
+    wsprintfA(temp_path, "%s.tmp", path);
+
+    HANDLE hfile = CreateFile(temp_path, GENERIC_WRITE, 0, 0, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+    if(hfile == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    DWORD written = 0;
+    BOOL ok = WriteFile(hfile, data, (DWORD)size, &written, 0);
+    CloseHandle(hfile);
+
+    if(!ok || written != size || !MoveFileExA(temp_path, path, MOVEFILE_REPLACE_EXISTING))
+    {
+        DeleteFileA(temp_path);
+        return false;
+    }
+
+    return true;
+}
+
+bool OsCreateSharedMemory(const char *name, u64 size, OsSharedMemory *memory)
+{
+    *memory = {};
+    char path[MAX_PATH];
+    wsprintfA(path, "Local\\%s", name);
+
+    HANDLE handle = CreateFileMappingA(INVALID_HANDLE_VALUE, 0, PAGE_READWRITE, (DWORD)(size >> 32), (DWORD)size, path);
+    if(!handle)
+    {
+        return false;
+    }
+
+    memory->data = MapViewOfFile(handle, FILE_MAP_ALL_ACCESS, 0, 0, size);
+    if(!memory->data)
+    {
+        CloseHandle(handle);
+        return false;
+    }
+
+    memory->size = size;
+    memory->handle = handle;
+    return true;
+}
+
+bool OsOpenSharedMemory(const char *name, OsSharedMemory *memory)
+{
+    *memory = {};
+    char path[MAX_PATH];
+    wsprintfA(path, "Local\\%s", name);
+
+    HANDLE handle = OpenFileMappingA(FILE_MAP_READ, FALSE, path);
+    if(!handle)
+    {
+        return false;
+    }
+
+    memory->data = MapViewOfFile(handle, FILE_MAP_READ, 0, 0, 0);
+    if(!memory->data)
+    {
+        CloseHandle(handle);
+        return false;
+    }
+
+    MEMORY_BASIC_INFORMATION info;
+    VirtualQuery(memory->data, &info, sizeof(info));
+    memory->size = info.RegionSize;
+    memory->handle = handle;
+    return true;
+}
+
+void OsCloseSharedMemory(OsSharedMemory *memory)
+{
+    if(memory->data) UnmapViewOfFile(memory->data);
+    if(memory->handle) CloseHandle(memory->handle);
+    *memory = {};
+}
+
+void *OsAllocMemory(u64 size)
+{
+    return VirtualAlloc(0, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+}
+
+void OsFreeMemory(void *memory, u64 size)
+{
+    VirtualFree(memory, 0, MEM_RELEASE);
+}
+
+u64 OsPageSize(void)
+{
+    SYSTEM_INFO sys_info;
+    GetSystemInfo(&sys_info);
+    return sys_info.dwPageSize;
+}
+
+u32 OsProcessorCount(void)
+{
+    SYSTEM_INFO sys_info;
+    GetSystemInfo(&sys_info);
+    return sys_info.dwNumberOfProcessors;
+}
+
+u32 OsCpuFeatures(void)
+{
+#if defined(_M_X64) || defined(_M_IX86)
+    int info[4];
+    __cpuid(info, 0);
+    int max_leaf = info[0];
+
+    __cpuid(info, 1);
+    u32 ecx1 = info[2];
+    u32 ebx7 = 0;
+    if(max_leaf >= 7)
+    {
+        __cpuidex(info, 7, 0);
+        ebx7 = info[1];
+    }
+
+    u64 xcr0 = (ecx1 & (1 << 27)) ? _xgetbv(0) : 0;
+    return OsDecodeCpuFeatures(ecx1, ebx7, xcr0);
+#else
+    return 0;
+#endif
+}
+
+u64 OsTimeNow(void)
+{
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    return counter.QuadPart;
+}
+
+u64 OsTimeFrequency(void)
+{
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    return frequency.QuadPart;
+}
+
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
+// Sleep() rounds up to the scheduler tick (15.6ms by default). A high
+// resolution waitable timer gets within ~0.5ms without changing the
+// system-wide timer period; older systems fall back to a regular timer
+// and a wider spin margin.
+void OsSleepUntil(u64 deadline)
+{
+    static HANDLE timer;
+    static u64 spin_margin;
+    u64 frequency = OsTimeFrequency();
+    if(!timer)
+    {
+        timer = CreateWaitableTimerExW(0, 0, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+        spin_margin = frequency / 1000;
+        if(!timer)
+        {
+            timer = CreateWaitableTimerExW(0, 0, 0, TIMER_ALL_ACCESS);
+            spin_margin = frequency / 50;
+        }
+    }
+
+    u64 now = OsTimeNow();
+    if(now + spin_margin < deadline)
+    {
+        LARGE_INTEGER due;
+        due.QuadPart = -(i64)((deadline - now - spin_margin) * 10000000 / frequency);
+        if(SetWaitableTimer(timer, &due, 0, 0, 0, FALSE))
+        {
+            WaitForSingleObject(timer, INFINITE);
+        }
+    }
+
+    while(OsTimeNow() < deadline)
+    {
+        OsPause();
+    }
+}
+
+i32 OsAtomicIncrement(OsAtomic *value)
+{
+    return InterlockedIncrement((volatile LONG *)value);
+}
+
+i32 OsAtomicDecrement(OsAtomic *value)
+{
+    return InterlockedDecrement((volatile LONG *)value);
+}
+
+i32 OsAtomicCompareExchange(OsAtomic *value, i32 exchange, i32 comparand)
+{
+    return InterlockedCompareExchange((volatile LONG *)value, exchange, comparand);
+}
+
+void OsAtomicStore(OsAtomic *value, i32 store)
+{
+    InterlockedExchange((volatile LONG *)value, store);
+}
+
+void OsMemoryBarrier(void)
+{
+    MemoryBarrier();
+}
+
+void OsPause(void)
+{
+    YieldProcessor();
+}
+
+OsThread OsCreateThread(OsThreadProc *proc, void *data)
+{
+    return CreateThread(0, 0, proc, data, 0, 0);
+}
+
+void OsCreateSemaphore(OsSemaphore *semaphore, u32 max_count)
+{
+    *semaphore = CreateSemaphoreEx(0, 0, max_count, 0, 0, SEMAPHORE_ALL_ACCESS);
+}
+
+void OsSignalSemaphore(OsSemaphore *semaphore)
+{
+    ReleaseSemaphore(*semaphore, 1, 0);
+}
+
+void OsWaitSemaphore(OsSemaphore *semaphore)
+{
+    WaitForSingleObjectEx(*semaphore, INFINITE, FALSE);
+}
+
+#else
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sched.h>
+#include <time.h>
+#include <errno.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+bool OsMapFile(const char *path, MappedFile *file)
+{
+    *file = {};
+    int fd = open(path, O_RDONLY);
+    if(fd < 0)
+    {
+        return false;
+    }
+
+    struct stat st;
+    if(fstat(fd, &st) == 0 && st.st_size > 0)
+    {
+        void *data = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(data != MAP_FAILED)
+        {
+            file->data = data;
+            file->size = st.st_size;
+        }
+    }
+
+    close(fd);
+    return file->data != 0;
+}
+
+void OsUnmapFile(MappedFile *file)
+{
+    if(file->data) munmap(file->data, file->size);
+    *file = {};
+}
+
+bool OsWriteFileAtomic(const char *path, const void *data, u64 size)
+{
+    char temp_path[4096];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+
+    int fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0)
+    {
+        return false;
+    }
+
+    const char *bytes = (const char *)data;
+    u64 written = 0;
+    while(written < size)
+    {
+        ssize_t result = write(fd, bytes + written, size - written);
+        if(result <= 0) break;
+        written += result;
+    }
+
+    bool ok = written == size && fsync(fd) == 0;
+    close(fd);
+
+    if(!ok || rename(temp_path, path) != 0)
+    {
+        unlink(temp_path);
+        return false;
+    }
+
+    return true;
+}
+
+bool OsCreateSharedMemory(const char *name, u64 size, OsSharedMemory *memory)
+{
+    *memory = {};
+    snprintf(memory->path, sizeof(memory->path), "/%s", name);
+
+    int fd = shm_open(memory->path, O_CREAT | O_RDWR, 0644);
+    if(fd < 0)
+    {
+        return false;
+    }
+
+    void *data = MAP_FAILED;
+    if(ftruncate(fd, size) == 0)
+    {
+        data = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+
+    close(fd);
+    if(data == MAP_FAILED)
+    {
+        shm_unlink(memory->path);
+        return false;
+    }
+
+    memory->data = data;
+    memory->size = size;
+    memory->owner = true;
+    return true;
+}
+
+bool OsOpenSharedMemory(const char *name, OsSharedMemory *memory)
+{
+    *memory = {};
+    snprintf(memory->path, sizeof(memory->path), "/%s", name);
+
+    int fd = shm_open(memory->path, O_RDONLY, 0);
+    if(fd < 0)
+    {
+        return false;
+    }
+
+    struct stat st;
+    if(fstat(fd, &st) == 0 && st.st_size > 0)
+    {
+        void *data = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if(data != MAP_FAILED)
+        {
+            memory->data = data;
+            memory->size = st.st_size;
+        }
+    }
+
+    close(fd);
+    return memory->data != 0;
+}
+
+void OsCloseSharedMemory(OsSharedMemory *memory)
+{
+    if(memory->data) munmap(memory->data, memory->size);
+    if(memory->owner) shm_unlink(memory->path);
+    *memory = {};
+}
+
+void *OsAllocMemory(u64 size)
+{
+    void *memory = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return memory == MAP_FAILED ? 0 : memory;
+}
+
+void OsFreeMemory(void *memory, u64 size)
+{
+    munmap(memory, size);
+}
+
+u64 OsPageSize(void)
+{
+    return sysconf(_SC_PAGESIZE);
+}
+
+u32 OsProcessorCount(void)
+{
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (u32)count : 1;
+}
+
+u32 OsCpuFeatures(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    u32 eax, ebx, ecx, edx;
+    if(!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+    {
+        return 0;
+    }
+
+    u32 ecx1 = ecx;
+    u32 ebx7 = 0;
+    if(__get_cpuid_max(0, 0) >= 7)
+    {
+        __cpuid_count(7, 0, eax, ebx, ecx, edx);
+        ebx7 = ebx;
+    }
+
+    u64 xcr0 = 0;
+    if(ecx1 & (1 << 27))
+    {
+        u32 lo, hi;
+        __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+        xcr0 = ((u64)hi << 32) | lo;
+    }
+
+    return OsDecodeCpuFeatures(ecx1, ebx7, xcr0);
+#else
+    return 0;
+#endif
+}
+
+u64 OsTimeNow(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+u64 OsTimeFrequency(void)
+{
+    return 1000000000;
+}
+
+// clock_nanosleep on an absolute deadline is already accurate to tens of
+// microseconds; the short spin covers the wakeup latency.
+void OsSleepUntil(u64 deadline)
+{
+    const u64 spin_margin = 200000;
+    if(OsTimeNow() + spin_margin < deadline)
+    {
+        struct timespec ts;
+        u64 wake = deadline - spin_margin;
+        ts.tv_sec = wake / 1000000000;
+        ts.tv_nsec = wake % 1000000000;
+        while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, 0) == EINTR)
+        {
+        }
+    }
+
+    while(OsTimeNow() < deadline)
+    {
+        OsPause();
+    }
+}
+
+i32 OsAtomicIncrement(OsAtomic *value)
+{
+    return __atomic_add_fetch(value, 1, __ATOMIC_SEQ_CST);
+}
+
+i32 OsAtomicDecrement(OsAtomic *value)
+{
+    return __atomic_sub_fetch(value, 1, __ATOMIC_SEQ_CST);
+}
+
+i32 OsAtomicCompareExchange(OsAtomic *value, i32 exchange, i32 comparand)
+{
+    __atomic_compare_exchange_n(value, &comparand, exchange, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return comparand;
+}
+
+void OsAtomicStore(OsAtomic *value, i32 store)
+{
+    __atomic_store_n(value, store, __ATOMIC_SEQ_CST);
+}
+
+void OsMemoryBarrier(void)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+void OsPause(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#else
+    sched_yield();
+#endif
+}
+
+OsThread OsCreateThread(OsThreadProc *proc, void *data)
+{
+    pthread_t thread = {};
+    pthread_create(&thread, 0, proc, data);
+    return thread;
+}
+
+void OsCreateSemaphore(OsSemaphore *semaphore, u32 max_count)
+{
+    (void)max_count;
+    sem_init(semaphore, 0, 0);
+}
+
+void OsSignalSemaphore(OsSemaphore *semaphore)
+{
+    sem_post(semaphore);
+}
+
+void OsWaitSemaphore(OsSemaphore *semaphore)
+{
+    while(sem_wait(semaphore) != 0)
+    {
+    }
+}
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef OS_H
+#define OS_H
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <semaphore.h>
+#endif
+
+#include "types.hh"
+
+// The few OS services the engine needs, so that everything outside the
+// window layer builds on both Win32 and POSIX.
+
+struct MappedFile
+{
+    void *data;
+    u64 size;
+};
+
+// Named memory other processes can map. The creator maps it read/write and
+// removes the name when it closes; others open it read only.
+struct OsSharedMemory
+{
+    void *data;
+    u64 size;
+#ifdef _WIN32
+    HANDLE handle;
+#else
+    bool owner;
+    char path[64];
+#endif
+};
+
+bool OsMapFile(const char *path, MappedFile *file);
+void OsUnmapFile(MappedFile *file);
+bool OsWriteFileAtomic(const char *path, const void *data, u64 size);
+
+bool OsCreateSharedMemory(const char *name, u64 size, OsSharedMemory *memory);
+bool OsOpenSharedMemory(const char *name, OsSharedMemory *memory);
+void OsCloseSharedMemory(OsSharedMemory *memory);
+
+void *OsAllocMemory(u64 size);
+void OsFreeMemory(void *memory, u64 size);
+u64 OsPageSize(void);
+u32 OsProcessorCount(void);
+
+enum OsCpuFeature
+{
+    OS_CPU_SSE41 = 1 << 0,
+    OS_CPU_AVX2 = 1 << 1,
+    OS_CPU_AVX512 = 1 << 2,
+};
+
+// Instruction sets the CPU has and the OS saves the registers of. AVX2
+// implies FMA, AVX512 is the foundation subset. Zero off x86.
+u32 OsCpuFeatures(void);
+
+// Monotonic high-resolution clock in ticks of OsTimeFrequency() per second.
+u64 OsTimeNow(void);
+u64 OsTimeFrequency(void);
+// Sleeps most of the way and spins the remainder, so the wakeup lands
+// within a few microseconds of the deadline.
+void OsSleepUntil(u64 deadline);
+
+typedef volatile i32 OsAtomic;
+
+i32 OsAtomicIncrement(OsAtomic *value);
+i32 OsAtomicDecrement(OsAtomic *value);
+i32 OsAtomicCompareExchange(OsAtomic *value, i32 exchange, i32 comparand);
+void OsAtomicStore(OsAtomic *value, i32 store);
+void OsMemoryBarrier(void);
+void OsPause(void);
+
+#ifdef _WIN32
+#define OS_THREAD_PROC(name) DWORD WINAPI name(LPVOID data)
+typedef HANDLE OsThread;
+typedef HANDLE OsSemaphore;
+#else
+#define OS_THREAD_PROC(name) void *name(void *data)
+typedef pthread_t OsThread;
+typedef sem_t OsSemaphore;
+#endif
+
+typedef OS_THREAD_PROC(OsThreadProc);
+
+OsThread OsCreateThread(OsThreadProc *proc, void *data);
+void OsCreateSemaphore(OsSemaphore *semaphore, u32 max_count);
+void OsSignalSemaphore(OsSemaphore *semaphore);
+void OsWaitSemaphore(OsSemaphore *semaphore);
+
+#endif //OS_H
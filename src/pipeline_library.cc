@@ -0,0 +1,219 @@
+#include <string.h>
+#include "pipeline_library.hh"
+#include "assets.hh"
+
+PipelineLibrary *CreatePipelineLibrary(Arena *arena, VkDevice device, VkPipelineCache cache,
+                                       JobQueue *jobs, bool dynamic_state)
+{
+    PipelineLibrary *library = ArenaAllocStruct(arena, PipelineLibrary);
+    memset(library, 0, sizeof(*library));
+    library->device = device;
+    library->cache = cache;
+    library->jobs = jobs;
+    library->dynamic_state = dynamic_state;
+    library->fallback = PIPELINE_INVALID;
+    return library;
+}
+
+// State that is set per draw with extended dynamic state is left out of the
+// key, so permutations that only differ there share one pipeline.
+static void MakePipelineKey(PipelineLibrary *library, PipelineDesc *desc, PipelineKey *key)
+{
+    memset(key, 0, sizeof(*key));
+    key->vertex_shader = AssetHashString(desc->vertex_shader_path);
+    key->pixel_shader = AssetHashString(desc->pixel_shader_path);
+    key->layout = (u64)desc->layout.pipe_layout;
+    key->target_format = desc->target_format;
+    key->depth_format = desc->depth_format;
+
+    VertexLayout *vertex_layout = &desc->vertex_layout;
+    key->vertex_layout.binding_count = vertex_layout->binding_count;
+    key->vertex_layout.attribute_count = vertex_layout->attribute_count;
+    memcpy(key->vertex_layout.bindings, vertex_layout->bindings,
+           vertex_layout->binding_count * sizeof(VkVertexInputBindingDescription));
+    memcpy(key->vertex_layout.attributes, vertex_layout->attributes,
+           vertex_layout->attribute_count * sizeof(VkVertexInputAttributeDescription));
+
+    key->state.topology = desc->state.topology;
+    key->state.blend_mode = desc->state.blend_mode;
+    if(!library->dynamic_state)
+    {
+        key->state.cull_mode = desc->state.cull_mode;
+        key->state.front_face = desc->state.front_face;
+        key->state.depth_compare = desc->state.depth_compare;
+        key->state.depth_test = desc->state.depth_test;
+        key->state.depth_write = desc->state.depth_write;
+    }
+
+    key->spec_count = desc->spec_count;
+    memcpy(key->spec_constants, desc->spec_constants, desc->spec_count * sizeof(u32));
+}
+
+static void CompilePipelineEntry(PipelineLibrary *library, PipelineEntry *entry)
+{
+    PipelineKey *key = &entry->key;
+    VkFormat target_format = key->target_format;
+    VkFormat depth_format = key->depth_format;
+
+    GraphicsPipelineCreateInfo pipeline_info = {};
+    pipeline_info.layout = entry->layout;
+    pipeline_info.vertex_binding_count = key->vertex_layout.binding_count;
+    pipeline_info.vertex_bindings = key->vertex_layout.bindings;
+    pipeline_info.vertex_attribute_count = key->vertex_layout.attribute_count;
+    pipeline_info.vertex_attributes = key->vertex_layout.attributes;
+    pipeline_info.target_format = &target_format;
+    pipeline_info.depth_format = depth_format != VK_FORMAT_UNDEFINED ? &depth_format : 0;
+    pipeline_info.spec_count = key->spec_count;
+    pipeline_info.spec_constants = key->spec_constants;
+    pipeline_info.dynamic_state = library->dynamic_state;
+
+    // Dynamic fields are zero in the key; bake the defaults instead.
+    PipelineState state = key->state;
+    if(library->dynamic_state)
+    {
+        PipelineState defaults = DefaultPipelineState();
+        state.cull_mode = defaults.cull_mode;
+        state.front_face = defaults.front_face;
+        state.depth_compare = defaults.depth_compare;
+        state.depth_test = defaults.depth_test;
+        state.depth_write = defaults.depth_write;
+    }
+
+    pipeline_info.state = &state;
+
+    VkShaderModule vertex_module = LoadShaderModule(library->device, entry->vertex_shader_path);
+    VkShaderModule pixel_module = LoadShaderModule(library->device, entry->pixel_shader_path);
+
+    Pipeline pipeline = BuildGraphicsPipeline(library->device, library->cache, &pipeline_info,
+                                              vertex_module, pixel_module);
+
+    vkDestroyShaderModule(library->device, vertex_module, 0);
+    vkDestroyShaderModule(library->device, pixel_module, 0);
+
+    entry->pipeline = pipeline;
+    OsAtomicStore(&entry->ready, 1);
+}
+
+static void CompilePipelineJob(void *data)
+{
+    PipelineEntry *entry = (PipelineEntry *)data;
+    CompilePipelineEntry(entry->library, entry);
+}
+
+u32 PipelineLibraryFind(PipelineLibrary *library, PipelineDesc *desc, bool async)
+{
+    PipelineKey key;
+    MakePipelineKey(library, desc, &key);
+    u64 hash = AssetHashBytes(&key, sizeof(key));
+
+    u32 mask = PIPELINE_TABLE_SIZE - 1;
+    u32 probe = (u32)hash & mask;
+    for(;; probe = (probe + 1) & mask)
+    {
+        u32 index = library->table[probe];
+        if(index == 0)
+        {
+            break;
+        }
+
+        PipelineEntry *entry = &library->entries[index - 1];
+        if(entry->hash == hash && memcmp(&entry->key, &key, sizeof(key)) == 0)
+        {
+            return index - 1;
+        }
+    }
+
+    if(library->entry_count >= MAX_PIPELINES)
+    {
+        return library->fallback;
+    }
+
+    u32 index = library->entry_count++;
+    PipelineEntry *entry = &library->entries[index];
+    entry->library = library;
+    entry->key = key;
+    entry->hash = hash;
+    entry->vertex_shader_path = desc->vertex_shader_path;
+    entry->pixel_shader_path = desc->pixel_shader_path;
+    entry->layout = desc->layout;
+    entry->ready = 0;
+    library->table[probe] = index + 1;
+
+    if(async && library->jobs && library->fallback != PIPELINE_INVALID)
+    {
+        JobsAdd(library->jobs, CompilePipelineJob, entry, &library->pending);
+    }
+
+    else
+    {
+        CompilePipelineEntry(library, entry);
+    }
+
+    return index;
+}
+
+Pipeline *PipelineLibraryGet(PipelineLibrary *library, PipelineDesc *desc, bool async)
+{
+    return PipelineLibraryResolve(library, PipelineLibraryFind(library, desc, async));
+}
+
+Pipeline *PipelineLibraryResolve(PipelineLibrary *library, u32 index)
+{
+    if(index != PIPELINE_INVALID && library->entries[index].ready)
+    {
+        return &library->entries[index].pipeline;
+    }
+
+    if(library->fallback != PIPELINE_INVALID)
+    {
+        return &library->entries[library->fallback].pipeline;
+    }
+
+    return 0;
+}
+
+void PipelineLibrarySetFallback(PipelineLibrary *library, PipelineDesc *desc)
+{
+    library->fallback = PipelineLibraryFind(library, desc, false);
+}
+
+// Queues every desc and waits, so known permutations compile in parallel
+// at startup instead of one by one on first draw.
+void PipelineLibraryPrecompile(PipelineLibrary *library, u32 count, PipelineDesc *descs)
+{
+    for(u32 i = 0; i < count; i++)
+    {
+        PipelineLibraryFind(library, &descs[i], true);
+    }
+
+    PipelineLibraryWait(library);
+}
+
+void PipelineLibraryWait(PipelineLibrary *library)
+{
+    if(library->jobs)
+    {
+        JobsWait(library->jobs, &library->pending);
+    }
+}
+
+// Layouts belong to whoever made the descs and are left alone.
+void DestroyPipelineLibrary(PipelineLibrary *library)
+{
+    PipelineLibraryWait(library);
+    for(u32 i = 0; i < library->entry_count; i++)
+    {
+        PipelineEntry *entry = &library->entries[i];
+        if(entry->pipeline.pipeline)
+        {
+            vkDestroyPipeline(library->device, entry->pipeline.pipeline, 0);
+        }
+
+        entry->pipeline = {};
+        OsAtomicStore(&entry->ready, 0);
+    }
+
+    library->entry_count = 0;
+    library->fallback = PIPELINE_INVALID;
+    memset(library->table, 0, sizeof(library->table));
+}
@@ -0,0 +1,97 @@
+#ifndef PIPELINE_LIBRARY_H
+#define PIPELINE_LIBRARY_H
+
+#define MAX_PIPELINES 256
+#define PIPELINE_TABLE_SIZE (MAX_PIPELINES * 2)
+#define MAX_VERTEX_BINDINGS 4
+#define MAX_VERTEX_ATTRIBUTES 16
+#define PIPELINE_INVALID 0xffffffff
+
+#include <vulkan/vulkan.h>
+
+#include "os.hh"
+#include "types.hh"
+#include "jobs.hh"
+#include "arena_alloc.hh"
+#include "vk_pipeline.hh"
+
+struct VertexLayout
+{
+    u32 binding_count;
+    VkVertexInputBindingDescription bindings[MAX_VERTEX_BINDINGS];
+    u32 attribute_count;
+    VkVertexInputAttributeDescription attributes[MAX_VERTEX_ATTRIBUTES];
+};
+
+// Everything that makes two pipelines differ. Built zeroed and compared as
+// bytes, so padding must stay zero.
+struct PipelineKey
+{
+    u64 vertex_shader;
+    u64 pixel_shader;
+    u64 layout;
+    VertexLayout vertex_layout;
+    VkFormat target_format;
+    VkFormat depth_format;
+    PipelineState state;
+    u32 spec_count;
+    u32 spec_constants[MAX_SPEC_CONSTANTS];
+};
+
+struct PipelineDesc
+{
+    const char *vertex_shader_path;
+    const char *pixel_shader_path;
+    PipelineLayout layout;
+    VertexLayout vertex_layout;
+    VkFormat target_format;
+    VkFormat depth_format;
+    PipelineState state;
+    u32 spec_count;
+    u32 spec_constants[MAX_SPEC_CONSTANTS];
+};
+
+struct PipelineLibrary;
+
+struct PipelineEntry
+{
+    PipelineLibrary *library;
+    PipelineKey key;
+    u64 hash;
+    const char *vertex_shader_path;
+    const char *pixel_shader_path;
+    PipelineLayout layout;
+
+    OsAtomic ready;
+    Pipeline pipeline;
+};
+
+// Pipelines are created on first use. A miss either compiles inline or,
+// when a fallback is set, queues the compile on the job system and hands
+// back the fallback until the job publishes the result.
+struct PipelineLibrary
+{
+    VkDevice device;
+    VkPipelineCache cache;
+    JobQueue *jobs;
+    bool dynamic_state;
+
+    JobCounter pending;
+    u32 fallback;
+    u32 entry_count;
+    PipelineEntry entries[MAX_PIPELINES];
+    u32 table[PIPELINE_TABLE_SIZE];
+};
+
+PipelineLibrary *CreatePipelineLibrary(Arena *arena, VkDevice device, VkPipelineCache cache,
+                                       JobQueue *jobs, bool dynamic_state);
+
+u32 PipelineLibraryFind(PipelineLibrary *library, PipelineDesc *desc, bool async);
+Pipeline *PipelineLibraryGet(PipelineLibrary *library, PipelineDesc *desc, bool async);
+Pipeline *PipelineLibraryResolve(PipelineLibrary *library, u32 index);
+void PipelineLibrarySetFallback(PipelineLibrary *library, PipelineDesc *desc);
+void PipelineLibraryPrecompile(PipelineLibrary *library, u32 count, PipelineDesc *descs);
+void PipelineLibraryWait(PipelineLibrary *library);
+void DestroyPipelineLibrary(PipelineLibrary *library);
+
+#endif //PIPELINE_LIBRARY_H
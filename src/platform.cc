@@ -38,7 +38,8 @@ LRESULT CALLBACK WindowProc(HWND window, UINT msg, WPARAM wParam, LPARAM lParam)
     {
         case WM_DESTROY:
         {
-            ExitProcess(0);
+            platform->quit = true;
+            return 0;
         }
 
         case WM_MOUSEMOVE:
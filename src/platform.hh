@@ -9,6 +9,7 @@ struct Platform
     HWND window;
     POINT cursor_delta;
     POINT cursor_pos;
+    bool quit;
 };
 
 Platform *CreatePlatform(Arena *arena, int width, int height, const char *window_name);
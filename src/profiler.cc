@@ -0,0 +1,384 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include "profiler.hh"
+
+#ifdef PROFILE
+
+#define PROFILE_GPU_QUERIES (PROFILE_MAX_GPU_ZONES * 2)
+
+#ifdef _WIN32
+#define PROFILE_HOST_TIME_DOMAIN VK_TIME_DOMAIN_QUERY_PERFORMANCE_COUNTER_EXT
+#else
+#define PROFILE_HOST_TIME_DOMAIN VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT
+#endif
+
+static u64 profile_start;
+static OsAtomic profile_thread_count;
+static ProfileThread profile_threads[PROFILE_MAX_THREADS];
+static thread_local ProfileThread *profile_thread;
+static ProfileGpu profile_gpu;
+
+// Slots are claimed with an atomic increment and published by storing the
+// ring pointer last, so the trace writer skips slots still being set up.
+static ProfileThread *ProfilerRegister(const char *name)
+{
+    i32 index = OsAtomicIncrement(&profile_thread_count) - 1;
+    if(index >= PROFILE_MAX_THREADS)
+    {
+        return 0;
+    }
+
+    ProfileThread *thread = &profile_threads[index];
+    thread->name = name;
+    thread->id = index + 1;
+    ProfileEvent *events = (ProfileEvent *)OsAllocMemory(PROFILE_RING_SIZE * sizeof(ProfileEvent));
+    OsMemoryBarrier();
+    thread->events = events;
+    return thread;
+}
+
+static ProfileThread *ProfilerGetThread(void)
+{
+    if(!profile_thread)
+    {
+        profile_thread = ProfilerRegister(0);
+    }
+
+    return profile_thread;
+}
+
+static void ProfilerPush(ProfileThread *thread, const char *name, u64 begin, u64 end)
+{
+    if(!thread || !thread->events)
+    {
+        return;
+    }
+
+    u32 write = thread->write;
+    ProfileEvent *event = &thread->events[write % PROFILE_RING_SIZE];
+    event->name = name;
+    event->begin = begin;
+    event->end = end;
+    OsAtomicStore(&thread->write, write + 1);
+}
+
+void ProfilerInit(void)
+{
+    profile_start = OsTimeNow();
+    ProfilerSetThreadName("Main");
+}
+
+void ProfilerSetThreadName(const char *name)
+{
+    ProfileThread *thread = ProfilerGetThread();
+    if(thread)
+    {
+        thread->name = name;
+    }
+}
+
+void ProfilerRecord(const char *name, u64 begin, u64 end)
+{
+    ProfilerPush(ProfilerGetThread(), name, begin, end);
+}
+
+struct TraceWriter
+{
+    char *data;
+    u64 size;
+    u64 capacity;
+};
+
+static void TraceAppend(TraceWriter *writer, const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    u64 remaining = writer->capacity - writer->size;
+    int written = vsnprintf(writer->data + writer->size, remaining, format, args);
+    va_end(args);
+
+    if(written > 0 && (u64)written < remaining)
+    {
+        writer->size += written;
+    }
+}
+
+// Chrome trace event format, which chrome://tracing and Perfetto both load.
+// CPU and GPU zones share one clock, so the GPU track lines up under the
+// frames that submitted it.
+bool ProfilerWriteTrace(const char *path)
+{
+    u32 thread_count = profile_thread_count;
+    if(thread_count > PROFILE_MAX_THREADS)
+    {
+        thread_count = PROFILE_MAX_THREADS;
+    }
+
+    u64 event_size = 160;
+    u64 capacity = (u64)(thread_count * (PROFILE_RING_SIZE + 1) + 1) * event_size;
+    u64 scratch_size = PROFILE_RING_SIZE * sizeof(ProfileEvent);
+
+    TraceWriter writer = {};
+    writer.data = (char *)OsAllocMemory(capacity);
+    writer.capacity = capacity;
+    ProfileEvent *scratch = (ProfileEvent *)OsAllocMemory(scratch_size);
+    if(!writer.data || !scratch)
+    {
+        if(writer.data) OsFreeMemory(writer.data, capacity);
+        if(scratch) OsFreeMemory(scratch, scratch_size);
+        return false;
+    }
+
+    double us_per_tick = 1000000.0 / OsTimeFrequency();
+    bool first = true;
+
+    TraceAppend(&writer, "{\"traceEvents\":[\n");
+    for(u32 i = 0; i < thread_count; i++)
+    {
+        ProfileThread *thread = &profile_threads[i];
+        if(!thread->events)
+        {
+            continue;
+        }
+
+        u32 end = thread->write;
+        OsMemoryBarrier();
+        u32 count = end < PROFILE_RING_SIZE ? end : PROFILE_RING_SIZE;
+        u32 first_event = end - count;
+        for(u32 j = 0; j < count; j++)
+        {
+            scratch[j] = thread->events[(first_event + j) % PROFILE_RING_SIZE];
+        }
+
+        // While event n is being written its slot still holds n - RING, so
+        // anything the writer may have reached since the copy is dropped.
+        OsMemoryBarrier();
+        u32 after = thread->write;
+        u32 skip = 0;
+        if(after - first_event >= PROFILE_RING_SIZE)
+        {
+            skip = after - first_event - PROFILE_RING_SIZE + 1;
+        }
+
+        if(skip > count)
+        {
+            skip = count;
+        }
+
+        char default_name[32];
+        const char *name = thread->name;
+        if(!name)
+        {
+            snprintf(default_name, sizeof(default_name), "Thread %u", thread->id);
+            name = default_name;
+        }
+
+        TraceAppend(&writer, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                    first ? "" : ",\n", thread->id, name);
+        first = false;
+
+        for(u32 j = skip; j < count; j++)
+        {
+            ProfileEvent *event = &scratch[j];
+            double ts = (double)(i64)(event->begin - profile_start) * us_per_tick;
+            double dur = (double)(event->end - event->begin) * us_per_tick;
+            TraceAppend(&writer, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                        event->name, thread->id, ts, dur);
+        }
+    }
+    TraceAppend(&writer, "\n]}\n");
+
+    bool ok = OsWriteFileAtomic(path, writer.data, writer.size);
+    OsFreeMemory(scratch, scratch_size);
+    OsFreeMemory(writer.data, capacity);
+    return ok;
+}
+
+void ProfilerGpuInit(Device device)
+{
+    ProfileGpu *gpu = &profile_gpu;
+    *gpu = {};
+
+    u32 family_count = 0;
+    VkQueueFamilyProperties families[16];
+    vkGetPhysicalDeviceQueueFamilyProperties(device.adapter, &family_count, 0);
+    if(family_count > 16) family_count = 16;
+    vkGetPhysicalDeviceQueueFamilyProperties(device.adapter, &family_count, families);
+
+    u32 valid_bits = families[device.queue_family_index].timestampValidBits;
+    if(valid_bits == 0)
+    {
+        return;
+    }
+
+    VkPhysicalDeviceProperties props;
+    vkGetPhysicalDeviceProperties(device.adapter, &props);
+
+    VkQueryPoolCreateInfo pool_info = {};
+    pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    pool_info.queryCount = MAX_FRAMES * PROFILE_GPU_QUERIES;
+    if(vkCreateQueryPool(device.device, &pool_info, 0, &gpu->pool) != VK_SUCCESS)
+    {
+        gpu->pool = 0;
+        return;
+    }
+
+    gpu->device = device.device;
+    gpu->get_calibrated_timestamps = device.get_calibrated_timestamps;
+    gpu->ns_per_tick = props.limits.timestampPeriod;
+    gpu->valid_mask = valid_bits >= 64 ? ~0ull : (1ull << valid_bits) - 1;
+    gpu->track = ProfilerRegister("GPU");
+}
+
+void ProfilerGpuShutdown(void)
+{
+    ProfileGpu *gpu = &profile_gpu;
+    if(gpu->pool)
+    {
+        vkDestroyQueryPool(gpu->device, gpu->pool, 0);
+        gpu->pool = 0;
+    }
+}
+
+static i64 GpuTickDelta(u64 mask, u64 ticks, u64 reference)
+{
+    u64 delta = (ticks - reference) & mask;
+    if(delta > (mask >> 1))
+    {
+        return -(i64)((reference - ticks) & mask);
+    }
+
+    return (i64)delta;
+}
+
+// With calibrated timestamps the device and host clocks are sampled
+// together, which places each zone exactly. Without them the first zone
+// is pinned to the CPU submit time, which is only a lower bound.
+static void ProfilerGpuResolve(ProfileGpu *gpu, ProfileGpuFrame *frame, u32 base)
+{
+    u64 ticks[PROFILE_GPU_QUERIES];
+    VkResult result = vkGetQueryPoolResults(gpu->device, gpu->pool, base, frame->zone_count * 2,
+                                            sizeof(ticks), ticks, sizeof(u64), VK_QUERY_RESULT_64_BIT);
+    if(result != VK_SUCCESS)
+    {
+        return;
+    }
+
+    u64 gpu_reference = ticks[0];
+    u64 cpu_reference = frame->submit_time;
+    if(gpu->get_calibrated_timestamps)
+    {
+        VkCalibratedTimestampInfoEXT infos[2] = {};
+        infos[0].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+        infos[0].timeDomain = VK_TIME_DOMAIN_DEVICE_EXT;
+        infos[1].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+        infos[1].timeDomain = PROFILE_HOST_TIME_DOMAIN;
+
+        u64 timestamps[2];
+        u64 deviation = 0;
+        if(gpu->get_calibrated_timestamps(gpu->device, 2, infos, timestamps, &deviation) == VK_SUCCESS)
+        {
+            gpu_reference = timestamps[0];
+            cpu_reference = timestamps[1];
+        }
+    }
+
+    double cpu_ticks_per_gpu_tick = gpu->ns_per_tick * OsTimeFrequency() / 1000000000.0;
+    for(u32 i = 0; i < frame->zone_count; i++)
+    {
+        i64 begin = GpuTickDelta(gpu->valid_mask, ticks[i * 2], gpu_reference);
+        i64 end = GpuTickDelta(gpu->valid_mask, ticks[i * 2 + 1], gpu_reference);
+        ProfilerPush(gpu->track, frame->names[i],
+                     cpu_reference + (i64)(begin * cpu_ticks_per_gpu_tick),
+                     cpu_reference + (i64)(end * cpu_ticks_per_gpu_tick));
+    }
+}
+
+// Called once the slot's previous submission has completed.
+void ProfilerGpuBeginFrame(VkCommandBuffer cmd, u32 slot)
+{
+    ProfileGpu *gpu = &profile_gpu;
+    if(!gpu->pool)
+    {
+        return;
+    }
+
+    ProfileGpuFrame *frame = &gpu->frames[slot];
+    u32 base = slot * PROFILE_GPU_QUERIES;
+    if(frame->pending && frame->zone_count)
+    {
+        ProfilerGpuResolve(gpu, frame, base);
+    }
+
+    frame->pending = false;
+    frame->zone_count = 0;
+    gpu->slot = slot;
+    gpu->depth = 0;
+    vkCmdResetQueryPool(cmd, gpu->pool, base, PROFILE_GPU_QUERIES);
+}
+
+void ProfilerGpuEndFrame(VkCommandBuffer cmd)
+{
+    ProfileGpu *gpu = &profile_gpu;
+    if(!gpu->pool)
+    {
+        return;
+    }
+
+    while(gpu->depth)
+    {
+        ProfilerGpuEnd(cmd);
+    }
+
+    ProfileGpuFrame *frame = &gpu->frames[gpu->slot];
+    frame->submit_time = OsTimeNow();
+    frame->pending = true;
+}
+
+// Zones past the per-frame or nesting limits are dropped, but still
+// balanced so the matching end does not close the wrong zone.
+void ProfilerGpuBegin(VkCommandBuffer cmd, const char *name)
+{
+    ProfileGpu *gpu = &profile_gpu;
+    if(!gpu->pool)
+    {
+        return;
+    }
+
+    ProfileGpuFrame *frame = &gpu->frames[gpu->slot];
+    u32 zone = 0xffffffff;
+    if(gpu->depth < PROFILE_MAX_GPU_DEPTH && frame->zone_count < PROFILE_MAX_GPU_ZONES)
+    {
+        zone = frame->zone_count++;
+        frame->names[zone] = name;
+        vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT, gpu->pool,
+                             gpu->slot * PROFILE_GPU_QUERIES + zone * 2);
+    }
+
+    if(gpu->depth < PROFILE_MAX_GPU_DEPTH)
+    {
+        gpu->stack[gpu->depth] = zone;
+    }
+    gpu->depth++;
+}
+
+void ProfilerGpuEnd(VkCommandBuffer cmd)
+{
+    ProfileGpu *gpu = &profile_gpu;
+    if(!gpu->pool || !gpu->depth)
+    {
+        return;
+    }
+
+    gpu->depth--;
+    u32 zone = gpu->depth < PROFILE_MAX_GPU_DEPTH ? gpu->stack[gpu->depth] : 0xffffffff;
+    if(zone != 0xffffffff)
+    {
+        vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, gpu->pool,
+                             gpu->slot * PROFILE_GPU_QUERIES + zone * 2 + 1);
+    }
+}
+
+#endif //PROFILE
@@ -0,0 +1,123 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+// Built only when PROFILE is defined (build.bat and build.sh define it
+// unless given "release"). Without it every macro below expands to
+// nothing and none of profiler.cc is compiled.
+
+#ifdef PROFILE
+
+#define PROFILE_MAX_THREADS 64
+#define PROFILE_RING_SIZE 16384
+#define PROFILE_MAX_GPU_ZONES 64
+#define PROFILE_MAX_GPU_DEPTH 16
+
+#include <vulkan/vulkan.h>
+
+#include "os.hh"
+#include "types.hh"
+#include "vk_utils.hh"
+
+struct ProfileEvent
+{
+    const char *name;
+    u64 begin;
+    u64 end;
+};
+
+// One writer per ring: the thread that owns it, or the render thread for
+// the GPU track. The reader copies events out and then checks the write
+// count again to drop any the writer lapped meanwhile, so neither side
+// ever takes a lock.
+struct ProfileThread
+{
+    const char *name;
+    u32 id;
+    OsAtomic write;
+    ProfileEvent *events;
+};
+
+struct ProfileGpuFrame
+{
+    bool pending;
+    u64 submit_time;
+    u32 zone_count;
+    const char *names[PROFILE_MAX_GPU_ZONES];
+};
+
+// Timestamp queries are written per frame slot and read back when the slot
+// comes around again, by which point its fence has signalled.
+struct ProfileGpu
+{
+    VkDevice device;
+    VkQueryPool pool;
+    PFN_vkGetCalibratedTimestampsEXT get_calibrated_timestamps;
+    double ns_per_tick;
+    u64 valid_mask;
+
+    ProfileThread *track;
+    u32 slot;
+    u32 depth;
+    u32 stack[PROFILE_MAX_GPU_DEPTH];
+    ProfileGpuFrame frames[MAX_FRAMES];
+};
+
+void ProfilerInit(void);
+void ProfilerSetThreadName(const char *name);
+void ProfilerRecord(const char *name, u64 begin, u64 end);
+bool ProfilerWriteTrace(const char *path);
+
+void ProfilerGpuInit(Device device);
+void ProfilerGpuShutdown(void);
+void ProfilerGpuBeginFrame(VkCommandBuffer cmd, u32 slot);
+void ProfilerGpuEndFrame(VkCommandBuffer cmd);
+void ProfilerGpuBegin(VkCommandBuffer cmd, const char *name);
+void ProfilerGpuEnd(VkCommandBuffer cmd);
+
+struct ProfileScope
+{
+    const char *name;
+    u64 begin;
+
+    ProfileScope(const char *zone_name)
+    {
+        name = zone_name;
+        begin = OsTimeNow();
+    }
+
+    ~ProfileScope()
+    {
+        ProfilerRecord(name, begin, OsTimeNow());
+    }
+};
+
+#define PROFILE_JOIN2(a, b) a##b
+#define PROFILE_JOIN(a, b) PROFILE_JOIN2(a, b)
+
+#define PROFILE_INIT() ProfilerInit()
+#define PROFILE_THREAD(name) ProfilerSetThreadName(name)
+#define PROFILE_ZONE(name) ProfileScope PROFILE_JOIN(profile_zone_, __LINE__)(name)
+
+#define PROFILE_GPU_INIT(device) ProfilerGpuInit(device)
+#define PROFILE_GPU_SHUTDOWN() ProfilerGpuShutdown()
+#define PROFILE_GPU_BEGIN_FRAME(cmd, slot) ProfilerGpuBeginFrame(cmd, slot)
+#define PROFILE_GPU_END_FRAME(cmd) ProfilerGpuEndFrame(cmd)
+#define PROFILE_GPU_BEGIN(cmd, name) ProfilerGpuBegin(cmd, name)
+#define PROFILE_GPU_END(cmd) ProfilerGpuEnd(cmd)
+
+#else
+
+#define PROFILE_INIT()
+#define PROFILE_THREAD(name)
+#define PROFILE_ZONE(name)
+
+#define PROFILE_GPU_INIT(device)
+#define PROFILE_GPU_SHUTDOWN()
+#define PROFILE_GPU_BEGIN_FRAME(cmd, slot)
+#define PROFILE_GPU_END_FRAME(cmd)
+#define PROFILE_GPU_BEGIN(cmd, name)
+#define PROFILE_GPU_END(cmd)
+
+#endif //PROFILE
+
+#endif //PROFILER_H
@@ -0,0 +1,784 @@
+#include <string.h>
+#include "render_graph.hh"
+#include "gpu_memory.hh"
+#include "profiler.hh"
+
+#define GRAPH_WRITE_ACCESS (VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | \
+                            VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT | \
+                            VK_ACCESS_2_MEMORY_WRITE_BIT)
+
+GraphAccessInfo GraphGetAccessInfo(GraphAccessType type)
+{
+    GraphAccessInfo info = {};
+    switch(type)
+    {
+        case GRAPH_COLOR_ATTACHMENT:
+        {
+            info.stages = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+            info.access = VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT;
+            info.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+            info.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+            info.write = true;
+        } break;
+
+        case GRAPH_DEPTH_ATTACHMENT:
+        {
+            info.stages = VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT;
+            info.access = VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+            info.layout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL;
+            info.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+            info.write = true;
+        } break;
+
+        case GRAPH_DEPTH_READ:
+        {
+            info.stages = VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT |
+                          VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT;
+            info.access = VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_SHADER_SAMPLED_READ_BIT;
+            info.layout = VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL;
+            info.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+        } break;
+
+        case GRAPH_SAMPLED:
+        {
+            info.stages = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+            info.access = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT;
+            info.layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            info.usage = VK_IMAGE_USAGE_SAMPLED_BIT;
+        } break;
+
+        case GRAPH_STORAGE_READ:
+        {
+            info.stages = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT;
+            info.access = VK_ACCESS_2_SHADER_STORAGE_READ_BIT;
+            info.layout = VK_IMAGE_LAYOUT_GENERAL;
+            info.usage = VK_IMAGE_USAGE_STORAGE_BIT;
+        } break;
+
+        case GRAPH_STORAGE_WRITE:
+        {
+            info.stages = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+            info.access = VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+            info.layout = VK_IMAGE_LAYOUT_GENERAL;
+            info.usage = VK_IMAGE_USAGE_STORAGE_BIT;
+            info.write = true;
+        } break;
+
+        case GRAPH_TRANSFER_SRC:
+        {
+            info.stages = VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT;
+            info.access = VK_ACCESS_2_TRANSFER_READ_BIT;
+            info.layout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+            info.usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        } break;
+
+        case GRAPH_TRANSFER_DST:
+        {
+            info.stages = VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT;
+            info.access = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+            info.layout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            info.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+            info.write = true;
+        } break;
+
+        case GRAPH_VERTEX_READ:
+        {
+            info.stages = VK_PIPELINE_STAGE_2_VERTEX_INPUT_BIT;
+            info.access = VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_2_INDEX_READ_BIT;
+        } break;
+
+        case GRAPH_UNIFORM_READ:
+        {
+            info.stages = VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT |
+                          VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+            info.access = VK_ACCESS_2_UNIFORM_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_READ_BIT;
+        } break;
+
+        case GRAPH_INDIRECT_READ:
+        {
+            info.stages = VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT;
+            info.access = VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT;
+        } break;
+
+        default: break;
+    }
+
+    return info;
+}
+
+void RenderGraphReset(RenderGraph *graph)
+{
+    graph->pass_count = 0;
+    graph->resource_count = 0;
+    graph->barrier_count = 0;
+    graph->final_barrier = 0;
+    graph->final_barrier_count = 0;
+    graph->transient_size = 0;
+    graph->transient_memory_bits = 0;
+}
+
+static u32 RenderGraphAddResource(RenderGraph *graph, GraphResourceType type)
+{
+    if(graph->resource_count >= MAX_GRAPH_RESOURCES)
+    {
+        return GRAPH_INVALID;
+    }
+
+    u32 index = graph->resource_count++;
+    GraphResource *resource = &graph->resources[index];
+    *resource = {};
+    resource->type = type;
+    resource->first_pass = GRAPH_INVALID;
+    return index;
+}
+
+// Importing the same image twice returns the existing resource, so callers
+// can import by handle without tracking what is already in the graph.
+u32 RenderGraphImportImage(RenderGraph *graph, VkImage image, VkImageView view, VkFormat format,
+                           VkExtent2D extent, VkImageAspectFlags aspect,
+                           VkImageLayout initial_layout, VkPipelineStageFlags2 initial_stages)
+{
+    for(u32 i = 0; i < graph->resource_count; i++)
+    {
+        if(graph->resources[i].imported && graph->resources[i].image == image)
+        {
+            return i;
+        }
+    }
+
+    u32 index = RenderGraphAddResource(graph, GRAPH_IMAGE);
+    if(index == GRAPH_INVALID)
+    {
+        return index;
+    }
+
+    GraphResource *resource = &graph->resources[index];
+    resource->imported = true;
+    resource->image = image;
+    resource->view = view;
+    resource->format = format;
+    resource->extent = extent;
+    resource->aspect = aspect;
+    resource->initial_layout = initial_layout;
+    resource->initial_stages = initial_stages;
+    return index;
+}
+
+void RenderGraphSetOutput(RenderGraph *graph, u32 resource, VkImageLayout final_layout,
+                          VkPipelineStageFlags2 final_stages)
+{
+    if(resource < graph->resource_count)
+    {
+        graph->resources[resource].output = true;
+        graph->resources[resource].final_layout = final_layout;
+        graph->resources[resource].final_stages = final_stages;
+    }
+}
+
+u32 RenderGraphImportBuffer(RenderGraph *graph, VkBuffer buffer)
+{
+    for(u32 i = 0; i < graph->resource_count; i++)
+    {
+        if(graph->resources[i].imported && graph->resources[i].buffer == buffer)
+        {
+            return i;
+        }
+    }
+
+    u32 index = RenderGraphAddResource(graph, GRAPH_BUFFER);
+    if(index != GRAPH_INVALID)
+    {
+        graph->resources[index].imported = true;
+        graph->resources[index].buffer = buffer;
+    }
+
+    return index;
+}
+
+u32 RenderGraphCreateImage(RenderGraph *graph, VkFormat format, VkExtent2D extent, VkImageAspectFlags aspect)
+{
+    u32 index = RenderGraphAddResource(graph, GRAPH_IMAGE);
+    if(index != GRAPH_INVALID)
+    {
+        GraphResource *resource = &graph->resources[index];
+        resource->format = format;
+        resource->extent = extent;
+        resource->aspect = aspect;
+    }
+
+    return index;
+}
+
+u32 RenderGraphAddPass(RenderGraph *graph, const char *name, GraphPassProc *execute, void *data)
+{
+    if(graph->pass_count >= MAX_GRAPH_PASSES)
+    {
+        return GRAPH_INVALID;
+    }
+
+    u32 index = graph->pass_count++;
+    GraphPass *pass = &graph->passes[index];
+    *pass = {};
+    pass->name = name;
+    pass->execute = execute;
+    pass->data = data;
+    return index;
+}
+
+void RenderGraphAccess(RenderGraph *graph, u32 pass_index, u32 resource, GraphAccessType type)
+{
+    if(pass_index >= graph->pass_count || resource >= graph->resource_count)
+    {
+        return;
+    }
+
+    GraphPass *pass = &graph->passes[pass_index];
+    if(pass->access_count >= MAX_PASS_ACCESSES)
+    {
+        return;
+    }
+
+    GraphAccess *access = &pass->accesses[pass->access_count++];
+    access->resource = resource;
+    access->type = type;
+    graph->resources[resource].usage |= GraphGetAccessInfo(type).usage;
+}
+
+void RenderGraphSetSideEffect(RenderGraph *graph, u32 pass)
+{
+    if(pass < graph->pass_count)
+    {
+        graph->passes[pass].side_effect = true;
+    }
+}
+
+// Walks back from the outputs. A pass survives if it has side effects or
+// touches anything a surviving later pass or an output needs; everything it
+// touches then becomes needed in turn. Writers are kept conservatively since
+// there is no resource versioning to tell a full overwrite from a blend.
+static void RenderGraphCull(RenderGraph *graph)
+{
+    bool live[MAX_GRAPH_RESOURCES] = {};
+    for(u32 i = 0; i < graph->resource_count; i++)
+    {
+        live[i] = graph->resources[i].output;
+    }
+
+    for(u32 p = graph->pass_count; p-- > 0;)
+    {
+        GraphPass *pass = &graph->passes[p];
+        bool needed = pass->side_effect;
+        for(u32 a = 0; a < pass->access_count && !needed; a++)
+        {
+            GraphAccess *access = &pass->accesses[a];
+            needed = live[access->resource] && GraphGetAccessInfo(access->type).write;
+        }
+
+        pass->culled = !needed;
+        if(needed)
+        {
+            for(u32 a = 0; a < pass->access_count; a++)
+            {
+                live[pass->accesses[a].resource] = true;
+            }
+        }
+    }
+}
+
+struct GraphResourceState
+{
+    VkImageLayout layout;
+    VkPipelineStageFlags2 write_stages;
+    VkAccessFlags2 write_access;
+    VkPipelineStageFlags2 read_stages;
+};
+
+static bool RenderGraphPushBarrier(RenderGraph *graph, u32 resource, GraphResourceState *state,
+                                   VkPipelineStageFlags2 dst_stages, VkAccessFlags2 dst_access,
+                                   VkImageLayout new_layout)
+{
+    if(graph->barrier_count >= MAX_GRAPH_BARRIERS)
+    {
+        return false;
+    }
+
+    GraphBarrier *barrier = &graph->barriers[graph->barrier_count++];
+    barrier->resource = resource;
+    barrier->src_stages = state->write_stages | state->read_stages;
+    barrier->src_access = state->write_access;
+    barrier->dst_stages = dst_stages;
+    barrier->dst_access = dst_access;
+    barrier->old_layout = state->layout;
+    barrier->new_layout = new_layout;
+    return true;
+}
+
+bool RenderGraphCompile(RenderGraph *graph)
+{
+    PROFILE_ZONE("RenderGraphCompile");
+    RenderGraphCull(graph);
+
+    for(u32 i = 0; i < graph->resource_count; i++)
+    {
+        GraphResource *resource = &graph->resources[i];
+        resource->used = false;
+        resource->first_pass = GRAPH_INVALID;
+        resource->last_pass = 0;
+    }
+
+    for(u32 p = 0; p < graph->pass_count; p++)
+    {
+        GraphPass *pass = &graph->passes[p];
+        for(u32 a = 0; a < pass->access_count && !pass->culled; a++)
+        {
+            GraphResource *resource = &graph->resources[pass->accesses[a].resource];
+            if(!resource->used) resource->first_pass = p;
+            resource->used = true;
+            resource->last_pass = p;
+        }
+    }
+
+    // Every resource starts out as if the stages it was last used in wrote
+    // it. For imports that is whatever the caller says, e.g. the previous
+    // frame's depth tests. Transient memory may still be in use by an earlier
+    // frame or by whatever aliased it before, so they assume every stage.
+    GraphResourceState states[MAX_GRAPH_RESOURCES];
+    for(u32 i = 0; i < graph->resource_count; i++)
+    {
+        GraphResource *resource = &graph->resources[i];
+        GraphResourceState *state = &states[i];
+        *state = {};
+        state->layout = resource->imported ? resource->initial_layout : VK_IMAGE_LAYOUT_UNDEFINED;
+        state->write_stages = resource->imported ? resource->initial_stages : VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+        state->write_access = state->write_stages ? VK_ACCESS_2_MEMORY_WRITE_BIT : 0;
+    }
+
+    graph->barrier_count = 0;
+    for(u32 p = 0; p < graph->pass_count; p++)
+    {
+        GraphPass *pass = &graph->passes[p];
+        pass->first_barrier = graph->barrier_count;
+        pass->barrier_count = 0;
+        if(pass->culled)
+        {
+            continue;
+        }
+
+        for(u32 a = 0; a < pass->access_count; a++)
+        {
+            u32 index = pass->accesses[a].resource;
+            GraphAccessInfo info = GraphGetAccessInfo(pass->accesses[a].type);
+
+            // Several accesses to one resource in a pass collapse into one.
+            bool seen = false;
+            for(u32 b = 0; b < a; b++)
+            {
+                seen |= pass->accesses[b].resource == index;
+            }
+
+            if(seen)
+            {
+                continue;
+            }
+
+            for(u32 b = a + 1; b < pass->access_count; b++)
+            {
+                if(pass->accesses[b].resource == index)
+                {
+                    GraphAccessInfo other = GraphGetAccessInfo(pass->accesses[b].type);
+                    info.stages |= other.stages;
+                    info.access |= other.access;
+                    info.write |= other.write;
+                }
+            }
+
+            GraphResource *resource = &graph->resources[index];
+            GraphResourceState *state = &states[index];
+            bool is_image = resource->type == GRAPH_IMAGE;
+
+            if(is_image && info.layout != state->layout)
+            {
+                if(!RenderGraphPushBarrier(graph, index, state, info.stages, info.access, info.layout))
+                {
+                    return false;
+                }
+
+                state->layout = info.layout;
+                state->write_stages = info.stages;
+                state->write_access = info.write ? info.access & GRAPH_WRITE_ACCESS : 0;
+                state->read_stages = info.write ? 0 : info.stages;
+            }
+
+            else if(info.write)
+            {
+                if(state->write_stages | state->read_stages)
+                {
+                    if(!RenderGraphPushBarrier(graph, index, state, info.stages, info.access, state->layout))
+                    {
+                        return false;
+                    }
+                }
+
+                state->write_stages = info.stages;
+                state->write_access = info.access & GRAPH_WRITE_ACCESS;
+                state->read_stages = 0;
+            }
+
+            else
+            {
+                VkPipelineStageFlags2 new_stages = info.stages & ~state->read_stages;
+                if(new_stages && state->write_stages)
+                {
+                    GraphResourceState src = *state;
+                    src.read_stages = 0;
+                    if(!RenderGraphPushBarrier(graph, index, &src, info.stages, info.access, state->layout))
+                    {
+                        return false;
+                    }
+                }
+
+                state->read_stages |= info.stages;
+            }
+        }
+
+        pass->barrier_count = graph->barrier_count - pass->first_barrier;
+    }
+
+    graph->final_barrier = graph->barrier_count;
+    for(u32 i = 0; i < graph->resource_count; i++)
+    {
+        GraphResource *resource = &graph->resources[i];
+        if(resource->output && resource->type == GRAPH_IMAGE && resource->final_layout != states[i].layout)
+        {
+            if(!RenderGraphPushBarrier(graph, i, &states[i], resource->final_stages, 0, resource->final_layout))
+            {
+                return false;
+            }
+        }
+    }
+
+    graph->final_barrier_count = graph->barrier_count - graph->final_barrier;
+    return true;
+}
+
+// Greedy first fit, largest first. Two transients may share bytes only if
+// their pass ranges do not overlap.
+void RenderGraphPlaceTransients(RenderGraph *graph)
+{
+    u32 order[MAX_GRAPH_RESOURCES];
+    u32 count = 0;
+    graph->transient_size = 0;
+    graph->transient_memory_bits = 0xffffffff;
+
+    for(u32 i = 0; i < graph->resource_count; i++)
+    {
+        GraphResource *resource = &graph->resources[i];
+        if(resource->imported || !resource->used)
+        {
+            continue;
+        }
+
+        u32 j = count++;
+        while(j > 0 && graph->resources[order[j - 1]].size < resource->size)
+        {
+            order[j] = order[j - 1];
+            j--;
+        }
+
+        order[j] = i;
+    }
+
+    for(u32 i = 0; i < count; i++)
+    {
+        GraphResource *resource = &graph->resources[order[i]];
+        u64 alignment = resource->alignment ? resource->alignment : 1;
+        u64 offset = 0;
+
+        for(bool moved = true; moved;)
+        {
+            moved = false;
+            for(u32 j = 0; j < i; j++)
+            {
+                GraphResource *placed = &graph->resources[order[j]];
+                bool lifetimes_overlap = placed->first_pass <= resource->last_pass &&
+                                         resource->first_pass <= placed->last_pass;
+                bool memory_overlaps = placed->offset < offset + resource->size &&
+                                       offset < placed->offset + placed->size;
+                if(lifetimes_overlap && memory_overlaps)
+                {
+                    offset = (placed->offset + placed->size + alignment - 1) / alignment * alignment;
+                    moved = true;
+                }
+            }
+        }
+
+        resource->offset = offset;
+        if(offset + resource->size > graph->transient_size)
+        {
+            graph->transient_size = offset + resource->size;
+        }
+
+        graph->transient_memory_bits &= resource->memory_type_bits;
+    }
+}
+
+static VkImageCreateInfo GraphImageInfo(GraphResource *resource)
+{
+    VkImageCreateInfo image_info = {};
+    image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_info.imageType = VK_IMAGE_TYPE_2D;
+    image_info.format = resource->format;
+    image_info.extent.width = resource->extent.width;
+    image_info.extent.height = resource->extent.height;
+    image_info.extent.depth = 1;
+    image_info.mipLevels = 1;
+    image_info.arrayLayers = 1;
+    image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+    image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    image_info.usage = resource->usage;
+    image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    return image_info;
+}
+
+static bool TransientMatches(GraphTransientImage *transient, GraphResource *resource)
+{
+    return transient->image &&
+           transient->format == resource->format &&
+           transient->extent.width == resource->extent.width &&
+           transient->extent.height == resource->extent.height &&
+           transient->usage == resource->usage &&
+           transient->offset == resource->offset;
+}
+
+void RenderGraphRealize(RenderGraph *graph, Device device)
+{
+    for(u32 i = 0; i < graph->resource_count; i++)
+    {
+        GraphResource *resource = &graph->resources[i];
+        if(resource->imported || !resource->used)
+        {
+            continue;
+        }
+
+        VkImageCreateInfo image_info = GraphImageInfo(resource);
+
+        VkDeviceImageMemoryRequirements reqs_info = {};
+        reqs_info.sType = VK_STRUCTURE_TYPE_DEVICE_IMAGE_MEMORY_REQUIREMENTS;
+        reqs_info.pCreateInfo = &image_info;
+
+        VkMemoryRequirements2 reqs = {};
+        reqs.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+        vkGetDeviceImageMemoryRequirements(device.device, &reqs_info, &reqs);
+
+        resource->size = reqs.memoryRequirements.size;
+        resource->alignment = reqs.memoryRequirements.alignment;
+        resource->memory_type_bits = reqs.memoryRequirements.memoryTypeBits;
+    }
+
+    RenderGraphPlaceTransients(graph);
+
+    bool rebuild = graph->transient_size > graph->heap_size;
+    for(u32 i = 0; i < graph->resource_count && !rebuild; i++)
+    {
+        GraphResource *resource = &graph->resources[i];
+        if(!resource->imported && resource->used)
+        {
+            rebuild = !TransientMatches(&graph->transients[i], resource);
+        }
+    }
+
+    // Only happens on the first frame or when targets change size, so a
+    // full wait is cheaper than tracking which frame last used each image.
+    if(rebuild)
+    {
+        vkDeviceWaitIdle(device.device);
+        for(u32 i = 0; i < MAX_GRAPH_RESOURCES; i++)
+        {
+            GraphTransientImage *transient = &graph->transients[i];
+            if(transient->image)
+            {
+                vkDestroyImageView(device.device, transient->view, 0);
+                vkDestroyImage(device.device, transient->image, 0);
+            }
+
+            *transient = {};
+        }
+
+        if(graph->transient_size > graph->heap_size)
+        {
+            if(graph->heap)
+            {
+                GpuMemoryRelease(device, GPU_MEMORY_RENDER_TARGET, graph->heap);
+                vmaFreeMemory(device.allocator, graph->heap);
+                graph->heap = 0;
+                graph->heap_size = 0;
+            }
+
+            VkMemoryRequirements heap_reqs = {};
+            heap_reqs.size = graph->transient_size;
+            heap_reqs.alignment = 64 * KB;
+            heap_reqs.memoryTypeBits = graph->transient_memory_bits;
+
+            VmaAllocationCreateInfo alloc_info = {};
+            alloc_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+            alloc_info.flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
+
+            if(vmaAllocateMemory(device.allocator, &heap_reqs, &alloc_info, &graph->heap, 0) == VK_SUCCESS)
+            {
+                GpuMemoryTrack(device, GPU_MEMORY_RENDER_TARGET, graph->heap);
+                graph->heap_size = graph->transient_size;
+            }
+        }
+
+        for(u32 i = 0; i < graph->resource_count && graph->heap; i++)
+        {
+            GraphResource *resource = &graph->resources[i];
+            if(resource->imported || !resource->used)
+            {
+                continue;
+            }
+
+            GraphTransientImage *transient = &graph->transients[i];
+            VkImageCreateInfo image_info = GraphImageInfo(resource);
+            vkCreateImage(device.device, &image_info, 0, &transient->image);
+            vmaBindImageMemory2(device.allocator, graph->heap, resource->offset, transient->image, 0);
+
+            VkImageViewCreateInfo view_info = {};
+            view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+            view_info.image = transient->image;
+            view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+            view_info.format = resource->format;
+            view_info.subresourceRange.aspectMask = resource->aspect;
+            view_info.subresourceRange.levelCount = 1;
+            view_info.subresourceRange.layerCount = 1;
+            vkCreateImageView(device.device, &view_info, 0, &transient->view);
+
+            transient->format = resource->format;
+            transient->extent = resource->extent;
+            transient->usage = resource->usage;
+            transient->offset = resource->offset;
+        }
+    }
+
+    for(u32 i = 0; i < graph->resource_count; i++)
+    {
+        GraphResource *resource = &graph->resources[i];
+        if(!resource->imported && resource->used)
+        {
+            resource->image = graph->transients[i].image;
+            resource->view = graph->transients[i].view;
+        }
+    }
+}
+
+VkImageView RenderGraphGetView(RenderGraph *graph, u32 resource)
+{
+    return resource < graph->resource_count ? graph->resources[resource].view : 0;
+}
+
+// Only once no frame that used the transients is in flight.
+void DestroyRenderGraph(RenderGraph *graph, Device device)
+{
+    for(u32 i = 0; i < MAX_GRAPH_RESOURCES; i++)
+    {
+        GraphTransientImage *transient = &graph->transients[i];
+        if(transient->image)
+        {
+            vkDestroyImageView(device.device, transient->view, 0);
+            vkDestroyImage(device.device, transient->image, 0);
+        }
+
+        *transient = {};
+    }
+
+    if(graph->heap)
+    {
+        GpuMemoryRelease(device, GPU_MEMORY_RENDER_TARGET, graph->heap);
+        vmaFreeMemory(device.allocator, graph->heap);
+        graph->heap = 0;
+        graph->heap_size = 0;
+    }
+}
+
+static void RenderGraphEmitBarriers(RenderGraph *graph, VkCommandBuffer cmd, u32 first, u32 count)
+{
+    if(count == 0)
+    {
+        return;
+    }
+
+    VkImageMemoryBarrier2 image_barriers[MAX_GRAPH_BARRIERS];
+    VkBufferMemoryBarrier2 buffer_barriers[MAX_GRAPH_BARRIERS];
+    u32 image_count = 0;
+    u32 buffer_count = 0;
+
+    for(u32 i = first; i < first + count; i++)
+    {
+        GraphBarrier *barrier = &graph->barriers[i];
+        GraphResource *resource = &graph->resources[barrier->resource];
+        if(resource->type == GRAPH_IMAGE)
+        {
+            VkImageMemoryBarrier2 *image_barrier = &image_barriers[image_count++];
+            *image_barrier = {};
+            image_barrier->sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+            image_barrier->srcStageMask = barrier->src_stages;
+            image_barrier->srcAccessMask = barrier->src_access;
+            image_barrier->dstStageMask = barrier->dst_stages;
+            image_barrier->dstAccessMask = barrier->dst_access;
+            image_barrier->oldLayout = barrier->old_layout;
+            image_barrier->newLayout = barrier->new_layout;
+            image_barrier->srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            image_barrier->dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            image_barrier->image = resource->image;
+            image_barrier->subresourceRange.aspectMask = resource->aspect;
+            image_barrier->subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+            image_barrier->subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+        }
+
+        else
+        {
+            VkBufferMemoryBarrier2 *buffer_barrier = &buffer_barriers[buffer_count++];
+            *buffer_barrier = {};
+            buffer_barrier->sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2;
+            buffer_barrier->srcStageMask = barrier->src_stages;
+            buffer_barrier->srcAccessMask = barrier->src_access;
+            buffer_barrier->dstStageMask = barrier->dst_stages;
+            buffer_barrier->dstAccessMask = barrier->dst_access;
+            buffer_barrier->srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            buffer_barrier->dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            buffer_barrier->buffer = resource->buffer;
+            buffer_barrier->size = VK_WHOLE_SIZE;
+        }
+    }
+
+    VkDependencyInfo dependency = {};
+    dependency.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    dependency.imageMemoryBarrierCount = image_count;
+    dependency.pImageMemoryBarriers = image_barriers;
+    dependency.bufferMemoryBarrierCount = buffer_count;
+    dependency.pBufferMemoryBarriers = buffer_barriers;
+    vkCmdPipelineBarrier2(cmd, &dependency);
+}
+
+void RenderGraphExecute(RenderGraph *graph, VkCommandBuffer cmd)
+{
+    for(u32 p = 0; p < graph->pass_count; p++)
+    {
+        GraphPass *pass = &graph->passes[p];
+        if(pass->culled)
+        {
+            continue;
+        }
+
+        PROFILE_ZONE(pass->name);
+        PROFILE_GPU_BEGIN(cmd, pass->name);
+        RenderGraphEmitBarriers(graph, cmd, pass->first_barrier, pass->barrier_count);
+        if(pass->execute)
+        {
+            pass->execute(graph, cmd, pass->data);
+        }
+        PROFILE_GPU_END(cmd);
+    }
+
+    RenderGraphEmitBarriers(graph, cmd, graph->final_barrier, graph->final_barrier_count);
+}
@@ -0,0 +1,174 @@
+#ifndef RENDER_GRAPH_H
+#define RENDER_GRAPH_H
+
+#define MAX_GRAPH_PASSES 64
+#define MAX_GRAPH_RESOURCES 64
+#define MAX_PASS_ACCESSES 16
+#define MAX_GRAPH_BARRIERS 256
+#define GRAPH_INVALID 0xffffffff
+
+#include <vulkan/vulkan.h>
+
+#include "types.hh"
+#include "vk_utils.hh"
+#include "third_party/vk_mem_alloc.h"
+
+enum GraphAccessType
+{
+    GRAPH_COLOR_ATTACHMENT,
+    GRAPH_DEPTH_ATTACHMENT,
+    GRAPH_DEPTH_READ,
+    GRAPH_SAMPLED,
+    GRAPH_STORAGE_READ,
+    GRAPH_STORAGE_WRITE,
+    GRAPH_TRANSFER_SRC,
+    GRAPH_TRANSFER_DST,
+    GRAPH_VERTEX_READ,
+    GRAPH_UNIFORM_READ,
+    GRAPH_INDIRECT_READ,
+    GRAPH_ACCESS_COUNT,
+};
+
+struct GraphAccessInfo
+{
+    VkPipelineStageFlags2 stages;
+    VkAccessFlags2 access;
+    VkImageLayout layout;
+    VkImageUsageFlags usage;
+    bool write;
+};
+
+enum GraphResourceType
+{
+    GRAPH_IMAGE,
+    GRAPH_BUFFER,
+};
+
+struct GraphResource
+{
+    GraphResourceType type;
+    bool imported;
+    bool output;
+
+    VkImage image;
+    VkImageView view;
+    VkBuffer buffer;
+    VkFormat format;
+    VkExtent2D extent;
+    VkImageAspectFlags aspect;
+    VkImageUsageFlags usage;
+
+    // Imported resources: state on entry and, for outputs, the layout the
+    // graph must leave them in.
+    VkImageLayout initial_layout;
+    VkPipelineStageFlags2 initial_stages;
+    VkImageLayout final_layout;
+    VkPipelineStageFlags2 final_stages;
+
+    // Filled by the compile step.
+    bool used;
+    u32 first_pass;
+    u32 last_pass;
+
+    // Transients: memory requirements in, placement out.
+    u64 size;
+    u64 alignment;
+    u32 memory_type_bits;
+    u64 offset;
+};
+
+struct GraphAccess
+{
+    u32 resource;
+    GraphAccessType type;
+};
+
+struct RenderGraph;
+typedef void GraphPassProc(RenderGraph *graph, VkCommandBuffer cmd, void *data);
+
+struct GraphPass
+{
+    const char *name;
+    GraphPassProc *execute;
+    void *data;
+    bool side_effect;
+    bool culled;
+
+    u32 access_count;
+    GraphAccess accesses[MAX_PASS_ACCESSES];
+
+    u32 first_barrier;
+    u32 barrier_count;
+};
+
+struct GraphBarrier
+{
+    u32 resource;
+    VkPipelineStageFlags2 src_stages;
+    VkAccessFlags2 src_access;
+    VkPipelineStageFlags2 dst_stages;
+    VkAccessFlags2 dst_access;
+    VkImageLayout old_layout;
+    VkImageLayout new_layout;
+};
+
+struct GraphTransientImage
+{
+    VkImage image;
+    VkImageView view;
+    VkFormat format;
+    VkExtent2D extent;
+    VkImageUsageFlags usage;
+    u64 offset;
+};
+
+// Passes and resources are declared every frame, then compiled into a list
+// of barrier batches. Compile and placement are plain CPU code with no
+// Vulkan calls; realize and execute do the device work.
+struct RenderGraph
+{
+    u32 pass_count;
+    GraphPass passes[MAX_GRAPH_PASSES];
+
+    u32 resource_count;
+    GraphResource resources[MAX_GRAPH_RESOURCES];
+
+    u32 barrier_count;
+    GraphBarrier barriers[MAX_GRAPH_BARRIERS];
+    u32 final_barrier;
+    u32 final_barrier_count;
+
+    u64 transient_size;
+    u32 transient_memory_bits;
+
+    // Transient images persist across frames and are only recreated when
+    // the placement or description changes.
+    VmaAllocation heap;
+    u64 heap_size;
+    GraphTransientImage transients[MAX_GRAPH_RESOURCES];
+};
+
+GraphAccessInfo GraphGetAccessInfo(GraphAccessType type);
+
+void RenderGraphReset(RenderGraph *graph);
+u32 RenderGraphImportImage(RenderGraph *graph, VkImage image, VkImageView view, VkFormat format,
+                           VkExtent2D extent, VkImageAspectFlags aspect,
+                           VkImageLayout initial_layout, VkPipelineStageFlags2 initial_stages);
+void RenderGraphSetOutput(RenderGraph *graph, u32 resource, VkImageLayout final_layout,
+                          VkPipelineStageFlags2 final_stages);
+u32 RenderGraphImportBuffer(RenderGraph *graph, VkBuffer buffer);
+u32 RenderGraphCreateImage(RenderGraph *graph, VkFormat format, VkExtent2D extent, VkImageAspectFlags aspect);
+
+u32 RenderGraphAddPass(RenderGraph *graph, const char *name, GraphPassProc *execute, void *data);
+void RenderGraphAccess(RenderGraph *graph, u32 pass, u32 resource, GraphAccessType type);
+void RenderGraphSetSideEffect(RenderGraph *graph, u32 pass);
+
+bool RenderGraphCompile(RenderGraph *graph);
+void RenderGraphPlaceTransients(RenderGraph *graph);
+
+void RenderGraphRealize(RenderGraph *graph, Device device);
+void RenderGraphExecute(RenderGraph *graph, VkCommandBuffer cmd);
+VkImageView RenderGraphGetView(RenderGraph *graph, u32 resource);
+void DestroyRenderGraph(RenderGraph *graph, Device device);
+
+#endif //RENDER_GRAPH_H
@@ -0,0 +1,369 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "os.hh"
+#include "engine.hh"
+#include "capture.hh"
+#include "assets.hh"
+#include "arena_alloc.hh"
+#include "third_party/HandmadeMath.h"
+
+#define MAX_REPLAY_MODELS 4096
+
+struct ReplaySettings
+{
+    const char *capture_path;
+    const char *output_path;
+    bool null_backend;
+    u32 loops;
+    u32 frames_in_flight;
+};
+
+// Replays against the engine, or with the null backend only decodes. Both
+// fold every decoded argument into the same hash, so two runs of the same
+// capture agree and a capture that replays differently shows up.
+struct Replay
+{
+    Engine *engine;
+    Model *models;
+    Model *batch_models;
+    HMM_Mat4 *batch_worlds;
+    PointLight *lights;
+    HMM_Mat4 view;
+    u32 image_index;
+
+    u64 hash;
+    u64 frames;
+    u64 draws;
+    u64 frame_start;
+    u64 frame_min;
+    u64 frame_max;
+};
+
+static void PrintUsage(void)
+{
+    printf("usage: replay [options] file.cap\n"
+           "  -null                  decode only, without a device\n"
+           "  -loops N               replay the capture N times (default 1)\n"
+           "  -inflight N            frames in flight (default: as captured)\n"
+           "  -o file.json           write the report here as well as stdout\n"
+           "Runs headless and unpaced; set VK_ICD_FILENAMES to pick a software ICD.\n");
+}
+
+static bool ParseArgs(int argc, char **argv, ReplaySettings *settings)
+{
+    *settings = {};
+    settings->loops = 1;
+
+    for(int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        if(strcmp(arg, "-null") == 0) settings->null_backend = true;
+        else if(strcmp(arg, "-loops") == 0 && i + 1 < argc) settings->loops = atoi(argv[++i]);
+        else if(strcmp(arg, "-inflight") == 0 && i + 1 < argc) settings->frames_in_flight = atoi(argv[++i]);
+        else if(strcmp(arg, "-o") == 0 && i + 1 < argc) settings->output_path = argv[++i];
+        else if(arg[0] != '-' && !settings->capture_path) settings->capture_path = arg;
+        else return false;
+    }
+
+    return settings->capture_path && settings->loops > 0;
+}
+
+// FNV-1a, continued from the previous value.
+static u64 ReplayHash(u64 hash, const void *data, u64 size)
+{
+    const u8 *bytes = (const u8 *)data;
+    for(u64 i = 0; i < size; i++)
+    {
+        hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    }
+
+    return hash;
+}
+
+static Model ReplayModel(Replay *replay, u32 model)
+{
+    Model result = {};
+    if(model && model < MAX_REPLAY_MODELS)
+    {
+        result = replay->models[model];
+    }
+
+    return result;
+}
+
+static void ReplayDraws(Replay *replay, CaptureCommand *command)
+{
+    const u8 *at = command->draws;
+    for(u32 first = 0; first < command->draw_count; first += MAX_DRAWS)
+    {
+        u32 count = command->draw_count - first < MAX_DRAWS ? command->draw_count - first : MAX_DRAWS;
+        for(u32 i = 0; i < count; i++)
+        {
+            u32 model;
+            at = CaptureNextDraw(at, &model, &replay->batch_worlds[i]);
+            replay->batch_models[i] = ReplayModel(replay, model);
+            replay->hash = ReplayHash(replay->hash, &model, sizeof(u32));
+            replay->hash = ReplayHash(replay->hash, &replay->batch_worlds[i], sizeof(HMM_Mat4));
+        }
+
+        replay->draws += count;
+        if(!replay->engine)
+        {
+            continue;
+        }
+
+        if(command->op == CAPTURE_DRAW)
+        {
+            EngineDrawModel(replay->engine, replay->view, replay->batch_models[0], replay->batch_worlds[0]);
+        }
+
+        else
+        {
+            EngineDrawModels(replay->engine, replay->view, replay->batch_models, replay->batch_worlds, count);
+        }
+    }
+}
+
+// The joint matrices go into the frame region like the application's did.
+static void ReplaySkinnedDraw(Replay *replay, CaptureCommand *command)
+{
+    u32 model;
+    HMM_Mat4 world;
+    CaptureNextDraw(command->draws, &model, &world);
+    u64 size = sizeof(HMM_Mat4) * command->joint_count;
+    replay->hash = ReplayHash(replay->hash, &model, sizeof(u32));
+    replay->hash = ReplayHash(replay->hash, &world, sizeof(HMM_Mat4));
+    replay->hash = ReplayHash(replay->hash, command->joints, size);
+    replay->draws++;
+    if(!replay->engine)
+    {
+        return;
+    }
+
+    u32 joint_base = MESH_NO_JOINTS;
+    if(command->joint_count)
+    {
+        HMM_Mat4 *joints = EngineAllocJoints(replay->engine, command->joint_count, &joint_base);
+        if(joints)
+        {
+            memcpy(joints, command->joints, size);
+        }
+    }
+
+    EngineDrawSkinnedModel(replay->engine, replay->view, ReplayModel(replay, model), world, joint_base);
+}
+
+static void ReplayCommand(Replay *replay, CaptureCommand *command)
+{
+    Engine *engine = replay->engine;
+    replay->hash = ReplayHash(replay->hash, &command->op, sizeof(command->op));
+    switch(command->op)
+    {
+        case CAPTURE_LOAD_MODEL:
+        {
+            replay->hash = ReplayHash(replay->hash, command->path, strlen(command->path));
+            if(engine && command->model < MAX_REPLAY_MODELS && command->path[0])
+            {
+                const char *path = command->path;
+                replay->models[command->model] = EngineLoadCompiledModel(engine, AssetId{AssetHashString(path), path});
+            }
+        } break;
+
+        case CAPTURE_RELEASE_MODEL:
+        {
+            replay->hash = ReplayHash(replay->hash, &command->model, sizeof(u32));
+            if(engine && command->model && command->model < MAX_REPLAY_MODELS)
+            {
+                EngineReleaseModel(engine, &replay->models[command->model]);
+            }
+        } break;
+
+        case CAPTURE_BEGIN_FRAME:
+        {
+            replay->frame_start = OsTimeNow();
+            replay->image_index = engine ? EngineBegin(engine) : 0;
+        } break;
+
+        case CAPTURE_END_FRAME:
+        {
+            if(engine)
+            {
+                EngineEnd(engine, replay->image_index);
+                ReadbackFrame readback;
+                while(EngineReadback(engine, &readback, false))
+                {
+                }
+            }
+
+            u64 ticks = OsTimeNow() - replay->frame_start;
+            if(replay->frames == 0 || ticks < replay->frame_min) replay->frame_min = ticks;
+            if(ticks > replay->frame_max) replay->frame_max = ticks;
+            replay->frames++;
+        } break;
+
+        case CAPTURE_BEGIN_RENDERING:
+        {
+            replay->hash = ReplayHash(replay->hash, &command->depth, sizeof(bool));
+            replay->hash = ReplayHash(replay->hash, &command->clear, sizeof(HMM_Vec4));
+            if(engine)
+            {
+                VkClearValue clear = {};
+                memcpy(clear.color.float32, &command->clear, sizeof(HMM_Vec4));
+                Texture target = EngineGetSceneTarget(engine, replay->image_index);
+                EngineBeginRendering(engine, target, command->depth ? &engine->depth : 0, clear);
+            }
+        } break;
+
+        case CAPTURE_END_RENDERING:
+        {
+            if(engine)
+            {
+                EngineEndRendering(engine);
+            }
+        } break;
+
+        case CAPTURE_SET_VIEW:
+        {
+            replay->view = command->view;
+            replay->hash = ReplayHash(replay->hash, &command->view, sizeof(HMM_Mat4));
+        } break;
+
+        case CAPTURE_DRAW:
+        case CAPTURE_DRAW_BATCH:
+        {
+            ReplayDraws(replay, command);
+        } break;
+
+        case CAPTURE_DRAW_SKINNED:
+        {
+            ReplaySkinnedDraw(replay, command);
+        } break;
+
+        case CAPTURE_SET_LIGHTS:
+        {
+            u64 size = sizeof(PointLight) * command->light_count;
+            memcpy(replay->lights, command->lights, size);
+            replay->hash = ReplayHash(replay->hash, &command->view, sizeof(HMM_Mat4));
+            replay->hash = ReplayHash(replay->hash, &command->projection, sizeof(HMM_Mat4));
+            replay->hash = ReplayHash(replay->hash, &command->ambient, sizeof(HMM_Vec3));
+            replay->hash = ReplayHash(replay->hash, replay->lights, size);
+            if(engine)
+            {
+                EngineSetLights(engine, command->view, command->projection, command->ambient,
+                                replay->lights, command->light_count);
+            }
+        } break;
+
+        default: break;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    ReplaySettings settings;
+    if(!ParseArgs(argc, argv, &settings))
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    CaptureReader reader;
+    if(!OpenCapture(&reader, settings.capture_path))
+    {
+        printf("replay: %s is not a capture\n", settings.capture_path);
+        return 1;
+    }
+
+    CaptureHeader header = reader.header;
+    Arena global_arena = CreateNewArena(0, 16 * MB);
+    Arena engine_arena = CreateNewArena(&global_arena, 4 * MB);
+
+    Replay replay = {};
+    replay.hash = 0xcbf29ce484222325ull;
+    replay.models = (Model *)ArenaAlloc(&global_arena, sizeof(Model) * MAX_REPLAY_MODELS, 0);
+    replay.batch_models = (Model *)ArenaAlloc(&global_arena, sizeof(Model) * MAX_DRAWS, 0);
+    replay.batch_worlds = (HMM_Mat4 *)ArenaAlloc(&global_arena, sizeof(HMM_Mat4) * MAX_DRAWS, 16);
+    replay.lights = (PointLight *)ArenaAlloc(&global_arena, sizeof(PointLight) * CAPTURE_MAX_LIGHTS, 0);
+    if(!replay.models || !replay.batch_models || !replay.batch_worlds || !replay.lights)
+    {
+        printf("replay: out of memory\n");
+        return 1;
+    }
+
+    Engine engine;
+    if(!settings.null_backend)
+    {
+        EngineConfig config = DefaultEngineConfig();
+        config.width = header.width;
+        config.height = header.height;
+        config.frames_in_flight = settings.frames_in_flight ? settings.frames_in_flight : header.frames_in_flight;
+        engine = CreateEngine(&engine_arena, config);
+        replay.engine = &engine;
+    }
+
+    // Models are loaded by the stream itself; later loops hit the asset
+    // cache for them, like a level reload would.
+    bool failed = false;
+    u64 start = OsTimeNow();
+    for(u32 loop = 0; loop < settings.loops && !failed; loop++)
+    {
+        if(loop > 0 && !OpenCapture(&reader, settings.capture_path))
+        {
+            failed = true;
+            break;
+        }
+
+        CaptureCommand command;
+        while(CaptureRead(&reader, &command))
+        {
+            ReplayCommand(&replay, &command);
+        }
+
+        failed = reader.error;
+        CloseCapture(&reader);
+    }
+
+    u64 total = OsTimeNow() - start;
+    if(replay.engine)
+    {
+        DestroyEngine(&engine);
+    }
+
+    if(failed)
+    {
+        printf("replay: %s is corrupt after %llu frames\n", settings.capture_path,
+               (unsigned long long)replay.frames);
+        return 1;
+    }
+
+    double ms_per_tick = 1000.0 / OsTimeFrequency();
+    u64 frames = replay.frames ? replay.frames : 1;
+    char report[1024];
+    int size = snprintf(report, sizeof(report),
+                        "{\n"
+                        "  \"backend\": \"%s\",\n"
+                        "  \"width\": %u,\n"
+                        "  \"height\": %u,\n"
+                        "  \"frames\": %llu,\n"
+                        "  \"draws\": %llu,\n"
+                        "  \"total_ms\": %.4f,\n"
+                        "  \"frame_ms\": {\"avg\": %.4f, \"min\": %.4f, \"max\": %.4f},\n"
+                        "  \"hash\": \"%016llx\"\n"
+                        "}\n",
+                        settings.null_backend ? "null" : "engine",
+                        header.width, header.height,
+                        (unsigned long long)replay.frames, (unsigned long long)replay.draws,
+                        total * ms_per_tick, total * ms_per_tick / frames,
+                        replay.frame_min * ms_per_tick, replay.frame_max * ms_per_tick,
+                        (unsigned long long)replay.hash);
+
+    fputs(report, stdout);
+    if(settings.output_path && !OsWriteFileAtomic(settings.output_path, report, size))
+    {
+        printf("replay: failed to write %s\n", settings.output_path);
+        return 1;
+    }
+
+    return 0;
+}
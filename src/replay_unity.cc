@@ -0,0 +1,25 @@
+#include "engine.cc"
+#include "vk_utils.cc"
+#include "dds.cc"
+#include "texture_stream.cc"
+#include "assets.cc"
+#include "jobs.cc"
+#include "vk_pipeline.cc"
+#include "pipeline_library.cc"
+#include "render_graph.cc"
+#include "gpu_memory.cc"
+#include "destroy_queue.cc"
+#include "frame_alloc.cc"
+#include "dynamic_res.cc"
+#include "capture.cc"
+#include "telemetry.cc"
+#include "simd_math.cc"
+#include "transform.cc"
+#include "light_cluster.cc"
+#include "animation.cc"
+#include "third_party.cc"
+#include "camera.cc"
+#include "arena_alloc.cc"
+#include "os.cc"
+#include "profiler.cc"
+#include "replay.cc"
@@ -0,0 +1,1049 @@
+#include "os.hh"
+#include "simd_math.hh"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define MATH_X86
+#include <immintrin.h>
+#endif
+
+// MSVC compiles any intrinsic anywhere; GCC and Clang need the wider
+// kernels marked so that the rest of the build stays at the baseline ISA.
+#ifdef _MSC_VER
+#define MATH_TARGET(isa)
+#else
+#define MATH_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+static HMM_Mat4 MathCompose(HMM_Vec3 position, HMM_Quat rotation, HMM_Vec3 scale)
+{
+    HMM_Mat4 result = HMM_QToM4(rotation);
+    result.Columns[0] = result.Columns[0] * scale.X;
+    result.Columns[1] = result.Columns[1] * scale.Y;
+    result.Columns[2] = result.Columns[2] * scale.Z;
+    result.Columns[3] = HMM_V4V(position, 1.0f);
+    return result;
+}
+
+static void MulMat4Scalar(HMM_Mat4 *out, HMM_Mat4 left, const HMM_Mat4 *right, u32 count)
+{
+    for(u32 i = 0; i < count; i++)
+    {
+        out[i] = left * right[i];
+    }
+}
+
+static void MulMat4PairsScalar(HMM_Mat4 *out, const HMM_Mat4 *left, const HMM_Mat4 *right, u32 count)
+{
+    for(u32 i = 0; i < count; i++)
+    {
+        out[i] = left[i] * right[i];
+    }
+}
+
+static void ComposeTRSScalar(HMM_Mat4 *out, const HMM_Vec3 *positions, const HMM_Quat *rotations,
+                             const HMM_Vec3 *scales, u32 count)
+{
+    for(u32 i = 0; i < count; i++)
+    {
+        out[i] = MathCompose(positions[i], rotations[i], scales[i]);
+    }
+}
+
+static void TransformSpheresScalar(HMM_Vec4 *out, const HMM_Mat4 *matrices, const HMM_Vec4 *spheres, u32 count)
+{
+    for(u32 i = 0; i < count; i++)
+    {
+        HMM_Mat4 m = matrices[i];
+        HMM_Vec4 sphere = spheres[i];
+        HMM_Vec4 center = m * HMM_V4(sphere.X, sphere.Y, sphere.Z, 1.0f);
+
+        float scale_sq = HMM_LenSqrV3(m.Columns[0].XYZ);
+        float scale_y = HMM_LenSqrV3(m.Columns[1].XYZ);
+        float scale_z = HMM_LenSqrV3(m.Columns[2].XYZ);
+        if(scale_y > scale_sq) scale_sq = scale_y;
+        if(scale_z > scale_sq) scale_sq = scale_z;
+
+        out[i] = HMM_V4(center.X, center.Y, center.Z, sphere.W * HMM_SqrtF(scale_sq));
+    }
+}
+
+static void BlendTRSScalar(float *out, const float *a, const float *b, float weight, u32 stride, u32 count)
+{
+    for(u32 c = MATH_TX; c < MATH_QX; c++)
+    {
+        for(u32 i = c * stride; i < c * stride + count; i++)
+        {
+            out[i] = a[i] + (b[i] - a[i]) * weight;
+        }
+    }
+
+    for(u32 i = 0; i < count; i++)
+    {
+        float qa[4], qb[4];
+        float dot = 0.0f;
+        for(u32 k = 0; k < 4; k++)
+        {
+            qa[k] = a[(MATH_QX + k) * stride + i];
+            qb[k] = b[(MATH_QX + k) * stride + i];
+            dot += qa[k] * qb[k];
+        }
+
+        float q[4];
+        float length_sq = 0.0f;
+        for(u32 k = 0; k < 4; k++)
+        {
+            float target = dot < 0.0f ? -qb[k] : qb[k];
+            q[k] = qa[k] + (target - qa[k]) * weight;
+            length_sq += q[k] * q[k];
+        }
+
+        float length = HMM_SqrtF(length_sq);
+        for(u32 k = 0; k < 4; k++)
+        {
+            out[(MATH_QX + k) * stride + i] = q[k] / length;
+        }
+    }
+}
+
+static void ComposeTRSSoAScalar(HMM_Mat4 *out, const float *trs, u32 stride, u32 count)
+{
+    for(u32 i = 0; i < count; i++)
+    {
+        float x = trs[MATH_QX * stride + i], y = trs[MATH_QY * stride + i];
+        float z = trs[MATH_QZ * stride + i], w = trs[MATH_QW * stride + i];
+        float sx = trs[MATH_SX * stride + i], sy = trs[MATH_SY * stride + i], sz = trs[MATH_SZ * stride + i];
+
+        HMM_Mat4 m;
+        m.Columns[0] = HMM_V4((1.0f - 2.0f * (y * y + z * z)) * sx, 2.0f * (x * y + w * z) * sx,
+                              2.0f * (x * z - w * y) * sx, 0.0f);
+        m.Columns[1] = HMM_V4(2.0f * (x * y - w * z) * sy, (1.0f - 2.0f * (x * x + z * z)) * sy,
+                              2.0f * (y * z + w * x) * sy, 0.0f);
+        m.Columns[2] = HMM_V4(2.0f * (x * z + w * y) * sz, 2.0f * (y * z - w * x) * sz,
+                              (1.0f - 2.0f * (x * x + y * y)) * sz, 0.0f);
+        m.Columns[3] = HMM_V4(trs[MATH_TX * stride + i], trs[MATH_TY * stride + i], trs[MATH_TZ * stride + i], 1.0f);
+        out[i] = m;
+    }
+}
+
+static void MulMat4HierarchyScalar(HMM_Mat4 *out, const HMM_Mat4 *locals, const u16 *parents, u32 count)
+{
+    for(u32 i = 0; i < count; i++)
+    {
+        out[i] = parents[i] == MATH_NO_PARENT ? locals[i] : out[parents[i]] * locals[i];
+    }
+}
+
+#ifdef MATH_X86
+
+// SSE4.1: one element at a time for the products, four at a time through
+// transposes for the rest. The products sum in the same order HandmadeMath
+// does, so they match it exactly.
+
+static inline MATH_TARGET("sse4.1") __m128 CombineSSE(__m128 col, __m128 l0, __m128 l1, __m128 l2, __m128 l3)
+{
+    __m128 result = _mm_mul_ps(_mm_shuffle_ps(col, col, 0x00), l0);
+    result = _mm_add_ps(result, _mm_mul_ps(_mm_shuffle_ps(col, col, 0x55), l1));
+    result = _mm_add_ps(result, _mm_mul_ps(_mm_shuffle_ps(col, col, 0xaa), l2));
+    result = _mm_add_ps(result, _mm_mul_ps(_mm_shuffle_ps(col, col, 0xff), l3));
+    return result;
+}
+
+static MATH_TARGET("sse4.1") void MulMat4SSE(HMM_Mat4 *out, HMM_Mat4 left, const HMM_Mat4 *right, u32 count)
+{
+    __m128 l0 = _mm_loadu_ps(left.Elements[0]);
+    __m128 l1 = _mm_loadu_ps(left.Elements[1]);
+    __m128 l2 = _mm_loadu_ps(left.Elements[2]);
+    __m128 l3 = _mm_loadu_ps(left.Elements[3]);
+    for(u32 i = 0; i < count; i++)
+    {
+        for(u32 c = 0; c < 4; c++)
+        {
+            __m128 col = _mm_loadu_ps(right[i].Elements[c]);
+            _mm_storeu_ps(out[i].Elements[c], CombineSSE(col, l0, l1, l2, l3));
+        }
+    }
+}
+
+static MATH_TARGET("sse4.1") void MulMat4PairsSSE(HMM_Mat4 *out, const HMM_Mat4 *left, const HMM_Mat4 *right, u32 count)
+{
+    for(u32 i = 0; i < count; i++)
+    {
+        __m128 l0 = _mm_loadu_ps(left[i].Elements[0]);
+        __m128 l1 = _mm_loadu_ps(left[i].Elements[1]);
+        __m128 l2 = _mm_loadu_ps(left[i].Elements[2]);
+        __m128 l3 = _mm_loadu_ps(left[i].Elements[3]);
+        for(u32 c = 0; c < 4; c++)
+        {
+            __m128 col = _mm_loadu_ps(right[i].Elements[c]);
+            _mm_storeu_ps(out[i].Elements[c], CombineSSE(col, l0, l1, l2, l3));
+        }
+    }
+}
+
+// Builds four matrices from a rotation, scale and translation per lane
+// and stores them as columns.
+static inline MATH_TARGET("sse4.1") void StoreComposedSSE(HMM_Mat4 *out, __m128 x, __m128 y, __m128 z, __m128 w,
+                                                          __m128 sx, __m128 sy, __m128 sz,
+                                                          __m128 px, __m128 py, __m128 pz)
+{
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 two = _mm_set1_ps(2.0f);
+    __m128 zero = _mm_setzero_ps();
+
+    __m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+    __m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+    __m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+
+    __m128 cols[4][4];
+    cols[0][0] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), sx);
+    cols[0][1] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), sx);
+    cols[0][2] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), sx);
+    cols[0][3] = zero;
+    cols[1][0] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), sy);
+    cols[1][1] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), sy);
+    cols[1][2] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), sy);
+    cols[1][3] = zero;
+    cols[2][0] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), sz);
+    cols[2][1] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), sz);
+    cols[2][2] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), sz);
+    cols[2][3] = zero;
+    cols[3][0] = px;
+    cols[3][1] = py;
+    cols[3][2] = pz;
+    cols[3][3] = one;
+
+    for(u32 c = 0; c < 4; c++)
+    {
+        __m128 r0 = cols[c][0], r1 = cols[c][1], r2 = cols[c][2], r3 = cols[c][3];
+        _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+        _mm_storeu_ps(out[0].Elements[c], r0);
+        _mm_storeu_ps(out[1].Elements[c], r1);
+        _mm_storeu_ps(out[2].Elements[c], r2);
+        _mm_storeu_ps(out[3].Elements[c], r3);
+    }
+}
+
+static MATH_TARGET("sse4.1") void ComposeTRSSSE(HMM_Mat4 *out, const HMM_Vec3 *positions, const HMM_Quat *rotations,
+                                                const HMM_Vec3 *scales, u32 count)
+{
+    u32 i = 0;
+    for(; i + 4 <= count; i += 4)
+    {
+        __m128 x = _mm_loadu_ps(rotations[i + 0].Elements);
+        __m128 y = _mm_loadu_ps(rotations[i + 1].Elements);
+        __m128 z = _mm_loadu_ps(rotations[i + 2].Elements);
+        __m128 w = _mm_loadu_ps(rotations[i + 3].Elements);
+        _MM_TRANSPOSE4_PS(x, y, z, w);
+
+        __m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)),
+                                            _mm_add_ps(_mm_mul_ps(z, z), _mm_mul_ps(w, w))));
+        x = _mm_div_ps(x, len);
+        y = _mm_div_ps(y, len);
+        z = _mm_div_ps(z, len);
+        w = _mm_div_ps(w, len);
+
+        __m128 sx = _mm_set_ps(scales[i + 3].X, scales[i + 2].X, scales[i + 1].X, scales[i].X);
+        __m128 sy = _mm_set_ps(scales[i + 3].Y, scales[i + 2].Y, scales[i + 1].Y, scales[i].Y);
+        __m128 sz = _mm_set_ps(scales[i + 3].Z, scales[i + 2].Z, scales[i + 1].Z, scales[i].Z);
+        __m128 px = _mm_set_ps(positions[i + 3].X, positions[i + 2].X, positions[i + 1].X, positions[i].X);
+        __m128 py = _mm_set_ps(positions[i + 3].Y, positions[i + 2].Y, positions[i + 1].Y, positions[i].Y);
+        __m128 pz = _mm_set_ps(positions[i + 3].Z, positions[i + 2].Z, positions[i + 1].Z, positions[i].Z);
+        StoreComposedSSE(out + i, x, y, z, w, sx, sy, sz, px, py, pz);
+    }
+
+    ComposeTRSScalar(out + i, positions + i, rotations + i, scales + i, count - i);
+}
+
+static MATH_TARGET("sse4.1") void TransformSpheresSSE(HMM_Vec4 *out, const HMM_Mat4 *matrices,
+                                                      const HMM_Vec4 *spheres, u32 count)
+{
+    u32 i = 0;
+    for(; i + 4 <= count; i += 4)
+    {
+        __m128 m[4][4];
+        for(u32 c = 0; c < 4; c++)
+        {
+            m[c][0] = _mm_loadu_ps(matrices[i + 0].Elements[c]);
+            m[c][1] = _mm_loadu_ps(matrices[i + 1].Elements[c]);
+            m[c][2] = _mm_loadu_ps(matrices[i + 2].Elements[c]);
+            m[c][3] = _mm_loadu_ps(matrices[i + 3].Elements[c]);
+            _MM_TRANSPOSE4_PS(m[c][0], m[c][1], m[c][2], m[c][3]);
+        }
+
+        __m128 cx = _mm_loadu_ps(spheres[i + 0].Elements);
+        __m128 cy = _mm_loadu_ps(spheres[i + 1].Elements);
+        __m128 cz = _mm_loadu_ps(spheres[i + 2].Elements);
+        __m128 radius = _mm_loadu_ps(spheres[i + 3].Elements);
+        _MM_TRANSPOSE4_PS(cx, cy, cz, radius);
+
+        __m128 center[3];
+        __m128 scale_sq[3];
+        for(u32 r = 0; r < 3; r++)
+        {
+            center[r] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[0][r], cx), _mm_mul_ps(m[1][r], cy)),
+                                   _mm_add_ps(_mm_mul_ps(m[2][r], cz), m[3][r]));
+            scale_sq[r] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[r][0], m[r][0]), _mm_mul_ps(m[r][1], m[r][1])),
+                                     _mm_mul_ps(m[r][2], m[r][2]));
+        }
+
+        __m128 max_sq = _mm_max_ps(_mm_max_ps(scale_sq[0], scale_sq[1]), scale_sq[2]);
+        __m128 ox = center[0], oy = center[1], oz = center[2];
+        __m128 ow = _mm_mul_ps(radius, _mm_sqrt_ps(max_sq));
+        _MM_TRANSPOSE4_PS(ox, oy, oz, ow);
+        _mm_storeu_ps(out[i + 0].Elements, ox);
+        _mm_storeu_ps(out[i + 1].Elements, oy);
+        _mm_storeu_ps(out[i + 2].Elements, oz);
+        _mm_storeu_ps(out[i + 3].Elements, ow);
+    }
+
+    TransformSpheresScalar(out + i, matrices + i, spheres + i, count - i);
+}
+
+// Structure-of-arrays input needs no transposes on the way in.
+static MATH_TARGET("sse4.1") void BlendTRSSSE(float *out, const float *a, const float *b, float weight, u32 stride, u32 count)
+{
+    __m128 t = _mm_set1_ps(weight);
+    __m128 zero = _mm_setzero_ps();
+    __m128 sign = _mm_set1_ps(-0.0f);
+    u32 wide = count & ~3u;
+    for(u32 c = MATH_TX; c < MATH_QX; c++)
+    {
+        for(u32 i = c * stride; i < c * stride + wide; i += 4)
+        {
+            __m128 va = _mm_loadu_ps(a + i);
+            _mm_storeu_ps(out + i, _mm_add_ps(va, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(b + i), va), t)));
+        }
+    }
+
+    for(u32 i = 0; i < wide; i += 4)
+    {
+        __m128 qa[4], qb[4];
+        for(u32 k = 0; k < 4; k++)
+        {
+            qa[k] = _mm_loadu_ps(a + (MATH_QX + k) * stride + i);
+            qb[k] = _mm_loadu_ps(b + (MATH_QX + k) * stride + i);
+        }
+
+        __m128 dot = _mm_mul_ps(qa[0], qb[0]);
+        dot = _mm_add_ps(dot, _mm_mul_ps(qa[1], qb[1]));
+        dot = _mm_add_ps(dot, _mm_mul_ps(qa[2], qb[2]));
+        dot = _mm_add_ps(dot, _mm_mul_ps(qa[3], qb[3]));
+        __m128 flip = _mm_and_ps(_mm_cmplt_ps(dot, zero), sign);
+
+        __m128 q[4];
+        __m128 length_sq = zero;
+        for(u32 k = 0; k < 4; k++)
+        {
+            __m128 target = _mm_xor_ps(qb[k], flip);
+            q[k] = _mm_add_ps(qa[k], _mm_mul_ps(_mm_sub_ps(target, qa[k]), t));
+            length_sq = _mm_add_ps(length_sq, _mm_mul_ps(q[k], q[k]));
+        }
+
+        __m128 length = _mm_sqrt_ps(length_sq);
+        for(u32 k = 0; k < 4; k++)
+        {
+            _mm_storeu_ps(out + (MATH_QX + k) * stride + i, _mm_div_ps(q[k], length));
+        }
+    }
+
+    BlendTRSScalar(out + wide, a + wide, b + wide, weight, stride, count - wide);
+}
+
+static MATH_TARGET("sse4.1") void ComposeTRSSoASSE(HMM_Mat4 *out, const float *trs, u32 stride, u32 count)
+{
+    u32 i = 0;
+    for(; i + 4 <= count; i += 4)
+    {
+        __m128 channels[MATH_TRS_CHANNELS];
+        for(u32 c = 0; c < MATH_TRS_CHANNELS; c++)
+        {
+            channels[c] = _mm_loadu_ps(trs + c * stride + i);
+        }
+
+        StoreComposedSSE(out + i, channels[MATH_QX], channels[MATH_QY], channels[MATH_QZ], channels[MATH_QW],
+                         channels[MATH_SX], channels[MATH_SY], channels[MATH_SZ],
+                         channels[MATH_TX], channels[MATH_TY], channels[MATH_TZ]);
+    }
+
+    ComposeTRSSoAScalar(out + i, trs + i, stride, count - i);
+}
+
+// Each matrix depends on one before it, so this stays one at a time.
+static MATH_TARGET("sse4.1") void MulMat4HierarchySSE(HMM_Mat4 *out, const HMM_Mat4 *locals, const u16 *parents, u32 count)
+{
+    for(u32 i = 0; i < count; i++)
+    {
+        if(parents[i] == MATH_NO_PARENT)
+        {
+            out[i] = locals[i];
+            continue;
+        }
+
+        const HMM_Mat4 *parent = &out[parents[i]];
+        __m128 l0 = _mm_loadu_ps(parent->Elements[0]);
+        __m128 l1 = _mm_loadu_ps(parent->Elements[1]);
+        __m128 l2 = _mm_loadu_ps(parent->Elements[2]);
+        __m128 l3 = _mm_loadu_ps(parent->Elements[3]);
+        for(u32 c = 0; c < 4; c++)
+        {
+            __m128 col = _mm_loadu_ps(locals[i].Elements[c]);
+            _mm_storeu_ps(out[i].Elements[c], CombineSSE(col, l0, l1, l2, l3));
+        }
+    }
+}
+
+// AVX2: two matrix columns per register for the products, eight elements
+// per group otherwise. Shuffles and unpacks stay inside 128-bit lanes, so
+// the SSE transpose works unchanged on two groups of four at once.
+
+static inline MATH_TARGET("avx2,fma") void Transpose256(__m256 &a, __m256 &b, __m256 &c, __m256 &d)
+{
+    __m256 t0 = _mm256_unpacklo_ps(a, b);
+    __m256 t1 = _mm256_unpackhi_ps(a, b);
+    __m256 t2 = _mm256_unpacklo_ps(c, d);
+    __m256 t3 = _mm256_unpackhi_ps(c, d);
+    a = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+    b = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+    c = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+    d = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+}
+
+static inline MATH_TARGET("avx2,fma") __m256 Load256(const float *low, const float *high)
+{
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(low)), _mm_loadu_ps(high), 1);
+}
+
+static inline MATH_TARGET("avx2,fma") void Store256(float *low, float *high, __m256 value)
+{
+    _mm_storeu_ps(low, _mm256_castps256_ps128(value));
+    _mm_storeu_ps(high, _mm256_extractf128_ps(value, 1));
+}
+
+static inline MATH_TARGET("avx2,fma") __m256 CombineAVX2(__m256 cols, __m256 l0, __m256 l1, __m256 l2, __m256 l3)
+{
+    __m256 result = _mm256_mul_ps(_mm256_permute_ps(cols, 0x00), l0);
+    result = _mm256_fmadd_ps(_mm256_permute_ps(cols, 0x55), l1, result);
+    result = _mm256_fmadd_ps(_mm256_permute_ps(cols, 0xaa), l2, result);
+    result = _mm256_fmadd_ps(_mm256_permute_ps(cols, 0xff), l3, result);
+    return result;
+}
+
+static MATH_TARGET("avx2,fma") void MulMat4AVX2(HMM_Mat4 *out, HMM_Mat4 left, const HMM_Mat4 *right, u32 count)
+{
+    __m256 l0 = _mm256_broadcast_ps((const __m128 *)left.Elements[0]);
+    __m256 l1 = _mm256_broadcast_ps((const __m128 *)left.Elements[1]);
+    __m256 l2 = _mm256_broadcast_ps((const __m128 *)left.Elements[2]);
+    __m256 l3 = _mm256_broadcast_ps((const __m128 *)left.Elements[3]);
+    for(u32 i = 0; i < count; i++)
+    {
+        __m256 c01 = _mm256_loadu_ps(right[i].Elements[0]);
+        __m256 c23 = _mm256_loadu_ps(right[i].Elements[2]);
+        _mm256_storeu_ps(out[i].Elements[0], CombineAVX2(c01, l0, l1, l2, l3));
+        _mm256_storeu_ps(out[i].Elements[2], CombineAVX2(c23, l0, l1, l2, l3));
+    }
+}
+
+static MATH_TARGET("avx2,fma") void MulMat4PairsAVX2(HMM_Mat4 *out, const HMM_Mat4 *left, const HMM_Mat4 *right, u32 count)
+{
+    for(u32 i = 0; i < count; i++)
+    {
+        __m256 l0 = _mm256_broadcast_ps((const __m128 *)left[i].Elements[0]);
+        __m256 l1 = _mm256_broadcast_ps((const __m128 *)left[i].Elements[1]);
+        __m256 l2 = _mm256_broadcast_ps((const __m128 *)left[i].Elements[2]);
+        __m256 l3 = _mm256_broadcast_ps((const __m128 *)left[i].Elements[3]);
+        __m256 c01 = _mm256_loadu_ps(right[i].Elements[0]);
+        __m256 c23 = _mm256_loadu_ps(right[i].Elements[2]);
+        _mm256_storeu_ps(out[i].Elements[0], CombineAVX2(c01, l0, l1, l2, l3));
+        _mm256_storeu_ps(out[i].Elements[2], CombineAVX2(c23, l0, l1, l2, l3));
+    }
+}
+
+// The lanes of the inputs belong to elements 0-7 in order, which is also
+// what the transposes of the quaternion loads below produce: elements 0-3
+// low and 4-7 high.
+static inline MATH_TARGET("avx2,fma") void StoreComposedAVX2(HMM_Mat4 *out, __m256 x, __m256 y, __m256 z, __m256 w,
+                                                             __m256 scale_x, __m256 scale_y, __m256 scale_z,
+                                                             __m256 px, __m256 py, __m256 pz)
+{
+    __m256 one = _mm256_set1_ps(1.0f);
+    __m256 two = _mm256_set1_ps(2.0f);
+    __m256 zero = _mm256_setzero_ps();
+
+    __m256 xx = _mm256_mul_ps(x, x), yy = _mm256_mul_ps(y, y), zz = _mm256_mul_ps(z, z);
+    __m256 xy = _mm256_mul_ps(x, y), xz = _mm256_mul_ps(x, z), yz = _mm256_mul_ps(y, z);
+    __m256 wx = _mm256_mul_ps(w, x), wy = _mm256_mul_ps(w, y), wz = _mm256_mul_ps(w, z);
+
+    __m256 cols[4][4];
+    cols[0][0] = _mm256_mul_ps(_mm256_fnmadd_ps(two, _mm256_add_ps(yy, zz), one), scale_x);
+    cols[0][1] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(xy, wz)), scale_x);
+    cols[0][2] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(xz, wy)), scale_x);
+    cols[0][3] = zero;
+    cols[1][0] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(xy, wz)), scale_y);
+    cols[1][1] = _mm256_mul_ps(_mm256_fnmadd_ps(two, _mm256_add_ps(xx, zz), one), scale_y);
+    cols[1][2] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(yz, wx)), scale_y);
+    cols[1][3] = zero;
+    cols[2][0] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(xz, wy)), scale_z);
+    cols[2][1] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(yz, wx)), scale_z);
+    cols[2][2] = _mm256_mul_ps(_mm256_fnmadd_ps(two, _mm256_add_ps(xx, yy), one), scale_z);
+    cols[2][3] = zero;
+    cols[3][0] = px;
+    cols[3][1] = py;
+    cols[3][2] = pz;
+    cols[3][3] = one;
+
+    for(u32 c = 0; c < 4; c++)
+    {
+        __m256 r0 = cols[c][0], r1 = cols[c][1], r2 = cols[c][2], r3 = cols[c][3];
+        Transpose256(r0, r1, r2, r3);
+        Store256(out[0].Elements[c], out[4].Elements[c], r0);
+        Store256(out[1].Elements[c], out[5].Elements[c], r1);
+        Store256(out[2].Elements[c], out[6].Elements[c], r2);
+        Store256(out[3].Elements[c], out[7].Elements[c], r3);
+    }
+}
+
+static MATH_TARGET("avx2,fma") void ComposeTRSAVX2(HMM_Mat4 *out, const HMM_Vec3 *positions, const HMM_Quat *rotations,
+                                                   const HMM_Vec3 *scales, u32 count)
+{
+    u32 i = 0;
+    for(; i + 8 <= count; i += 8)
+    {
+        __m256 x = Load256(rotations[i + 0].Elements, rotations[i + 4].Elements);
+        __m256 y = Load256(rotations[i + 1].Elements, rotations[i + 5].Elements);
+        __m256 z = Load256(rotations[i + 2].Elements, rotations[i + 6].Elements);
+        __m256 w = Load256(rotations[i + 3].Elements, rotations[i + 7].Elements);
+        Transpose256(x, y, z, w);
+
+        __m256 len = _mm256_sqrt_ps(_mm256_fmadd_ps(x, x, _mm256_fmadd_ps(y, y, _mm256_fmadd_ps(z, z, _mm256_mul_ps(w, w)))));
+        x = _mm256_div_ps(x, len);
+        y = _mm256_div_ps(y, len);
+        z = _mm256_div_ps(z, len);
+        w = _mm256_div_ps(w, len);
+
+        float sx[8], sy[8], sz[8], px[8], py[8], pz[8];
+        for(u32 k = 0; k < 8; k++)
+        {
+            sx[k] = scales[i + k].X;
+            sy[k] = scales[i + k].Y;
+            sz[k] = scales[i + k].Z;
+            px[k] = positions[i + k].X;
+            py[k] = positions[i + k].Y;
+            pz[k] = positions[i + k].Z;
+        }
+
+        StoreComposedAVX2(out + i, x, y, z, w, _mm256_loadu_ps(sx), _mm256_loadu_ps(sy), _mm256_loadu_ps(sz),
+                          _mm256_loadu_ps(px), _mm256_loadu_ps(py), _mm256_loadu_ps(pz));
+    }
+
+    ComposeTRSSSE(out + i, positions + i, rotations + i, scales + i, count - i);
+}
+
+static MATH_TARGET("avx2,fma") void TransformSpheresAVX2(HMM_Vec4 *out, const HMM_Mat4 *matrices,
+                                                         const HMM_Vec4 *spheres, u32 count)
+{
+    u32 i = 0;
+    for(; i + 8 <= count; i += 8)
+    {
+        __m256 m[4][4];
+        for(u32 c = 0; c < 4; c++)
+        {
+            m[c][0] = Load256(matrices[i + 0].Elements[c], matrices[i + 4].Elements[c]);
+            m[c][1] = Load256(matrices[i + 1].Elements[c], matrices[i + 5].Elements[c]);
+            m[c][2] = Load256(matrices[i + 2].Elements[c], matrices[i + 6].Elements[c]);
+            m[c][3] = Load256(matrices[i + 3].Elements[c], matrices[i + 7].Elements[c]);
+            Transpose256(m[c][0], m[c][1], m[c][2], m[c][3]);
+        }
+
+        __m256 cx = Load256(spheres[i + 0].Elements, spheres[i + 4].Elements);
+        __m256 cy = Load256(spheres[i + 1].Elements, spheres[i + 5].Elements);
+        __m256 cz = Load256(spheres[i + 2].Elements, spheres[i + 6].Elements);
+        __m256 radius = Load256(spheres[i + 3].Elements, spheres[i + 7].Elements);
+        Transpose256(cx, cy, cz, radius);
+
+        __m256 center[3];
+        __m256 scale_sq[3];
+        for(u32 r = 0; r < 3; r++)
+        {
+            center[r] = _mm256_fmadd_ps(m[0][r], cx, _mm256_fmadd_ps(m[1][r], cy, _mm256_fmadd_ps(m[2][r], cz, m[3][r])));
+            scale_sq[r] = _mm256_fmadd_ps(m[r][0], m[r][0], _mm256_fmadd_ps(m[r][1], m[r][1], _mm256_mul_ps(m[r][2], m[r][2])));
+        }
+
+        __m256 max_sq = _mm256_max_ps(_mm256_max_ps(scale_sq[0], scale_sq[1]), scale_sq[2]);
+        __m256 ox = center[0], oy = center[1], oz = center[2];
+        __m256 ow = _mm256_mul_ps(radius, _mm256_sqrt_ps(max_sq));
+        Transpose256(ox, oy, oz, ow);
+        Store256(out[i + 0].Elements, out[i + 4].Elements, ox);
+        Store256(out[i + 1].Elements, out[i + 5].Elements, oy);
+        Store256(out[i + 2].Elements, out[i + 6].Elements, oz);
+        Store256(out[i + 3].Elements, out[i + 7].Elements, ow);
+    }
+
+    TransformSpheresSSE(out + i, matrices + i, spheres + i, count - i);
+}
+
+static MATH_TARGET("avx2,fma") void BlendTRSAVX2(float *out, const float *a, const float *b, float weight, u32 stride, u32 count)
+{
+    __m256 t = _mm256_set1_ps(weight);
+    __m256 zero = _mm256_setzero_ps();
+    __m256 sign = _mm256_set1_ps(-0.0f);
+    u32 wide = count & ~7u;
+    for(u32 c = MATH_TX; c < MATH_QX; c++)
+    {
+        for(u32 i = c * stride; i < c * stride + wide; i += 8)
+        {
+            __m256 va = _mm256_loadu_ps(a + i);
+            _mm256_storeu_ps(out + i, _mm256_fmadd_ps(_mm256_sub_ps(_mm256_loadu_ps(b + i), va), t, va));
+        }
+    }
+
+    for(u32 i = 0; i < wide; i += 8)
+    {
+        __m256 qa[4], qb[4];
+        for(u32 k = 0; k < 4; k++)
+        {
+            qa[k] = _mm256_loadu_ps(a + (MATH_QX + k) * stride + i);
+            qb[k] = _mm256_loadu_ps(b + (MATH_QX + k) * stride + i);
+        }
+
+        __m256 dot = _mm256_mul_ps(qa[0], qb[0]);
+        dot = _mm256_fmadd_ps(qa[1], qb[1], dot);
+        dot = _mm256_fmadd_ps(qa[2], qb[2], dot);
+        dot = _mm256_fmadd_ps(qa[3], qb[3], dot);
+        __m256 flip = _mm256_and_ps(_mm256_cmp_ps(dot, zero, _CMP_LT_OQ), sign);
+
+        __m256 q[4];
+        __m256 length_sq = zero;
+        for(u32 k = 0; k < 4; k++)
+        {
+            __m256 target = _mm256_xor_ps(qb[k], flip);
+            q[k] = _mm256_fmadd_ps(_mm256_sub_ps(target, qa[k]), t, qa[k]);
+            length_sq = _mm256_fmadd_ps(q[k], q[k], length_sq);
+        }
+
+        __m256 length = _mm256_sqrt_ps(length_sq);
+        for(u32 k = 0; k < 4; k++)
+        {
+            _mm256_storeu_ps(out + (MATH_QX + k) * stride + i, _mm256_div_ps(q[k], length));
+        }
+    }
+
+    BlendTRSSSE(out + wide, a + wide, b + wide, weight, stride, count - wide);
+}
+
+static MATH_TARGET("avx2,fma") void ComposeTRSSoAAVX2(HMM_Mat4 *out, const float *trs, u32 stride, u32 count)
+{
+    u32 i = 0;
+    for(; i + 8 <= count; i += 8)
+    {
+        __m256 channels[MATH_TRS_CHANNELS];
+        for(u32 c = 0; c < MATH_TRS_CHANNELS; c++)
+        {
+            channels[c] = _mm256_loadu_ps(trs + c * stride + i);
+        }
+
+        StoreComposedAVX2(out + i, channels[MATH_QX], channels[MATH_QY], channels[MATH_QZ], channels[MATH_QW],
+                          channels[MATH_SX], channels[MATH_SY], channels[MATH_SZ],
+                          channels[MATH_TX], channels[MATH_TY], channels[MATH_TZ]);
+    }
+
+    ComposeTRSSoASSE(out + i, trs + i, stride, count - i);
+}
+
+static MATH_TARGET("avx2,fma") void MulMat4HierarchyAVX2(HMM_Mat4 *out, const HMM_Mat4 *locals, const u16 *parents, u32 count)
+{
+    for(u32 i = 0; i < count; i++)
+    {
+        if(parents[i] == MATH_NO_PARENT)
+        {
+            out[i] = locals[i];
+            continue;
+        }
+
+        const HMM_Mat4 *parent = &out[parents[i]];
+        __m256 l0 = _mm256_broadcast_ps((const __m128 *)parent->Elements[0]);
+        __m256 l1 = _mm256_broadcast_ps((const __m128 *)parent->Elements[1]);
+        __m256 l2 = _mm256_broadcast_ps((const __m128 *)parent->Elements[2]);
+        __m256 l3 = _mm256_broadcast_ps((const __m128 *)parent->Elements[3]);
+        __m256 c01 = _mm256_loadu_ps(locals[i].Elements[0]);
+        __m256 c23 = _mm256_loadu_ps(locals[i].Elements[2]);
+        _mm256_storeu_ps(out[i].Elements[0], CombineAVX2(c01, l0, l1, l2, l3));
+        _mm256_storeu_ps(out[i].Elements[2], CombineAVX2(c23, l0, l1, l2, l3));
+    }
+}
+
+// AVX-512: a whole matrix per register for the products, sixteen elements
+// per group otherwise, again as four lane-wise groups of four.
+
+static inline MATH_TARGET("avx512f") void Transpose512(__m512 &a, __m512 &b, __m512 &c, __m512 &d)
+{
+    __m512 t0 = _mm512_unpacklo_ps(a, b);
+    __m512 t1 = _mm512_unpackhi_ps(a, b);
+    __m512 t2 = _mm512_unpacklo_ps(c, d);
+    __m512 t3 = _mm512_unpackhi_ps(c, d);
+    a = _mm512_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+    b = _mm512_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+    c = _mm512_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+    d = _mm512_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+}
+
+static inline MATH_TARGET("avx512f") __m512 Load512(const float *l0, const float *l1, const float *l2, const float *l3)
+{
+    __m512 result = _mm512_castps128_ps512(_mm_loadu_ps(l0));
+    result = _mm512_insertf32x4(result, _mm_loadu_ps(l1), 1);
+    result = _mm512_insertf32x4(result, _mm_loadu_ps(l2), 2);
+    result = _mm512_insertf32x4(result, _mm_loadu_ps(l3), 3);
+    return result;
+}
+
+static inline MATH_TARGET("avx512f") void Store512(float *l0, float *l1, float *l2, float *l3, __m512 value)
+{
+    _mm_storeu_ps(l0, _mm512_castps512_ps128(value));
+    _mm_storeu_ps(l1, _mm512_extractf32x4_ps(value, 1));
+    _mm_storeu_ps(l2, _mm512_extractf32x4_ps(value, 2));
+    _mm_storeu_ps(l3, _mm512_extractf32x4_ps(value, 3));
+}
+
+static inline MATH_TARGET("avx512f") __m512 CombineAVX512(__m512 cols, __m512 l0, __m512 l1, __m512 l2, __m512 l3)
+{
+    __m512 result = _mm512_mul_ps(_mm512_permute_ps(cols, 0x00), l0);
+    result = _mm512_fmadd_ps(_mm512_permute_ps(cols, 0x55), l1, result);
+    result = _mm512_fmadd_ps(_mm512_permute_ps(cols, 0xaa), l2, result);
+    result = _mm512_fmadd_ps(_mm512_permute_ps(cols, 0xff), l3, result);
+    return result;
+}
+
+static MATH_TARGET("avx512f") void MulMat4AVX512(HMM_Mat4 *out, HMM_Mat4 left, const HMM_Mat4 *right, u32 count)
+{
+    __m512 l0 = _mm512_broadcast_f32x4(_mm_loadu_ps(left.Elements[0]));
+    __m512 l1 = _mm512_broadcast_f32x4(_mm_loadu_ps(left.Elements[1]));
+    __m512 l2 = _mm512_broadcast_f32x4(_mm_loadu_ps(left.Elements[2]));
+    __m512 l3 = _mm512_broadcast_f32x4(_mm_loadu_ps(left.Elements[3]));
+    for(u32 i = 0; i < count; i++)
+    {
+        __m512 cols = _mm512_loadu_ps(right[i].Elements[0]);
+        _mm512_storeu_ps(out[i].Elements[0], CombineAVX512(cols, l0, l1, l2, l3));
+    }
+}
+
+static MATH_TARGET("avx512f") void MulMat4PairsAVX512(HMM_Mat4 *out, const HMM_Mat4 *left, const HMM_Mat4 *right, u32 count)
+{
+    for(u32 i = 0; i < count; i++)
+    {
+        __m512 l0 = _mm512_broadcast_f32x4(_mm_loadu_ps(left[i].Elements[0]));
+        __m512 l1 = _mm512_broadcast_f32x4(_mm_loadu_ps(left[i].Elements[1]));
+        __m512 l2 = _mm512_broadcast_f32x4(_mm_loadu_ps(left[i].Elements[2]));
+        __m512 l3 = _mm512_broadcast_f32x4(_mm_loadu_ps(left[i].Elements[3]));
+        __m512 cols = _mm512_loadu_ps(right[i].Elements[0]);
+        _mm512_storeu_ps(out[i].Elements[0], CombineAVX512(cols, l0, l1, l2, l3));
+    }
+}
+
+static inline MATH_TARGET("avx512f") void StoreComposedAVX512(HMM_Mat4 *out, __m512 x, __m512 y, __m512 z, __m512 w,
+                                                               __m512 scale_x, __m512 scale_y, __m512 scale_z,
+                                                               __m512 px, __m512 py, __m512 pz)
+{
+    __m512 one = _mm512_set1_ps(1.0f);
+    __m512 two = _mm512_set1_ps(2.0f);
+    __m512 zero = _mm512_setzero_ps();
+
+    __m512 xx = _mm512_mul_ps(x, x), yy = _mm512_mul_ps(y, y), zz = _mm512_mul_ps(z, z);
+    __m512 xy = _mm512_mul_ps(x, y), xz = _mm512_mul_ps(x, z), yz = _mm512_mul_ps(y, z);
+    __m512 wx = _mm512_mul_ps(w, x), wy = _mm512_mul_ps(w, y), wz = _mm512_mul_ps(w, z);
+
+    __m512 cols[4][4];
+    cols[0][0] = _mm512_mul_ps(_mm512_fnmadd_ps(two, _mm512_add_ps(yy, zz), one), scale_x);
+    cols[0][1] = _mm512_mul_ps(_mm512_mul_ps(two, _mm512_add_ps(xy, wz)), scale_x);
+    cols[0][2] = _mm512_mul_ps(_mm512_mul_ps(two, _mm512_sub_ps(xz, wy)), scale_x);
+    cols[0][3] = zero;
+    cols[1][0] = _mm512_mul_ps(_mm512_mul_ps(two, _mm512_sub_ps(xy, wz)), scale_y);
+    cols[1][1] = _mm512_mul_ps(_mm512_fnmadd_ps(two, _mm512_add_ps(xx, zz), one), scale_y);
+    cols[1][2] = _mm512_mul_ps(_mm512_mul_ps(two, _mm512_add_ps(yz, wx)), scale_y);
+    cols[1][3] = zero;
+    cols[2][0] = _mm512_mul_ps(_mm512_mul_ps(two, _mm512_add_ps(xz, wy)), scale_z);
+    cols[2][1] = _mm512_mul_ps(_mm512_mul_ps(two, _mm512_sub_ps(yz, wx)), scale_z);
+    cols[2][2] = _mm512_mul_ps(_mm512_fnmadd_ps(two, _mm512_add_ps(xx, yy), one), scale_z);
+    cols[2][3] = zero;
+    cols[3][0] = px;
+    cols[3][1] = py;
+    cols[3][2] = pz;
+    cols[3][3] = one;
+
+    for(u32 c = 0; c < 4; c++)
+    {
+        __m512 r0 = cols[c][0], r1 = cols[c][1], r2 = cols[c][2], r3 = cols[c][3];
+        Transpose512(r0, r1, r2, r3);
+        Store512(out[0].Elements[c], out[4].Elements[c], out[8].Elements[c], out[12].Elements[c], r0);
+        Store512(out[1].Elements[c], out[5].Elements[c], out[9].Elements[c], out[13].Elements[c], r1);
+        Store512(out[2].Elements[c], out[6].Elements[c], out[10].Elements[c], out[14].Elements[c], r2);
+        Store512(out[3].Elements[c], out[7].Elements[c], out[11].Elements[c], out[15].Elements[c], r3);
+    }
+}
+
+static MATH_TARGET("avx512f") void ComposeTRSAVX512(HMM_Mat4 *out, const HMM_Vec3 *positions, const HMM_Quat *rotations,
+                                                    const HMM_Vec3 *scales, u32 count)
+{
+    u32 i = 0;
+    for(; i + 16 <= count; i += 16)
+    {
+        __m512 x = Load512(rotations[i + 0].Elements, rotations[i + 4].Elements,
+                           rotations[i + 8].Elements, rotations[i + 12].Elements);
+        __m512 y = Load512(rotations[i + 1].Elements, rotations[i + 5].Elements,
+                           rotations[i + 9].Elements, rotations[i + 13].Elements);
+        __m512 z = Load512(rotations[i + 2].Elements, rotations[i + 6].Elements,
+                           rotations[i + 10].Elements, rotations[i + 14].Elements);
+        __m512 w = Load512(rotations[i + 3].Elements, rotations[i + 7].Elements,
+                           rotations[i + 11].Elements, rotations[i + 15].Elements);
+        Transpose512(x, y, z, w);
+
+        __m512 len = _mm512_sqrt_ps(_mm512_fmadd_ps(x, x, _mm512_fmadd_ps(y, y, _mm512_fmadd_ps(z, z, _mm512_mul_ps(w, w)))));
+        x = _mm512_div_ps(x, len);
+        y = _mm512_div_ps(y, len);
+        z = _mm512_div_ps(z, len);
+        w = _mm512_div_ps(w, len);
+
+        float sx[16], sy[16], sz[16], px[16], py[16], pz[16];
+        for(u32 k = 0; k < 16; k++)
+        {
+            sx[k] = scales[i + k].X;
+            sy[k] = scales[i + k].Y;
+            sz[k] = scales[i + k].Z;
+            px[k] = positions[i + k].X;
+            py[k] = positions[i + k].Y;
+            pz[k] = positions[i + k].Z;
+        }
+
+        StoreComposedAVX512(out + i, x, y, z, w, _mm512_loadu_ps(sx), _mm512_loadu_ps(sy), _mm512_loadu_ps(sz),
+                            _mm512_loadu_ps(px), _mm512_loadu_ps(py), _mm512_loadu_ps(pz));
+    }
+
+    ComposeTRSAVX2(out + i, positions + i, rotations + i, scales + i, count - i);
+}
+
+static MATH_TARGET("avx512f") void TransformSpheresAVX512(HMM_Vec4 *out, const HMM_Mat4 *matrices,
+                                                          const HMM_Vec4 *spheres, u32 count)
+{
+    u32 i = 0;
+    for(; i + 16 <= count; i += 16)
+    {
+        __m512 m[4][4];
+        for(u32 c = 0; c < 4; c++)
+        {
+            for(u32 k = 0; k < 4; k++)
+            {
+                m[c][k] = Load512(matrices[i + k].Elements[c], matrices[i + 4 + k].Elements[c],
+                                  matrices[i + 8 + k].Elements[c], matrices[i + 12 + k].Elements[c]);
+            }
+            Transpose512(m[c][0], m[c][1], m[c][2], m[c][3]);
+        }
+
+        __m512 cx = Load512(spheres[i + 0].Elements, spheres[i + 4].Elements, spheres[i + 8].Elements, spheres[i + 12].Elements);
+        __m512 cy = Load512(spheres[i + 1].Elements, spheres[i + 5].Elements, spheres[i + 9].Elements, spheres[i + 13].Elements);
+        __m512 cz = Load512(spheres[i + 2].Elements, spheres[i + 6].Elements, spheres[i + 10].Elements, spheres[i + 14].Elements);
+        __m512 radius = Load512(spheres[i + 3].Elements, spheres[i + 7].Elements, spheres[i + 11].Elements, spheres[i + 15].Elements);
+        Transpose512(cx, cy, cz, radius);
+
+        __m512 center[3];
+        __m512 scale_sq[3];
+        for(u32 r = 0; r < 3; r++)
+        {
+            center[r] = _mm512_fmadd_ps(m[0][r], cx, _mm512_fmadd_ps(m[1][r], cy, _mm512_fmadd_ps(m[2][r], cz, m[3][r])));
+            scale_sq[r] = _mm512_fmadd_ps(m[r][0], m[r][0], _mm512_fmadd_ps(m[r][1], m[r][1], _mm512_mul_ps(m[r][2], m[r][2])));
+        }
+
+        __m512 max_sq = _mm512_max_ps(_mm512_max_ps(scale_sq[0], scale_sq[1]), scale_sq[2]);
+        __m512 ox = center[0], oy = center[1], oz = center[2];
+        __m512 ow = _mm512_mul_ps(radius, _mm512_sqrt_ps(max_sq));
+        Transpose512(ox, oy, oz, ow);
+        Store512(out[i + 0].Elements, out[i + 4].Elements, out[i + 8].Elements, out[i + 12].Elements, ox);
+        Store512(out[i + 1].Elements, out[i + 5].Elements, out[i + 9].Elements, out[i + 13].Elements, oy);
+        Store512(out[i + 2].Elements, out[i + 6].Elements, out[i + 10].Elements, out[i + 14].Elements, oz);
+        Store512(out[i + 3].Elements, out[i + 7].Elements, out[i + 11].Elements, out[i + 15].Elements, ow);
+    }
+
+    TransformSpheresAVX2(out + i, matrices + i, spheres + i, count - i);
+}
+
+static MATH_TARGET("avx512f") void BlendTRSAVX512(float *out, const float *a, const float *b, float weight, u32 stride, u32 count)
+{
+    __m512 t = _mm512_set1_ps(weight);
+    __m512 zero = _mm512_setzero_ps();
+    u32 wide = count & ~15u;
+    for(u32 c = MATH_TX; c < MATH_QX; c++)
+    {
+        for(u32 i = c * stride; i < c * stride + wide; i += 16)
+        {
+            __m512 va = _mm512_loadu_ps(a + i);
+            _mm512_storeu_ps(out + i, _mm512_fmadd_ps(_mm512_sub_ps(_mm512_loadu_ps(b + i), va), t, va));
+        }
+    }
+
+    for(u32 i = 0; i < wide; i += 16)
+    {
+        __m512 qa[4], qb[4];
+        for(u32 k = 0; k < 4; k++)
+        {
+            qa[k] = _mm512_loadu_ps(a + (MATH_QX + k) * stride + i);
+            qb[k] = _mm512_loadu_ps(b + (MATH_QX + k) * stride + i);
+        }
+
+        __m512 dot = _mm512_mul_ps(qa[0], qb[0]);
+        dot = _mm512_fmadd_ps(qa[1], qb[1], dot);
+        dot = _mm512_fmadd_ps(qa[2], qb[2], dot);
+        dot = _mm512_fmadd_ps(qa[3], qb[3], dot);
+        __mmask16 flip = _mm512_cmp_ps_mask(dot, zero, _CMP_LT_OQ);
+
+        __m512 q[4];
+        __m512 length_sq = zero;
+        for(u32 k = 0; k < 4; k++)
+        {
+            __m512 target = _mm512_mask_sub_ps(qb[k], flip, zero, qb[k]);
+            q[k] = _mm512_fmadd_ps(_mm512_sub_ps(target, qa[k]), t, qa[k]);
+            length_sq = _mm512_fmadd_ps(q[k], q[k], length_sq);
+        }
+
+        __m512 length = _mm512_sqrt_ps(length_sq);
+        for(u32 k = 0; k < 4; k++)
+        {
+            _mm512_storeu_ps(out + (MATH_QX + k) * stride + i, _mm512_div_ps(q[k], length));
+        }
+    }
+
+    BlendTRSAVX2(out + wide, a + wide, b + wide, weight, stride, count - wide);
+}
+
+static MATH_TARGET("avx512f") void ComposeTRSSoAAVX512(HMM_Mat4 *out, const float *trs, u32 stride, u32 count)
+{
+    u32 i = 0;
+    for(; i + 16 <= count; i += 16)
+    {
+        __m512 channels[MATH_TRS_CHANNELS];
+        for(u32 c = 0; c < MATH_TRS_CHANNELS; c++)
+        {
+            channels[c] = _mm512_loadu_ps(trs + c * stride + i);
+        }
+
+        StoreComposedAVX512(out + i, channels[MATH_QX], channels[MATH_QY], channels[MATH_QZ], channels[MATH_QW],
+                            channels[MATH_SX], channels[MATH_SY], channels[MATH_SZ],
+                            channels[MATH_TX], channels[MATH_TY], channels[MATH_TZ]);
+    }
+
+    ComposeTRSSoAAVX2(out + i, trs + i, stride, count - i);
+}
+
+static MATH_TARGET("avx512f") void MulMat4HierarchyAVX512(HMM_Mat4 *out, const HMM_Mat4 *locals, const u16 *parents, u32 count)
+{
+    for(u32 i = 0; i < count; i++)
+    {
+        if(parents[i] == MATH_NO_PARENT)
+        {
+            out[i] = locals[i];
+            continue;
+        }
+
+        const HMM_Mat4 *parent = &out[parents[i]];
+        __m512 l0 = _mm512_broadcast_f32x4(_mm_loadu_ps(parent->Elements[0]));
+        __m512 l1 = _mm512_broadcast_f32x4(_mm_loadu_ps(parent->Elements[1]));
+        __m512 l2 = _mm512_broadcast_f32x4(_mm_loadu_ps(parent->Elements[2]));
+        __m512 l3 = _mm512_broadcast_f32x4(_mm_loadu_ps(parent->Elements[3]));
+        __m512 cols = _mm512_loadu_ps(locals[i].Elements[0]);
+        _mm512_storeu_ps(out[i].Elements[0], CombineAVX512(cols, l0, l1, l2, l3));
+    }
+}
+
+#endif //MATH_X86
+
+static MathKernels math_kernels =
+{
+    MATH_SCALAR, "scalar", MulMat4Scalar, MulMat4PairsScalar, ComposeTRSScalar, TransformSpheresScalar,
+    BlendTRSScalar, ComposeTRSSoAScalar, MulMat4HierarchyScalar,
+};
+
+MathIsa MathBestIsa(void)
+{
+    u32 features = OsCpuFeatures();
+    if(features & OS_CPU_AVX512) return MATH_AVX512;
+    if(features & OS_CPU_AVX2) return MATH_AVX2;
+    if(features & OS_CPU_SSE41) return MATH_SSE41;
+    return MATH_SCALAR;
+}
+
+// Fails for instruction sets the CPU does not have, so benchmarks and
+// checks can walk every variant.
+bool MathGetKernels(MathIsa isa, MathKernels *kernels)
+{
+    if(isa > MathBestIsa())
+    {
+        return false;
+    }
+
+    switch(isa)
+    {
+#ifdef MATH_X86
+        case MATH_SSE41:
+            *kernels = {isa, "sse4.1", MulMat4SSE, MulMat4PairsSSE, ComposeTRSSSE, TransformSpheresSSE,
+                        BlendTRSSSE, ComposeTRSSoASSE, MulMat4HierarchySSE};
+            return true;
+        case MATH_AVX2:
+            *kernels = {isa, "avx2", MulMat4AVX2, MulMat4PairsAVX2, ComposeTRSAVX2, TransformSpheresAVX2,
+                        BlendTRSAVX2, ComposeTRSSoAAVX2, MulMat4HierarchyAVX2};
+            return true;
+        case MATH_AVX512:
+            *kernels = {isa, "avx512", MulMat4AVX512, MulMat4PairsAVX512, ComposeTRSAVX512, TransformSpheresAVX512,
+                        BlendTRSAVX512, ComposeTRSSoAAVX512, MulMat4HierarchyAVX512};
+            return true;
+#endif
+        case MATH_SCALAR:
+            *kernels = {isa, "scalar", MulMat4Scalar, MulMat4PairsScalar, ComposeTRSScalar, TransformSpheresScalar,
+                        BlendTRSScalar, ComposeTRSSoAScalar, MulMat4HierarchyScalar};
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Until this runs every call takes the scalar path.
+void MathInit(void)
+{
+    MathGetKernels(MathBestIsa(), &math_kernels);
+}
+
+MathKernels *MathActive(void)
+{
+    return &math_kernels;
+}
+
+void MathMulMat4(HMM_Mat4 *out, HMM_Mat4 left, const HMM_Mat4 *right, u32 count)
+{
+    math_kernels.mul_mat4(out, left, right, count);
+}
+
+void MathMulMat4Pairs(HMM_Mat4 *out, const HMM_Mat4 *left, const HMM_Mat4 *right, u32 count)
+{
+    math_kernels.mul_mat4_pairs(out, left, right, count);
+}
+
+void MathComposeTRS(HMM_Mat4 *out, const HMM_Vec3 *positions, const HMM_Quat *rotations,
+                    const HMM_Vec3 *scales, u32 count)
+{
+    math_kernels.compose_trs(out, positions, rotations, scales, count);
+}
+
+void MathTransformSpheres(HMM_Vec4 *out, const HMM_Mat4 *matrices, const HMM_Vec4 *spheres, u32 count)
+{
+    math_kernels.transform_spheres(out, matrices, spheres, count);
+}
+
+void MathBlendTRS(float *out, const float *a, const float *b, float weight, u32 stride, u32 count)
+{
+    math_kernels.blend_trs(out, a, b, weight, stride, count);
+}
+
+void MathComposeTRSSoA(HMM_Mat4 *out, const float *trs, u32 stride, u32 count)
+{
+    math_kernels.compose_trs_soa(out, trs, stride, count);
+}
+
+void MathMulMat4Hierarchy(HMM_Mat4 *out, const HMM_Mat4 *locals, const u16 *parents, u32 count)
+{
+    math_kernels.mul_mat4_hierarchy(out, locals, parents, count);
+}
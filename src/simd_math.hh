@@ -0,0 +1,92 @@
+#ifndef SIMD_MATH_H
+#define SIMD_MATH_H
+
+#include "types.hh"
+#include "third_party/HandmadeMath.h"
+
+// Batched versions of the HandmadeMath operations hot loops apply to
+// thousands of elements. Each has a scalar version that calls HandmadeMath
+// and SSE4.1, AVX2 and AVX-512 versions; MathInit picks the widest one the
+// CPU runs. Inputs are the engine's arrays as they are. The wide kernels
+// transpose groups of 4, 8 or 16 elements into registers, so the math
+// itself runs structure-of-arrays.
+//
+// Outputs may alias the right hand matrices, never the left ones.
+
+#define MATH_NO_PARENT 0xffff
+
+// Transforms as structure-of-arrays: channel c of element i is at
+// c * stride + i. Translation and scale come first, so one lerp covers
+// them, and rotations last.
+enum MathTRSChannel
+{
+    MATH_TX,
+    MATH_TY,
+    MATH_TZ,
+    MATH_SX,
+    MATH_SY,
+    MATH_SZ,
+    MATH_QX,
+    MATH_QY,
+    MATH_QZ,
+    MATH_QW,
+    MATH_TRS_CHANNELS,
+};
+
+enum MathIsa
+{
+    MATH_SCALAR,
+    MATH_SSE41,
+    MATH_AVX2,
+    MATH_AVX512,
+    MATH_ISA_COUNT,
+};
+
+// out[i] = left * right[i]
+typedef void MathMulMat4Proc(HMM_Mat4 *out, HMM_Mat4 left, const HMM_Mat4 *right, u32 count);
+// out[i] = left[i] * right[i]
+typedef void MathMulMat4PairsProc(HMM_Mat4 *out, const HMM_Mat4 *left, const HMM_Mat4 *right, u32 count);
+// out[i] = translate(positions[i]) * rotate(rotations[i]) * scale(scales[i])
+typedef void MathComposeTRSProc(HMM_Mat4 *out, const HMM_Vec3 *positions, const HMM_Quat *rotations,
+                                const HMM_Vec3 *scales, u32 count);
+// Bounding spheres as center and radius. The center is transformed as a
+// point, the radius scaled by the largest axis scale of the matrix.
+typedef void MathTransformSpheresProc(HMM_Vec4 *out, const HMM_Mat4 *matrices, const HMM_Vec4 *spheres, u32 count);
+// Lerps translations and scales and nlerps rotations along the shorter
+// arc, on structure-of-arrays transforms. out may alias either input.
+typedef void MathBlendTRSProc(float *out, const float *a, const float *b, float weight, u32 stride, u32 count);
+// As ComposeTRS on structure-of-arrays transforms, whose rotations must
+// already be unit length.
+typedef void MathComposeTRSSoAProc(HMM_Mat4 *out, const float *trs, u32 stride, u32 count);
+// out[i] = out[parents[i]] * locals[i], or locals[i] for MATH_NO_PARENT.
+// Parents come before their children. out may alias locals.
+typedef void MathMulMat4HierarchyProc(HMM_Mat4 *out, const HMM_Mat4 *locals, const u16 *parents, u32 count);
+
+struct MathKernels
+{
+    MathIsa isa;
+    const char *name;
+    MathMulMat4Proc *mul_mat4;
+    MathMulMat4PairsProc *mul_mat4_pairs;
+    MathComposeTRSProc *compose_trs;
+    MathTransformSpheresProc *transform_spheres;
+    MathBlendTRSProc *blend_trs;
+    MathComposeTRSSoAProc *compose_trs_soa;
+    MathMulMat4HierarchyProc *mul_mat4_hierarchy;
+};
+
+void MathInit(void);
+MathIsa MathBestIsa(void);
+bool MathGetKernels(MathIsa isa, MathKernels *kernels);
+MathKernels *MathActive(void);
+
+void MathMulMat4(HMM_Mat4 *out, HMM_Mat4 left, const HMM_Mat4 *right, u32 count);
+void MathMulMat4Pairs(HMM_Mat4 *out, const HMM_Mat4 *left, const HMM_Mat4 *right, u32 count);
+void MathComposeTRS(HMM_Mat4 *out, const HMM_Vec3 *positions, const HMM_Quat *rotations,
+                    const HMM_Vec3 *scales, u32 count);
+void MathTransformSpheres(HMM_Vec4 *out, const HMM_Mat4 *matrices, const HMM_Vec4 *spheres, u32 count);
+void MathBlendTRS(float *out, const float *a, const float *b, float weight, u32 stride, u32 count);
+void MathComposeTRSSoA(HMM_Mat4 *out, const float *trs, u32 stride, u32 count);
+void MathMulMat4Hierarchy(HMM_Mat4 *out, const HMM_Mat4 *locals, const u16 *parents, u32 count);
+
+#endif //SIMD_MATH_H
@@ -0,0 +1,102 @@
+#include <string.h>
+#include "telemetry.hh"
+
+bool CreateTelemetry(Telemetry *telemetry, const char *name)
+{
+    *telemetry = {};
+    if(!OsCreateSharedMemory(name, sizeof(TelemetryBlock), &telemetry->memory))
+    {
+        return false;
+    }
+
+    // A block left behind by a crashed run may be reused as is; starting
+    // over with an even sequence keeps readers from spinning on it.
+    TelemetryBlock *block = (TelemetryBlock *)telemetry->memory.data;
+    memset(block, 0, sizeof(TelemetryBlock));
+    block->version = TELEMETRY_VERSION;
+    block->size = sizeof(TelemetryBlock);
+    block->history = TELEMETRY_HISTORY;
+    OsMemoryBarrier();
+    block->magic = TELEMETRY_MAGIC;
+    telemetry->block = block;
+    return true;
+}
+
+void DestroyTelemetry(Telemetry *telemetry)
+{
+    OsCloseSharedMemory(&telemetry->memory);
+    *telemetry = {};
+}
+
+void TelemetryPublish(Telemetry *telemetry, TelemetryFrame *frame)
+{
+    TelemetryBlock *block = telemetry->block;
+    if(!block)
+    {
+        return;
+    }
+
+    u64 index = block->frame_count;
+    OsAtomicIncrement(&block->sequence);
+    block->frames[index % TELEMETRY_HISTORY] = *frame;
+    block->frame_count = index + 1;
+    OsAtomicIncrement(&block->sequence);
+}
+
+bool OpenTelemetry(Telemetry *telemetry, const char *name)
+{
+    *telemetry = {};
+    if(!OsOpenSharedMemory(name, &telemetry->memory))
+    {
+        return false;
+    }
+
+    TelemetryBlock *block = (TelemetryBlock *)telemetry->memory.data;
+    if(telemetry->memory.size < sizeof(TelemetryBlock) || block->magic != TELEMETRY_MAGIC ||
+       block->version != TELEMETRY_VERSION || block->size != sizeof(TelemetryBlock))
+    {
+        OsCloseSharedMemory(&telemetry->memory);
+        return false;
+    }
+
+    telemetry->block = block;
+    return true;
+}
+
+// Copies frames oldest first, starting at the index in next, and moves
+// next past the last one copied. Frames that have already dropped out of
+// the history are skipped. Returns how many were copied.
+u32 TelemetryRead(Telemetry *telemetry, u64 *next, TelemetryFrame *frames, u32 max_frames)
+{
+    TelemetryBlock *block = telemetry->block;
+    for(;;)
+    {
+        i32 sequence = block->sequence;
+        if(sequence & 1)
+        {
+            OsPause();
+            continue;
+        }
+
+        OsMemoryBarrier();
+        u64 count = block->frame_count;
+        u64 start = *next;
+        if(count > TELEMETRY_HISTORY && start < count - TELEMETRY_HISTORY)
+        {
+            start = count - TELEMETRY_HISTORY;
+        }
+
+        u32 copied = 0;
+        for(u64 i = start; i < count && copied < max_frames; i++)
+        {
+            frames[copied++] = block->frames[i % TELEMETRY_HISTORY];
+        }
+
+        OsMemoryBarrier();
+        if(block->sequence == sequence)
+        {
+            *next = start + copied;
+            return copied;
+        }
+    }
+}
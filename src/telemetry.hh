@@ -0,0 +1,73 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#define TELEMETRY_MAGIC 0x4d4c4554
+#define TELEMETRY_VERSION 1
+#define TELEMETRY_HISTORY 256
+#define TELEMETRY_DEFAULT_NAME "engine_telemetry"
+
+#include "os.hh"
+#include "types.hh"
+
+// Counters for one frame, gathered whether or not anything publishes them.
+// Uploads are host to device bytes from mesh loads and texture streaming;
+// frame data is what went through the per-frame allocator. Times are in
+// milliseconds of CPU time except gpu_ms.
+struct TelemetryFrame
+{
+    u64 frame;
+    u32 draw_calls;
+    u32 pipeline_binds;
+    u32 descriptor_binds;
+    u32 buffer_binds;
+    u32 render_passes;
+    u32 padding;
+    u64 triangles;
+    u64 upload_bytes;
+    u64 frame_data_bytes;
+
+    float cpu_ms;
+    float fence_wait_ms;
+    float acquire_ms;
+    float gpu_ms;
+    float render_scale;
+    u32 padding2;
+
+    u64 arena_used;
+    u64 arena_capacity;
+    u64 vram_usage;
+    u64 vram_budget;
+};
+
+// Lives in shared memory with the engine as its only writer, which never
+// waits for readers: it makes sequence odd, writes the frame, and makes it
+// even again. Readers copy what they need and retry if sequence was odd or
+// changed meanwhile. Frame n sits at frames[n % history], so a reader that
+// polls slower than the frame rate still sees every frame as long as it
+// keeps within the history.
+struct TelemetryBlock
+{
+    u32 magic;
+    u32 version;
+    u32 size;
+    u32 history;
+    OsAtomic sequence;
+    u32 padding;
+    u64 frame_count;
+    TelemetryFrame frames[TELEMETRY_HISTORY];
+};
+
+struct Telemetry
+{
+    OsSharedMemory memory;
+    TelemetryBlock *block;
+};
+
+bool CreateTelemetry(Telemetry *telemetry, const char *name);
+void DestroyTelemetry(Telemetry *telemetry);
+void TelemetryPublish(Telemetry *telemetry, TelemetryFrame *frame);
+
+bool OpenTelemetry(Telemetry *telemetry, const char *name);
+u32 TelemetryRead(Telemetry *telemetry, u64 *next, TelemetryFrame *frames, u32 max_frames);
+
+#endif //TELEMETRY_H
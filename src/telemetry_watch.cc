@@ -0,0 +1,114 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "os.hh"
+#include "telemetry.hh"
+
+#define WATCH_BATCH 64
+
+struct WatchSettings
+{
+    const char *name;
+    u32 poll_ms;
+    u64 frames;
+};
+
+static void PrintUsage(void)
+{
+    printf("usage: telemetry_watch [options]\n"
+           "  -name N                shared memory name (default " TELEMETRY_DEFAULT_NAME ")\n"
+           "  -poll MS               poll interval (default 100)\n"
+           "  -frames N              stop after N frames (default: until the engine exits)\n"
+           "Prints one CSV line per frame. Waits for the engine to start.\n");
+}
+
+static bool ParseArgs(int argc, char **argv, WatchSettings *settings)
+{
+    *settings = {};
+    settings->name = TELEMETRY_DEFAULT_NAME;
+    settings->poll_ms = 100;
+
+    for(int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        if(strcmp(arg, "-name") == 0 && i + 1 < argc) settings->name = argv[++i];
+        else if(strcmp(arg, "-poll") == 0 && i + 1 < argc) settings->poll_ms = atoi(argv[++i]);
+        else if(strcmp(arg, "-frames") == 0 && i + 1 < argc) settings->frames = atoll(argv[++i]);
+        else return false;
+    }
+
+    return settings->poll_ms > 0;
+}
+
+// Reading only touches the shared block, so the engine never notices how
+// many watchers there are or how slow they are.
+int main(int argc, char **argv)
+{
+    WatchSettings settings;
+    if(!ParseArgs(argc, argv, &settings))
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    u64 poll_ticks = OsTimeFrequency() * settings.poll_ms / 1000;
+    Telemetry telemetry;
+    while(!OpenTelemetry(&telemetry, settings.name))
+    {
+        OsSleepUntil(OsTimeNow() + poll_ticks);
+    }
+
+    printf("frame,cpu_ms,gpu_ms,fence_wait_ms,acquire_ms,draw_calls,pipeline_binds,descriptor_binds,"
+           "buffer_binds,render_passes,triangles,upload_bytes,frame_data_bytes,render_scale,"
+           "arena_used,arena_capacity,vram_usage,vram_budget\n");
+
+    // The block stays mapped after the engine exits and removes the name,
+    // so a block that stops advancing for a second is taken as gone.
+    TelemetryFrame frames[WATCH_BATCH];
+    u64 next = 0;
+    u64 printed = 0;
+    u64 last_change = OsTimeNow();
+    for(;;)
+    {
+        u32 count = TelemetryRead(&telemetry, &next, frames, WATCH_BATCH);
+        for(u32 i = 0; i < count; i++)
+        {
+            TelemetryFrame *f = &frames[i];
+            printf("%llu,%.3f,%.3f,%.3f,%.3f,%u,%u,%u,%u,%u,%llu,%llu,%llu,%.3f,%llu,%llu,%llu,%llu\n",
+                   (unsigned long long)f->frame, f->cpu_ms, f->gpu_ms, f->fence_wait_ms, f->acquire_ms,
+                   f->draw_calls, f->pipeline_binds, f->descriptor_binds, f->buffer_binds, f->render_passes,
+                   (unsigned long long)f->triangles, (unsigned long long)f->upload_bytes,
+                   (unsigned long long)f->frame_data_bytes, f->render_scale,
+                   (unsigned long long)f->arena_used, (unsigned long long)f->arena_capacity,
+                   (unsigned long long)f->vram_usage, (unsigned long long)f->vram_budget);
+        }
+
+        printed += count;
+        if(settings.frames && printed >= settings.frames)
+        {
+            break;
+        }
+
+        u64 now = OsTimeNow();
+        if(count)
+        {
+            last_change = now;
+        }
+
+        else if(now - last_change > OsTimeFrequency())
+        {
+            break;
+        }
+
+        if(count == WATCH_BATCH)
+        {
+            continue;
+        }
+
+        fflush(stdout);
+        OsSleepUntil(now + poll_ticks);
+    }
+
+    DestroyTelemetry(&telemetry);
+    return 0;
+}
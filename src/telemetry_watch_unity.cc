@@ -0,0 +1,3 @@
+#include "os.cc"
+#include "telemetry.cc"
+#include "telemetry_watch.cc"
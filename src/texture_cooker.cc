@@ -0,0 +1,462 @@
+#include <windows.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "types.hh"
+#include "arena_alloc.hh"
+#include "jobs.hh"
+#include "dds.hh"
+#include "image_io.hh"
+#include "bc_encode.hh"
+
+#define MAX_MIPS 16
+#define BLOCKS_PER_JOB 64
+
+struct CookSettings
+{
+    DDSFormat format;
+    u32 quality;
+    u32 threads;
+    bool linear;
+    bool normal_map;
+    bool srgb;
+    bool mips;
+    const char *input_path;
+    const char *output_path;
+};
+
+struct MipLevel
+{
+    u32 width;
+    u32 height;
+    u8 *pixels;
+
+    u32 blocks_x;
+    u32 blocks_y;
+    u32 first_block;
+    u64 data_offset;
+};
+
+struct CookJob
+{
+    DDSFormat format;
+    u32 quality;
+    u32 channels;
+    u32 block_size;
+    u32 mip_count;
+    MipLevel mips[MAX_MIPS];
+    u8 *data;
+
+    volatile LONG64 squared_error[MAX_MIPS];
+};
+
+struct DownsampleJob
+{
+    const MipLevel *src;
+    MipLevel *dst;
+    bool linear;
+    bool normal_map;
+};
+
+static float srgb_to_linear[256];
+
+static u8 LinearToSRGB(float v)
+{
+    v = v < 0 ? 0 : (v > 1 ? 1 : v);
+    float s = v <= 0.0031308f ? v * 12.92f : 1.055f * powf(v, 1.0f / 2.4f) - 0.055f;
+    return (u8)(s * 255.0f + 0.5f);
+}
+
+static u8 UnitToByte(float v)
+{
+    v = v < 0 ? 0 : (v > 1 ? 1 : v);
+    return (u8)(v * 255.0f + 0.5f);
+}
+
+static void DownsampleRows(void *data, u32 begin, u32 end)
+{
+    DownsampleJob *job = (DownsampleJob *)data;
+    const MipLevel *src = job->src;
+    MipLevel *dst = job->dst;
+
+    for(u32 y = begin; y < end; y++)
+    {
+        u32 y0 = y * 2;
+        u32 y1 = y0 + 1 < src->height ? y0 + 1 : src->height - 1;
+        for(u32 x = 0; x < dst->width; x++)
+        {
+            u32 x0 = x * 2;
+            u32 x1 = x0 + 1 < src->width ? x0 + 1 : src->width - 1;
+            const u8 *taps[4] = {
+                src->pixels + ((u64)y0 * src->width + x0) * 4,
+                src->pixels + ((u64)y0 * src->width + x1) * 4,
+                src->pixels + ((u64)y1 * src->width + x0) * 4,
+                src->pixels + ((u64)y1 * src->width + x1) * 4,
+            };
+
+            float sum[4] = {};
+            for(u32 t = 0; t < 4; t++)
+            {
+                for(u32 ch = 0; ch < 4; ch++)
+                {
+                    bool decode = !job->linear && !job->normal_map && ch < 3;
+                    sum[ch] += decode ? srgb_to_linear[taps[t][ch]] : taps[t][ch] / 255.0f;
+                }
+            }
+
+            u8 *out = dst->pixels + ((u64)y * dst->width + x) * 4;
+            if(job->normal_map)
+            {
+                float n[3];
+                float length = 0;
+                for(u32 ch = 0; ch < 3; ch++)
+                {
+                    n[ch] = sum[ch] * 0.5f - 1.0f;
+                    length += n[ch] * n[ch];
+                }
+
+                length = length > 1e-12f ? 1.0f / sqrtf(length) : 0.0f;
+                for(u32 ch = 0; ch < 3; ch++)
+                {
+                    out[ch] = UnitToByte(n[ch] * length * 0.5f + 0.5f);
+                }
+            }
+
+            else
+            {
+                for(u32 ch = 0; ch < 3; ch++)
+                {
+                    out[ch] = job->linear ? UnitToByte(sum[ch] * 0.25f) : LinearToSRGB(sum[ch] * 0.25f);
+                }
+            }
+
+            out[3] = UnitToByte(sum[3] * 0.25f);
+        }
+    }
+}
+
+static void GatherBlock(const MipLevel *mip, u32 bx, u32 by, u8 *block)
+{
+    for(u32 y = 0; y < 4; y++)
+    {
+        u32 sy = by * 4 + y < mip->height ? by * 4 + y : mip->height - 1;
+        for(u32 x = 0; x < 4; x++)
+        {
+            u32 sx = bx * 4 + x < mip->width ? bx * 4 + x : mip->width - 1;
+            memcpy(block + (y * 4 + x) * 4, mip->pixels + ((u64)sy * mip->width + sx) * 4, 4);
+        }
+    }
+}
+
+static u32 FindMip(CookJob *job, u32 block)
+{
+    u32 mip = 0;
+    while(mip + 1 < job->mip_count && block >= job->mips[mip + 1].first_block)
+    {
+        mip++;
+    }
+
+    return mip;
+}
+
+static void EncodeBlocks(void *data, u32 begin, u32 end)
+{
+    CookJob *job = (CookJob *)data;
+    u32 mip_index = FindMip(job, begin);
+
+    for(u32 block = begin; block < end; block++)
+    {
+        while(mip_index + 1 < job->mip_count && block >= job->mips[mip_index + 1].first_block)
+        {
+            mip_index++;
+        }
+
+        MipLevel *mip = &job->mips[mip_index];
+        u32 local = block - mip->first_block;
+        u32 bx = local % mip->blocks_x;
+        u32 by = local / mip->blocks_x;
+
+        u8 pixels[64];
+        GatherBlock(mip, bx, by, pixels);
+        BCEncodeBlock(job->format, pixels, job->data + mip->data_offset + (u64)local * job->block_size, job->quality);
+    }
+}
+
+static void MeasureBlocks(void *data, u32 begin, u32 end)
+{
+    CookJob *job = (CookJob *)data;
+    u32 channels = job->channels;
+
+    u32 mip_index = FindMip(job, begin);
+    u64 error = 0;
+    for(u32 block = begin; block < end; block++)
+    {
+        while(mip_index + 1 < job->mip_count && block >= job->mips[mip_index + 1].first_block)
+        {
+            InterlockedAdd64(&job->squared_error[mip_index], error);
+            error = 0;
+            mip_index++;
+        }
+
+        MipLevel *mip = &job->mips[mip_index];
+        u32 local = block - mip->first_block;
+        u32 bx = local % mip->blocks_x;
+        u32 by = local / mip->blocks_x;
+
+        u8 decoded[64];
+        BCDecodeBlock(job->format, job->data + mip->data_offset + (u64)local * job->block_size, decoded);
+
+        for(u32 y = 0; y < 4 && by * 4 + y < mip->height; y++)
+        {
+            for(u32 x = 0; x < 4 && bx * 4 + x < mip->width; x++)
+            {
+                const u8 *src = mip->pixels + ((u64)(by * 4 + y) * mip->width + bx * 4 + x) * 4;
+                const u8 *dst = decoded + (y * 4 + x) * 4;
+                for(u32 ch = 0; ch < channels; ch++)
+                {
+                    int diff = (int)src[ch] - (int)dst[ch];
+                    error += diff * diff;
+                }
+            }
+        }
+    }
+
+    InterlockedAdd64(&job->squared_error[mip_index], error);
+}
+
+static double PSNR(u64 squared_error, u64 samples)
+{
+    if(squared_error == 0 || samples == 0)
+    {
+        return INFINITY;
+    }
+
+    double mse = (double)squared_error / (double)samples;
+    return 10.0 * log10(255.0 * 255.0 / mse);
+}
+
+static double Seconds(LARGE_INTEGER begin, LARGE_INTEGER end)
+{
+    LARGE_INTEGER freq;
+    QueryPerformanceFrequency(&freq);
+    return (double)(end.QuadPart - begin.QuadPart) / (double)freq.QuadPart;
+}
+
+static bool ParseFormat(const char *name, DDSFormat *format)
+{
+    if(strcmp(name, "bc1") == 0) *format = DDS_FORMAT_BC1;
+    else if(strcmp(name, "bc4") == 0) *format = DDS_FORMAT_BC4;
+    else if(strcmp(name, "bc5") == 0) *format = DDS_FORMAT_BC5;
+    else if(strcmp(name, "bc7") == 0) *format = DDS_FORMAT_BC7;
+    else return false;
+    return true;
+}
+
+static void PrintUsage(void)
+{
+    printf("usage: cooker [options] input.(png|tga) output.dds\n"
+           "  -f bc1|bc4|bc5|bc7  block format (default bc1)\n"
+           "  -q 0|1|2            quality: fast, normal, high (default 1)\n"
+           "  -j N                worker threads (default: all cores)\n"
+           "  --linear            data texture, filter mips without sRGB decode\n"
+           "  --normal            normal map, renormalize when filtering mips\n"
+           "  --srgb              tag bc1/bc7 output as an sRGB format\n"
+           "  --no-mips           only encode the top level\n");
+}
+
+static bool ParseArgs(int argc, char **argv, CookSettings *settings)
+{
+    *settings = {};
+    settings->format = DDS_FORMAT_BC1;
+    settings->quality = BC_QUALITY_NORMAL;
+    settings->mips = true;
+
+    for(int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        if(strcmp(arg, "-f") == 0 && i + 1 < argc)
+        {
+            if(!ParseFormat(argv[++i], &settings->format)) return false;
+        }
+
+        else if(strcmp(arg, "-q") == 0 && i + 1 < argc)
+        {
+            settings->quality = atoi(argv[++i]);
+            if(settings->quality > BC_QUALITY_HIGH) return false;
+        }
+
+        else if(strcmp(arg, "-j") == 0 && i + 1 < argc)
+        {
+            settings->threads = atoi(argv[++i]);
+        }
+
+        else if(strcmp(arg, "--linear") == 0) settings->linear = true;
+        else if(strcmp(arg, "--normal") == 0) settings->normal_map = true;
+        else if(strcmp(arg, "--srgb") == 0) settings->srgb = true;
+        else if(strcmp(arg, "--no-mips") == 0) settings->mips = false;
+        else if(!settings->input_path) settings->input_path = arg;
+        else if(!settings->output_path) settings->output_path = arg;
+        else return false;
+    }
+
+    if(settings->srgb)
+    {
+        if(settings->format == DDS_FORMAT_BC1) settings->format = DDS_FORMAT_BC1_SRGB;
+        else if(settings->format == DDS_FORMAT_BC7) settings->format = DDS_FORMAT_BC7_SRGB;
+    }
+
+    return settings->input_path && settings->output_path;
+}
+
+int main(int argc, char **argv)
+{
+    CookSettings settings;
+    if(!ParseArgs(argc, argv, &settings))
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    for(u32 i = 0; i < 256; i++)
+    {
+        float c = i / 255.0f;
+        srgb_to_linear[i] = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+    }
+
+    Arena arena = CreateNewArena(0, 1 * GB);
+    Arena job_arena = CreateNewArena(&arena, sizeof(JobQueue));
+    u32 workers = settings.threads ? settings.threads - 1 : 0;
+    JobQueue *queue = settings.threads == 1 ? 0 : CreateJobQueue(&job_arena, workers);
+
+    Image image;
+    if(!ImageLoad(&arena, settings.input_path, &image))
+    {
+        printf("cooker: failed to load %s\n", settings.input_path);
+        return 1;
+    }
+
+    CookJob *job = ArenaAllocStruct(&arena, CookJob);
+    *job = {};
+    job->format = settings.format;
+    job->quality = settings.quality;
+    job->block_size = DDSBlockSize(settings.format);
+
+    // BC1 only carries 1-bit alpha, so it is measured when the source uses it.
+    bool has_alpha = false;
+    for(u64 i = 0; i < (u64)image.width * image.height && !has_alpha; i++)
+    {
+        has_alpha = image.pixels[i * 4 + 3] != 255;
+    }
+
+    switch(settings.format)
+    {
+        case DDS_FORMAT_BC1:
+        case DDS_FORMAT_BC1_SRGB: job->channels = has_alpha ? 4 : 3; break;
+        case DDS_FORMAT_BC4: job->channels = 1; break;
+        case DDS_FORMAT_BC5: job->channels = 2; break;
+        default: job->channels = 4; break;
+    }
+
+    LARGE_INTEGER mip_begin, mip_end;
+    QueryPerformanceCounter(&mip_begin);
+
+    job->mips[0].width = image.width;
+    job->mips[0].height = image.height;
+    job->mips[0].pixels = image.pixels;
+    job->mip_count = 1;
+
+    while(settings.mips && job->mip_count < MAX_MIPS)
+    {
+        MipLevel *src = &job->mips[job->mip_count - 1];
+        if(src->width == 1 && src->height == 1)
+        {
+            break;
+        }
+
+        MipLevel *dst = &job->mips[job->mip_count++];
+        dst->width = src->width > 1 ? src->width / 2 : 1;
+        dst->height = src->height > 1 ? src->height / 2 : 1;
+        dst->pixels = (u8 *)ArenaAlloc(&arena, (u64)dst->width * dst->height * 4, 0);
+
+        DownsampleJob downsample = {src, dst, settings.linear, settings.normal_map};
+        JobsParallelFor(queue, dst->height, 16, DownsampleRows, &downsample);
+    }
+
+    QueryPerformanceCounter(&mip_end);
+
+    u32 total_blocks = 0;
+    u64 total_pixels = 0;
+    u64 data_size = 0;
+    for(u32 i = 0; i < job->mip_count; i++)
+    {
+        MipLevel *mip = &job->mips[i];
+        mip->blocks_x = (mip->width + 3) / 4;
+        mip->blocks_y = (mip->height + 3) / 4;
+        mip->first_block = total_blocks;
+        mip->data_offset = data_size;
+
+        total_blocks += mip->blocks_x * mip->blocks_y;
+        total_pixels += (u64)mip->width * mip->height;
+        data_size += DDSMipSize(mip->width, mip->height, job->block_size);
+    }
+
+    u8 header[256];
+    u32 header_size = DDSWriteHeader(header, settings.format, image.width, image.height, job->mip_count);
+
+    job->data = (u8 *)ArenaAlloc(&arena, data_size, 0);
+    if(!job->data)
+    {
+        printf("cooker: out of memory\n");
+        return 1;
+    }
+
+    LARGE_INTEGER encode_begin, encode_end;
+    QueryPerformanceCounter(&encode_begin);
+    JobsParallelFor(queue, total_blocks, BLOCKS_PER_JOB, EncodeBlocks, job);
+    QueryPerformanceCounter(&encode_end);
+
+    JobsParallelFor(queue, total_blocks, BLOCKS_PER_JOB, MeasureBlocks, job);
+
+    HANDLE hfile = CreateFile(settings.output_path, GENERIC_WRITE, 0, 0, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+    DWORD written = 0;
+    bool ok = hfile != INVALID_HANDLE_VALUE &&
+              WriteFile(hfile, header, header_size, &written, 0) &&
+              WriteFile(hfile, job->data, (DWORD)data_size, &written, 0);
+    if(hfile != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(hfile);
+    }
+
+    if(!ok)
+    {
+        printf("cooker: failed to write %s\n", settings.output_path);
+        return 1;
+    }
+
+    double mip_seconds = Seconds(mip_begin, mip_end);
+    double encode_seconds = Seconds(encode_begin, encode_end);
+    u32 threads = queue ? queue->worker_count + 1 : 1;
+
+    printf("%s -> %s\n", settings.input_path, settings.output_path);
+    printf("  %ux%u, %u mips, %u blocks, %u threads, quality %u\n",
+           image.width, image.height, job->mip_count, total_blocks, threads, settings.quality);
+    printf("  mips   %8.2f ms\n", mip_seconds * 1000.0);
+    printf("  encode %8.2f ms, %.2f MPix/s\n", encode_seconds * 1000.0,
+           total_pixels / encode_seconds / 1000000.0);
+
+    u64 all_error = 0;
+    u64 all_samples = 0;
+    for(u32 i = 0; i < job->mip_count; i++)
+    {
+        u64 samples = (u64)job->mips[i].width * job->mips[i].height * job->channels;
+        all_error += job->squared_error[i];
+        all_samples += samples;
+        printf("  mip %2u %5ux%-5u PSNR %6.2f dB\n", i, job->mips[i].width, job->mips[i].height,
+               PSNR(job->squared_error[i], samples));
+    }
+
+    printf("  total PSNR %6.2f dB\n", PSNR(all_error, all_samples));
+    return 0;
+}
@@ -0,0 +1,759 @@
+#include "os.hh"
+#include <math.h>
+#include "texture_stream.hh"
+#include "gpu_memory.hh"
+
+static u32 MipExtent(u32 size, u32 mip)
+{
+    size >>= mip;
+    return size ? size : 1;
+}
+
+static void StreamerSetMinLod(TextureStreamer *streamer, u32 slot, u32 mip)
+{
+    ((float *)streamer->lod_data)[slot] = (float)mip;
+}
+
+static VkBuffer CreateMappedBuffer(Device device, VkDeviceSize size, VkBufferUsageFlags usage,
+                                   VmaAllocation *alloc, u8 **mapped)
+{
+    VkBufferCreateInfo buff_info = {};
+    buff_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buff_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    buff_info.usage = usage;
+    buff_info.size = size;
+
+    VmaAllocationCreateInfo alloc_info = {};
+    alloc_info.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+    alloc_info.requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    alloc_info.usage = VMA_MEMORY_USAGE_AUTO;
+
+    VkBuffer buffer;
+    VmaAllocationInfo info;
+    vmaCreateBuffer(device.allocator, &buff_info, &alloc_info, &buffer, alloc, &info);
+    GpuMemoryTrack(device, GPU_MEMORY_STAGING, *alloc);
+    *mapped = (u8 *)info.pMappedData;
+    return buffer;
+}
+
+void CreateTextureStreamer(TextureStreamer *streamer, Device device, u64 budget)
+{
+    *streamer = {};
+    streamer->device = device;
+    streamer->sparse = device.sparse_residency;
+    streamer->budget = budget;
+
+    streamer->lod_buffer = CreateMappedBuffer(device, sizeof(float) * MAX_STREAMED_TEXTURES,
+                                              VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                              &streamer->lod_alloc, &streamer->lod_data);
+
+    streamer->staging = CreateMappedBuffer(device, STREAM_STAGING_SIZE, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                           &streamer->staging_alloc, &streamer->staging_data);
+
+    VkCommandPoolCreateInfo pool_info = {};
+    pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    pool_info.queueFamilyIndex = device.queue_family_index;
+    vkCreateCommandPool(device.device, &pool_info, 0, &streamer->pool);
+
+    VkCommandBufferAllocateInfo cmd_info = {};
+    cmd_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    cmd_info.commandPool = streamer->pool;
+    cmd_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    cmd_info.commandBufferCount = 1;
+    vkAllocateCommandBuffers(device.device, &cmd_info, &streamer->cmd);
+
+    VkFenceCreateInfo fence_info = {};
+    fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    vkCreateFence(device.device, &fence_info, 0, &streamer->fence);
+
+    VkSemaphoreCreateInfo sema_info = {};
+    sema_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    vkCreateSemaphore(device.device, &sema_info, 0, &streamer->bind_sema);
+}
+
+// Only once the device is idle.
+void DestroyTextureStreamer(TextureStreamer *streamer)
+{
+    Device device = streamer->device;
+    for(u32 i = 0; i < streamer->texture_count; i++)
+    {
+        StreamedTexture *tex = &streamer->textures[i];
+        if(!tex->texture.image)
+        {
+            continue;
+        }
+
+        if(tex->texture.alloc)
+        {
+            GpuMemoryRelease(device, GPU_MEMORY_TEXTURE, tex->texture.alloc);
+        }
+
+        DestroyTexture(device, &tex->texture);
+        if(tex->tail_alloc)
+        {
+            GpuMemoryRelease(device, GPU_MEMORY_TEXTURE, tex->tail_alloc);
+            vmaFreeMemory(device.allocator, tex->tail_alloc);
+        }
+
+        for(u32 mip = 0; mip < MAX_STREAM_MIPS; mip++)
+        {
+            if(tex->mip_allocs[mip])
+            {
+                GpuMemoryRelease(device, GPU_MEMORY_TEXTURE, tex->mip_allocs[mip]);
+                vmaFreeMemory(device.allocator, tex->mip_allocs[mip]);
+            }
+        }
+
+        OsUnmapFile(&tex->file);
+    }
+
+    for(u32 i = 0; i < streamer->retired_count; i++)
+    {
+        GpuMemoryRelease(device, GPU_MEMORY_TEXTURE, streamer->retired[i]);
+        vmaFreeMemory(device.allocator, streamer->retired[i]);
+    }
+
+    GpuMemoryRelease(device, GPU_MEMORY_STAGING, streamer->lod_alloc);
+    vmaDestroyBuffer(device.allocator, streamer->lod_buffer, streamer->lod_alloc);
+    GpuMemoryRelease(device, GPU_MEMORY_STAGING, streamer->staging_alloc);
+    vmaDestroyBuffer(device.allocator, streamer->staging, streamer->staging_alloc);
+
+    vkDestroyCommandPool(device.device, streamer->pool, 0);
+    vkDestroyFence(device.device, streamer->fence, 0);
+    vkDestroySemaphore(device.device, streamer->bind_sema, 0);
+    *streamer = {};
+}
+
+static bool SparseFormatSupported(Device device, VkFormat format, VkImageUsageFlags usage)
+{
+    u32 count = 0;
+    vkGetPhysicalDeviceSparseImageFormatProperties(device.adapter, format, VK_IMAGE_TYPE_2D,
+                                                   VK_SAMPLE_COUNT_1_BIT, usage,
+                                                   VK_IMAGE_TILING_OPTIMAL, &count, 0);
+    return count > 0;
+}
+
+// Returns whether the mip tail bind was queued, in which case it signals
+// bind_sema and the tail upload has to wait on it.
+static bool CreateSparseTexture(TextureStreamer *streamer, StreamedTexture *tex, VkImageUsageFlags usage)
+{
+    Device device = streamer->device;
+    u32 mip_count = tex->dds.mip_count;
+
+    VkImageCreateInfo image_info = {};
+    image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_info.flags = VK_IMAGE_CREATE_SPARSE_BINDING_BIT | VK_IMAGE_CREATE_SPARSE_RESIDENCY_BIT;
+    image_info.imageType = VK_IMAGE_TYPE_2D;
+    image_info.format = tex->format;
+    image_info.extent.width = tex->dds.width;
+    image_info.extent.height = tex->dds.height;
+    image_info.extent.depth = 1;
+    image_info.mipLevels = mip_count;
+    image_info.arrayLayers = 1;
+    image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+    image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    image_info.usage = usage;
+    image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    Texture *texture = &tex->texture;
+    texture->rect.extent.width = tex->dds.width;
+    texture->rect.extent.height = tex->dds.height;
+    texture->mip_count = mip_count;
+    vkCreateImage(device.device, &image_info, 0, &texture->image);
+
+    vkGetImageMemoryRequirements(device.device, texture->image, &tex->memory_requirements);
+
+    u32 sparse_count = 1;
+    VkSparseImageMemoryRequirements sparse_reqs = {};
+    vkGetImageSparseMemoryRequirements(device.device, texture->image, &sparse_count, &sparse_reqs);
+
+    VkExtent3D granularity = sparse_reqs.formatProperties.imageGranularity;
+    u64 page_size = tex->memory_requirements.alignment;
+    tex->tail_mip = sparse_reqs.imageMipTailFirstLod < mip_count ? sparse_reqs.imageMipTailFirstLod : mip_count;
+
+    for(u32 mip = 0; mip < tex->tail_mip; mip++)
+    {
+        u64 pages_x = (MipExtent(tex->dds.width, mip) + granularity.width - 1) / granularity.width;
+        u64 pages_y = (MipExtent(tex->dds.height, mip) + granularity.height - 1) / granularity.height;
+        tex->mip_vram[mip] = pages_x * pages_y * page_size;
+    }
+
+    bool bound = false;
+    if(tex->tail_mip < mip_count)
+    {
+        VkMemoryRequirements tail_reqs = tex->memory_requirements;
+        tail_reqs.size = sparse_reqs.imageMipTailSize;
+
+        VmaAllocationCreateInfo alloc_info = {};
+        alloc_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+
+        VmaAllocationInfo info;
+        vmaAllocateMemory(device.allocator, &tail_reqs, &alloc_info, &tex->tail_alloc, &info);
+        GpuMemoryTrack(device, GPU_MEMORY_TEXTURE, tex->tail_alloc);
+        tex->tail_vram = sparse_reqs.imageMipTailSize;
+
+        VkSparseMemoryBind tail_bind = {};
+        tail_bind.resourceOffset = sparse_reqs.imageMipTailOffset;
+        tail_bind.size = sparse_reqs.imageMipTailSize;
+        tail_bind.memory = info.deviceMemory;
+        tail_bind.memoryOffset = info.offset;
+
+        VkSparseImageOpaqueMemoryBindInfo opaque_info = {};
+        opaque_info.image = texture->image;
+        opaque_info.bindCount = 1;
+        opaque_info.pBinds = &tail_bind;
+
+        VkBindSparseInfo bind_info = {};
+        bind_info.sType = VK_STRUCTURE_TYPE_BIND_SPARSE_INFO;
+        bind_info.imageOpaqueBindCount = 1;
+        bind_info.pImageOpaqueBinds = &opaque_info;
+        bind_info.signalSemaphoreCount = 1;
+        bind_info.pSignalSemaphores = &streamer->bind_sema;
+
+        vkQueueBindSparse(device.queue, 1, &bind_info, 0);
+        bound = true;
+    }
+
+    VkImageViewCreateInfo view_info = {};
+    view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    view_info.image = texture->image;
+    view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    view_info.format = tex->format;
+    view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    view_info.subresourceRange.levelCount = mip_count;
+    view_info.subresourceRange.layerCount = 1;
+    vkCreateImageView(device.device, &view_info, 0, &texture->view);
+    return bound;
+}
+
+// Copies mips [first, last) into staging at staging_offset and records the
+// transfer. Returns the number of staging bytes used.
+static u64 RecordMipUpload(TextureStreamer *streamer, StreamedTexture *tex, u32 first, u32 last,
+                           u64 staging_offset)
+{
+    VkCommandBuffer cmd = streamer->cmd;
+
+    TransitionImageInfo trans_info = {};
+    trans_info.image = tex->texture.image;
+    trans_info.old_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    trans_info.new_layout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    trans_info.src_access_mask = 0;
+    trans_info.dst_access_mask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    trans_info.aspect_mask = VK_IMAGE_ASPECT_COLOR_BIT;
+    trans_info.src_stage_mask = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+    trans_info.dst_stage_mask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    trans_info.base_mip = first;
+    trans_info.mip_count = last - first;
+    TransitionImage(cmd, &trans_info);
+
+    u64 used = 0;
+    for(u32 mip = first; mip < last; mip++)
+    {
+        memcpy(streamer->staging_data + staging_offset + used,
+               tex->dds.data + tex->mip_offsets[mip], tex->mip_bytes[mip]);
+
+        VkBufferImageCopy region = {};
+        region.bufferOffset = staging_offset + used;
+        region.imageExtent.width = MipExtent(tex->dds.width, mip);
+        region.imageExtent.height = MipExtent(tex->dds.height, mip);
+        region.imageExtent.depth = 1;
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.mipLevel = mip;
+        region.imageSubresource.layerCount = 1;
+
+        vkCmdCopyBufferToImage(cmd, streamer->staging, tex->texture.image,
+                               VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+        // Copy offsets must stay aligned to the texel block size.
+        used += (tex->mip_bytes[mip] + 15) & ~15ull;
+    }
+
+    trans_info.old_layout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    trans_info.new_layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    trans_info.src_access_mask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    trans_info.dst_access_mask = VK_ACCESS_SHADER_READ_BIT;
+    trans_info.src_stage_mask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    trans_info.dst_stage_mask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    TransitionImage(cmd, &trans_info);
+
+    streamer->uploaded_bytes += used;
+    return used;
+}
+
+static void StreamerFinishUpload(TextureStreamer *streamer)
+{
+    Device device = streamer->device;
+    vkResetFences(device.device, 1, &streamer->fence);
+    streamer->uploading = false;
+
+    for(u32 i = 0; i < streamer->texture_count; i++)
+    {
+        StreamedTexture *tex = &streamer->textures[i];
+        if(tex->uploading_mip < tex->resident_mip)
+        {
+            tex->resident_mip = tex->uploading_mip;
+            tex->evict_mip = tex->uploading_mip;
+            StreamerSetMinLod(streamer, i, tex->resident_mip);
+        }
+    }
+
+    for(u32 i = 0; i < streamer->retired_count; i++)
+    {
+        GpuMemoryRelease(device, GPU_MEMORY_TEXTURE, streamer->retired[i]);
+        vmaFreeMemory(device.allocator, streamer->retired[i]);
+    }
+
+    streamer->retired_count = 0;
+}
+
+// Takes over the mapping, which backs the finer mips for as long as the
+// texture lives, and unmaps it on failure. The tail upload is only waited
+// for when the staging buffer is needed again, so loading does not stall
+// the frames in flight; later submits are ordered after it on the queue.
+u32 StreamerLoadTexture(TextureStreamer *streamer, MappedFile *file)
+{
+    DDSInfo dds;
+    bool full = streamer->texture_count >= MAX_STREAMED_TEXTURES && streamer->free_count == 0;
+    if(full || !file->data ||
+       !DDSParse(file->data, file->size, &dds) || dds.mip_count > MAX_STREAM_MIPS)
+    {
+        OsUnmapFile(file);
+        return STREAM_INVALID_SLOT;
+    }
+
+    Device device = streamer->device;
+    if(streamer->uploading)
+    {
+        vkWaitForFences(device.device, 1, &streamer->fence, VK_TRUE, UINT64_MAX);
+        StreamerFinishUpload(streamer);
+    }
+
+    u32 slot = streamer->free_count ? streamer->free_slots[--streamer->free_count] : streamer->texture_count++;
+    StreamedTexture *tex = &streamer->textures[slot];
+    *tex = {};
+    tex->file = *file;
+    tex->dds = dds;
+    tex->format = DDSToVkFormat(dds.format);
+
+    u64 offset = 0;
+    for(u32 mip = 0; mip < dds.mip_count; mip++)
+    {
+        tex->mip_offsets[mip] = offset;
+        tex->mip_bytes[mip] = DDSMipSize(MipExtent(dds.width, mip), MipExtent(dds.height, mip), dds.block_size);
+        offset += tex->mip_bytes[mip];
+    }
+
+    VkImageUsageFlags usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    bool bound = false;
+
+    if(streamer->sparse && SparseFormatSupported(device, tex->format, usage))
+    {
+        bound = CreateSparseTexture(streamer, tex, usage);
+        streamer->resident_bytes += tex->tail_vram;
+    }
+
+    else
+    {
+        // Without sparse residency the whole chain is allocated up front and
+        // only the upload is deferred, so the budget cannot reclaim anything.
+        tex->texture = CreateTexture(device, tex->format, usage, dds.width, dds.height, dds.mip_count);
+        GpuMemoryTrack(device, GPU_MEMORY_TEXTURE, tex->texture.alloc);
+        tex->tail_mip = dds.mip_count - 1;
+        for(u32 mip = 0; mip < dds.mip_count; mip++)
+        {
+            if(MipExtent(dds.width, mip) <= STREAM_TAIL_SIZE && MipExtent(dds.height, mip) <= STREAM_TAIL_SIZE)
+            {
+                tex->tail_mip = mip;
+                break;
+            }
+        }
+
+        for(u32 mip = 0; mip < dds.mip_count; mip++)
+        {
+            tex->tail_vram += tex->mip_bytes[mip];
+        }
+
+        streamer->resident_bytes += tex->tail_vram;
+    }
+
+    u32 tail = tex->tail_mip < dds.mip_count ? tex->tail_mip : dds.mip_count - 1;
+    tex->tail_mip = tail;
+    tex->resident_mip = tail;
+    tex->target_mip = tail;
+    tex->uploading_mip = tail;
+    tex->evict_mip = tail;
+
+    // Only the tail is uploaded here; the finer levels are left undefined
+    // until streamed in.
+    VkCommandBufferBeginInfo begin = {};
+    begin.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(streamer->cmd, &begin);
+
+    if(tail > 0)
+    {
+        TransitionImageInfo trans_info = {};
+        trans_info.image = tex->texture.image;
+        trans_info.old_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        trans_info.new_layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        trans_info.dst_access_mask = VK_ACCESS_SHADER_READ_BIT;
+        trans_info.aspect_mask = VK_IMAGE_ASPECT_COLOR_BIT;
+        trans_info.src_stage_mask = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+        trans_info.dst_stage_mask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+        trans_info.mip_count = tail;
+        TransitionImage(streamer->cmd, &trans_info);
+    }
+
+    RecordMipUpload(streamer, tex, tail, dds.mip_count, 0);
+    vkEndCommandBuffer(streamer->cmd);
+
+    VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    VkSubmitInfo submit = {};
+    submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit.commandBufferCount = 1;
+    submit.pCommandBuffers = &streamer->cmd;
+    if(bound)
+    {
+        submit.waitSemaphoreCount = 1;
+        submit.pWaitSemaphores = &streamer->bind_sema;
+        submit.pWaitDstStageMask = &wait_stage;
+    }
+
+    vkQueueSubmit(device.queue, 1, &submit, streamer->fence);
+    streamer->uploading = true;
+
+    StreamerSetMinLod(streamer, slot, tail);
+    return slot;
+}
+
+// Everything the texture holds, resident mips included, is queued for
+// destruction after the frames that may still sample it, and so is the
+// slot itself, since their draws index the descriptor at that slot. The
+// upload in flight may still be writing the image, so it is finished first.
+void StreamerUnloadTexture(TextureStreamer *streamer, u32 slot, DestroyQueue *queue)
+{
+    if(slot >= streamer->texture_count || !streamer->textures[slot].texture.image)
+    {
+        return;
+    }
+
+    Device device = streamer->device;
+    if(streamer->uploading)
+    {
+        vkWaitForFences(device.device, 1, &streamer->fence, VK_TRUE, UINT64_MAX);
+        StreamerFinishUpload(streamer);
+    }
+
+    StreamedTexture *tex = &streamer->textures[slot];
+    DestroyQueueImageView(queue, tex->texture.view);
+    DestroyQueueImage(queue, tex->texture.image, tex->texture.alloc, GPU_MEMORY_TEXTURE);
+
+    u64 freed = tex->tail_vram;
+    if(tex->tail_alloc)
+    {
+        DestroyQueueMemory(queue, tex->tail_alloc, GPU_MEMORY_TEXTURE);
+    }
+
+    for(u32 mip = 0; mip < MAX_STREAM_MIPS; mip++)
+    {
+        if(tex->mip_allocs[mip])
+        {
+            DestroyQueueMemory(queue, tex->mip_allocs[mip], GPU_MEMORY_TEXTURE);
+            freed += tex->mip_vram[mip];
+        }
+    }
+
+    streamer->resident_bytes = streamer->resident_bytes > freed ? streamer->resident_bytes - freed : 0;
+    OsUnmapFile(&tex->file);
+    *tex = {};
+    DestroyQueueSlot(queue, streamer->free_slots, &streamer->free_count, slot);
+}
+
+void StreamerRequest(TextureStreamer *streamer, u32 slot, float screen_size)
+{
+    if(slot >= streamer->texture_count)
+    {
+        return;
+    }
+
+    StreamedTexture *tex = &streamer->textures[slot];
+    if(tex->last_request_frame != streamer->frame || screen_size > tex->screen_size)
+    {
+        tex->screen_size = screen_size;
+    }
+
+    tex->last_request_frame = streamer->frame;
+}
+
+VkDescriptorBufferInfo StreamerLodDescriptor(TextureStreamer *streamer)
+{
+    VkDescriptorBufferInfo info = {};
+    info.buffer = streamer->lod_buffer;
+    info.range = VK_WHOLE_SIZE;
+    return info;
+}
+
+static u64 StreamedBytes(StreamedTexture *tex, u32 first_mip)
+{
+    u64 bytes = 0;
+    for(u32 mip = first_mip; mip < tex->tail_mip; mip++)
+    {
+        bytes += tex->mip_vram[mip];
+    }
+
+    return bytes;
+}
+
+static void StreamerChooseTargets(TextureStreamer *streamer)
+{
+    u64 committed = 0;
+    for(u32 i = 0; i < streamer->texture_count; i++)
+    {
+        StreamedTexture *tex = &streamer->textures[i];
+        u32 desired = tex->tail_mip;
+
+        bool requested = streamer->frame - tex->last_request_frame <= STREAM_IDLE_FRAMES;
+        if(requested)
+        {
+            u32 size = tex->dds.width > tex->dds.height ? tex->dds.width : tex->dds.height;
+            float ratio = size / (tex->screen_size > 1.0f ? tex->screen_size : 1.0f);
+            int mip = ratio > 1.0f ? (int)floorf(log2f(ratio)) : 0;
+            desired = (u32)mip < tex->tail_mip ? (u32)mip : tex->tail_mip;
+        }
+
+        tex->target_mip = desired;
+        committed += tex->tail_vram;
+        if(streamer->sparse)
+        {
+            committed += StreamedBytes(tex, desired);
+        }
+    }
+
+    // Over budget: drop a level from whichever texture covers the least of
+    // the screen until everything fits.
+    while(streamer->sparse && committed > streamer->budget)
+    {
+        StreamedTexture *victim = 0;
+        float victim_size = 0.0f;
+        for(u32 i = 0; i < streamer->texture_count; i++)
+        {
+            StreamedTexture *tex = &streamer->textures[i];
+            float size = tex->last_request_frame == streamer->frame ? tex->screen_size : 0.0f;
+            if(tex->target_mip < tex->tail_mip && (!victim || size < victim_size))
+            {
+                victim = tex;
+                victim_size = size;
+            }
+        }
+
+        if(!victim)
+        {
+            break;
+        }
+
+        committed -= victim->mip_vram[victim->target_mip];
+        victim->target_mip++;
+    }
+}
+
+void StreamerUpdate(TextureStreamer *streamer)
+{
+    Device device = streamer->device;
+
+    if(streamer->uploading && vkGetFenceStatus(device.device, streamer->fence) == VK_SUCCESS)
+    {
+        StreamerFinishUpload(streamer);
+    }
+
+    StreamerChooseTargets(streamer);
+
+    // Dropping detail is immediate on the shader side: raise the floor now
+    // and release the memory once no frame in flight can still sample it.
+    for(u32 i = 0; i < streamer->texture_count; i++)
+    {
+        StreamedTexture *tex = &streamer->textures[i];
+        if(!streamer->sparse || tex->uploading_mip < tex->resident_mip)
+        {
+            continue;
+        }
+
+        if(tex->target_mip > tex->resident_mip && tex->target_mip != tex->evict_mip)
+        {
+            tex->evict_mip = tex->target_mip;
+            tex->evict_frame = streamer->frame;
+            StreamerSetMinLod(streamer, i, tex->evict_mip);
+        }
+
+        else if(tex->target_mip <= tex->resident_mip && tex->evict_mip > tex->resident_mip)
+        {
+            tex->evict_mip = tex->resident_mip;
+            StreamerSetMinLod(streamer, i, tex->resident_mip);
+        }
+    }
+
+    streamer->frame++;
+    if(streamer->uploading)
+    {
+        return;
+    }
+
+    VkSparseImageMemoryBind binds[MAX_STREAM_BINDS];
+    VkSparseImageMemoryBindInfo image_binds[MAX_STREAMED_TEXTURES];
+    u32 bind_count = 0;
+    u32 image_bind_count = 0;
+
+    VkCommandBufferBeginInfo begin = {};
+    begin.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(streamer->cmd, &begin);
+
+    u64 staging_used = 0;
+    bool recorded = false;
+
+    for(u32 i = 0; i < streamer->texture_count; i++)
+    {
+        StreamedTexture *tex = &streamer->textures[i];
+        if(tex->evict_mip <= tex->resident_mip || streamer->frame < tex->evict_frame + MAX_FRAMES + 1)
+        {
+            continue;
+        }
+
+        u32 count = tex->evict_mip - tex->resident_mip;
+        if(bind_count + count > MAX_STREAM_BINDS || streamer->retired_count + count > MAX_STREAM_RETIRED)
+        {
+            break;
+        }
+
+        VkSparseImageMemoryBindInfo *image_bind = &image_binds[image_bind_count++];
+        image_bind->image = tex->texture.image;
+        image_bind->bindCount = count;
+        image_bind->pBinds = &binds[bind_count];
+
+        for(u32 mip = tex->resident_mip; mip < tex->evict_mip; mip++)
+        {
+            VkSparseImageMemoryBind *bind = &binds[bind_count++];
+            *bind = {};
+            bind->subresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            bind->subresource.mipLevel = mip;
+            bind->extent.width = MipExtent(tex->dds.width, mip);
+            bind->extent.height = MipExtent(tex->dds.height, mip);
+            bind->extent.depth = 1;
+
+            streamer->retired[streamer->retired_count++] = tex->mip_allocs[mip];
+            streamer->resident_bytes -= tex->mip_vram[mip];
+            tex->mip_allocs[mip] = 0;
+        }
+
+        tex->resident_mip = tex->evict_mip;
+        tex->uploading_mip = tex->evict_mip;
+    }
+
+    // Stream in, largest on screen first, one level at a time so that every
+    // texture makes progress within the staging budget.
+    for(;;)
+    {
+        StreamedTexture *best = 0;
+        for(u32 i = 0; i < streamer->texture_count; i++)
+        {
+            StreamedTexture *tex = &streamer->textures[i];
+            u32 next = tex->uploading_mip;
+            if(tex->target_mip >= next || tex->evict_mip > tex->resident_mip)
+            {
+                continue;
+            }
+
+            if(!best || tex->screen_size > best->screen_size)
+            {
+                best = tex;
+            }
+        }
+
+        if(!best)
+        {
+            break;
+        }
+
+        u32 mip = best->uploading_mip - 1;
+        u64 cost = streamer->sparse ? best->mip_vram[mip] : 0;
+        u64 staged = (best->mip_bytes[mip] + 15) & ~15ull;
+        if(staging_used + staged > STREAM_STAGING_SIZE || bind_count >= MAX_STREAM_BINDS ||
+           (streamer->sparse && streamer->resident_bytes + cost > streamer->budget))
+        {
+            break;
+        }
+
+        if(streamer->sparse)
+        {
+            VkMemoryRequirements reqs = best->memory_requirements;
+            reqs.size = best->mip_vram[mip];
+
+            VmaAllocationCreateInfo alloc_info = {};
+            alloc_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+
+            VmaAllocationInfo info;
+            if(vmaAllocateMemory(device.allocator, &reqs, &alloc_info, &best->mip_allocs[mip], &info) != VK_SUCCESS)
+            {
+                break;
+            }
+
+            GpuMemoryTrack(device, GPU_MEMORY_TEXTURE, best->mip_allocs[mip]);
+            VkSparseImageMemoryBind *bind = &binds[bind_count++];
+            *bind = {};
+            bind->subresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            bind->subresource.mipLevel = mip;
+            bind->extent.width = MipExtent(best->dds.width, mip);
+            bind->extent.height = MipExtent(best->dds.height, mip);
+            bind->extent.depth = 1;
+            bind->memory = info.deviceMemory;
+            bind->memoryOffset = info.offset;
+
+            VkSparseImageMemoryBindInfo *image_bind = &image_binds[image_bind_count++];
+            image_bind->image = best->texture.image;
+            image_bind->bindCount = 1;
+            image_bind->pBinds = bind;
+
+            streamer->resident_bytes += cost;
+        }
+
+        staging_used += RecordMipUpload(streamer, best, mip, mip + 1, staging_used);
+        best->uploading_mip = mip;
+        recorded = true;
+    }
+
+    vkEndCommandBuffer(streamer->cmd);
+
+    if(image_bind_count)
+    {
+        VkBindSparseInfo bind_info = {};
+        bind_info.sType = VK_STRUCTURE_TYPE_BIND_SPARSE_INFO;
+        bind_info.imageBindCount = image_bind_count;
+        bind_info.pImageBinds = image_binds;
+        if(recorded)
+        {
+            bind_info.signalSemaphoreCount = 1;
+            bind_info.pSignalSemaphores = &streamer->bind_sema;
+        }
+
+        vkQueueBindSparse(device.queue, 1, &bind_info, recorded ? 0 : streamer->fence);
+        streamer->uploading = true;
+    }
+
+    if(recorded)
+    {
+        VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+        VkSubmitInfo submit = {};
+        submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submit.commandBufferCount = 1;
+        submit.pCommandBuffers = &streamer->cmd;
+        if(image_bind_count)
+        {
+            submit.waitSemaphoreCount = 1;
+            submit.pWaitSemaphores = &streamer->bind_sema;
+            submit.pWaitDstStageMask = &wait_stage;
+        }
+
+        vkQueueSubmit(device.queue, 1, &submit, streamer->fence);
+        streamer->uploading = true;
+    }
+}
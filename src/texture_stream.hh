@@ -0,0 +1,99 @@
+#ifndef TEXTURE_STREAM_H
+#define TEXTURE_STREAM_H
+
+#define MAX_STREAMED_TEXTURES 128
+#define MAX_STREAM_MIPS 16
+#define MAX_STREAM_RETIRED 256
+#define MAX_STREAM_BINDS 256
+#define STREAM_INVALID_SLOT 0xffffffff
+#define STREAM_TAIL_SIZE 64
+#define STREAM_STAGING_SIZE (32 * MB)
+#define STREAM_IDLE_FRAMES 120
+
+#include "os.hh"
+#include <vulkan/vulkan.h>
+
+#include "types.hh"
+#include "dds.hh"
+#include "vk_utils.hh"
+#include "destroy_queue.hh"
+#include "arena_alloc.hh"
+#include "third_party/vk_mem_alloc.h"
+
+// Textures are created with every mip level but only the coarse mip tail
+// is backed and uploaded at load. Finer mips are bound (sparse residency)
+// and uploaded on demand, and released again when the budget needs room.
+// The finest sampleable level is published to shaders as a per-texture
+// min LOD in a host visible storage buffer indexed by slot, since samplers
+// and views are immutable and a descriptor in use by a pending frame cannot
+// be rewritten. A zeroed entry is an unused slot and every pass over the
+// textures skips it.
+struct StreamedTexture
+{
+    Texture texture;
+    VkFormat format;
+    MappedFile file;
+    DDSInfo dds;
+    u64 mip_offsets[MAX_STREAM_MIPS];
+    u64 mip_bytes[MAX_STREAM_MIPS];
+
+    VkMemoryRequirements memory_requirements;
+    u64 mip_vram[MAX_STREAM_MIPS];
+    u64 tail_vram;
+    VmaAllocation tail_alloc;
+    VmaAllocation mip_allocs[MAX_STREAM_MIPS];
+
+    u32 tail_mip;
+    u32 resident_mip;
+    u32 target_mip;
+    u32 uploading_mip;
+    u32 evict_mip;
+    u64 evict_frame;
+
+    float screen_size;
+    u64 last_request_frame;
+};
+
+struct TextureStreamer
+{
+    Device device;
+    bool sparse;
+
+    u64 budget;
+    u64 resident_bytes;
+    u64 frame;
+
+    u32 texture_count;
+    StreamedTexture textures[MAX_STREAMED_TEXTURES];
+    u32 free_count;
+    u32 free_slots[MAX_STREAMED_TEXTURES];
+
+    VkBuffer lod_buffer;
+    VmaAllocation lod_alloc;
+    u8 *lod_data;
+
+    VkBuffer staging;
+    VmaAllocation staging_alloc;
+    u8 *staging_data;
+
+    VkCommandPool pool;
+    VkCommandBuffer cmd;
+    VkFence fence;
+    VkSemaphore bind_sema;
+    bool uploading;
+    u64 uploaded_bytes;
+
+    u32 retired_count;
+    VmaAllocation retired[MAX_STREAM_RETIRED];
+};
+
+void CreateTextureStreamer(TextureStreamer *streamer, Device device, u64 budget);
+void DestroyTextureStreamer(TextureStreamer *streamer);
+u32 StreamerLoadTexture(TextureStreamer *streamer, MappedFile *file);
+void StreamerUnloadTexture(TextureStreamer *streamer, u32 slot, DestroyQueue *queue);
+void StreamerRequest(TextureStreamer *streamer, u32 slot, float screen_size);
+void StreamerUpdate(TextureStreamer *streamer);
+
+VkDescriptorBufferInfo StreamerLodDescriptor(TextureStreamer *streamer);
+
+#endif //TEXTURE_STREAM_H
@@ -0,0 +1,427 @@
+#include "transform.hh"
+#include "profiler.hh"
+#include "simd_math.hh"
+
+// Slot arrays are walked by SIMD matrix code, so they start on a cache
+// line regardless of what the arena handed out before.
+static void *TransformAlloc(Arena *arena, u64 size)
+{
+    u8 *memory = (u8 *)ArenaAlloc(arena, size + 63, 0);
+    return (void *)(((uintptr_t)memory + 63) & ~(uintptr_t)63);
+}
+
+TransformSystem *CreateTransformSystem(Arena *arena, u32 capacity, JobQueue *jobs)
+{
+    TransformSystem *system = ArenaAllocStruct(arena, TransformSystem);
+    *system = {};
+    system->capacity = capacity;
+    system->jobs = jobs;
+    system->next_id = 1;
+
+    system->positions = (HMM_Vec3 *)TransformAlloc(arena, sizeof(HMM_Vec3) * capacity);
+    system->rotations = (HMM_Quat *)TransformAlloc(arena, sizeof(HMM_Quat) * capacity);
+    system->scales = (HMM_Vec3 *)TransformAlloc(arena, sizeof(HMM_Vec3) * capacity);
+    system->worlds = (HMM_Mat4 *)TransformAlloc(arena, sizeof(HMM_Mat4) * capacity);
+    system->parents = (u32 *)TransformAlloc(arena, sizeof(u32) * capacity);
+    system->slot_ids = (u32 *)TransformAlloc(arena, sizeof(u32) * capacity);
+    system->depths = (u8 *)TransformAlloc(arena, capacity);
+    system->flags = (u8 *)TransformAlloc(arena, capacity);
+
+    system->sort_positions = (HMM_Vec3 *)TransformAlloc(arena, sizeof(HMM_Vec3) * capacity);
+    system->sort_rotations = (HMM_Quat *)TransformAlloc(arena, sizeof(HMM_Quat) * capacity);
+    system->sort_scales = (HMM_Vec3 *)TransformAlloc(arena, sizeof(HMM_Vec3) * capacity);
+    system->sort_worlds = (HMM_Mat4 *)TransformAlloc(arena, sizeof(HMM_Mat4) * capacity);
+    system->sort_slot_ids = (u32 *)TransformAlloc(arena, sizeof(u32) * capacity);
+    system->sort_flags = (u8 *)TransformAlloc(arena, capacity);
+
+    // Ids start at 1, so the id tables have one more entry than slots.
+    system->id_slots = (u32 *)TransformAlloc(arena, sizeof(u32) * (capacity + 1));
+    system->id_parents = (u32 *)TransformAlloc(arena, sizeof(u32) * (capacity + 1));
+    system->id_generations = (u32 *)TransformAlloc(arena, sizeof(u32) * (capacity + 1));
+    system->free_ids = (u32 *)TransformAlloc(arena, sizeof(u32) * capacity);
+
+    if(!system->free_ids)
+    {
+        system->capacity = 0;
+    }
+
+    return system;
+}
+
+static u32 TransformResolve(TransformSystem *system, TransformHandle handle)
+{
+    if(handle.index == 0 || handle.index >= system->next_id ||
+       system->id_generations[handle.index] != handle.generation ||
+       system->id_slots[handle.index] == TRANSFORM_NONE)
+    {
+        return 0;
+    }
+
+    return handle.index;
+}
+
+// Walks the id links rather than trusting depths[], which is stale for
+// anything reparented since the last sort.
+static u32 TransformDepth(TransformSystem *system, u32 id)
+{
+    u32 depth = 0;
+    for(u32 parent = system->id_parents[id]; parent != TRANSFORM_NONE; parent = system->id_parents[parent])
+    {
+        depth++;
+    }
+
+    return depth;
+}
+
+TransformHandle TransformCreate(TransformSystem *system, TransformHandle parent)
+{
+    TransformHandle handle = {};
+    u32 parent_id = TransformResolve(system, parent);
+    u32 depth = parent_id ? TransformDepth(system, parent_id) + 1 : 0;
+    if(system->count >= system->capacity || depth >= MAX_TRANSFORM_DEPTH)
+    {
+        return handle;
+    }
+
+    u32 id = 0;
+    if(system->free_count)
+    {
+        id = system->free_ids[--system->free_count];
+    }
+
+    else
+    {
+        id = system->next_id++;
+        system->id_generations[id] = 0;
+    }
+
+    u32 slot = system->count++;
+
+    system->positions[slot] = HMM_V3(0, 0, 0);
+    system->rotations[slot] = HMM_Q(0, 0, 0, 1);
+    system->scales[slot] = HMM_V3(1, 1, 1);
+    system->worlds[slot] = HMM_M4D(1.0f);
+    system->parents[slot] = parent_id ? system->id_slots[parent_id] : TRANSFORM_NONE;
+    system->slot_ids[slot] = id;
+    system->depths[slot] = (u8)depth;
+    system->flags[slot] = TRANSFORM_DIRTY;
+
+    system->id_slots[id] = slot;
+    system->id_parents[id] = parent_id ? parent_id : TRANSFORM_NONE;
+
+    // Appending at or below the deepest level keeps the order, so only the
+    // level ranges need extending.
+    if(!system->unsorted && system->level_count && depth + 1 < system->level_count)
+    {
+        system->unsorted = true;
+    }
+
+    if(!system->unsorted)
+    {
+        for(u32 level = system->level_count; level <= depth; level++)
+        {
+            system->level_starts[level] = slot;
+        }
+
+        if(system->level_count < depth + 1)
+        {
+            system->level_count = depth + 1;
+        }
+
+        system->level_starts[system->level_count] = system->count;
+    }
+
+    handle.index = id;
+    handle.generation = system->id_generations[id];
+    return handle;
+}
+
+// Children are kept and become roots, so their local transform is now
+// relative to the world.
+void TransformDestroy(TransformSystem *system, TransformHandle handle)
+{
+    u32 id = TransformResolve(system, handle);
+    if(!id)
+    {
+        return;
+    }
+
+    for(u32 i = 1; i < system->next_id; i++)
+    {
+        if(system->id_parents[i] == id)
+        {
+            system->id_parents[i] = TRANSFORM_NONE;
+            if(system->id_slots[i] != TRANSFORM_NONE)
+            {
+                system->flags[system->id_slots[i]] |= TRANSFORM_DIRTY;
+            }
+        }
+    }
+
+    u32 slot = system->id_slots[id];
+    system->slot_ids[slot] = 0;
+    system->flags[slot] = 0;
+    system->id_slots[id] = TRANSFORM_NONE;
+    system->id_parents[id] = TRANSFORM_NONE;
+    system->id_generations[id]++;
+    system->free_ids[system->free_count++] = id;
+    system->unsorted = true;
+}
+
+// Fails rather than create a cycle or a chain deeper than the level table.
+bool TransformSetParent(TransformSystem *system, TransformHandle handle, TransformHandle parent)
+{
+    u32 id = TransformResolve(system, handle);
+    u32 parent_id = TransformResolve(system, parent);
+    if(!id || (parent.index && !parent_id))
+    {
+        return false;
+    }
+
+    u32 depth = 0;
+    if(parent_id)
+    {
+        for(u32 ancestor = parent_id; ancestor != TRANSFORM_NONE; ancestor = system->id_parents[ancestor])
+        {
+            if(ancestor == id)
+            {
+                return false;
+            }
+
+            depth++;
+        }
+    }
+
+    // The subtree below the node keeps its height, which the deepest level
+    // seen so far bounds from above.
+    u32 old_depth = TransformDepth(system, id);
+    u32 deepest = depth + (system->level_count > old_depth + 1 ? system->level_count - 1 - old_depth : 0);
+    if(deepest >= MAX_TRANSFORM_DEPTH)
+    {
+        return false;
+    }
+
+    system->id_parents[id] = parent_id ? parent_id : TRANSFORM_NONE;
+    system->flags[system->id_slots[id]] |= TRANSFORM_DIRTY;
+    if(system->level_count < deepest + 1)
+    {
+        system->level_count = deepest + 1;
+    }
+
+    system->unsorted = true;
+    return true;
+}
+
+// Counting sort of the live slots by depth. Stable, so siblings keep
+// their relative order and a hierarchy that did not change sorts to the
+// same layout.
+static void TransformSort(TransformSystem *system)
+{
+    PROFILE_ZONE("TransformSort");
+    u32 counts[MAX_TRANSFORM_DEPTH] = {};
+    u32 level_count = 0;
+    for(u32 slot = 0; slot < system->count; slot++)
+    {
+        u32 id = system->slot_ids[slot];
+        if(!id)
+        {
+            continue;
+        }
+
+        u32 depth = TransformDepth(system, id);
+        system->depths[slot] = (u8)depth;
+        counts[depth]++;
+        if(level_count < depth + 1)
+        {
+            level_count = depth + 1;
+        }
+    }
+
+    u32 cursors[MAX_TRANSFORM_DEPTH];
+    u32 live = 0;
+    for(u32 level = 0; level < level_count; level++)
+    {
+        system->level_starts[level] = live;
+        cursors[level] = live;
+        live += counts[level];
+    }
+    system->level_starts[level_count] = live;
+
+    for(u32 slot = 0; slot < system->count; slot++)
+    {
+        u32 id = system->slot_ids[slot];
+        if(!id)
+        {
+            continue;
+        }
+
+        u32 dst = cursors[system->depths[slot]]++;
+        system->sort_positions[dst] = system->positions[slot];
+        system->sort_rotations[dst] = system->rotations[slot];
+        system->sort_scales[dst] = system->scales[slot];
+        system->sort_worlds[dst] = system->worlds[slot];
+        system->sort_slot_ids[dst] = id;
+        system->sort_flags[dst] = system->flags[slot];
+        system->id_slots[id] = dst;
+    }
+
+    HMM_Vec3 *positions = system->positions;
+    HMM_Quat *rotations = system->rotations;
+    HMM_Vec3 *scales = system->scales;
+    HMM_Mat4 *worlds = system->worlds;
+    u32 *slot_ids = system->slot_ids;
+    u8 *flags = system->flags;
+    system->positions = system->sort_positions;
+    system->rotations = system->sort_rotations;
+    system->scales = system->sort_scales;
+    system->worlds = system->sort_worlds;
+    system->slot_ids = system->sort_slot_ids;
+    system->flags = system->sort_flags;
+    system->sort_positions = positions;
+    system->sort_rotations = rotations;
+    system->sort_scales = scales;
+    system->sort_worlds = worlds;
+    system->sort_slot_ids = slot_ids;
+    system->sort_flags = flags;
+
+    for(u32 level = 0; level < level_count; level++)
+    {
+        for(u32 slot = system->level_starts[level]; slot < system->level_starts[level + 1]; slot++)
+        {
+            u32 parent_id = system->id_parents[system->slot_ids[slot]];
+            system->parents[slot] = parent_id == TRANSFORM_NONE ? TRANSFORM_NONE : system->id_slots[parent_id];
+            system->depths[slot] = (u8)level;
+        }
+    }
+
+    system->count = live;
+    system->level_count = level_count;
+    system->unsorted = false;
+}
+
+// Every parent in this range is on the previous level, which is complete
+// by the time the range runs, so ranges need no synchronization. Dirty
+// slots are gathered into small batches so the math runs through the
+// batched kernels.
+static void TransformUpdateRange(void *data, u32 begin, u32 end)
+{
+    TransformSystem *system = (TransformSystem *)data;
+
+    u32 slots[TRANSFORM_GATHER];
+    HMM_Vec3 positions[TRANSFORM_GATHER];
+    HMM_Quat rotations[TRANSFORM_GATHER];
+    HMM_Vec3 scales[TRANSFORM_GATHER];
+    HMM_Mat4 parents[TRANSFORM_GATHER];
+    HMM_Mat4 locals[TRANSFORM_GATHER];
+
+    u32 level_begin = system->level_begin;
+    u32 slot = level_begin + begin;
+    while(slot < level_begin + end)
+    {
+        u32 gathered = 0;
+        for(; slot < level_begin + end && gathered < TRANSFORM_GATHER; slot++)
+        {
+            u32 parent = system->parents[slot];
+            bool parent_changed = parent != TRANSFORM_NONE && (system->flags[parent] & TRANSFORM_CHANGED);
+            if(!(system->flags[slot] & TRANSFORM_DIRTY) && !parent_changed)
+            {
+                system->flags[slot] = 0;
+                continue;
+            }
+
+            slots[gathered] = slot;
+            positions[gathered] = system->positions[slot];
+            rotations[gathered] = system->rotations[slot];
+            scales[gathered] = system->scales[slot];
+            parents[gathered] = parent == TRANSFORM_NONE ? HMM_M4D(1.0f) : system->worlds[parent];
+            system->flags[slot] = TRANSFORM_CHANGED;
+            gathered++;
+        }
+
+        MathComposeTRS(locals, positions, rotations, scales, gathered);
+        MathMulMat4Pairs(locals, parents, locals, gathered);
+        for(u32 i = 0; i < gathered; i++)
+        {
+            system->worlds[slots[i]] = locals[i];
+        }
+    }
+}
+
+// Levels run in order, each one split across the job queue.
+void TransformUpdate(TransformSystem *system)
+{
+    PROFILE_ZONE("TransformUpdate");
+    if(system->unsorted)
+    {
+        TransformSort(system);
+    }
+
+    for(u32 level = 0; level < system->level_count; level++)
+    {
+        system->level_begin = system->level_starts[level];
+        u32 count = system->level_starts[level + 1] - system->level_starts[level];
+        JobsParallelFor(system->jobs, count, TRANSFORM_BATCH, TransformUpdateRange, system);
+    }
+}
+
+static u32 TransformSlot(TransformSystem *system, TransformHandle handle)
+{
+    u32 id = TransformResolve(system, handle);
+    return id ? system->id_slots[id] : TRANSFORM_NONE;
+}
+
+void TransformSetLocal(TransformSystem *system, TransformHandle handle,
+                       HMM_Vec3 position, HMM_Quat rotation, HMM_Vec3 scale)
+{
+    u32 slot = TransformSlot(system, handle);
+    if(slot != TRANSFORM_NONE)
+    {
+        system->positions[slot] = position;
+        system->rotations[slot] = rotation;
+        system->scales[slot] = scale;
+        system->flags[slot] |= TRANSFORM_DIRTY;
+    }
+}
+
+void TransformSetPosition(TransformSystem *system, TransformHandle handle, HMM_Vec3 position)
+{
+    u32 slot = TransformSlot(system, handle);
+    if(slot != TRANSFORM_NONE)
+    {
+        system->positions[slot] = position;
+        system->flags[slot] |= TRANSFORM_DIRTY;
+    }
+}
+
+void TransformSetRotation(TransformSystem *system, TransformHandle handle, HMM_Quat rotation)
+{
+    u32 slot = TransformSlot(system, handle);
+    if(slot != TRANSFORM_NONE)
+    {
+        system->rotations[slot] = rotation;
+        system->flags[slot] |= TRANSFORM_DIRTY;
+    }
+}
+
+void TransformSetScale(TransformSystem *system, TransformHandle handle, HMM_Vec3 scale)
+{
+    u32 slot = TransformSlot(system, handle);
+    if(slot != TRANSFORM_NONE)
+    {
+        system->scales[slot] = scale;
+        system->flags[slot] |= TRANSFORM_DIRTY;
+    }
+}
+
+// Valid as of the last TransformUpdate.
+HMM_Mat4 TransformWorld(TransformSystem *system, TransformHandle handle)
+{
+    u32 slot = TransformSlot(system, handle);
+    return slot != TRANSFORM_NONE ? system->worlds[slot] : HMM_M4D(1.0f);
+}
+
+bool TransformChanged(TransformSystem *system, TransformHandle handle)
+{
+    u32 slot = TransformSlot(system, handle);
+    return slot != TRANSFORM_NONE && (system->flags[slot] & TRANSFORM_CHANGED);
+}
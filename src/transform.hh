@@ -0,0 +1,88 @@
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#define MAX_TRANSFORM_DEPTH 64
+#define TRANSFORM_BATCH 512
+#define TRANSFORM_GATHER 64
+#define TRANSFORM_NONE 0xffffffff
+
+#include "types.hh"
+#include "jobs.hh"
+#include "arena_alloc.hh"
+#include "third_party/HandmadeMath.h"
+
+enum TransformFlags
+{
+    TRANSFORM_DIRTY = 1 << 0,
+    TRANSFORM_CHANGED = 1 << 1,
+};
+
+// Index 0 is never handed out, so a zeroed handle is always invalid. The
+// generation changes every time an id is reused.
+struct TransformHandle
+{
+    u32 index;
+    u32 generation;
+};
+
+// Per node data lives in structure-of-arrays slots sorted by depth, so one
+// level only ever reads world matrices of the level before it and each
+// level can be split across workers. Handles go through an id table since
+// slots move whenever the hierarchy is re-sorted.
+//
+// Setting a local transform marks the node dirty. TransformUpdate then
+// recomputes dirty nodes and everything below them, and leaves every other
+// world matrix untouched; TRANSFORM_CHANGED tells which ones moved.
+struct TransformSystem
+{
+    u32 capacity;
+    u32 count;
+    bool unsorted;
+    JobQueue *jobs;
+
+    HMM_Vec3 *positions;
+    HMM_Quat *rotations;
+    HMM_Vec3 *scales;
+    HMM_Mat4 *worlds;
+    u32 *parents;
+    u32 *slot_ids;
+    u8 *depths;
+    u8 *flags;
+
+    // Second set of slot arrays that sorting writes into and swaps with.
+    HMM_Vec3 *sort_positions;
+    HMM_Quat *sort_rotations;
+    HMM_Vec3 *sort_scales;
+    HMM_Mat4 *sort_worlds;
+    u32 *sort_slot_ids;
+    u8 *sort_flags;
+
+    u32 *id_slots;
+    u32 *id_parents;
+    u32 *id_generations;
+    u32 *free_ids;
+    u32 free_count;
+    u32 next_id;
+
+    u32 level_count;
+    u32 level_starts[MAX_TRANSFORM_DEPTH + 1];
+    u32 level_begin;
+    u32 updated_count;
+};
+
+TransformSystem *CreateTransformSystem(Arena *arena, u32 capacity, JobQueue *jobs);
+TransformHandle TransformCreate(TransformSystem *system, TransformHandle parent);
+void TransformDestroy(TransformSystem *system, TransformHandle handle);
+bool TransformSetParent(TransformSystem *system, TransformHandle handle, TransformHandle parent);
+
+void TransformSetLocal(TransformSystem *system, TransformHandle handle,
+                       HMM_Vec3 position, HMM_Quat rotation, HMM_Vec3 scale);
+void TransformSetPosition(TransformSystem *system, TransformHandle handle, HMM_Vec3 position);
+void TransformSetRotation(TransformSystem *system, TransformHandle handle, HMM_Quat rotation);
+void TransformSetScale(TransformSystem *system, TransformHandle handle, HMM_Vec3 scale);
+
+void TransformUpdate(TransformSystem *system);
+HMM_Mat4 TransformWorld(TransformSystem *system, TransformHandle handle);
+bool TransformChanged(TransformSystem *system, TransformHandle handle);
+
+#endif //TRANSFORM_H
@@ -1,5 +1,6 @@
-#include <windows.h>
+#include "os.hh"
 #include "vk_pipeline.hh"
+#include "assets.hh"
 
 PipelineLayout CreatePipelineLayout(VkDevice device, VkPipelineLayoutCreateInfo *layout_info)
 {
@@ -14,21 +15,38 @@ PipelineLayout CreatePipelineLayout(VkDevice device, VkPipelineLayoutCreateInfo
     return layout;
 }
 
-VkPipelineShaderStageCreateInfo CreateShaderStage(VkDevice device, const char *file_path, VkShaderStageFlagBits stage)
+// The set layouts go with it, since CreatePipelineLayout took them over.
+void DestroyPipelineLayout(VkDevice device, PipelineLayout *layout)
 {
-    VkShaderModule module;
+    vkDestroyPipelineLayout(device, layout->pipe_layout, 0);
+    for(u32 i = 0; i < layout->set_layout_count; i++)
+    {
+        vkDestroyDescriptorSetLayout(device, layout->set_layouts[i], 0);
+    }
 
-    HANDLE hfile = CreateFile(file_path, GENERIC_READ, 0, 0, OPEN_EXISTING, 0, 0);
-    LARGE_INTEGER fsize; GetFileSizeEx(hfile, &fsize);
-    HANDLE hmap = CreateFileMapping(hfile, 0, PAGE_READONLY, 0, 0, 0);
-    void *buffer = MapViewOfFile(hmap, FILE_MAP_READ, 0, 0, fsize.QuadPart);
-    
-    VkShaderModuleCreateInfo module_info = {};
-    module_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    module_info.codeSize = fsize.QuadPart;
-    module_info.pCode = (u32 *)buffer;
-    vkCreateShaderModule(device, &module_info, 0, &module);
-    
+    *layout = {};
+}
+
+VkShaderModule LoadShaderModule(VkDevice device, const char *file_path)
+{
+    VkShaderModule module = 0;
+
+    MappedFile file;
+    if(OsMapFile(file_path, &file))
+    {
+        VkShaderModuleCreateInfo module_info = {};
+        module_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        module_info.codeSize = file.size;
+        module_info.pCode = (u32 *)file.data;
+        vkCreateShaderModule(device, &module_info, 0, &module);
+        OsUnmapFile(&file);
+    }
+
+    return module;
+}
+
+VkPipelineShaderStageCreateInfo CreateShaderStage(VkShaderModule module, VkShaderStageFlagBits stage)
+{
     VkPipelineShaderStageCreateInfo stage_info = {};
     stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
     stage_info.stage = stage;
@@ -50,11 +68,11 @@ VkPipelineVertexInputStateCreateInfo CreateVertexInputState(u32 vertex_binding_c
     return vi_state;
 }
 
-VkPipelineInputAssemblyStateCreateInfo CreateInputAssembly(void)
+VkPipelineInputAssemblyStateCreateInfo CreateInputAssembly(PipelineState *state)
 {
     VkPipelineInputAssemblyStateCreateInfo ia_state = {};
     ia_state.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-    ia_state.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    ia_state.topology = state->topology;
     return ia_state;
 }
 
@@ -67,13 +85,13 @@ VkPipelineViewportStateCreateInfo CreateViewportState(void)
     return vp_state;
 }
 
-VkPipelineRasterizationStateCreateInfo CreateRasterState(void)
+VkPipelineRasterizationStateCreateInfo CreateRasterState(PipelineState *state)
 {
     VkPipelineRasterizationStateCreateInfo raster = {};
     raster.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
     raster.polygonMode = VK_POLYGON_MODE_FILL;
-    raster.cullMode = VK_CULL_MODE_BACK_BIT;
-    raster.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+    raster.cullMode = state->cull_mode;
+    raster.frontFace = state->front_face;
     raster.lineWidth = 1.0f;
     return raster;
 }
@@ -86,22 +104,84 @@ VkPipelineMultisampleStateCreateInfo CreateMultisampleState(void)
     return ms_state;
 }
 
-VkPipelineDepthStencilStateCreateInfo CreateDepthStencilState(void)
+VkPipelineDepthStencilStateCreateInfo CreateDepthStencilState(PipelineState *state)
 {
     VkPipelineDepthStencilStateCreateInfo depth_state = {};
     depth_state.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-    depth_state.depthTestEnable = VK_TRUE;
-    depth_state.depthWriteEnable = VK_TRUE;
-    depth_state.depthCompareOp = VK_COMPARE_OP_GREATER_OR_EQUAL;
+    depth_state.depthTestEnable = state->depth_test;
+    depth_state.depthWriteEnable = state->depth_write;
+    depth_state.depthCompareOp = state->depth_compare;
     depth_state.maxDepthBounds = 1.0f;
     return depth_state;
 }
 
-Pipeline CreateGraphicsPipeline(VkDevice device, GraphicsPipelineCreateInfo *pipeline_info)
+VkPipelineColorBlendAttachmentState CreateBlendAttachment(PipelineState *state)
+{
+    VkPipelineColorBlendAttachmentState color_attachment = {};
+    color_attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT 
+                                    | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+
+    if(state->blend_mode != BLEND_OPAQUE)
+    {
+        color_attachment.blendEnable = VK_TRUE;
+        color_attachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+        color_attachment.dstColorBlendFactor = state->blend_mode == BLEND_ADDITIVE ?
+            VK_BLEND_FACTOR_ONE : VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+        color_attachment.colorBlendOp = VK_BLEND_OP_ADD;
+        color_attachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+        color_attachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+        color_attachment.alphaBlendOp = VK_BLEND_OP_ADD;
+    }
+
+    return color_attachment;
+}
+
+PipelineState DefaultPipelineState(void)
+{
+    PipelineState state = {};
+    state.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    state.cull_mode = VK_CULL_MODE_BACK_BIT;
+    state.front_face = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+    state.depth_compare = VK_COMPARE_OP_GREATER_OR_EQUAL;
+    state.depth_test = VK_TRUE;
+    state.depth_write = VK_TRUE;
+    state.blend_mode = BLEND_OPAQUE;
+    return state;
+}
+
+void CmdSetPipelineState(VkCommandBuffer cmd, PipelineState *state)
+{
+    vkCmdSetCullMode(cmd, state->cull_mode);
+    vkCmdSetFrontFace(cmd, state->front_face);
+    vkCmdSetDepthTestEnable(cmd, state->depth_test);
+    vkCmdSetDepthWriteEnable(cmd, state->depth_write);
+    vkCmdSetDepthCompareOp(cmd, state->depth_compare);
+}
+
+Pipeline BuildGraphicsPipeline(VkDevice device, VkPipelineCache cache,
+                               GraphicsPipelineCreateInfo *pipeline_info,
+                               VkShaderModule vertex_module, VkShaderModule pixel_module)
 {
     Pipeline pipeline = {};
     pipeline.layout = pipeline_info->layout;
 
+    PipelineState state = pipeline_info->state ? *pipeline_info->state : DefaultPipelineState();
+
+    // Constant i lives at byte offset 4 * i; both stages see the same block.
+    VkSpecializationMapEntry spec_entries[MAX_SPEC_CONSTANTS];
+    for(u32 i = 0; i < pipeline_info->spec_count; i++)
+    {
+        spec_entries[i].constantID = i;
+        spec_entries[i].offset = i * sizeof(u32);
+        spec_entries[i].size = sizeof(u32);
+    }
+
+    VkSpecializationInfo spec_info = {};
+    spec_info.mapEntryCount = pipeline_info->spec_count;
+    spec_info.pMapEntries = spec_entries;
+    spec_info.dataSize = pipeline_info->spec_count * sizeof(u32);
+    spec_info.pData = pipeline_info->spec_constants;
+
     VkPipelineRenderingCreateInfo rendering = {};
     rendering.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
     rendering.colorAttachmentCount = 1;
@@ -110,38 +190,48 @@ Pipeline CreateGraphicsPipeline(VkDevice device, GraphicsPipelineCreateInfo *pip
         rendering.depthAttachmentFormat = *pipeline_info->depth_format;
     
     VkPipelineShaderStageCreateInfo stages[2] = {};
-    stages[0] = CreateShaderStage(device, pipeline_info->vertex_shader_path, VK_SHADER_STAGE_VERTEX_BIT);
-    stages[1] = CreateShaderStage(device, pipeline_info->pixel_shader_path, VK_SHADER_STAGE_FRAGMENT_BIT);
+    stages[0] = CreateShaderStage(vertex_module, VK_SHADER_STAGE_VERTEX_BIT);
+    stages[1] = CreateShaderStage(pixel_module, VK_SHADER_STAGE_FRAGMENT_BIT);
+    if(pipeline_info->spec_count)
+    {
+        stages[0].pSpecializationInfo = &spec_info;
+        stages[1].pSpecializationInfo = &spec_info;
+    }
 
     VkPipelineVertexInputStateCreateInfo vi_state = CreateVertexInputState(
         pipeline_info->vertex_binding_count, pipeline_info->vertex_bindings,
         pipeline_info->vertex_attribute_count, pipeline_info->vertex_attributes);
     
-    VkPipelineInputAssemblyStateCreateInfo ia_state = CreateInputAssembly();
+    VkPipelineInputAssemblyStateCreateInfo ia_state = CreateInputAssembly(&state);
     VkPipelineViewportStateCreateInfo vp_state = CreateViewportState();
-    VkPipelineRasterizationStateCreateInfo raster = CreateRasterState();
+    VkPipelineRasterizationStateCreateInfo raster = CreateRasterState(&state);
     VkPipelineMultisampleStateCreateInfo ms_state = CreateMultisampleState();
     VkPipelineDepthStencilStateCreateInfo *depth_state = 0;
     VkPipelineDepthStencilStateCreateInfo _depth_state;
     if(pipeline_info->depth_format)
     {
-        _depth_state = CreateDepthStencilState();
+        _depth_state = CreateDepthStencilState(&state);
         depth_state = &_depth_state;
     }
     
-    VkPipelineColorBlendAttachmentState color_attachment = {};
-    color_attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT 
-                                    | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    VkPipelineColorBlendAttachmentState color_attachment = CreateBlendAttachment(&state);
     
     VkPipelineColorBlendStateCreateInfo cb_state = {};
     cb_state.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
     cb_state.attachmentCount = 1;
     cb_state.pAttachments = &color_attachment;
     
-    VkDynamicState dynamic_states[2] = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+    // With extended dynamic state the raster and depth fields above are
+    // only defaults; the real values come from CmdSetPipelineState.
+    VkDynamicState dynamic_states[7] = {
+        VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR,
+        VK_DYNAMIC_STATE_CULL_MODE, VK_DYNAMIC_STATE_FRONT_FACE,
+        VK_DYNAMIC_STATE_DEPTH_TEST_ENABLE, VK_DYNAMIC_STATE_DEPTH_WRITE_ENABLE,
+        VK_DYNAMIC_STATE_DEPTH_COMPARE_OP,
+    };
     VkPipelineDynamicStateCreateInfo dynamic_state = {};
     dynamic_state.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-    dynamic_state.dynamicStateCount = 2;
+    dynamic_state.dynamicStateCount = pipeline_info->dynamic_state ? 7 : 2;
     dynamic_state.pDynamicStates = dynamic_states;
     
     VkGraphicsPipelineCreateInfo gp_info = {};
@@ -159,6 +249,204 @@ Pipeline CreateGraphicsPipeline(VkDevice device, GraphicsPipelineCreateInfo *pip
     gp_info.pDynamicState = &dynamic_state;
     gp_info.layout = pipeline_info->layout.pipe_layout;
     
-    vkCreateGraphicsPipelines(device, 0, 1, &gp_info, 0, &pipeline.pipeline);
+    vkCreateGraphicsPipelines(device, cache, 1, &gp_info, 0, &pipeline.pipeline);
     return pipeline;
 }
+
+struct PipelineBatch
+{
+    VkDevice device;
+    VkPipelineCache cache;
+    GraphicsPipelineCreateInfo *infos;
+    Pipeline *pipelines;
+
+    u32 module_count;
+    const char *module_paths[MAX_PIPELINE_BATCH * 2];
+    VkShaderModule modules[MAX_PIPELINE_BATCH * 2];
+};
+
+static VkShaderModule BatchFindModule(PipelineBatch *batch, const char *file_path)
+{
+    for(u32 i = 0; i < batch->module_count; i++)
+    {
+        if(strcmp(batch->module_paths[i], file_path) == 0)
+        {
+            return batch->modules[i];
+        }
+    }
+
+    return 0;
+}
+
+static void BatchAddModule(PipelineBatch *batch, const char *file_path)
+{
+    if(BatchFindModule(batch, file_path))
+    {
+        return;
+    }
+
+    u32 index = batch->module_count++;
+    batch->module_paths[index] = file_path;
+    batch->modules[index] = LoadShaderModule(batch->device, file_path);
+}
+
+static void BuildPipelineRange(void *data, u32 begin, u32 end)
+{
+    PipelineBatch *batch = (PipelineBatch *)data;
+    for(u32 i = begin; i < end; i++)
+    {
+        GraphicsPipelineCreateInfo *info = &batch->infos[i];
+        batch->pipelines[i] = BuildGraphicsPipeline(batch->device, batch->cache, info,
+                                                    BatchFindModule(batch, info->vertex_shader_path),
+                                                    BatchFindModule(batch, info->pixel_shader_path));
+    }
+}
+
+// Shader modules are loaded once per batch and shared by every pipeline in
+// it. Pipelines then compile one per job; the cache is internally
+// synchronized so all jobs feed the same one.
+void CreateGraphicsPipelines(VkDevice device, VkPipelineCache cache, JobQueue *jobs,
+                             u32 count, GraphicsPipelineCreateInfo *infos, Pipeline *pipelines)
+{
+    PipelineBatch batch = {};
+    batch.device = device;
+    batch.cache = cache;
+    batch.infos = infos;
+    batch.pipelines = pipelines;
+
+    for(u32 begin = 0; begin < count; begin += MAX_PIPELINE_BATCH)
+    {
+        u32 batch_count = count - begin < MAX_PIPELINE_BATCH ? count - begin : MAX_PIPELINE_BATCH;
+        batch.infos = infos + begin;
+        batch.pipelines = pipelines + begin;
+        batch.module_count = 0;
+
+        for(u32 i = 0; i < batch_count; i++)
+        {
+            BatchAddModule(&batch, batch.infos[i].vertex_shader_path);
+            BatchAddModule(&batch, batch.infos[i].pixel_shader_path);
+        }
+
+        JobsParallelFor(jobs, batch_count, 1, BuildPipelineRange, &batch);
+
+        for(u32 i = 0; i < batch.module_count; i++)
+        {
+            vkDestroyShaderModule(device, batch.modules[i], 0);
+        }
+    }
+}
+
+Pipeline CreateGraphicsPipeline(VkDevice device, GraphicsPipelineCreateInfo *pipeline_info)
+{
+    Pipeline pipeline = {};
+    CreateGraphicsPipelines(device, 0, 0, 1, pipeline_info, &pipeline);
+    return pipeline;
+}
+
+// Compute pipelines are few and built once, so they skip the batching.
+VkPipeline CreateComputePipeline(VkDevice device, VkPipelineCache cache, PipelineLayout *layout,
+                                 const char *shader_path)
+{
+    VkShaderModule module = LoadShaderModule(device, shader_path);
+    if(!module)
+    {
+        return 0;
+    }
+
+    VkComputePipelineCreateInfo pipeline_info = {};
+    pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipeline_info.stage = CreateShaderStage(module, VK_SHADER_STAGE_COMPUTE_BIT);
+    pipeline_info.layout = layout->pipe_layout;
+
+    VkPipeline pipeline = 0;
+    vkCreateComputePipelines(device, cache, 1, &pipeline_info, 0, &pipeline);
+    vkDestroyShaderModule(device, module, 0);
+    return pipeline;
+}
+
+struct PipelineCacheHeader
+{
+    u32 magic;
+    u32 version;
+    u32 vendor_id;
+    u32 device_id;
+    u32 driver_version;
+    u8 uuid[VK_UUID_SIZE];
+    u64 data_size;
+    u64 data_hash;
+};
+
+static bool PipelineCacheMatches(PipelineCacheHeader *header, VkPhysicalDeviceProperties *props)
+{
+    return header->magic == PIPELINE_CACHE_MAGIC &&
+           header->version == PIPELINE_CACHE_VERSION &&
+           header->vendor_id == props->vendorID &&
+           header->device_id == props->deviceID &&
+           header->driver_version == props->driverVersion &&
+           memcmp(header->uuid, props->pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+// Data from another driver, another GPU or a torn write is ignored rather
+// than handed to the driver; a cold cache only costs compile time.
+VkPipelineCache CreatePipelineCache(VkPhysicalDevice adapter, VkDevice device, const char *file_path)
+{
+    VkPhysicalDeviceProperties props;
+    vkGetPhysicalDeviceProperties(adapter, &props);
+
+    VkPipelineCacheCreateInfo cache_info = {};
+    cache_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+
+    MappedFile file;
+    if(OsMapFile(file_path, &file) && file.size >= sizeof(PipelineCacheHeader))
+    {
+        PipelineCacheHeader *header = (PipelineCacheHeader *)file.data;
+        if(PipelineCacheMatches(header, &props) &&
+           header->data_size == file.size - sizeof(PipelineCacheHeader) &&
+           header->data_hash == AssetHashBytes(header + 1, header->data_size))
+        {
+            cache_info.initialDataSize = header->data_size;
+            cache_info.pInitialData = header + 1;
+        }
+    }
+
+    VkPipelineCache cache;
+    if(vkCreatePipelineCache(device, &cache_info, 0, &cache) != VK_SUCCESS)
+    {
+        cache_info.initialDataSize = 0;
+        cache_info.pInitialData = 0;
+        vkCreatePipelineCache(device, &cache_info, 0, &cache);
+    }
+
+    OsUnmapFile(&file);
+    return cache;
+}
+
+void SavePipelineCache(VkPhysicalDevice adapter, VkDevice device, VkPipelineCache cache, const char *file_path)
+{
+    size_t data_size = 0;
+    vkGetPipelineCacheData(device, cache, &data_size, 0);
+
+    u64 total = sizeof(PipelineCacheHeader) + data_size;
+    PipelineCacheHeader *header = (PipelineCacheHeader *)OsAllocMemory(total);
+    if(!header || vkGetPipelineCacheData(device, cache, &data_size, header + 1) != VK_SUCCESS)
+    {
+        if(header) OsFreeMemory(header, total);
+        return;
+    }
+
+    VkPhysicalDeviceProperties props;
+    vkGetPhysicalDeviceProperties(adapter, &props);
+
+    *header = {};
+    header->magic = PIPELINE_CACHE_MAGIC;
+    header->version = PIPELINE_CACHE_VERSION;
+    header->vendor_id = props.vendorID;
+    header->device_id = props.deviceID;
+    header->driver_version = props.driverVersion;
+    memcpy(header->uuid, props.pipelineCacheUUID, VK_UUID_SIZE);
+    header->data_size = data_size;
+    header->data_hash = AssetHashBytes(header + 1, data_size);
+
+    OsWriteFileAtomic(file_path, header, total);
+    OsFreeMemory(header, total);
+}
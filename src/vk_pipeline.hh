@@ -2,8 +2,13 @@
 #define VK_PIPELINE_H
 
 #define MAX_SET_LAYOUTS 32
+#define MAX_PIPELINE_BATCH 64
+#define PIPELINE_CACHE_MAGIC 0x48435050
+#define PIPELINE_CACHE_VERSION 1
+#define MAX_SPEC_CONSTANTS 8
 
 #include "types.hh"
+#include "jobs.hh"
 #include <vulkan/vulkan.h>
 
 struct PipelineLayout
@@ -13,6 +18,27 @@ struct PipelineLayout
     VkPipelineLayout pipe_layout;
 };
 
+enum BlendMode
+{
+    BLEND_OPAQUE,
+    BLEND_ALPHA,
+    BLEND_ADDITIVE,
+};
+
+// Fixed function state that varies between permutations. Plain enums so it
+// can be hashed and compared as bytes.
+struct PipelineState
+{
+    VkPrimitiveTopology topology;
+    VkCullModeFlags cull_mode;
+    VkFrontFace front_face;
+    VkCompareOp depth_compare;
+    u8 depth_test;
+    u8 depth_write;
+    u8 blend_mode;
+    u8 pad;
+};
+
 struct GraphicsPipelineCreateInfo
 {
     PipelineLayout layout;
@@ -24,6 +50,11 @@ struct GraphicsPipelineCreateInfo
     VkVertexInputAttributeDescription *vertex_attributes;
     VkFormat *target_format;
     VkFormat *depth_format;
+
+    PipelineState *state;
+    u32 spec_count;
+    u32 *spec_constants;
+    bool dynamic_state;
 };
 
 struct Pipeline
@@ -33,6 +64,21 @@ struct Pipeline
 };
 
 PipelineLayout CreatePipelineLayout(VkDevice device, VkPipelineLayoutCreateInfo *layout_info);
+void DestroyPipelineLayout(VkDevice device, PipelineLayout *layout);
+PipelineState DefaultPipelineState(void);
+void CmdSetPipelineState(VkCommandBuffer cmd, PipelineState *state);
+
+VkShaderModule LoadShaderModule(VkDevice device, const char *file_path);
+Pipeline BuildGraphicsPipeline(VkDevice device, VkPipelineCache cache,
+                               GraphicsPipelineCreateInfo *pipeline_info,
+                               VkShaderModule vertex_module, VkShaderModule pixel_module);
 Pipeline CreateGraphicsPipeline(VkDevice device, GraphicsPipelineCreateInfo *pipeline_info);
+void CreateGraphicsPipelines(VkDevice device, VkPipelineCache cache, JobQueue *jobs,
+                             u32 count, GraphicsPipelineCreateInfo *infos, Pipeline *pipelines);
+VkPipeline CreateComputePipeline(VkDevice device, VkPipelineCache cache, PipelineLayout *layout,
+                                 const char *shader_path);
+
+VkPipelineCache CreatePipelineCache(VkPhysicalDevice adapter, VkDevice device, const char *file_path);
+void SavePipelineCache(VkPhysicalDevice adapter, VkDevice device, VkPipelineCache cache, const char *file_path);
 
 #endif //VK_PIPELINE_H
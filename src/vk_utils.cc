@@ -1,22 +1,73 @@
-#include <windows.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
 
+#include "os.hh"
 #include "vk_utils.hh"
+#include "gpu_memory.hh"
+#include "dds.hh"
 #include <vulkan/vulkan.h>
+#ifdef _WIN32
 #include <vulkan/vulkan_win32.h>
+#endif
 
-VkInstance CreateInstance(void)
+static bool InstanceHasLayer(const char *name)
 {
-    VkInstance instance;
+    u32 count = 0;
+    VkLayerProperties layers[64];
+    vkEnumerateInstanceLayerProperties(&count, 0);
+    if(count > 64) count = 64;
+    vkEnumerateInstanceLayerProperties(&count, layers);
+
+    for(u32 i = 0; i < count; i++)
+    {
+        if(strcmp(layers[i].layerName, name) == 0) return true;
+    }
+
+    return false;
+}
+
+static bool InstanceHasExtension(const char *name)
+{
+    u32 count = 0;
+    VkExtensionProperties extensions[64];
+    vkEnumerateInstanceExtensionProperties(0, &count, 0);
+    if(count > 64) count = 64;
+    vkEnumerateInstanceExtensionProperties(0, &count, extensions);
+
+    for(u32 i = 0; i < count; i++)
+    {
+        if(strcmp(extensions[i].extensionName, name) == 0) return true;
+    }
+
+    return false;
+}
+
+// Surface extensions are only requested when there is a window, and the
+// validation layer only when it is installed, so a headless instance can be
+// created on a bare build host or a software ICD.
+VkInstance CreateInstance(bool surface)
+{
+    VkInstance instance = 0;
 
     VkApplicationInfo app_info = {};
     app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
     app_info.apiVersion = VK_API_VERSION_1_3;
     
-    const char *instance_enabled_extensions[3] = {
-        "VK_KHR_surface",
-        "VK_KHR_win32_surface",
-        "VK_EXT_debug_utils"
-    };
+    u32 extension_count = 0;
+    const char *instance_enabled_extensions[3];
+    if(surface)
+    {
+        instance_enabled_extensions[extension_count++] = "VK_KHR_surface";
+#ifdef _WIN32
+        instance_enabled_extensions[extension_count++] = "VK_KHR_win32_surface";
+#endif
+    }
+
+    if(InstanceHasExtension("VK_EXT_debug_utils"))
+    {
+        instance_enabled_extensions[extension_count++] = "VK_EXT_debug_utils";
+    }
 
     const char *instance_enabled_layers[1] = {
         "VK_LAYER_KHRONOS_validation"
@@ -25,27 +76,83 @@ VkInstance CreateInstance(void)
     VkInstanceCreateInfo inst_info = {};
     inst_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
     inst_info.pApplicationInfo = &app_info;
-    inst_info.enabledExtensionCount = 3;
+    inst_info.enabledExtensionCount = extension_count;
     inst_info.ppEnabledExtensionNames = instance_enabled_extensions;
-    inst_info.enabledLayerCount = 1;
+    inst_info.enabledLayerCount = InstanceHasLayer(instance_enabled_layers[0]) ? 1 : 0;
     inst_info.ppEnabledLayerNames = instance_enabled_layers;
 
     vkCreateInstance(&inst_info, 0, &instance);
     return instance;
 }
 
-VkSurfaceKHR CreateSurface(VkInstance instance, HWND window)
+VkSurfaceKHR CreateSurface(VkInstance instance, void *window)
 {
-    VkSurfaceKHR surface;
-    
+    VkSurfaceKHR surface = 0;
+
+#ifdef _WIN32
     VkWin32SurfaceCreateInfoKHR surf_info = {};
     surf_info.sType = VK_STRUCTURE_TYPE_WIN32_SURFACE_CREATE_INFO_KHR;
-    surf_info.hwnd = window;
+    surf_info.hwnd = (HWND)window;
 
     vkCreateWin32SurfaceKHR(instance, &surf_info, 0, &surface);
+#endif
     return surface;
 }
 
+// Features the renderer has no fallback for: bindless textures, depth-only
+// layouts, timeline semaphores, sync2 barriers and dynamic rendering.
+// Returns the first one the adapter lacks, or 0.
+static const char *MissingDeviceFeature(VkPhysicalDevice adapter)
+{
+    VkPhysicalDeviceVulkan12Features vulkan12 = {};
+    vulkan12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
+    VkPhysicalDeviceSynchronization2Features synchronization2 = {};
+    synchronization2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES;
+    synchronization2.pNext = &vulkan12;
+
+    VkPhysicalDeviceDynamicRenderingFeatures dynamic_rendering = {};
+    dynamic_rendering.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES;
+    dynamic_rendering.pNext = &synchronization2;
+
+    VkPhysicalDeviceFeatures2 supported = {};
+    supported.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    supported.pNext = &dynamic_rendering;
+    vkGetPhysicalDeviceFeatures2(adapter, &supported);
+
+    struct RequiredFeature
+    {
+        VkBool32 supported;
+        const char *name;
+    };
+
+    RequiredFeature required[] =
+    {
+        {vulkan12.descriptorIndexing, "descriptorIndexing"},
+        {vulkan12.runtimeDescriptorArray, "runtimeDescriptorArray"},
+        {vulkan12.descriptorBindingPartiallyBound, "descriptorBindingPartiallyBound"},
+        {vulkan12.descriptorBindingSampledImageUpdateAfterBind, "descriptorBindingSampledImageUpdateAfterBind"},
+        {vulkan12.shaderSampledImageArrayNonUniformIndexing, "shaderSampledImageArrayNonUniformIndexing"},
+        {vulkan12.separateDepthStencilLayouts, "separateDepthStencilLayouts"},
+        {vulkan12.timelineSemaphore, "timelineSemaphore"},
+        {synchronization2.synchronization2, "synchronization2"},
+        {dynamic_rendering.dynamicRendering, "dynamicRendering"},
+    };
+
+    for(u32 i = 0; i < sizeof(required) / sizeof(required[0]); i++)
+    {
+        if(!required[i].supported)
+        {
+            return required[i].name;
+        }
+    }
+
+    return 0;
+}
+
+// Adapters missing a required feature are skipped, so a capable second GPU
+// still gets picked. With none left there is nothing to fall back to, and
+// vkCreateDevice would only fail with VK_ERROR_FEATURE_NOT_PRESENT later.
 Device CreateDevice(VkInstance instance, VkSurfaceKHR surface)
 {
     Device device = {};
@@ -58,6 +165,15 @@ Device CreateDevice(VkInstance instance, VkSurfaceKHR surface)
     for(int i = 0; i < adapter_count; i++)
     {
         VkPhysicalDevice adapter = adapters[i];
+        const char *missing = MissingDeviceFeature(adapter);
+        if(missing)
+        {
+            VkPhysicalDeviceProperties props;
+            vkGetPhysicalDeviceProperties(adapter, &props);
+            printf("%s does not support %s, skipping it\n", props.deviceName, missing);
+            continue;
+        }
+
         uint32_t queue_fam_prop_count = 0;
         VkQueueFamilyProperties queue_fam_props[16];
         vkGetPhysicalDeviceQueueFamilyProperties(adapter, &queue_fam_prop_count, 0);
@@ -69,11 +185,16 @@ Device CreateDevice(VkInstance instance, VkSurfaceKHR surface)
             VkQueueFamilyProperties queue_fam_prop = queue_fam_props[j];
             if((queue_fam_prop.queueFlags & VK_QUEUE_GRAPHICS_BIT))
             {
-                VkBool32 supported = false;
-                vkGetPhysicalDeviceSurfaceSupportKHR(adapter, j, surface, &supported);
+                VkBool32 supported = surface == 0;
+                if(surface)
+                {
+                    vkGetPhysicalDeviceSurfaceSupportKHR(adapter, j, surface, &supported);
+                }
+
                 if(supported)
                 {
                     device.queue_family_index = j;
+                    device.sparse_residency = (queue_fam_prop.queueFlags & VK_QUEUE_SPARSE_BINDING_BIT) != 0;
                     found_adapter = true;
                     break;
                 }
@@ -85,43 +206,252 @@ Device CreateDevice(VkInstance instance, VkSurfaceKHR surface)
             device.adapter = adapter;
             break;
         }
+    }
+
+    if(!device.adapter)
+    {
+        printf("no Vulkan device can run this renderer\n");
+        exit(1);
     }
 
-    float queue_priority[1] = {1.0f};
-    VkDeviceQueueCreateInfo queue_info = {};
-    queue_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-    queue_info.queueCount = 1;
-    queue_info.pQueuePriorities = queue_priority;
-    queue_info.queueFamilyIndex = device.queue_family_index;
-
+    // Async compute prefers a family without graphics, which on most desktop
+    // parts is scheduled alongside the graphics queue; a second queue of the
+    // graphics family is the next best thing. Transfer only takes a family
+    // that does nothing but copies, since anything else would just be
+    // another graphics or compute queue.
+    u32 family_count = 0;
+    VkQueueFamilyProperties families[16];
+    vkGetPhysicalDeviceQueueFamilyProperties(device.adapter, &family_count, 0);
+    if(family_count > 16) family_count = 16;
+    vkGetPhysicalDeviceQueueFamilyProperties(device.adapter, &family_count, families);
+
+    device.compute_family_index = device.queue_family_index;
+    device.transfer_family_index = device.queue_family_index;
+    for(u32 i = 0; i < family_count; i++)
+    {
+        VkQueueFlags flags = families[i].queueFlags;
+        if(device.compute_family_index == device.queue_family_index &&
+           (flags & VK_QUEUE_COMPUTE_BIT) && !(flags & VK_QUEUE_GRAPHICS_BIT))
+        {
+            device.compute_family_index = i;
+        }
+
+        if(device.transfer_family_index == device.queue_family_index &&
+           (flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)))
+        {
+            device.transfer_family_index = i;
+        }
+    }
+
+    u32 compute_queue_index = 0;
+    if(device.compute_family_index == device.queue_family_index &&
+       families[device.queue_family_index].queueCount > 1)
+    {
+        compute_queue_index = 1;
+    }
+
+    device.async_compute = device.compute_family_index != device.queue_family_index || compute_queue_index != 0;
+
+    float queue_priority[2] = {1.0f, 1.0f};
+    u32 queue_info_count = 0;
+    VkDeviceQueueCreateInfo queue_infos[3] = {};
+    queue_infos[queue_info_count].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+    queue_infos[queue_info_count].queueCount = 1 + compute_queue_index;
+    queue_infos[queue_info_count].pQueuePriorities = queue_priority;
+    queue_infos[queue_info_count].queueFamilyIndex = device.queue_family_index;
+    queue_info_count++;
+
+    if(device.compute_family_index != device.queue_family_index)
+    {
+        queue_infos[queue_info_count].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+        queue_infos[queue_info_count].queueCount = 1;
+        queue_infos[queue_info_count].pQueuePriorities = queue_priority;
+        queue_infos[queue_info_count].queueFamilyIndex = device.compute_family_index;
+        queue_info_count++;
+    }
+
+    if(device.transfer_family_index != device.queue_family_index)
+    {
+        queue_infos[queue_info_count].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+        queue_infos[queue_info_count].queueCount = 1;
+        queue_infos[queue_info_count].pQueuePriorities = queue_priority;
+        queue_infos[queue_info_count].queueFamilyIndex = device.transfer_family_index;
+        queue_info_count++;
+    }
+
+    VkPhysicalDeviceVulkan12Features descriptor_indexing = {};
+    descriptor_indexing.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    descriptor_indexing.descriptorIndexing = VK_TRUE;
+    descriptor_indexing.runtimeDescriptorArray = VK_TRUE;
+    descriptor_indexing.descriptorBindingPartiallyBound = VK_TRUE;
+    descriptor_indexing.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+    descriptor_indexing.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+    descriptor_indexing.separateDepthStencilLayouts = VK_TRUE;
+    descriptor_indexing.timelineSemaphore = VK_TRUE;
+
+    VkPhysicalDeviceSynchronization2Features synchronization2 = {};
+    synchronization2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES;
+    synchronization2.pNext = &descriptor_indexing;
+    synchronization2.synchronization2 = VK_TRUE;
+
     VkPhysicalDeviceDynamicRenderingFeatures dynamic_rendering = {};
     dynamic_rendering.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES;
+    dynamic_rendering.pNext = &synchronization2;
     dynamic_rendering.dynamicRendering = VK_TRUE;
+
+    // Present wait lets the latency mode block until the last frame is on
+    // screen. Calibrated timestamps line GPU profiler zones up with the CPU
+    // clock. Memory budget reports the driver's per-heap budget and usage
+    // instead of VMA estimating them. All of these are optional.
+    u32 extension_count = 0;
+    VkExtensionProperties extensions[256];
+    vkEnumerateDeviceExtensionProperties(device.adapter, 0, &extension_count, 0);
+    if(extension_count > 256) extension_count = 256;
+    vkEnumerateDeviceExtensionProperties(device.adapter, 0, &extension_count, extensions);
+
+    bool has_present_id = false;
+    bool has_present_wait = false;
+    bool has_calibrated_timestamps = false;
+    bool has_memory_budget = false;
+    for(u32 i = 0; i < extension_count; i++)
+    {
+        has_present_id |= strcmp(extensions[i].extensionName, VK_KHR_PRESENT_ID_EXTENSION_NAME) == 0;
+        has_present_wait |= strcmp(extensions[i].extensionName, VK_KHR_PRESENT_WAIT_EXTENSION_NAME) == 0;
+        has_calibrated_timestamps |= strcmp(extensions[i].extensionName, VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME) == 0;
+        has_memory_budget |= strcmp(extensions[i].extensionName, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0;
+    }
+
+    VkPhysicalDevicePresentWaitFeaturesKHR present_wait = {};
+    present_wait.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+
+    VkPhysicalDevicePresentIdFeaturesKHR present_id = {};
+    present_id.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+    present_id.pNext = &present_wait;
+
+    if(has_present_id && has_present_wait)
+    {
+        VkPhysicalDeviceFeatures2 supported = {};
+        supported.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        supported.pNext = &present_id;
+        vkGetPhysicalDeviceFeatures2(device.adapter, &supported);
+    }
+
+    u32 device_extension_count = 0;
+    const char *device_enabled_extension[5];
+    if(surface)
+    {
+        device_enabled_extension[device_extension_count++] = "VK_KHR_swapchain";
+    }
+
+    if(has_calibrated_timestamps)
+    {
+        device_enabled_extension[device_extension_count++] = VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME;
+    }
+
+    if(has_memory_budget)
+    {
+        device_enabled_extension[device_extension_count++] = VK_EXT_MEMORY_BUDGET_EXTENSION_NAME;
+        device.memory_budget = true;
+    }
+
+    bool enable_present_wait = surface && present_id.presentId && present_wait.presentWait;
+    if(enable_present_wait)
+    {
+        device_enabled_extension[device_extension_count++] = VK_KHR_PRESENT_ID_EXTENSION_NAME;
+        device_enabled_extension[device_extension_count++] = VK_KHR_PRESENT_WAIT_EXTENSION_NAME;
+        present_wait.pNext = dynamic_rendering.pNext;
+        dynamic_rendering.pNext = &present_id;
+    }
+
+    VkPhysicalDeviceProperties props;
+    vkGetPhysicalDeviceProperties(device.adapter, &props);
+    device.extended_dynamic_state = props.apiVersion >= VK_API_VERSION_1_3;
+
+    VkPhysicalDeviceFeatures supported_features = {};
+    vkGetPhysicalDeviceFeatures(device.adapter, &supported_features);
+
+    VkPhysicalDeviceFeatures features = {};
+    if(device.sparse_residency && supported_features.sparseBinding && supported_features.sparseResidencyImage2D)
+    {
+        features.sparseBinding = VK_TRUE;
+        features.sparseResidencyImage2D = VK_TRUE;
+    }
+
+    else
+    {
+        device.sparse_residency = false;
+    }
     
-    const char *device_enabled_extension[1] = {"VK_KHR_swapchain"};
     VkDeviceCreateInfo dev_info = {};
     dev_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
     dev_info.pNext = &dynamic_rendering;
-    dev_info.enabledExtensionCount = 1;
+    dev_info.enabledExtensionCount = device_extension_count;
     dev_info.ppEnabledExtensionNames = device_enabled_extension;
-    dev_info.queueCreateInfoCount = 1;
-    dev_info.pQueueCreateInfos = &queue_info;
+    dev_info.queueCreateInfoCount = queue_info_count;
+    dev_info.pQueueCreateInfos = queue_infos;
+    dev_info.pEnabledFeatures = &features;
     
     vkCreateDevice(device.adapter, &dev_info, 0, &device.device);
     vkGetDeviceQueue(device.device, device.queue_family_index, 0, &device.queue);
+    vkGetDeviceQueue(device.device, device.compute_family_index, compute_queue_index, &device.compute_queue);
+    vkGetDeviceQueue(device.device, device.transfer_family_index, 0, &device.transfer_queue);
+
+    if(enable_present_wait)
+    {
+        device.wait_for_present = (PFN_vkWaitForPresentKHR)vkGetDeviceProcAddr(device.device, "vkWaitForPresentKHR");
+    }
+
+    if(has_calibrated_timestamps)
+    {
+        device.get_calibrated_timestamps = (PFN_vkGetCalibratedTimestampsEXT)vkGetDeviceProcAddr(device.device, "vkGetCalibratedTimestampsEXT");
+    }
 
     VmaAllocatorCreateInfo allocator_info = {};
     allocator_info.vulkanApiVersion = VK_API_VERSION_1_3;
     allocator_info.instance = instance;
     allocator_info.physicalDevice = device.adapter;
     allocator_info.device = device.device;
+    if(device.memory_budget)
+    {
+        allocator_info.flags |= VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT;
+    }
 
     vmaCreateAllocator(&allocator_info, &device.allocator);
     
     return device;
 }
 
-SwapChain CreateSwapChain(Device device, VkSurfaceKHR surface)
+// Falls back towards FIFO, the only mode every surface must support.
+// IMMEDIATE prefers MAILBOX over FIFO since both avoid blocking on vblank.
+static VkPresentModeKHR ChoosePresentMode(Device device, VkSurfaceKHR surface, VkPresentModeKHR requested)
+{
+    u32 mode_count = 0;
+    VkPresentModeKHR modes[16];
+    vkGetPhysicalDeviceSurfacePresentModesKHR(device.adapter, surface, &mode_count, 0);
+    if(mode_count > 16) mode_count = 16;
+    vkGetPhysicalDeviceSurfacePresentModesKHR(device.adapter, surface, &mode_count, modes);
+
+    VkPresentModeKHR candidates[3] = {requested, VK_PRESENT_MODE_FIFO_KHR, VK_PRESENT_MODE_FIFO_KHR};
+    if(requested == VK_PRESENT_MODE_IMMEDIATE_KHR)
+    {
+        candidates[1] = VK_PRESENT_MODE_MAILBOX_KHR;
+    }
+
+    for(u32 i = 0; i < 3; i++)
+    {
+        for(u32 j = 0; j < mode_count; j++)
+        {
+            if(modes[j] == candidates[i])
+            {
+                return candidates[i];
+            }
+        }
+    }
+
+    return VK_PRESENT_MODE_FIFO_KHR;
+}
+
+SwapChain CreateSwapChain(Device device, VkSurfaceKHR surface, VkPresentModeKHR present_mode)
 {
     SwapChain swapchain = {};
     
@@ -141,6 +471,7 @@ SwapChain CreateSwapChain(Device device, VkSurfaceKHR surface)
     vkGetPhysicalDeviceSurfaceFormatsKHR(device.adapter, surface, &surf_format_count, 0);
     vkGetPhysicalDeviceSurfaceFormatsKHR(device.adapter, surface, &surf_format_count, surf_formats);
     swapchain.swap_format = surf_formats[0].format;
+    swapchain.present_mode = ChoosePresentMode(device, surface, present_mode);
     
     VkSwapchainCreateInfoKHR swap_info = {};
     swap_info.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
@@ -150,18 +481,24 @@ SwapChain CreateSwapChain(Device device, VkSurfaceKHR surface)
     swap_info.imageColorSpace = surf_formats[0].colorSpace;
     swap_info.imageExtent = surf_caps.currentExtent;
     swap_info.imageArrayLayers = 1;
-    swap_info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    // Transfer destination where the surface allows it, for upscaling a
+    // scene rendered at a lower resolution.
+    swapchain.image_usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+                            (surf_caps.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+    swap_info.imageUsage = swapchain.image_usage;
     swap_info.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
     swap_info.preTransform = surf_caps.currentTransform;
     swap_info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
-    swap_info.presentMode = VK_PRESENT_MODE_FIFO_KHR;
+    swap_info.presentMode = swapchain.present_mode;
     swap_info.clipped = VK_TRUE;
     
     vkCreateSwapchainKHR(device.device, &swap_info, 0, &swapchain.swapchain);
 
     uint32_t swap_image_count = 0;
     vkGetSwapchainImagesKHR(device.device, swapchain.swapchain, &swap_image_count, 0);
+    if(swap_image_count > MAX_SWAP_IMAGE) swap_image_count = MAX_SWAP_IMAGE;
     vkGetSwapchainImagesKHR(device.device, swapchain.swapchain, &swap_image_count, swapchain.swap_images);
+    swapchain.image_count = swap_image_count;
 
     VkImageViewCreateInfo img_view_info = {};
     img_view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -180,14 +517,14 @@ SwapChain CreateSwapChain(Device device, VkSurfaceKHR surface)
     return swapchain;
 }
 
-Command CreateCommand(Device device)
+Command CreateCommand(Device device, u32 queue_family_index)
 {
     Command command = {};
 
     VkCommandPoolCreateInfo pool_info = {};
     pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
     pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-    pool_info.queueFamilyIndex = device.queue_family_index;
+    pool_info.queueFamilyIndex = queue_family_index;
     
     vkCreateCommandPool(device.device, &pool_info, 0, &command.pool);
 
@@ -204,62 +541,72 @@ Command CreateCommand(Device device)
 
 SyncStructs CreateSyncStructs(Device device)
 {
-    SyncStructs sync;
-    
-    VkFenceCreateInfo fence_info = {};
-    fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+    SyncStructs sync = {};
+
+    VkSemaphoreTypeCreateInfo type_info = {};
+    type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
 
     VkSemaphoreCreateInfo sema_info = {};
     sema_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    sema_info.pNext = &type_info;
+    vkCreateSemaphore(device.device, &sema_info, 0, &sync.timeline);
 
+    sema_info.pNext = 0;
     for(int i = 0; i < MAX_FRAMES; i++)
     {
-        vkCreateFence(device.device, &fence_info, 0, &sync.fences[i]);
         vkCreateSemaphore(device.device, &sema_info, 0, &sync.acq_semas[i]);
+    }
+
+    for(int i = 0; i < MAX_SWAP_IMAGE; i++)
+    {
         vkCreateSemaphore(device.device, &sema_info, 0, &sync.pres_semas[i]);
     }
 
     return sync;
 }
 
-struct DDSPixelFormat
-{
-    u32 size;
-    u32 flags;
-    u32 four_cc;
-    u32 rgb_bit_count;
-    u32 r_bit_mask;
-    u32 g_bit_mask;
-    u32 b_bit_mask;
-    u32 a_bit_mask;
-};
-
-struct DDSHeader
-{
-    u32 size;
-    u32 flags;
-    u32 height;
-    u32 width;
-    u32 pitch_or_linear_size;
-    u32 depth;
-    u32 mip_map_count;
-    u32 reserved1[11];
-    DDSPixelFormat ddspf;
-    u32 caps;
-    u32 caps2;
-    u32 caps3;
-    u32 caps4;
-    u32 reserved;
-};
-
-struct DDSFile
-{
-    char magic[4];
-    DDSHeader header;
-    char data_begin;
-};
-
+// Everything allocated from the device has to be gone by now.
+void DestroyDevice(Device *device)
+{
+    vmaDestroyAllocator(device->allocator);
+    vkDestroyDevice(device->device, 0);
+    *device = {};
+}
+
+void DestroySwapChain(Device device, SwapChain *swapchain)
+{
+    for(u32 i = 0; i < swapchain->image_count; i++)
+    {
+        vkDestroyImageView(device.device, swapchain->swap_views[i], 0);
+    }
+
+    vkDestroySwapchainKHR(device.device, swapchain->swapchain, 0);
+    *swapchain = {};
+}
+
+void DestroyCommand(Device device, Command *command)
+{
+    vkDestroyCommandPool(device.device, command->pool, 0);
+    *command = {};
+}
+
+void DestroySyncStructs(Device device, SyncStructs *sync)
+{
+    vkDestroySemaphore(device.device, sync->timeline, 0);
+    for(u32 i = 0; i < MAX_FRAMES; i++)
+    {
+        vkDestroySemaphore(device.device, sync->acq_semas[i], 0);
+    }
+
+    for(u32 i = 0; i < MAX_SWAP_IMAGE; i++)
+    {
+        vkDestroySemaphore(device.device, sync->pres_semas[i], 0);
+    }
+
+    *sync = {};
+}
+
 Texture CreateTexture(Device device, VkFormat format,
                       VkImageUsageFlags usage, u32 width,
                       u32 height, u32 mip_count)
@@ -303,25 +650,75 @@ Texture CreateTexture(Device device, VkFormat format,
 
     vkCreateImageView(device.device, &view_info, 0, &texture.view);
     return texture;
+}
+
+// Whoever tracked the allocation releases it from GpuMemory first.
+void DestroyTexture(Device device, Texture *texture)
+{
+    if(texture->view)
+    {
+        vkDestroyImageView(device.device, texture->view, 0);
+    }
+
+    if(texture->image)
+    {
+        vmaDestroyImage(device.allocator, texture->image, texture->alloc);
+    }
+
+    *texture = {};
 }
 
+// D16_UNORM_S8_UINT is missing on many desktop and software drivers. Only
+// the depth aspect is used, so any of these will do.
+VkFormat ChooseDepthFormat(Device device)
+{
+    VkFormat candidates[4] = {
+        VK_FORMAT_D16_UNORM_S8_UINT,
+        VK_FORMAT_D16_UNORM,
+        VK_FORMAT_D32_SFLOAT,
+        VK_FORMAT_D24_UNORM_S8_UINT,
+    };
+
+    for(u32 i = 0; i < 4; i++)
+    {
+        VkFormatProperties props;
+        vkGetPhysicalDeviceFormatProperties(device.adapter, candidates[i], &props);
+        if(props.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT)
+        {
+            return candidates[i];
+        }
+    }
+
+    return VK_FORMAT_D32_SFLOAT;
+}
+
+VkFormat DDSToVkFormat(DDSFormat format)
+{
+    switch(format)
+    {
+        case DDS_FORMAT_BC1: return VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+        case DDS_FORMAT_BC1_SRGB: return VK_FORMAT_BC1_RGBA_SRGB_BLOCK;
+        case DDS_FORMAT_BC4: return VK_FORMAT_BC4_UNORM_BLOCK;
+        case DDS_FORMAT_BC5: return VK_FORMAT_BC5_UNORM_BLOCK;
+        case DDS_FORMAT_BC7: return VK_FORMAT_BC7_UNORM_BLOCK;
+        case DDS_FORMAT_BC7_SRGB: return VK_FORMAT_BC7_SRGB_BLOCK;
+        default: return VK_FORMAT_UNDEFINED;
+    }
+}
+
 Texture LoadTextreFromDDS(Device device, Command command, const char *file_path)
 {
-    HANDLE hfile = CreateFile(file_path, GENERIC_READ, 0, 0, OPEN_EXISTING, 0, 0);
-    LARGE_INTEGER fsize; GetFileSizeEx(hfile, &fsize);
-    HANDLE hmap = CreateFileMapping(hfile, 0, PAGE_READONLY, 0, 0, 0);
-    DDSFile *buffer = (DDSFile *)MapViewOfFile(hmap, FILE_MAP_READ, 0, 0, fsize.QuadPart);
-
-    VkDeviceSize buffer_size = 0;
-    int w = buffer->header.width;
-    int h = buffer->header.height;
-    int block_size = 8;
-    for(int i = 0; i < buffer->header.mip_map_count; i++)
+    MappedFile file;
+    OsMapFile(file_path, &file);
+
+    DDSInfo dds;
+    if(!file.data || !DDSParse(file.data, file.size, &dds))
     {
-        int size = ((w + 3) / 4) * ((h + 3) / 4) * block_size;
-        buffer_size += size;
-        w /= 2; h /= 2;
+        OsUnmapFile(&file);
+        return {};
     }
+
+    VkDeviceSize buffer_size = dds.data_size;
 
     VkBufferCreateInfo staging_info = {};
     staging_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -341,16 +738,18 @@ Texture LoadTextreFromDDS(Device device, Command command, const char *file_path)
 
     void *staging_data;
     vmaMapMemory(device.allocator, staging_alloc, &staging_data);
-    memcpy(staging_data, &buffer->data_begin, buffer_size);
+    memcpy(staging_data, dds.data, buffer_size);
     vmaUnmapMemory(device.allocator, staging_alloc);
+    OsUnmapFile(&file);
         
-    VkFormat tex_format = VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+    VkFormat tex_format = DDSToVkFormat(dds.format);
     VkImageUsageFlags tex_usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
-    u32 width = buffer->header.width;
-    u32 height = buffer->header.height;
-    u32 mip_count = buffer->header.mip_map_count;
+    u32 width = dds.width;
+    u32 height = dds.height;
+    u32 mip_count = dds.mip_count;
 
     Texture texture = CreateTexture(device, tex_format, tex_usage, width, height, mip_count);
+    GpuMemoryTrack(device, GPU_MEMORY_TEXTURE, texture.alloc);
     
     VkCommandBufferBeginInfo begin = {};
     begin.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
@@ -369,12 +768,12 @@ Texture LoadTextreFromDDS(Device device, Command command, const char *file_path)
 
     TransitionImage(command.cmds[0], &trans_info);
 
-    int offset = 0;
-    w = buffer->header.width;
-    h = buffer->header.height;
+    VkDeviceSize offset = 0;
+    u32 w = dds.width;
+    u32 h = dds.height;
     for(int i = 0; i < mip_count; i++)
     {
-        int size = ((w + 3) / 4) * ((h + 3) / 4) * block_size;
+        VkDeviceSize size = DDSMipSize(w, h, dds.block_size);
 
         VkBufferImageCopy region = {};
         region.bufferOffset = offset;
@@ -389,7 +788,8 @@ Texture LoadTextreFromDDS(Device device, Command command, const char *file_path)
 
         vkCmdCopyBufferToImage(command.cmds[0], staging, texture.image,
                                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
-        w /= 2; h /= 2;
+        w = w > 1 ? w / 2 : 1;
+        h = h > 1 ? h / 2 : 1;
     }
 
     trans_info.old_layout = trans_info.new_layout;
@@ -426,6 +826,7 @@ void TransitionImage(VkCommandBuffer cmd, TransitionImageInfo *transition)
     barrier.newLayout = transition->new_layout;
     barrier.image = transition->image;
     barrier.subresourceRange.aspectMask = transition->aspect_mask;
+    barrier.subresourceRange.baseMipLevel = transition->base_mip;
     barrier.subresourceRange.levelCount = transition->mip_count;
     barrier.subresourceRange.layerCount = 1;
 
@@ -433,3 +834,80 @@ void TransitionImage(VkCommandBuffer cmd, TransitionImageInfo *transition)
                          transition->dst_stage_mask,
                          0, 0, 0, 0, 0, 1, &barrier);
 }
+
+static void QueueTransferBarrier(VkCommandBuffer cmd, QueueTransfer *transfer,
+                                 VkPipelineStageFlags2 src_stages, VkAccessFlags2 src_access,
+                                 VkPipelineStageFlags2 dst_stages, VkAccessFlags2 dst_access)
+{
+    u32 src_family = VK_QUEUE_FAMILY_IGNORED;
+    u32 dst_family = VK_QUEUE_FAMILY_IGNORED;
+    if(transfer->src_family != transfer->dst_family)
+    {
+        src_family = transfer->src_family;
+        dst_family = transfer->dst_family;
+    }
+
+    VkBufferMemoryBarrier2 buffer_barrier = {};
+    VkImageMemoryBarrier2 image_barrier = {};
+    VkDependencyInfo dependency = {};
+    dependency.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    if(transfer->buffer)
+    {
+        buffer_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2;
+        buffer_barrier.srcStageMask = src_stages;
+        buffer_barrier.srcAccessMask = src_access;
+        buffer_barrier.dstStageMask = dst_stages;
+        buffer_barrier.dstAccessMask = dst_access;
+        buffer_barrier.srcQueueFamilyIndex = src_family;
+        buffer_barrier.dstQueueFamilyIndex = dst_family;
+        buffer_barrier.buffer = transfer->buffer;
+        buffer_barrier.size = VK_WHOLE_SIZE;
+        dependency.bufferMemoryBarrierCount = 1;
+        dependency.pBufferMemoryBarriers = &buffer_barrier;
+    }
+
+    else
+    {
+        image_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+        image_barrier.srcStageMask = src_stages;
+        image_barrier.srcAccessMask = src_access;
+        image_barrier.dstStageMask = dst_stages;
+        image_barrier.dstAccessMask = dst_access;
+        image_barrier.oldLayout = transfer->old_layout;
+        image_barrier.newLayout = transfer->new_layout;
+        image_barrier.srcQueueFamilyIndex = src_family;
+        image_barrier.dstQueueFamilyIndex = dst_family;
+        image_barrier.image = transfer->image;
+        image_barrier.subresourceRange.aspectMask = transfer->aspect;
+        image_barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+        image_barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+        dependency.imageMemoryBarrierCount = 1;
+        dependency.pImageMemoryBarriers = &image_barrier;
+    }
+
+    vkCmdPipelineBarrier2(cmd, &dependency);
+}
+
+// The destination half of a release is ignored by the spec and left empty;
+// the semaphore wait on the other queue provides it.
+void QueueRelease(VkCommandBuffer cmd, QueueTransfer *transfer)
+{
+    if(transfer->src_family == transfer->dst_family)
+    {
+        QueueTransferBarrier(cmd, transfer, transfer->src_stages, transfer->src_access,
+                             transfer->dst_stages, transfer->dst_access);
+        return;
+    }
+
+    QueueTransferBarrier(cmd, transfer, transfer->src_stages, transfer->src_access, VK_PIPELINE_STAGE_2_NONE, 0);
+}
+
+void QueueAcquire(VkCommandBuffer cmd, QueueTransfer *transfer)
+{
+    if(transfer->src_family == transfer->dst_family)
+    {
+        return;
+    }
+
+    QueueTransferBarrier(cmd, transfer, VK_PIPELINE_STAGE_2_NONE, 0, transfer->dst_stages, transfer->dst_access);
+}
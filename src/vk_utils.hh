@@ -2,21 +2,39 @@
 #define VK_UTILS_H
 
 #define MAX_SWAP_IMAGE 16
-#define MAX_FRAMES 2
+#define MAX_FRAMES 3
 
-#include <windows.h>
 #include <vulkan/vulkan.h>
 
 #include "types.hh"
+#include "dds.hh"
 #include "third_party/vk_mem_alloc.h"
 
+struct GpuMemory;
+
+// memory is owned by whoever creates it after the device and is null until
+// then; allocations made before that are simply not attributed.
+// The compute and transfer queues are the graphics queue itself when the
+// device has nothing better; async_compute is only set when compute work
+// really runs on a queue of its own.
 struct Device
 {
     VkPhysicalDevice adapter;
     VkDevice device;
     VkQueue queue;
     uint32_t queue_family_index;
+    VkQueue compute_queue;
+    u32 compute_family_index;
+    VkQueue transfer_queue;
+    u32 transfer_family_index;
+    bool async_compute;
     VmaAllocator allocator;
+    bool sparse_residency;
+    bool extended_dynamic_state;
+    bool memory_budget;
+    GpuMemory *memory;
+    PFN_vkWaitForPresentKHR wait_for_present;
+    PFN_vkGetCalibratedTimestampsEXT get_calibrated_timestamps;
 };
 
 struct SwapChain
@@ -26,6 +44,9 @@ struct SwapChain
     VkImageView swap_views[MAX_SWAP_IMAGE];
     VkRect2D render_area;
     VkFormat swap_format;
+    VkImageUsageFlags image_usage;
+    u32 image_count;
+    VkPresentModeKHR present_mode;
 };
 
 struct Command
@@ -34,11 +55,16 @@ struct Command
     VkCommandBuffer cmds[MAX_FRAMES];
 };
 
+// One timeline semaphore counts submitted frames. A frame slot can be
+// reused once the timeline reaches the value it was last submitted with.
+// Present semaphores belong to swapchain images, since an image is only
+// handed back after its previous present has consumed the semaphore.
 struct SyncStructs
 {
-    VkFence fences[MAX_FRAMES];
+    VkSemaphore timeline;
+    u64 frame_values[MAX_FRAMES];
     VkSemaphore acq_semas[MAX_FRAMES];
-    VkSemaphore pres_semas[MAX_FRAMES];
+    VkSemaphore pres_semas[MAX_SWAP_IMAGE];
 };
 
 struct Texture
@@ -60,22 +86,52 @@ struct TransitionImageInfo
     VkImageAspectFlags aspect_mask;
     VkPipelineStageFlags src_stage_mask;
     VkPipelineStageFlags dst_stage_mask;
+    u32 base_mip;
     u32 mip_count;
 };
 
-VkInstance CreateInstance(void);
-VkSurfaceKHR CreateSurface(VkInstance instance, HWND window);
+// A queue family ownership transfer, or a plain barrier when both families
+// are the same. The release is recorded on the source queue and the
+// acquire, with the same description, on the destination queue after a
+// semaphore wait; only the release side records anything within a family.
+// Images move with all their mips and layers.
+struct QueueTransfer
+{
+    VkBuffer buffer;
+    VkImage image;
+    VkImageAspectFlags aspect;
+    VkImageLayout old_layout;
+    VkImageLayout new_layout;
+    VkPipelineStageFlags2 src_stages;
+    VkAccessFlags2 src_access;
+    VkPipelineStageFlags2 dst_stages;
+    VkAccessFlags2 dst_access;
+    u32 src_family;
+    u32 dst_family;
+};
+
+VkInstance CreateInstance(bool surface);
+VkSurfaceKHR CreateSurface(VkInstance instance, void *window);
 Device CreateDevice(VkInstance instance, VkSurfaceKHR surface);
-SwapChain CreateSwapChain(Device device, VkSurfaceKHR surface);
-Command CreateCommand(Device device);
+SwapChain CreateSwapChain(Device device, VkSurfaceKHR surface, VkPresentModeKHR present_mode);
+Command CreateCommand(Device device, u32 queue_family_index);
 SyncStructs CreateSyncStructs(Device device);
+void DestroyDevice(Device *device);
+void DestroySwapChain(Device device, SwapChain *swapchain);
+void DestroyCommand(Device device, Command *command);
+void DestroySyncStructs(Device device, SyncStructs *sync);
 
 Texture CreateTexture(Device device, VkFormat format,
                       VkImageUsageFlags usage, u32 width,
                       u32 height, u32 mip_count);
+void DestroyTexture(Device device, Texture *texture);
 
+VkFormat ChooseDepthFormat(Device device);
+VkFormat DDSToVkFormat(DDSFormat format);
 Texture LoadTextreFromDDS(Device device, Command command, const char *file_path);
 
 void TransitionImage(VkCommandBuffer cmd, TransitionImageInfo *transition_info);
+void QueueRelease(VkCommandBuffer cmd, QueueTransfer *transfer);
+void QueueAcquire(VkCommandBuffer cmd, QueueTransfer *transfer);
 
 #endif //VK_UTILS_H